@@ -0,0 +1,58 @@
+/**
+	Regression test for the binning of HistogramEngine
+	Values outside of the range, infinities and NaNs have to end up in the border bins, in the SSE
+	loop as well as in the scalar loop over the last count % 4 values of a block. It only needs the
+	headers of VisTool, e.g. from a Visual Studio command prompt in this directory
+		cl /EHsc /O2 /I..\VisTool /I..\DXUT11\Core /I..\Effects11\inc /I..\..\..\external\AntTweakBar_116\include HistogramTest.cpp ..\VisTool\HistogramEngine.cpp ..\VisTool\util\ThreadPool.cpp
+
+	usage: HistogramTest
+	Prints the failed cases and returns 1 if any of them failed.
+*/
+
+#include "HistogramEngine.h"
+
+#include <iostream>
+#include <vector>
+#include <limits>
+#include <cmath>
+
+// bins values into [0, 1) with numBins bins and compares the counts
+static bool Check(const char * name, const std::vector<float> & values, int numBins, const std::vector<int> & expected)
+{
+	std::vector<float> histogram(numBins, -1.f);
+	HistogramEngine::Compute(values.data(), VolumeData::DF_FLOAT, sizeof(float), (unsigned int)values.size(),
+		XMFLOAT2(0.f, 1.f), numBins, histogram.data());
+
+	bool ok = true;
+	for(int i = 0; i < numBins; i++) {
+		float count = histogram[i] * values.size();
+		if(std::abs(count - expected[i]) > 1e-3f) {
+			std::cerr << name << ": bin " << i << " holds " << count << " values, expected " << expected[i] << std::endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+int main(int argc, char * argv[])
+{
+	const float inf = std::numeric_limits<float>::infinity();
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	bool ok = true;
+
+	// 7 values: the first four go through SSE, the rest through the scalar loop
+	ok &= Check("scalar tail", { 0.1f, 0.3f, 0.6f, 0.9f, 5.f, inf, nan }, 4, { 2, 1, 1, 3 });
+	ok &= Check("scalar tail below", { 0.1f, 0.3f, 0.6f, 0.9f, -5.f, -inf, 1.f }, 4, { 3, 1, 1, 2 });
+	ok &= Check("sse", { 5.f, inf, nan, -inf, 0.5f }, 4, { 2, 0, 1, 2 });
+
+	// a full block followed by a block of three values
+	std::vector<float> blocks(1027, 0.5f);
+	blocks[1024] = inf;
+	blocks[1025] = 1e30f;
+	blocks[1026] = nan;
+	ok &= Check("second block", blocks, 2, { 1, 1026 });
+
+	if(ok)
+		std::cout << "All histogram tests passed" << std::endl;
+	return ok ? 0 : 1;
+}
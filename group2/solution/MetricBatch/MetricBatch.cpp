@@ -0,0 +1,141 @@
+/**
+	Command line tool computing vector field metrics without a GPU
+	Uses the same MetricEngine as VisTool, so the results match the metric volumes shown there.
+	It has no Windows dependencies, on Linux it can be built with
+		g++ -O2 -std=c++11 -pthread -I../VisTool MetricBatch.cpp ../VisTool/MetricEngine.cpp ../VisTool/util/ThreadPool.cpp -o MetricBatch
+
+	usage: MetricBatch -metric <name> -res <x> <y> <z> -format <FLOAT3|FLOAT4|HALF3|HALF4>
+	                   [-range <min> <max>] [-boundary <value>] [-threads <n>] files...
+	Every file is a raw volume, the result is written to <file>.<metric>.raw as floats.
+	Without -range the metric values are written unmapped.
+*/
+
+#include "MetricEngine.h"
+#include "util/ThreadPool.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cfloat>
+
+static void PrintUsage(void)
+{
+	std::cerr << "usage: MetricBatch -metric <name> -res <x> <y> <z> -format <FLOAT3|FLOAT4|HALF3|HALF4>" << std::endl
+			  << "                   [-range <min> <max>] [-boundary <value>] [-threads <n>] files..." << std::endl
+			  << "metrics:";
+	for(int i = 0; i < MetricEngine::NUM_METRICS; i++)
+		std::cerr << " " << MetricEngine::GetMetricName((MetricEngine::Metric)i);
+	std::cerr << std::endl;
+}
+
+// reads a raw volume and pads three component data to four components
+static bool ReadVolume(const std::string & fileName, int components, size_t componentSize, size_t voxels, std::vector<char> & data)
+{
+	std::ifstream file(fileName, std::ios::in | std::ios::binary);
+	if(!file) {
+		std::cerr << "Could not open \"" << fileName << "\"!" << std::endl;
+		return false;
+	}
+
+	std::vector<char> raw(voxels * components * componentSize);
+	if(!file.read(raw.data(), raw.size())) {
+		std::cerr << "\"" << fileName << "\" is smaller than the given resolution!" << std::endl;
+		return false;
+	}
+
+	data.assign(voxels * 4 * componentSize, 0);
+	for(size_t v = 0; v < voxels; v++)
+		memcpy(&data[v * 4 * componentSize], &raw[v * components * componentSize], components * componentSize);
+	return true;
+}
+
+int main(int argc, char * argv[])
+{
+	MetricEngine::Metric metric = MetricEngine::NUM_METRICS;
+	int resolution[3] = {0, 0, 0};
+	int components = 0;
+	MetricEngine::InputFormat format = MetricEngine::IF_FLOAT4;
+	MetricEngine::Parameters params;
+	std::vector<std::string> files;
+
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(arg == "-metric" && i + 1 < argc) {
+			if(!MetricEngine::GetMetricFromName(argv[++i], metric)) {
+				std::cerr << "Unknown metric \"" << argv[i] << "\"!" << std::endl;
+				return 1;
+			}
+		}
+		else if(arg == "-res" && i + 3 < argc) {
+			for(int c = 0; c < 3; c++)
+				resolution[c] = atoi(argv[++i]);
+		}
+		else if(arg == "-format" && i + 1 < argc) {
+			std::string f = argv[++i];
+			components = (f == "FLOAT3" || f == "HALF3") ? 3 : (f == "FLOAT4" || f == "HALF4") ? 4 : 0;
+			format = f.compare(0, 4, "HALF") == 0 ? MetricEngine::IF_HALF4 : MetricEngine::IF_FLOAT4;
+		}
+		else if(arg == "-range" && i + 2 < argc) {
+			params.metricMin = (float)atof(argv[++i]);
+			params.metricMax = (float)atof(argv[++i]);
+		}
+		else if(arg == "-boundary" && i + 1 < argc) {
+			params.boundaryFixed = true;
+			params.boundaryValue = (float)atof(argv[++i]);
+		}
+		else if(arg == "-threads" && i + 1 < argc) {
+			ThreadPool::SetSharedNumThreads(atoi(argv[++i]));
+		}
+		else if(arg[0] == '-') {
+			PrintUsage();
+			return 1;
+		}
+		else
+			files.push_back(arg);
+	}
+
+	if(metric == MetricEngine::NUM_METRICS || !components || resolution[0] <= 0 || resolution[1] <= 0 || resolution[2] <= 0 || files.empty()) {
+		PrintUsage();
+		return 1;
+	}
+
+	// the boundary value is given unmapped like in VisTool
+	if(params.boundaryFixed)
+		params.boundaryValue = (params.boundaryValue - params.metricMin) / (params.metricMax - params.metricMin);
+
+	size_t voxels = (size_t)resolution[0] * resolution[1] * resolution[2];
+	size_t componentSize = format == MetricEngine::IF_HALF4 ? 2 : 4;
+	std::vector<char> data;
+	std::vector<float> result(voxels);
+
+	for(auto it = files.begin(); it != files.end(); it++) {
+		if(!ReadVolume(*it, components, componentSize, voxels, data))
+			return 1;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		MetricEngine::Compute(metric, data.data(), nullptr, format, resolution, params, result.data());
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		float minValue = FLT_MAX, maxValue = -FLT_MAX;
+		for(size_t v = 0; v < voxels; v++) {
+			minValue = std::min(minValue, result[v]);
+			maxValue = std::max(maxValue, result[v]);
+		}
+
+		std::string outName = *it + "." + MetricEngine::GetMetricName(metric) + ".raw";
+		std::ofstream out(outName, std::ios::out | std::ios::binary);
+		if(!out.write(reinterpret_cast<const char*>(result.data()), voxels * sizeof(float))) {
+			std::cerr << "Could not write \"" << outName << "\"!" << std::endl;
+			return 1;
+		}
+
+		std::cout << outName << ": " << ms << " ms, range [" << minValue << ", " << maxValue << "]" << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,376 @@
+/**
+	Command line tool rendering scalar volumes with the software raycaster
+	Uses the same SoftwareRayCaster as the "Render on CPU" button of VisTool, so the images match
+	those written there for the same camera, and reports the throughput in rays per second.
+	It has no Windows dependencies, on Linux it can be built with
+		g++ -O2 -std=c++11 -pthread -I../VisTool RaycastBatch.cpp ../VisTool/SoftwareRayCaster.cpp ../VisTool/BrickPyramid.cpp ../VisTool/DistanceField.cpp ../VisTool/PreIntegrationTable.cpp ../VisTool/util/ThreadPool.cpp -o RaycastBatch
+
+	usage: RaycastBatch -res <x> <y> <z> -format <BYTE|FLOAT> -tf <file.tf> [-pass <name>] [-size <w> <h>]
+	                    [-camera <yaw> <pitch> <distance>] [-fov <degrees>] [-step <voxels>] [-alpha <scale>]
+	                    [-iso <value> <value2>] [-lighting] [-skip] [-preint] [-adaptive <tolerance> <maxFactor>]
+	                    [-background <r> <g> <b>] [-repeat <n>] [-threads <n>] files...
+	Every file is a raw volume, the image is written to <file>.<pass>.ppm. The transfer function is a
+	.tf file saved by the transfer function editor. The camera orbits the center of the volume (in
+	texture space, angles in degrees, y is up), -repeat renders every image n times and reports the
+	fastest run.
+*/
+
+#include "SoftwareRayCaster.h"
+#include "BrickPyramid.h"
+#include "DistanceField.h"
+#include "PreIntegrationTable.h"
+#include "util/ThreadPool.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// like the transfer function editor
+static const int TF_SIZE = 488;
+
+static void PrintUsage(void)
+{
+	std::cerr << "usage: RaycastBatch -res <x> <y> <z> -format <BYTE|FLOAT> -tf <file.tf> [-pass <name>] [-size <w> <h>]" << std::endl
+			  << "                    [-camera <yaw> <pitch> <distance>] [-fov <degrees>] [-step <voxels>] [-alpha <scale>]" << std::endl
+			  << "                    [-iso <value> <value2>] [-lighting] [-skip] [-preint] [-adaptive <tolerance> <maxFactor>]" << std::endl
+			  << "                    [-background <r> <g> <b>] [-repeat <n>] [-threads <n>] files..." << std::endl
+			  << "passes:";
+	for(int i = 0; i < SoftwareRayCaster::NUM_MODES; i++)
+		std::cerr << " " << SoftwareRayCaster::GetModeName((SoftwareRayCaster::Mode)i);
+	std::cerr << std::endl;
+}
+
+// reads the control points of a .tf file and samples them like TransferFunctionLine::fillArray
+static bool ReadTransferFunction(const std::string & fileName, std::vector<float> & tf)
+{
+	std::ifstream file(fileName, std::ios::in | std::ios::binary);
+	if(!file) {
+		std::cerr << "Could not open \"" << fileName << "\"!" << std::endl;
+		return false;
+	}
+
+	tf.assign(TF_SIZE * 4, 0.f);
+	for(int channel = 0; channel < 4; channel++) {
+		int numPoints = 0;
+		file.read(reinterpret_cast<char*>(&numPoints), sizeof(numPoints));
+		std::vector<float> points(2 * std::max(numPoints, 0));
+		if(!file || numPoints < 2 || !file.read(reinterpret_cast<char*>(points.data()), points.size() * sizeof(float))) {
+			std::cerr << "\"" << fileName << "\" is not a transfer function!" << std::endl;
+			return false;
+		}
+
+		int segment = 0;
+		for(int x = 0; x < TF_SIZE; x++) {
+			float pos = (float)x / (TF_SIZE - 1);
+			while(segment < numPoints - 2 && pos > points[2 * segment + 2])
+				segment++;
+			float x0 = points[2 * segment], x1 = points[2 * segment + 2];
+			float f = x1 > x0 ? std::min(1.f, std::max(0.f, (pos - x0) / (x1 - x0))) : 1.f;
+			tf[4 * x + channel] = points[2 * segment + 1] + f * (points[2 * segment + 3] - points[2 * segment + 1]);
+		}
+	}
+	return true;
+}
+
+static bool ReadVolume(const std::string & fileName, size_t componentSize, size_t voxels, std::vector<char> & data)
+{
+	std::ifstream file(fileName, std::ios::in | std::ios::binary);
+	if(!file) {
+		std::cerr << "Could not open \"" << fileName << "\"!" << std::endl;
+		return false;
+	}
+
+	data.resize(voxels * componentSize);
+	if(!file.read(data.data(), data.size())) {
+		std::cerr << "\"" << fileName << "\" is smaller than the given resolution!" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static void Cross(const float a[3], const float b[3], float r[3])
+{
+	r[0] = a[1] * b[2] - a[2] * b[1];
+	r[1] = a[2] * b[0] - a[0] * b[2];
+	r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static void Normalize(float v[3])
+{
+	float l = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	for(int c = 0; c < 3; c++)
+		v[c] /= l;
+}
+
+// r = a * b for row-major 4x4 matrices
+static void Multiply(const float a[16], const float b[16], float r[16])
+{
+	for(int i = 0; i < 4; i++)
+		for(int j = 0; j < 4; j++)
+			r[4 * i + j] = a[4 * i] * b[j] + a[4 * i + 1] * b[4 + j] + a[4 * i + 2] * b[8 + j] + a[4 * i + 3] * b[12 + j];
+}
+
+// Gauss-Jordan with partial pivoting
+static bool Invert(const float m[16], float r[16])
+{
+	double a[4][8];
+	for(int i = 0; i < 4; i++)
+		for(int j = 0; j < 4; j++) {
+			a[i][j] = m[4 * i + j];
+			a[i][4 + j] = i == j ? 1. : 0.;
+		}
+	for(int col = 0; col < 4; col++) {
+		int pivot = col;
+		for(int i = col + 1; i < 4; i++)
+			if(std::abs(a[i][col]) > std::abs(a[pivot][col]))
+				pivot = i;
+		if(a[pivot][col] == 0.)
+			return false;
+		std::swap(a[col], a[pivot]);
+		double scale = 1. / a[col][col];
+		for(int j = 0; j < 8; j++)
+			a[col][j] *= scale;
+		for(int i = 0; i < 4; i++) {
+			if(i == col)
+				continue;
+			double f = a[i][col];
+			for(int j = 0; j < 8; j++)
+				a[i][j] -= f * a[col][j];
+		}
+	}
+	for(int i = 0; i < 4; i++)
+		for(int j = 0; j < 4; j++)
+			r[4 * i + j] = (float)a[i][4 + j];
+	return true;
+}
+
+// inverse of the left-handed look-at and perspective matrices (row vectors like XMMatrixLookAtLH
+// and XMMatrixPerspectiveFovLH) of a camera orbiting the center of the volume, camPos is the eye
+static bool OrbitCamera(float yaw, float pitch, float distance, float fov, float aspect, float worldViewProjInv[16], float camPos[3])
+{
+	const float toRad = 3.14159265f / 180.f;
+	float center[3] = { 0.5f, 0.5f, 0.5f };
+	float up[3] = { 0.f, 1.f, 0.f };
+	camPos[0] = center[0] + distance * std::cos(pitch * toRad) * std::sin(yaw * toRad);
+	camPos[1] = center[1] + distance * std::sin(pitch * toRad);
+	camPos[2] = center[2] - distance * std::cos(pitch * toRad) * std::cos(yaw * toRad);
+
+	float zAxis[3], xAxis[3], yAxis[3];
+	for(int c = 0; c < 3; c++)
+		zAxis[c] = center[c] - camPos[c];
+	Normalize(zAxis);
+	Cross(up, zAxis, xAxis);
+	Normalize(xAxis);
+	Cross(zAxis, xAxis, yAxis);
+
+	float view[16] = {
+		xAxis[0], yAxis[0], zAxis[0], 0.f,
+		xAxis[1], yAxis[1], zAxis[1], 0.f,
+		xAxis[2], yAxis[2], zAxis[2], 0.f,
+		0.f, 0.f, 0.f, 1.f
+	};
+	for(int c = 0; c < 3; c++) {
+		view[12] -= xAxis[c] * camPos[c];
+		view[13] -= yAxis[c] * camPos[c];
+		view[14] -= zAxis[c] * camPos[c];
+	}
+
+	float zNear = std::max(1e-3f, distance - 1.f), zFar = distance + 1.f;
+	float yScale = 1.f / std::tan(0.5f * fov * toRad);
+	float proj[16] = {
+		yScale / aspect, 0.f, 0.f, 0.f,
+		0.f, yScale, 0.f, 0.f,
+		0.f, 0.f, zFar / (zFar - zNear), 1.f,
+		0.f, 0.f, -zNear * zFar / (zFar - zNear), 0.f
+	};
+
+	float viewProj[16];
+	Multiply(view, proj, viewProj);
+	return Invert(viewProj, worldViewProjInv);
+}
+
+int main(int argc, char * argv[])
+{
+	int resolution[3] = {0, 0, 0};
+	size_t componentSize = 0;
+	std::string tfName;
+	float yaw = 30.f, pitch = 20.f, distance = 2.f, fov = 45.f;
+	float step = 1.f;
+	bool skipping = false, preIntegration = false, adaptive = false;
+	float background[3] = {0.f, 0.f, 0.f};
+	int repeat = 1;
+	SoftwareRayCaster::Parameters params;
+	std::vector<std::string> files;
+
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(arg == "-res" && i + 3 < argc) {
+			for(int c = 0; c < 3; c++)
+				resolution[c] = atoi(argv[++i]);
+		}
+		else if(arg == "-format" && i + 1 < argc) {
+			std::string f = argv[++i];
+			componentSize = f == "BYTE" ? 1 : f == "FLOAT" ? 4 : 0;
+		}
+		else if(arg == "-tf" && i + 1 < argc) {
+			tfName = argv[++i];
+		}
+		else if(arg == "-pass" && i + 1 < argc) {
+			if(!SoftwareRayCaster::GetModeFromName(argv[++i], params.mode)) {
+				std::cerr << "Unknown pass \"" << argv[i] << "\"!" << std::endl;
+				return 1;
+			}
+		}
+		else if(arg == "-size" && i + 2 < argc) {
+			params.width = atoi(argv[++i]);
+			params.height = atoi(argv[++i]);
+		}
+		else if(arg == "-camera" && i + 3 < argc) {
+			yaw = (float)atof(argv[++i]);
+			pitch = (float)atof(argv[++i]);
+			distance = (float)atof(argv[++i]);
+		}
+		else if(arg == "-fov" && i + 1 < argc) {
+			fov = (float)atof(argv[++i]);
+		}
+		else if(arg == "-step" && i + 1 < argc) {
+			step = (float)atof(argv[++i]);
+		}
+		else if(arg == "-alpha" && i + 1 < argc) {
+			params.globalAlphaScale = (float)atof(argv[++i]);
+		}
+		else if(arg == "-iso" && i + 2 < argc) {
+			params.isoValue = (float)atof(argv[++i]);
+			params.isoValue2 = (float)atof(argv[++i]);
+		}
+		else if(arg == "-lighting") {
+			params.dvrLighting = true;
+		}
+		else if(arg == "-skip") {
+			skipping = true;
+		}
+		else if(arg == "-preint") {
+			preIntegration = true;
+		}
+		else if(arg == "-adaptive" && i + 2 < argc) {
+			adaptive = true;
+			params.samplingTolerance = (float)atof(argv[++i]);
+			params.maxStepFactor = (float)atof(argv[++i]);
+		}
+		else if(arg == "-background" && i + 3 < argc) {
+			for(int c = 0; c < 3; c++)
+				background[c] = (float)atof(argv[++i]);
+		}
+		else if(arg == "-repeat" && i + 1 < argc) {
+			repeat = std::max(1, atoi(argv[++i]));
+		}
+		else if(arg == "-threads" && i + 1 < argc) {
+			ThreadPool::SetSharedNumThreads(atoi(argv[++i]));
+		}
+		else if(arg[0] == '-') {
+			PrintUsage();
+			return 1;
+		}
+		else
+			files.push_back(arg);
+	}
+
+	if(!componentSize || tfName.empty() || resolution[0] <= 0 || resolution[1] <= 0 || resolution[2] <= 0
+		|| params.width <= 0 || params.height <= 0 || files.empty()) {
+		PrintUsage();
+		return 1;
+	}
+
+	std::vector<float> tf;
+	if(!ReadTransferFunction(tfName, tf))
+		return 1;
+
+	if(!OrbitCamera(yaw, pitch, distance, fov, (float)params.width / params.height, params.worldViewProjInv, params.lightPos)) {
+		std::cerr << "Invalid camera!" << std::endl;
+		return 1;
+	}
+
+	// the same step as RayCaster::RenderOnCPU
+	float avgResolution = (resolution[0] + resolution[1] + resolution[2]) / 3.f;
+	params.stepsize = step / avgResolution;
+	params.pixelStepsize = step;
+
+	bool iso = params.mode == SoftwareRayCaster::MODE_ISOSURFACE || params.mode == SoftwareRayCaster::MODE_ISOSURFACE_ALPHA
+		|| params.mode == SoftwareRayCaster::MODE_ISOSURFACE_ALPHA_GLOBAL || params.mode == SoftwareRayCaster::MODE_DUAL_ISOSURFACE;
+	bool dvr = params.mode == SoftwareRayCaster::MODE_DVR;
+
+	PreIntegrationTable preIntegrationTable;
+	if(preIntegration && dvr) {
+		preIntegrationTable.Build(tf.data(), TF_SIZE);
+		params.preIntegration = &preIntegrationTable;
+	}
+
+	size_t voxels = (size_t)resolution[0] * resolution[1] * resolution[2];
+	std::vector<char> data;
+	std::vector<float> volume(voxels);
+	BrickPyramid bricks;
+	BrickPyramid::Occupancy occupancy;
+	DistanceField distanceField;
+	std::vector<float> samplingRates;
+	SoftwareRayCaster::Image image;
+
+	for(auto it = files.begin(); it != files.end(); it++) {
+		if(!ReadVolume(*it, componentSize, voxels, data))
+			return 1;
+
+		// the raycaster samples normalized values like the UNORM texture
+		if(componentSize == 1) {
+			for(size_t v = 0; v < voxels; v++)
+				volume[v] = (unsigned char)data[v] / 255.f;
+		}
+		else
+			memcpy(volume.data(), data.data(), voxels * sizeof(float));
+
+		if((skipping && (iso || dvr)) || (adaptive && dvr)) {
+			bricks.Build(data.data(), componentSize == 1 ? BrickPyramid::IF_BYTE : BrickPyramid::IF_FLOAT, resolution);
+			params.bricks = &bricks;
+		}
+		if(skipping && (iso || dvr)) {
+			float isoValues[2] = { params.isoValue, params.mode == SoftwareRayCaster::MODE_DUAL_ISOSURFACE ? params.isoValue2 : params.isoValue };
+			if(iso)
+				bricks.ClassifyIsoValues(isoValues, 2, occupancy);
+			else
+				bricks.ClassifyTransferFunction(tf.data(), TF_SIZE, occupancy);
+			const BrickPyramid::Level & level = bricks.GetLevel(0);
+			float cellExtent[3];
+			for(int c = 0; c < 3; c++)
+				cellExtent[c] = (float)level.brickSize / resolution[c];
+			distanceField.Compute(occupancy.levels[0].data(), level.numBricks, cellExtent);
+			params.occupancy = &occupancy;
+			params.distances = &distanceField;
+		}
+		if(adaptive && dvr) {
+			bricks.ClassifySamplingRate(tf.data(), TF_SIZE, samplingRates);
+			params.samplingRates = &samplingRates;
+		}
+
+		SoftwareRayCaster::Statistics stats;
+		for(int r = 0; r < repeat; r++) {
+			SoftwareRayCaster::Statistics run = SoftwareRayCaster::Render(volume.data(), resolution, tf.data(), TF_SIZE, params, image);
+			if(r == 0 || run.milliseconds < stats.milliseconds)
+				stats = run;
+		}
+
+		std::string outName = *it + "." + SoftwareRayCaster::GetModeName(params.mode) + ".ppm";
+		if(!SoftwareRayCaster::WritePPM(outName, image, background)) {
+			std::cerr << "Could not write \"" << outName << "\"!" << std::endl;
+			return 1;
+		}
+
+		std::cout << outName << ": " << stats.milliseconds << " ms, " << stats.rays << " rays, "
+			<< stats.RaysPerSecond() / 1e6 << " Mrays/s, " << stats.samples << " samples" << std::endl;
+	}
+
+	return 0;
+}
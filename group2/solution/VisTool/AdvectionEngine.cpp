@@ -0,0 +1,427 @@
+#include "AdvectionEngine.h"
+
+#include "util/ThreadPool.h"
+#include "util/HalfFloat.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+namespace {
+	// the eight voxels around a sample position and the interpolation weights
+	struct Cell {
+		size_t	index[8];	// x fastest, then y, then z
+		__m128	wx, wy, wz;
+	};
+
+	inline void FindAxis(float p, int resolution, int & i0, int & i1, float & w)
+	{
+		// texel centers are at (i + 0.5) / resolution, outside of them the border is repeated
+		float f = std::max(0.f, std::min((float)(resolution - 1), p * resolution - 0.5f));
+		i0 = std::min((int)f, std::max(0, resolution - 2));
+		i1 = std::min(i0 + 1, resolution - 1);
+		w = f - i0;
+	}
+
+	inline void FindCell(const float p[3], const int resolution[3], Cell & cell)
+	{
+		int x0, x1, y0, y1, z0, z1;
+		float wx, wy, wz;
+		FindAxis(p[0], resolution[0], x0, x1, wx);
+		FindAxis(p[1], resolution[1], y0, y1, wy);
+		FindAxis(p[2], resolution[2], z0, z1, wz);
+
+		size_t sliceSize = (size_t)resolution[0] * resolution[1];
+		size_t rows[4] = {
+			z0 * sliceSize + (size_t)y0 * resolution[0],
+			z0 * sliceSize + (size_t)y1 * resolution[0],
+			z1 * sliceSize + (size_t)y0 * resolution[0],
+			z1 * sliceSize + (size_t)y1 * resolution[0]
+		};
+		for(int r = 0; r < 4; r++) {
+			cell.index[2 * r] = (rows[r] + x0) * 4;
+			cell.index[2 * r + 1] = (rows[r] + x1) * 4;
+		}
+		cell.wx = _mm_set1_ps(wx);
+		cell.wy = _mm_set1_ps(wy);
+		cell.wz = _mm_set1_ps(wz);
+	}
+
+	inline __m128 Lerp(__m128 a, __m128 b, __m128 w)
+	{
+		return _mm_add_ps(a, _mm_mul_ps(w, _mm_sub_ps(b, a)));
+	}
+
+	// all four components of a voxel are interpolated at once
+	inline __m128 Trilinear(const float * field, const Cell & cell)
+	{
+		__m128 c00 = Lerp(_mm_loadu_ps(field + cell.index[0]), _mm_loadu_ps(field + cell.index[1]), cell.wx);
+		__m128 c10 = Lerp(_mm_loadu_ps(field + cell.index[2]), _mm_loadu_ps(field + cell.index[3]), cell.wx);
+		__m128 c01 = Lerp(_mm_loadu_ps(field + cell.index[4]), _mm_loadu_ps(field + cell.index[5]), cell.wx);
+		__m128 c11 = Lerp(_mm_loadu_ps(field + cell.index[6]), _mm_loadu_ps(field + cell.index[7]), cell.wx);
+		return Lerp(Lerp(c00, c10, cell.wy), Lerp(c01, c11, cell.wy), cell.wz);
+	}
+
+	struct FieldSampler {
+		const float *	fields[2];
+		const int *		resolution;
+		float			timestepT;
+		__m128			t;
+
+		inline __m128 operator()(__m128 p) const
+		{
+			float pos[4];
+			_mm_storeu_ps(pos, p);
+			Cell cell;
+			FindCell(pos, resolution, cell);
+			__m128 v = Trilinear(fields[0], cell);
+			if(timestepT != 0.f)
+				v = Lerp(v, Trilinear(fields[1], cell), t);
+			return v;
+		}
+	};
+}
+
+void AdvectionEngine::Particles::Resize(size_t n)
+{
+	x.resize(n);
+	y.resize(n);
+	z.resize(n);
+	age.resize(n);
+	seedX.resize(n);
+	seedY.resize(n);
+	seedZ.resize(n);
+	ageSeed.resize(n);
+}
+
+AdvectionEngine::Parameters::Parameters() :
+	timeDelta(0.f),
+	timestepT(0.f),
+	maxLifetime(1.f),
+	integrator(INT_EULER)
+{
+	for(int i = 0; i < 3; i++) {
+		velocityScaling[i] = 1.f;
+		spawnRegionMin[i] = 0.f;
+		spawnRegionMax[i] = 1.f;
+	}
+}
+
+void AdvectionEngine::Pathlines::Init(const float * seeds, size_t numLines, int numVertices_, float startTime_, float stepsize_)
+{
+	x.resize(numLines);
+	y.resize(numLines);
+	z.resize(numLines);
+	assert(numVertices_ > 0);
+	vertices.resize(numLines * numVertices_ * 3);
+	numVertices = numVertices_;
+	startTime = startTime_;
+	time = startTime_;
+	stepsize = stepsize_;
+
+	for(size_t i = 0; i < numLines; i++) {
+		x[i] = seeds[3 * i];
+		y[i] = seeds[3 * i + 1];
+		z[i] = seeds[3 * i + 2];
+		float * v = &vertices[i * numVertices * 3];
+		v[0] = x[i];
+		v[1] = y[i];
+		v[2] = z[i];
+	}
+	numEmitted = 1;
+}
+
+void AdvectionEngine::FlowMap::Init(const int resolution_[3], float startTime_, float endTime_, float stepsize_)
+{
+	assert(stepsize_ > 0.f);
+	size_t n = (size_t)resolution_[0] * resolution_[1] * resolution_[2];
+	x.resize(n);
+	y.resize(n);
+	z.resize(n);
+	for(int c = 0; c < 3; c++)
+		resolution[c] = resolution_[c];
+	startTime = startTime_;
+	time = startTime_;
+	endTime = endTime_;
+	stepsize = stepsize_;
+	numSteps = 0;
+
+	size_t i = 0;
+	for(int gz = 0; gz < resolution[2]; gz++)
+		for(int gy = 0; gy < resolution[1]; gy++)
+			for(int gx = 0; gx < resolution[0]; gx++, i++) {
+				x[i] = (gx + 0.5f) / resolution[0];
+				y[i] = (gy + 0.5f) / resolution[1];
+				z[i] = (gz + 0.5f) / resolution[2];
+			}
+}
+
+AdvectionEngine::AdvectionEngine(void)
+{
+	for(int i = 0; i < 2; i++) {
+		m_fields[i] = nullptr;
+		m_convertedIds[i] = -1;
+	}
+	m_resolution[0] = m_resolution[1] = m_resolution[2] = 0;
+}
+
+void AdvectionEngine::ConvertField(const void * data, size_t voxels, std::vector<float> & converted)
+{
+	converted.resize(voxels * 4);
+	const uint16_t * src = static_cast<const uint16_t*>(data);
+	ThreadPool::GetShared().ParallelForRange(0, (int)voxels, [&](int begin, int end) {
+		for(size_t i = (size_t)begin * 4; i < (size_t)end * 4; i++)
+			converted[i] = HalfToFloat(src[i]);
+	}, 1 << 16);
+}
+
+void AdvectionEngine::SetFields(const void * data0, int id0, const void * data1, int id1, InputFormat format, const int resolution[3])
+{
+	bool resized = resolution[0] != m_resolution[0] || resolution[1] != m_resolution[1] || resolution[2] != m_resolution[2];
+	for(int i = 0; i < 3; i++)
+		m_resolution[i] = resolution[i];
+
+	if(format == IF_FLOAT4) {
+		m_fields[0] = static_cast<const float*>(data0);
+		m_fields[1] = static_cast<const float*>(data1);
+		return;
+	}
+
+	if(resized)
+		m_convertedIds[0] = m_convertedIds[1] = -1;
+
+	// the volume swaps its slots during playback, so the field we need may be in the other buffer
+	if(m_convertedIds[0] != id0 && m_convertedIds[1] == id0) {
+		std::swap(m_converted[0], m_converted[1]);
+		std::swap(m_convertedIds[0], m_convertedIds[1]);
+	}
+
+	size_t voxels = (size_t)resolution[0] * resolution[1] * resolution[2];
+	const void * data[2] = { data0, data1 };
+	int ids[2] = { id0, id1 };
+	for(int i = 0; i < 2; i++) {
+		if(data[i] && m_convertedIds[i] != ids[i]) {
+			ConvertField(data[i], voxels, m_converted[i]);
+			m_convertedIds[i] = ids[i];
+		}
+		m_fields[i] = data[i] ? m_converted[i].data() : nullptr;
+	}
+}
+
+void AdvectionEngine::Sample(const float p[3], float timestepT, float velocity[3]) const
+{
+	FieldSampler sample = { { m_fields[0], m_fields[1] }, m_resolution, timestepT, _mm_set1_ps(timestepT) };
+	float v[4];
+	_mm_storeu_ps(v, sample(_mm_setr_ps(p[0], p[1], p[2], 0.f)));
+	for(int i = 0; i < 3; i++)
+		velocity[i] = v[i];
+}
+
+void AdvectionEngine::Advect(Particles & particles, const Parameters & params, GPUParticle * gpuParticles) const
+{
+	assert(m_fields[0] && (params.timestepT == 0.f || m_fields[1]));
+
+	const FieldSampler sample = { { m_fields[0], m_fields[1] }, m_resolution, params.timestepT, _mm_set1_ps(params.timestepT) };
+	// the step in texture space per velocity unit
+	const __m128 h = _mm_mul_ps(_mm_set1_ps(params.timeDelta),
+		_mm_setr_ps(params.velocityScaling[0], params.velocityScaling[1], params.velocityScaling[2], 0.f));
+	const __m128 halfH = _mm_mul_ps(h, _mm_set1_ps(0.5f));
+	const __m128 sixthH = _mm_mul_ps(h, _mm_set1_ps(1.f / 6.f));
+	const __m128 two = _mm_set1_ps(2.f);
+	const float * spawnMin = params.spawnRegionMin;
+	const float spawnSize[3] = {
+		params.spawnRegionMax[0] - spawnMin[0],
+		params.spawnRegionMax[1] - spawnMin[1],
+		params.spawnRegionMax[2] - spawnMin[2]
+	};
+
+	ThreadPool::GetShared().ParallelForRange(0, (int)particles.Size(), [&](int begin, int end) {
+		for(int i = begin; i < end; i++) {
+			float x = particles.x[i], y = particles.y[i], z = particles.z[i];
+			float age = particles.age[i];
+
+			// same as reseedParticle in the shader: back to the seed position in the current spawn region
+			bool inside = x > 0.f && y > 0.f && z > 0.f && x <= 1.f && y <= 1.f && z <= 1.f;
+			bool expired = age > params.maxLifetime;
+			if(!inside || expired) {
+				x = particles.seedX[i] * spawnSize[0] + spawnMin[0];
+				y = particles.seedY[i] * spawnSize[1] + spawnMin[1];
+				z = particles.seedZ[i] * spawnSize[2] + spawnMin[2];
+			}
+			if(expired)
+				age = fmodf(age, params.maxLifetime) + particles.ageSeed[i] * params.maxLifetime;
+
+			__m128 p = _mm_setr_ps(x, y, z, 0.f);
+			switch(params.integrator) {
+			case INT_EULER:
+				p = _mm_add_ps(p, _mm_mul_ps(h, sample(p)));
+				break;
+			case INT_RK2: {
+				__m128 k1 = sample(p);
+				__m128 k2 = sample(_mm_add_ps(p, _mm_mul_ps(halfH, k1)));
+				p = _mm_add_ps(p, _mm_mul_ps(h, k2));
+				break;
+			}
+			case INT_RK4: {
+				__m128 k1 = sample(p);
+				__m128 k2 = sample(_mm_add_ps(p, _mm_mul_ps(halfH, k1)));
+				__m128 k3 = sample(_mm_add_ps(p, _mm_mul_ps(halfH, k2)));
+				__m128 k4 = sample(_mm_add_ps(p, _mm_mul_ps(h, k3)));
+				__m128 sum = _mm_add_ps(_mm_add_ps(k1, k4), _mm_mul_ps(two, _mm_add_ps(k2, k3)));
+				p = _mm_add_ps(p, _mm_mul_ps(sixthH, sum));
+				break;
+			}
+			}
+			age += params.timeDelta;
+
+			float pos[4];
+			_mm_storeu_ps(pos, p);
+			particles.x[i] = pos[0];
+			particles.y[i] = pos[1];
+			particles.z[i] = pos[2];
+			particles.age[i] = age;
+
+			if(gpuParticles) {
+				GPUParticle & g = gpuParticles[i];
+				g.pos[0] = pos[0];
+				g.pos[1] = pos[1];
+				g.pos[2] = pos[2];
+				g.age = age;
+				g.seedPos[0] = particles.seedX[i];
+				g.seedPos[1] = particles.seedY[i];
+				g.seedPos[2] = particles.seedZ[i];
+				g.ageSeed = particles.ageSeed[i];
+			}
+		}
+	}, 4096);
+}
+
+void AdvectionEngine::AdvancePathlines(Pathlines & lines, float intervalStart, float intervalEnd, const float velocityScaling[3]) const
+{
+	assert(m_fields[0]);
+	if(lines.Finished() || lines.time >= intervalEnd || !lines.Size())
+		return;
+
+	const __m128 scaling = _mm_setr_ps(velocityScaling[0], velocityScaling[1], velocityScaling[2], 0.f);
+	// a steady field has no second timestep and spans any interval
+	const float invInterval = intervalEnd > intervalStart && m_fields[1] ? 1.f / (intervalEnd - intervalStart) : 0.f;
+	// all lines take the same steps, so the shared state is advanced once at the end
+	float endTime = lines.time;
+	int endEmitted = lines.numEmitted;
+
+	ThreadPool::GetShared().ParallelForRange(0, (int)lines.Size(), [&](int begin, int end) {
+		FieldSampler sample = { { m_fields[0], m_fields[1] }, m_resolution, 0.f, _mm_setzero_ps() };
+		auto velocity = [&](__m128 p, float t) -> __m128 {
+			sample.timestepT = std::min(1.f, std::max(0.f, (t - intervalStart) * invInterval));
+			sample.t = _mm_set1_ps(sample.timestepT);
+			return _mm_mul_ps(scaling, sample(p));
+		};
+
+		float time = lines.time;
+		int emitted = lines.numEmitted;
+		for(int i = begin; i < end; i++) {
+			__m128 p = _mm_setr_ps(lines.x[i], lines.y[i], lines.z[i], 0.f);
+			float * vertices = &lines.vertices[(size_t)i * lines.numVertices * 3];
+			float pos[4];
+			time = lines.time;
+			emitted = lines.numEmitted;
+
+			// steps end at the vertices and at the end of the interval, so all stages stay within the two timesteps
+			while(emitted < lines.numVertices && time < intervalEnd) {
+				float vertexTime = lines.startTime + emitted * lines.stepsize;
+				float stepEnd = std::min(vertexTime, intervalEnd);
+				float h = stepEnd - time;
+
+				_mm_storeu_ps(pos, p);
+				bool inside = pos[0] > 0.f && pos[1] > 0.f && pos[2] > 0.f && pos[0] <= 1.f && pos[1] <= 1.f && pos[2] <= 1.f;
+				if(inside && h > 0.f) {
+					__m128 halfH = _mm_set1_ps(0.5f * h);
+					__m128 k1 = velocity(p, time);
+					__m128 k2 = velocity(_mm_add_ps(p, _mm_mul_ps(halfH, k1)), time + 0.5f * h);
+					__m128 k3 = velocity(_mm_add_ps(p, _mm_mul_ps(halfH, k2)), time + 0.5f * h);
+					__m128 k4 = velocity(_mm_add_ps(p, _mm_mul_ps(_mm_set1_ps(h), k3)), stepEnd);
+					__m128 sum = _mm_add_ps(_mm_add_ps(k1, k4), _mm_mul_ps(_mm_set1_ps(2.f), _mm_add_ps(k2, k3)));
+					p = _mm_add_ps(p, _mm_mul_ps(_mm_set1_ps(h / 6.f), sum));
+				}
+				time = stepEnd;
+
+				if(stepEnd == vertexTime) {
+					_mm_storeu_ps(pos, p);
+					vertices[emitted * 3] = pos[0];
+					vertices[emitted * 3 + 1] = pos[1];
+					vertices[emitted * 3 + 2] = pos[2];
+					emitted++;
+				}
+			}
+
+			_mm_storeu_ps(pos, p);
+			lines.x[i] = pos[0];
+			lines.y[i] = pos[1];
+			lines.z[i] = pos[2];
+		}
+
+		// every chunk ends in the same state
+		if(begin == 0) {
+			endTime = time;
+			endEmitted = emitted;
+		}
+	}, 1024);
+
+	lines.time = endTime;
+	lines.numEmitted = endEmitted;
+}
+
+void AdvectionEngine::AdvanceFlowMap(FlowMap & map, float intervalStart, float intervalEnd, const float velocityScaling[3]) const
+{
+	assert(m_fields[0]);
+	bool backward = map.endTime < map.startTime;
+	float stepEnd = backward ? std::max(map.endTime, intervalStart) : std::min(map.endTime, intervalEnd);
+	if(map.Finished() || !map.Size() || map.time < intervalStart || map.time > intervalEnd || stepEnd == map.time)
+		return;
+
+	const __m128 scaling = _mm_setr_ps(velocityScaling[0], velocityScaling[1], velocityScaling[2], 0.f);
+	const float invInterval = intervalEnd > intervalStart && m_fields[1] ? 1.f / (intervalEnd - intervalStart) : 0.f;
+	// all positions take the same steps, h is negative when integrating backward
+	const int numSteps = std::max(1, (int)std::ceil(std::abs(stepEnd - map.time) / map.stepsize));
+	const float h = (stepEnd - map.time) / numSteps;
+	const float startTime = map.time;
+
+	ThreadPool::GetShared().ParallelForRange(0, (int)map.Size(), [&](int begin, int end) {
+		FieldSampler sample = { { m_fields[0], m_fields[1] }, m_resolution, 0.f, _mm_setzero_ps() };
+		auto velocity = [&](__m128 p, float t) -> __m128 {
+			sample.timestepT = std::min(1.f, std::max(0.f, (t - intervalStart) * invInterval));
+			sample.t = _mm_set1_ps(sample.timestepT);
+			return _mm_mul_ps(scaling, sample(p));
+		};
+		const __m128 halfH = _mm_set1_ps(0.5f * h);
+		const __m128 fullH = _mm_set1_ps(h);
+		const __m128 sixthH = _mm_set1_ps(h / 6.f);
+		const __m128 two = _mm_set1_ps(2.f);
+
+		for(int i = begin; i < end; i++) {
+			// positions that left the volume keep moving with the border velocity (the sampler clamps),
+			// stopping them would show up as a strong separation from their neighbours
+			__m128 p = _mm_setr_ps(map.x[i], map.y[i], map.z[i], 0.f);
+			for(int s = 0; s < numSteps; s++) {
+				float t = startTime + s * h;
+				__m128 k1 = velocity(p, t);
+				__m128 k2 = velocity(_mm_add_ps(p, _mm_mul_ps(halfH, k1)), t + 0.5f * h);
+				__m128 k3 = velocity(_mm_add_ps(p, _mm_mul_ps(halfH, k2)), t + 0.5f * h);
+				__m128 k4 = velocity(_mm_add_ps(p, _mm_mul_ps(fullH, k3)), t + h);
+				__m128 sum = _mm_add_ps(_mm_add_ps(k1, k4), _mm_mul_ps(two, _mm_add_ps(k2, k3)));
+				p = _mm_add_ps(p, _mm_mul_ps(sixthH, sum));
+			}
+
+			float pos[4];
+			_mm_storeu_ps(pos, p);
+			map.x[i] = pos[0];
+			map.y[i] = pos[1];
+			map.z[i] = pos[2];
+		}
+	}, 1024);
+
+	map.time = stepEnd;
+	map.numSteps += numSteps;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+/*
+	CPU particle advection matching CSAdvect of ParticleTracer.fx
+	Particles live in texture space [0, 1]^3 and are stored as structure of arrays. The flow field
+	is sampled like the shader samples the volume textures (trilinear, texel centers at
+	(i + 0.5) / resolution, clamped at the borders) with SSE over the vector components, and both
+	timesteps are blended with timestepT. The field is frozen during one call, like in the shader.
+	Particles are processed in chunks on the shared thread pool.
+*/
+class AdvectionEngine
+{
+public:
+	enum Integrator {
+		INT_EULER,
+		INT_RK2,		// midpoint rule
+		INT_RK4
+	};
+
+	// four components per voxel, three component data has to be padded
+	enum InputFormat {
+		IF_FLOAT4,
+		IF_HALF4
+	};
+
+	struct Particles {
+		std::vector<float> x, y, z;
+		std::vector<float> age;
+		std::vector<float> seedX, seedY, seedZ;	// relative to the spawn region
+		std::vector<float> ageSeed;
+
+		void Resize(size_t n);
+		size_t Size() const {	return x.size();	};
+	};
+
+	// same layout as Particle in ParticleTracer.fx
+	struct GPUParticle {
+		float pos[3];
+		float age;
+		float seedPos[3];
+		float ageSeed;
+	};
+
+	struct Parameters {
+		float		timeDelta;
+		float		timestepT;			// weight of the second field
+		float		velocityScaling[3];	// from the velocity in the data to texture space
+		float		maxLifetime;
+		float		spawnRegionMin[3];
+		float		spawnRegionMax[3];
+		Integrator	integrator;
+
+		Parameters();
+	};
+
+	// pathlines in the time-dependent field, all lines share their time and vertex count
+	struct Pathlines {
+		std::vector<float> x, y, z;		// current positions
+		std::vector<float> vertices;	// numVertices xyz positions per line
+		int		numVertices;
+		int		numEmitted;				// vertices written so far
+		float	startTime;				// time of the first vertex
+		float	time;					// current time of the lines
+		float	stepsize;				// time between two vertices
+		float	GetEndTime() const {	return startTime + (numVertices - 1) * stepsize;	};
+
+		// lines start at the seeds (xyz) at startTime, the seed is the first vertex
+		void Init(const float * seeds, size_t numLines, int numVertices, float startTime, float stepsize);
+		size_t Size() const {	return x.size();	};
+		bool Finished() const {	return numEmitted >= numVertices;	};
+	};
+
+	// positions of grid points advected over a time span, e.g. for the FTLE
+	struct FlowMap {
+		std::vector<float> x, y, z;		// current positions, x fastest
+		int		resolution[3];			// of the grid, the seeds are at its texel centers
+		float	startTime;
+		float	time;					// current time of all positions
+		float	endTime;				// before the start time to integrate backward
+		float	stepsize;				// longest RK4 step
+		size_t	numSteps;				// RK4 steps taken by every position so far
+
+		void Init(const int resolution[3], float startTime, float endTime, float stepsize);
+		size_t Size() const {	return x.size();	};
+		bool Finished() const {	return time == endTime;	};
+	};
+
+	AdvectionEngine(void);
+
+	// the fields stay referenced until the next call, data1 may be nullptr if timestepT is always 0
+	// the ids identify the fields (e.g. the timestep), half data is only converted if they change
+	void SetFields(const void * data0, int id0, const void * data1, int id1, InputFormat format, const int resolution[3]);
+
+	// reseeds and advects all particles, optionally writing them in the GPU layout to gpuParticles
+	void Advect(Particles & particles, const Parameters & params, GPUParticle * gpuParticles = nullptr) const;
+
+	// advances the pathlines from their time to intervalEnd (at most) with RK4, the fields are the
+	// timesteps at intervalStart and intervalEnd and are interpolated linearly in between
+	void AdvancePathlines(Pathlines & lines, float intervalStart, float intervalEnd, const float velocityScaling[3]) const;
+
+	// advances the flow map towards its end time as far as it gets within the interval (in either
+	// direction) with equal RK4 steps, the fields are those of AdvancePathlines
+	void AdvanceFlowMap(FlowMap & map, float intervalStart, float intervalEnd, const float velocityScaling[3]) const;
+
+	// the interpolated velocity at p in texture space
+	void Sample(const float p[3], float timestepT, float velocity[3]) const;
+
+private:
+	// non-copyable since the fields may point into our own buffers
+	AdvectionEngine(const AdvectionEngine&);
+	AdvectionEngine& operator=(const AdvectionEngine&);
+
+	static void ConvertField(const void * data, size_t voxels, std::vector<float> & converted);
+
+	const float *		m_fields[2];
+	int					m_convertedIds[2];	// ids of the converted fields, -1 if none
+	std::vector<float>	m_converted[2];		// float copies of half data
+	int					m_resolution[3];
+};
@@ -0,0 +1,268 @@
+#include "BrickPyramid.h"
+
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cassert>
+
+namespace {
+	// value ranges and largest gradients of the bricks in one row (fixed y and z) of level 0
+	template<typename T>
+	void ComputeBrickRow(const T * data, const int resolution[3], float scale, int by, int bz, BrickPyramid::Level & level)
+	{
+		const size_t rx = resolution[0], slice = rx * resolution[1];
+		const int b = level.brickSize;
+		// one voxel halo, the neighbours are interpolated with at the brick borders
+		int y0 = std::max(0, by * b - 1), y1 = std::min(resolution[1] - 1, (by + 1) * b);
+		int z0 = std::max(0, bz * b - 1), z1 = std::min(resolution[2] - 1, (bz + 1) * b);
+
+		for(int bx = 0; bx < level.numBricks[0]; bx++) {
+			int x0 = std::max(0, bx * b - 1), x1 = std::min(resolution[0] - 1, (bx + 1) * b);
+			T lo = data[((size_t)z0 * resolution[1] + y0) * resolution[0] + x0];
+			T hi = lo;
+			float gradient2 = 0.f;
+			for(int z = z0; z <= z1; z++) {
+				// central differences, one sided at the borders of the volume
+				size_t zm = std::max(0, z - 1) * slice, zp = std::min(resolution[2] - 1, z + 1) * slice;
+				float hz = zp - zm > slice ? 0.5f : 1.f;
+				for(int y = y0; y <= y1; y++) {
+					size_t ym = std::max(0, y - 1) * rx, yp = std::min(resolution[1] - 1, y + 1) * rx;
+					float hy = yp - ym > rx ? 0.5f : 1.f;
+					const T * row = data + z * slice + y * rx;
+					for(int x = x0; x <= x1; x++) {
+						lo = std::min(lo, row[x]);
+						hi = std::max(hi, row[x]);
+
+						int xm = std::max(0, x - 1), xp = std::min(resolution[0] - 1, x + 1);
+						float gx = (xp - xm > 1 ? 0.5f : 1.f) * ((float)row[xp] - (float)row[xm]);
+						float gy = hy * ((float)data[z * slice + yp + x] - (float)data[z * slice + ym + x]);
+						float gz = hz * ((float)data[zp + y * rx + x] - (float)data[zm + y * rx + x]);
+						gradient2 = std::max(gradient2, gx * gx + gy * gy + gz * gz);
+					}
+				}
+			}
+			size_t i = level.Index(bx, by, bz);
+			level.minValues[i] = lo * scale;
+			level.maxValues[i] = hi * scale;
+			level.maxGradients[i] = std::sqrt(gradient2) * scale;
+		}
+	}
+
+	// texels a linearly filtered lookup of value in a table of size entries touches, clamped at the borders
+	inline void TexelRange(float value, int size, int & first, int & last)
+	{
+		float x = std::max(0.f, std::min((float)(size - 1), value * size - 0.5f));
+		first = (int)x;
+		last = std::min(first + 1, size - 1);
+	}
+}
+
+BrickPyramid::BrickPyramid(void)
+{
+	m_resolution[0] = m_resolution[1] = m_resolution[2] = 0;
+}
+
+void BrickPyramid::Build(const void * data, InputFormat format, const int resolution[3], int brickSize)
+{
+	assert(brickSize > 0);
+	std::copy(resolution, resolution + 3, m_resolution);
+
+	m_levels.assign(1, Level());
+	Level & level = m_levels[0];
+	level.brickSize = brickSize;
+	for(int c = 0; c < 3; c++)
+		level.numBricks[c] = (resolution[c] + brickSize - 1) / brickSize;
+	size_t numBricks = (size_t)level.numBricks[0] * level.numBricks[1] * level.numBricks[2];
+	level.minValues.resize(numBricks);
+	level.maxValues.resize(numBricks);
+	level.maxGradients.resize(numBricks);
+
+	// one task per row of bricks
+	ThreadPool::GetShared().ParallelFor(0, level.numBricks[1] * level.numBricks[2], [&](int row) {
+		int by = row % level.numBricks[1], bz = row / level.numBricks[1];
+		if(format == IF_BYTE)
+			ComputeBrickRow(static_cast<const unsigned char*>(data), resolution, 1.f / 255.f, by, bz, level);
+		else
+			ComputeBrickRow(static_cast<const float*>(data), resolution, 1.f, by, bz, level);
+	});
+
+	BuildLevels();
+}
+
+void BrickPyramid::Merge(const BrickPyramid & a, const BrickPyramid & b)
+{
+	assert(a.m_levels.size() == b.m_levels.size());
+	*this = a;
+	for(size_t l = 0; l < m_levels.size(); l++) {
+		Level & level = m_levels[l];
+		const Level & other = b.m_levels[l];
+		assert(level.minValues.size() == other.minValues.size());
+		for(size_t i = 0; i < level.minValues.size(); i++) {
+			level.minValues[i] = std::min(level.minValues[i], other.minValues[i]);
+			level.maxValues[i] = std::max(level.maxValues[i], other.maxValues[i]);
+		}
+		// the gradient of an interpolation of both is at most the larger one
+		for(size_t i = 0; i < level.maxGradients.size(); i++)
+			level.maxGradients[i] = std::max(level.maxGradients[i], other.maxGradients[i]);
+	}
+}
+
+// reduces 2x2x2 nodes until one is left
+void BrickPyramid::BuildLevels(void)
+{
+	while(m_levels.back().numBricks[0] > 1 || m_levels.back().numBricks[1] > 1 || m_levels.back().numBricks[2] > 1) {
+		Level next;
+		const Level & prev = m_levels.back();
+		next.brickSize = 2 * prev.brickSize;
+		for(int c = 0; c < 3; c++)
+			next.numBricks[c] = (prev.numBricks[c] + 1) / 2;
+		size_t numNodes = (size_t)next.numBricks[0] * next.numBricks[1] * next.numBricks[2];
+		next.minValues.assign(numNodes, FLT_MAX);
+		next.maxValues.assign(numNodes, -FLT_MAX);
+
+		for(int z = 0; z < prev.numBricks[2]; z++) {
+			for(int y = 0; y < prev.numBricks[1]; y++) {
+				for(int x = 0; x < prev.numBricks[0]; x++) {
+					size_t i = prev.Index(x, y, z), parent = next.Index(x / 2, y / 2, z / 2);
+					next.minValues[parent] = std::min(next.minValues[parent], prev.minValues[i]);
+					next.maxValues[parent] = std::max(next.maxValues[parent], prev.maxValues[i]);
+				}
+			}
+		}
+		m_levels.push_back(next);
+	}
+}
+
+void BrickPyramid::ClassifyTransferFunction(const float * tf, int tfSize, Occupancy & occupancy) const
+{
+	// number of entries with non-zero opacity before each entry, so a range is tested in O(1)
+	std::vector<int> opaque(tfSize + 1, 0);
+	for(int i = 0; i < tfSize; i++)
+		opaque[i + 1] = opaque[i] + (tf[4 * i + 3] > 0.f);
+
+	occupancy.levels.resize(m_levels.size());
+	if(m_levels.empty())
+		return;
+	const Level & level = m_levels[0];
+	std::vector<unsigned char> & occupied = occupancy.levels[0];
+	occupied.resize(level.minValues.size());
+	for(size_t i = 0; i < occupied.size(); i++) {
+		int first, last, unused;
+		TexelRange(level.minValues[i], tfSize, first, unused);
+		TexelRange(level.maxValues[i], tfSize, unused, last);
+		occupied[i] = opaque[last + 1] > opaque[first];
+	}
+
+	PropagateOccupancy(occupancy);
+}
+
+void BrickPyramid::ClassifyIsoValues(const float * isoValues, int numIsoValues, Occupancy & occupancy) const
+{
+	occupancy.levels.resize(m_levels.size());
+	if(m_levels.empty())
+		return;
+	const Level & level = m_levels[0];
+	std::vector<unsigned char> & occupied = occupancy.levels[0];
+	occupied.assign(level.minValues.size(), 0);
+	for(size_t i = 0; i < occupied.size(); i++)
+		for(int v = 0; v < numIsoValues; v++)
+			occupied[i] |= level.minValues[i] <= isoValues[v] && isoValues[v] <= level.maxValues[i];
+
+	PropagateOccupancy(occupancy);
+}
+
+void BrickPyramid::ClassifySamplingRate(const float * tf, int tfSize, std::vector<float> & rates) const
+{
+	rates.clear();
+	if(m_levels.empty() || tfSize < 2)
+		return;
+
+	// largest change of alpha and alpha * rgb per unit value between successive entries
+	std::vector<float> slopes(tfSize - 1);
+	for(int k = 0; k + 1 < tfSize; k++) {
+		const float * a = tf + 4 * k, * b = a + 4;
+		float slope = std::abs(b[3] - a[3]);
+		for(int c = 0; c < 3; c++)
+			slope = std::max(slope, std::abs(b[3] * b[c] - a[3] * a[c]));
+		slopes[k] = slope * tfSize;
+	}
+
+	const Level & level = m_levels[0];
+	const int * n = level.numBricks;
+	std::vector<float> own(level.minValues.size());
+	ThreadPool::GetShared().ParallelFor(0, n[1] * n[2], [&](int row) {
+		for(int x = 0; x < n[0]; x++) {
+			size_t i = level.Index(x, row % n[1], row / n[1]);
+			int first, last, unused;
+			TexelRange(level.minValues[i], tfSize, first, unused);
+			TexelRange(level.maxValues[i], tfSize, unused, last);
+			float slope = 0.f;
+			for(int k = first; k < last; k++)
+				slope = std::max(slope, slopes[k]);
+			own[i] = slope * level.maxGradients[i];
+		}
+	});
+
+	// a step taken in a brick ends in one of its neighbours
+	rates.resize(own.size());
+	ThreadPool::GetShared().ParallelFor(0, n[1] * n[2], [&](int row) {
+		int y = row % n[1], z = row / n[1];
+		for(int x = 0; x < n[0]; x++) {
+			float rate = 0.f;
+			for(int dz = std::max(0, z - 1); dz <= std::min(n[2] - 1, z + 1); dz++)
+				for(int dy = std::max(0, y - 1); dy <= std::min(n[1] - 1, y + 1); dy++)
+					for(int dx = std::max(0, x - 1); dx <= std::min(n[0] - 1, x + 1); dx++)
+						rate = std::max(rate, own[level.Index(dx, dy, dz)]);
+			rates[level.Index(x, y, z)] = rate;
+		}
+	});
+}
+
+// a node is occupied if any of its children is, which is tighter than classifying its range
+void BrickPyramid::PropagateOccupancy(Occupancy & occupancy) const
+{
+	for(size_t l = 1; l < m_levels.size(); l++) {
+		const Level & prev = m_levels[l - 1];
+		const Level & level = m_levels[l];
+		const std::vector<unsigned char> & children = occupancy.levels[l - 1];
+		std::vector<unsigned char> & occupied = occupancy.levels[l];
+		occupied.assign(level.minValues.size(), 0);
+		for(int z = 0; z < prev.numBricks[2]; z++)
+			for(int y = 0; y < prev.numBricks[1]; y++)
+				for(int x = 0; x < prev.numBricks[0]; x++)
+					occupied[level.Index(x / 2, y / 2, z / 2)] |= children[prev.Index(x, y, z)];
+	}
+}
+
+bool BrickPyramid::FindEmptyNode(const Occupancy & occupancy, const float p[3], float nodeMin[3], float nodeMax[3]) const
+{
+	if(m_levels.empty())
+		return false;
+
+	// the brick whose texel centers surround p
+	const Level & base = m_levels[0];
+	int brick[3];
+	for(int c = 0; c < 3; c++)
+		brick[c] = std::max(0, std::min(base.numBricks[c] - 1, (int)std::floor(p[c] * m_resolution[c] / base.brickSize)));
+	if(occupancy.levels[0][base.Index(brick[0], brick[1], brick[2])])
+		return false;
+
+	int l = 0;
+	while(l + 1 < (int)m_levels.size()) {
+		const Level & parent = m_levels[l + 1];
+		int s = l + 1;
+		if(occupancy.levels[l + 1][parent.Index(brick[0] >> s, brick[1] >> s, brick[2] >> s)])
+			break;
+		l++;
+	}
+
+	const Level & level = m_levels[l];
+	for(int c = 0; c < 3; c++) {
+		int node = brick[c] >> l;
+		nodeMin[c] = node == 0 ? -FLT_MAX : (float)node * level.brickSize / m_resolution[c];
+		nodeMax[c] = node == level.numBricks[c] - 1 ? FLT_MAX : (float)(node + 1) * level.brickSize / m_resolution[c];
+	}
+	return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+/*
+	Min/max pyramid over bricks of a scalar volume for empty-space skipping
+	Level 0 holds the value range of every brick of brickSize^3 voxels, including a one voxel halo
+	so the range covers everything trilinear interpolation can return between the texel centers of
+	the brick. Every further level combines 2x2x2 nodes of the one below until a single node is left.
+	Values are those the shaders see, bytes are normalized like the UNORM texture.
+	The occupancy of the nodes is classified separately for the current transfer function (a node
+	is empty if the opacity is zero over its whole value range) or isovalues (a node is empty if
+	no isovalue lies in its range), which only touches the bricks and takes no time compared to
+	building the pyramid. Level 0 is built in slabs of bricks on the shared thread pool.
+	Level 0 also keeps the largest gradient magnitude (central differences, value per voxel) of every
+	brick. Together with how fast the transfer function changes over the value range of a brick this
+	bounds how fast the classified color changes along a ray, i.e. the sampling rate the brick needs.
+*/
+class BrickPyramid
+{
+public:
+	enum InputFormat {
+		IF_BYTE,
+		IF_FLOAT
+	};
+
+	struct Level {
+		int					numBricks[3];
+		int					brickSize;		// in voxels
+		std::vector<float>	minValues;		// per node, x fastest
+		std::vector<float>	maxValues;
+		std::vector<float>	maxGradients;	// per brick, level 0 only
+
+		size_t Index(int x, int y, int z) const {	return ((size_t)z * numBricks[1] + y) * numBricks[0] + x;	};
+	};
+
+	// 1 per node that may contribute to the image, same layout as the levels
+	struct Occupancy {
+		std::vector<std::vector<unsigned char>> levels;
+	};
+
+	BrickPyramid(void);
+
+	void Build(const void * data, InputFormat format, const int resolution[3], int brickSize = 8);
+	// the ranges of both, they cover every linear interpolation of the two volumes
+	void Merge(const BrickPyramid & a, const BrickPyramid & b);
+
+	// tf are tfSize RGBA entries sampled linearly like the transfer function texture
+	void ClassifyTransferFunction(const float * tf, int tfSize, Occupancy & occupancy) const;
+	void ClassifyIsoValues(const float * isoValues, int numIsoValues, Occupancy & occupancy) const;
+	// upper bound of the change of alpha and alpha * rgb per voxel along any ray through each level 0
+	// brick or its neighbours, so a step of tolerance / rate voxels changes the classified color by
+	// at most tolerance; 0 where the transfer function is constant over the value range
+	void ClassifySamplingRate(const float * tf, int tfSize, std::vector<float> & rates) const;
+
+	// bounds (in texture space) of the largest empty node containing p, false if the brick at p is occupied
+	// the outer nodes extend to infinity since the volume is sampled clamped
+	bool FindEmptyNode(const Occupancy & occupancy, const float p[3], float nodeMin[3], float nodeMax[3]) const;
+
+	bool IsEmpty() const {						return m_levels.empty();	};
+	int GetNumLevels() const {					return (int)m_levels.size();	};
+	const Level & GetLevel(int level) const {	return m_levels[level];	};
+	const int * GetResolution() const {			return m_resolution;	};
+
+private:
+	void BuildLevels(void);
+	void PropagateOccupancy(Occupancy & occupancy) const;
+
+	int					m_resolution[3];
+	std::vector<Level>	m_levels;
+};
@@ -0,0 +1,82 @@
+#include "CompactEncoding.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	inline float SignNotZero(float x)
+	{
+		return x >= 0.f ? 1.f : -1.f;
+	}
+
+	inline uint16_t QuantizeSigned(float x)
+	{
+		return (uint16_t)(int16_t)std::floor(std::max(-1.f, std::min(1.f, x)) * 32767.f + 0.5f);
+	}
+}
+
+uint16_t CompactEncoding::QuantizeUnit(float x)
+{
+	return (uint16_t)std::floor(std::max(0.f, std::min(1.f, x)) * 65535.f + 0.5f);
+}
+
+float CompactEncoding::DequantizeUnit(uint16_t q)
+{
+	return q / 65535.f;
+}
+
+uint32_t CompactEncoding::EncodeOctahedral(const float n[3])
+{
+	// project onto the octahedron and fold the lower half over the diagonals
+	float l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+	float u = 0.f, v = 0.f;
+	if(l1 > 0.f) {
+		u = n[0] / l1;
+		v = n[1] / l1;
+		if(n[2] < 0.f) {
+			float fu = (1.f - std::abs(v)) * SignNotZero(u);
+			float fv = (1.f - std::abs(u)) * SignNotZero(v);
+			u = fu;
+			v = fv;
+		}
+	}
+	return (uint32_t)QuantizeSigned(u) | (uint32_t)QuantizeSigned(v) << 16;
+}
+
+void CompactEncoding::DecodeOctahedral(uint32_t e, float n[3])
+{
+	float u = std::max(-1.f, (int16_t)(e & 0xffff) / 32767.f);
+	float v = std::max(-1.f, (int16_t)(e >> 16) / 32767.f);
+	n[2] = 1.f - std::abs(u) - std::abs(v);
+	if(n[2] < 0.f) {
+		n[0] = (1.f - std::abs(v)) * SignNotZero(u);
+		n[1] = (1.f - std::abs(u)) * SignNotZero(v);
+	}
+	else {
+		n[0] = u;
+		n[1] = v;
+	}
+	float l = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	for(int c = 0; c < 3; c++)
+		n[c] /= l;
+}
+
+CompactEncoding::LineVertex CompactEncoding::EncodeLineVertex(const float pos[3], const float tangent[3], float age, float ageScale, float tfCoordinate)
+{
+	LineVertex v;
+	v.posXY = (uint32_t)QuantizeUnit(pos[0]) | (uint32_t)QuantizeUnit(pos[1]) << 16;
+	v.posZAge = (uint32_t)QuantizeUnit(pos[2]) | (uint32_t)QuantizeUnit(ageScale > 0.f ? age / ageScale : 0.f) << 16;
+	v.tangent = EncodeOctahedral(tangent);
+	v.color = tfCoordinate < 0.f ? 0 : QuantizeUnit(tfCoordinate) | COLOR_FROM_TF;
+	return v;
+}
+
+void CompactEncoding::DecodeLineVertex(const LineVertex & v, float ageScale, float pos[3], float tangent[3], float & age, float & tfCoordinate)
+{
+	pos[0] = DequantizeUnit(v.posXY & 0xffff);
+	pos[1] = DequantizeUnit(v.posXY >> 16);
+	pos[2] = DequantizeUnit(v.posZAge & 0xffff);
+	age = DequantizeUnit(v.posZAge >> 16) * ageScale;
+	DecodeOctahedral(v.tangent, tangent);
+	tfCoordinate = v.color & COLOR_FROM_TF ? DequantizeUnit(v.color & 0xffff) : -1.f;
+}
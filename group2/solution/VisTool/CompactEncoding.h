@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+	Quantized 16 byte layout of characteristic line vertices, the float layout takes 48 bytes
+	Positions are stored as 16 bit fixed point in the unit domain (texture space, clamped), the
+	age as 16 bit fixed point relative to an age scale (e.g. the lifetime of the lines), the tangent
+	octahedrally mapped to two 16 bit signed normalized values and the color either as a 16 bit
+	coordinate into the transfer function or as a flag for the uniform particle color.
+	EncodeLineVertex matches StoreStreamlineVertex in ParticleTracer.fx, DecodeLineVertex matches LoadCLVertex.
+*/
+class CompactEncoding
+{
+public:
+	// a uint4 in the shader
+	struct LineVertex {
+		uint32_t	posXY;		// x | y << 16
+		uint32_t	posZAge;	// z | age << 16
+		uint32_t	tangent;	// octahedral u | v << 16
+		uint32_t	color;		// transfer function coordinate | COLOR_FROM_TF, 0 for the uniform color
+	};
+	static const uint32_t COLOR_FROM_TF = 1u << 16;
+
+	// [0, 1] to 16 bit fixed point and back, values outside are clamped
+	static uint16_t QuantizeUnit(float x);
+	static float DequantizeUnit(uint16_t q);
+
+	// unit vector to two snorm16 values, a zero vector decodes to (0, 0, 1)
+	static uint32_t EncodeOctahedral(const float n[3]);
+	static void DecodeOctahedral(uint32_t e, float n[3]);
+
+	// tfCoordinate < 0 selects the uniform color, the age is clamped to [0, ageScale]
+	static LineVertex EncodeLineVertex(const float pos[3], const float tangent[3], float age, float ageScale, float tfCoordinate);
+	// tfCoordinate is -1 for the uniform color
+	static void DecodeLineVertex(const LineVertex & v, float ageScale, float pos[3], float tangent[3], float & age, float & tfCoordinate);
+};
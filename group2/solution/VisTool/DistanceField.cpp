@@ -0,0 +1,165 @@
+#include "DistanceField.h"
+
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cassert>
+
+namespace {
+	// the two axes enumerating the lines along axis
+	inline void LineAxes(int axis, int & u, int & v)
+	{
+		u = axis == 0 ? 1 : 0;
+		v = axis == 2 ? 1 : 2;
+	}
+}
+
+DistanceField::DistanceField(void)
+{
+	for(int c = 0; c < 3; c++) {
+		m_numCells[c] = 0;
+		m_cellExtent[c] = 0.f;
+	}
+}
+
+void DistanceField::Compute(const unsigned char * occupied, const int numCells[3], const float cellExtent[3])
+{
+	std::copy(numCells, numCells + 3, m_numCells);
+	std::copy(cellExtent, cellExtent + 3, m_cellExtent);
+	size_t numTotal = (size_t)numCells[0] * numCells[1] * numCells[2];
+	m_occupied.assign(occupied, occupied + numTotal);
+	for(int p = 0; p < 3; p++)
+		m_passes[p].assign(numTotal, 0);
+
+	for(int axis = 0; axis < 3; axis++) {
+		int u, v;
+		LineAxes(axis, u, v);
+		std::vector<int> lines(m_numCells[u] * m_numCells[v]);
+		for(int l = 0; l < (int)lines.size(); l++)
+			lines[l] = l;
+		TransformLines(axis, lines, nullptr);
+	}
+}
+
+size_t DistanceField::Update(const unsigned char * occupied)
+{
+	assert(!IsEmpty());
+
+	// cells whose input changed, per pass
+	std::vector<unsigned char> changed(m_occupied.size(), 0);
+	size_t numChanged = 0;
+	for(size_t i = 0; i < m_occupied.size(); i++) {
+		if(m_occupied[i] != occupied[i]) {
+			m_occupied[i] = occupied[i];
+			changed[i] = 1;
+			numChanged++;
+		}
+	}
+
+	for(int axis = 0; axis < 3 && numChanged; axis++) {
+		int u, v;
+		LineAxes(axis, u, v);
+		std::vector<unsigned char> dirty(m_numCells[u] * m_numCells[v], 0);
+		for(int z = 0; z < m_numCells[2]; z++) {
+			for(int y = 0; y < m_numCells[1]; y++) {
+				for(int x = 0; x < m_numCells[0]; x++) {
+					if(!changed[Index(x, y, z)])
+						continue;
+					int cell[3] = { x, y, z };
+					dirty[cell[u] + m_numCells[u] * cell[v]] = 1;
+				}
+			}
+		}
+
+		std::vector<int> lines;
+		for(int l = 0; l < (int)dirty.size(); l++)
+			if(dirty[l])
+				lines.push_back(l);
+		std::fill(changed.begin(), changed.end(), 0);
+		TransformLines(axis, lines, &changed);
+	}
+
+	return numChanged;
+}
+
+void DistanceField::TransformLines(int axis, const std::vector<int> & lines, std::vector<unsigned char> * changed)
+{
+	int u, v;
+	LineAxes(axis, u, v);
+	const int n = m_numCells[axis];
+	const std::vector<unsigned char> & input = axis == 0 ? m_occupied : m_passes[axis - 1];
+	std::vector<unsigned char> & output = m_passes[axis];
+
+	ThreadPool::GetShared().ParallelForRange(0, (int)lines.size(), [&](int begin, int end) {
+		std::vector<size_t> cells(n);
+		std::vector<int> f(n), g(n);
+		for(int l = begin; l < end; l++) {
+			int cell[3];
+			cell[u] = lines[l] % m_numCells[u];
+			cell[v] = lines[l] / m_numCells[u];
+			for(int i = 0; i < n; i++) {
+				cell[axis] = i;
+				cells[i] = Index(cell[0], cell[1], cell[2]);
+			}
+
+			if(axis == 0) {
+				// distance to the nearest occupied cell in the row, scanning in both directions
+				int d = MAX_DISTANCE;
+				for(int i = 0; i < n; i++) {
+					d = input[cells[i]] ? 0 : std::min(d + 1, MAX_DISTANCE);
+					g[i] = d;
+				}
+				d = MAX_DISTANCE;
+				for(int i = n - 1; i >= 0; i--) {
+					d = input[cells[i]] ? 0 : std::min(d + 1, MAX_DISTANCE);
+					g[i] = std::min(g[i], d);
+				}
+			}
+			else {
+				// min over i' of max(|i - i'|, f(i')), the search stops once |i - i'| can't improve it
+				for(int i = 0; i < n; i++)
+					f[i] = input[cells[i]];
+				for(int i = 0; i < n; i++) {
+					int best = f[i];
+					for(int d = 1; d < best && (i >= d || i + d < n); d++) {
+						if(i >= d)
+							best = std::min(best, std::max(d, f[i - d]));
+						if(i + d < n)
+							best = std::min(best, std::max(d, f[i + d]));
+					}
+					g[i] = best;
+				}
+			}
+
+			for(int i = 0; i < n; i++) {
+				if(output[cells[i]] != g[i]) {
+					output[cells[i]] = (unsigned char)g[i];
+					if(changed)
+						(*changed)[cells[i]] = 1;
+				}
+			}
+		}
+	}, 16);
+}
+
+bool DistanceField::FindEmptyRegion(const float p[3], float regionMin[3], float regionMax[3]) const
+{
+	if(IsEmpty())
+		return false;
+
+	int cell[3];
+	for(int c = 0; c < 3; c++)
+		cell[c] = std::max(0, std::min(m_numCells[c] - 1, (int)std::floor(p[c] / m_cellExtent[c])));
+	int d = GetDistances()[Index(cell[0], cell[1], cell[2])];
+	if(!d)
+		return false;
+
+	for(int c = 0; c < 3; c++) {
+		int lo = cell[c] - (d - 1), hi = cell[c] + d;
+		regionMin[c] = lo <= 0 ? -FLT_MAX : lo * m_cellExtent[c];
+		regionMax[c] = hi >= m_numCells[c] ? FLT_MAX : hi * m_cellExtent[c];
+	}
+	return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+/*
+	Chebyshev distance from every cell of a coarse grid (e.g. the bricks of a BrickPyramid) to the
+	nearest occupied cell, 0 for occupied cells and clamped to MAX_DISTANCE, one byte per cell
+	A ray at a cell with distance d can safely leap to the border of the cube of 2d - 1 cells around
+	it since no cell in there is occupied.
+	The transform is separable for the maximum norm: the distance along x is taken first, then
+	d(y) = min over y' of max(|y - y'|, d_x(y')) along y and the same along z. The lines of every pass
+	are processed on the shared thread pool. The results of the passes are kept, so after a change of
+	the occupancy (e.g. the isovalue moved) only the lines that contain a changed cell in the input
+	of a pass are transformed again.
+*/
+class DistanceField
+{
+public:
+	static const int MAX_DISTANCE = 255;
+
+	DistanceField(void);
+
+	// full transform, cellExtent is the size of a cell in texture space
+	void Compute(const unsigned char * occupied, const int numCells[3], const float cellExtent[3]);
+	// transforms the lines affected by cells whose occupancy changed, same grid as for Compute
+	// returns the number of changed cells
+	size_t Update(const unsigned char * occupied);
+
+	// bounds (in texture space) of the empty cube around p, false if the cell at p is occupied
+	// cubes touching the border extend to infinity since the volume is sampled clamped
+	bool FindEmptyRegion(const float p[3], float regionMin[3], float regionMax[3]) const;
+
+	bool IsEmpty() const {							return m_occupied.empty();	};
+	const int * GetNumCells() const {				return m_numCells;	};
+	const float * GetCellExtent() const {			return m_cellExtent;	};
+	const unsigned char * GetDistances() const {	return m_passes[2].data();	};
+
+private:
+	size_t Index(int x, int y, int z) const {	return ((size_t)z * m_numCells[1] + y) * m_numCells[0] + x;	};
+	// runs the pass along axis over the given lines, marking the cells whose result changed
+	void TransformLines(int axis, const std::vector<int> & lines, std::vector<unsigned char> * changed);
+
+	int									m_numCells[3];
+	float								m_cellExtent[3];
+	std::vector<unsigned char>			m_occupied;
+	std::vector<unsigned char>			m_passes[3];	// distances after the x, y and z pass
+};
@@ -0,0 +1,108 @@
+#include "FTLEEngine.h"
+
+#include "MetricEngine.h"
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+namespace {
+	// neighbours along one axis and the grid spacing between them, one-sided at the borders
+	inline void Neighbours(int i, int resolution, int & i0, int & i1, float & invDistance)
+	{
+		i0 = std::max(0, i - 1);
+		i1 = std::min(resolution - 1, i + 1);
+		invDistance = i1 > i0 ? (float)resolution / (i1 - i0) : 0.f;
+	}
+
+	// texel center i of the target in the coordinates of the source grid, the border is repeated
+	inline void SourceAxis(int i, int targetResolution, int resolution, int & i0, int & i1, float & w)
+	{
+		float f = (i + 0.5f) / targetResolution * resolution - 0.5f;
+		f = std::max(0.f, std::min((float)(resolution - 1), f));
+		i0 = std::min((int)f, std::max(0, resolution - 2));
+		i1 = std::min(i0 + 1, resolution - 1);
+		w = f - i0;
+	}
+}
+
+void FTLEEngine::Compute(const AdvectionEngine::FlowMap & map, const float extent[3], float * result)
+{
+	const int * res = map.resolution;
+	const float integrationTime = std::abs(map.time - map.startTime);
+	const float * positions[3] = { map.x.data(), map.y.data(), map.z.data() };
+	const size_t strides[3] = { 1, (size_t)res[0], (size_t)res[0] * res[1] };
+
+	ThreadPool::GetShared().ParallelForRange(0, res[2], [&](int begin, int end) {
+		for(int z = begin; z < end; z++)
+			for(int y = 0; y < res[1]; y++)
+				for(int x = 0; x < res[0]; x++) {
+					size_t index = z * strides[2] + y * strides[1] + x;
+					if(integrationTime == 0.f) {
+						result[index] = 0.f;
+						continue;
+					}
+
+					// F[i][j] = d position_i / d seed_j in world space
+					int g[3] = { x, y, z };
+					float F[3][3];
+					for(int j = 0; j < 3; j++) {
+						int i0, i1;
+						float invDistance;
+						Neighbours(g[j], res[j], i0, i1, invDistance);
+						size_t n0 = index + (i0 - g[j]) * strides[j];
+						size_t n1 = index + (i1 - g[j]) * strides[j];
+						for(int i = 0; i < 3; i++)
+							F[i][j] = (positions[i][n1] - positions[i][n0]) * invDistance * extent[i] / extent[j];
+					}
+
+					// C = F^T F
+					float C[3][3];
+					for(int i = 0; i < 3; i++)
+						for(int j = i; j < 3; j++)
+							C[i][j] = F[0][i] * F[0][j] + F[1][i] * F[1][j] + F[2][i] * F[2][j];
+
+					float eigenvalues[3];
+					MetricEngine::SymmetricEigenvalues(C[0][0], C[0][1], C[0][2], C[1][1], C[1][2], C[2][2], eigenvalues);
+					// C is positive semidefinite, the largest eigenvalue is only 0 where the map collapsed
+					result[index] = 0.5f * logf(std::max(eigenvalues[0], 1e-30f)) / integrationTime;
+				}
+	}, 1);
+}
+
+void FTLEEngine::Resample(const float * values, const int resolution[3], const int targetResolution[3], float * result)
+{
+	const size_t sliceSize = (size_t)resolution[0] * resolution[1];
+
+	ThreadPool::GetShared().ParallelForRange(0, targetResolution[2], [&](int begin, int end) {
+		for(int z = begin; z < end; z++) {
+			int z0, z1;
+			float wz;
+			SourceAxis(z, targetResolution[2], resolution[2], z0, z1, wz);
+			for(int y = 0; y < targetResolution[1]; y++) {
+				int y0, y1;
+				float wy;
+				SourceAxis(y, targetResolution[1], resolution[1], y0, y1, wy);
+				const float * rows[4] = {
+					values + z0 * sliceSize + (size_t)y0 * resolution[0],
+					values + z0 * sliceSize + (size_t)y1 * resolution[0],
+					values + z1 * sliceSize + (size_t)y0 * resolution[0],
+					values + z1 * sliceSize + (size_t)y1 * resolution[0]
+				};
+				float * dst = result + ((size_t)z * targetResolution[1] + y) * targetResolution[0];
+				for(int x = 0; x < targetResolution[0]; x++) {
+					int x0, x1;
+					float wx;
+					SourceAxis(x, targetResolution[0], resolution[0], x0, x1, wx);
+					float r[4];
+					for(int i = 0; i < 4; i++)
+						r[i] = rows[i][x0] + wx * (rows[i][x1] - rows[i][x0]);
+					float s0 = r[0] + wy * (r[1] - r[0]);
+					float s1 = r[2] + wy * (r[3] - r[2]);
+					dst[x] = s0 + wz * (s1 - s0);
+				}
+			}
+		}
+	}, 1);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "AdvectionEngine.h"
+
+/*
+	Finite-time Lyapunov exponent of a flow map
+	The gradient F of the flow map is taken with central differences between the neighbouring grid
+	points (one-sided at the borders). Positions are scaled from texture to world space by the extent
+	of the volume first, so the stretching is measured the same in every direction. The largest
+	eigenvalue of the right Cauchy-Green tensor C = F^T F gives FTLE = ln(sqrt(lambda_max)) / |T|,
+	T being the time the flow map was actually advected over.
+	The grid is processed in slices on the shared thread pool.
+*/
+class FTLEEngine
+{
+public:
+	// writes one value per grid point (x fastest), 0 if the map was not advected at all
+	static void Compute(const AdvectionEngine::FlowMap & map, const float extent[3], float * result);
+
+	// trilinear interpolation of a grid to another resolution, both are sampled at their texel centers
+	static void Resample(const float * values, const int resolution[3], const int targetResolution[3], float * result);
+};
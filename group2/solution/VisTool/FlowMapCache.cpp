@@ -0,0 +1,152 @@
+#include "FlowMapCache.h"
+
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+namespace {
+	// times closer than this fraction of an interval to a boundary are on it
+	const float BOUNDARY_TOLERANCE = 1e-4f;
+}
+
+FlowMapCache::FlowMapCache(void) :
+	m_budgetMB(256),
+	m_hits(0),
+	m_misses(0)
+{
+	m_settings.resolution[0] = m_settings.resolution[1] = m_settings.resolution[2] = 0;
+	m_settings.interval = 0.f;
+	m_settings.stepsize = 0.f;
+	m_settings.steady = false;
+}
+
+void FlowMapCache::Configure(const Settings & settings)
+{
+	assert(settings.interval > 0.f && settings.stepsize > 0.f);
+	if(settings == m_settings)
+		return;
+	Clear();
+	m_settings = settings;
+}
+
+void FlowMapCache::Clear(void)
+{
+	m_entries.clear();
+}
+
+size_t FlowMapCache::GetMaxEntries(void) const
+{
+	unsigned long long entrySize = (unsigned long long)m_settings.resolution[0] * m_settings.resolution[1] * m_settings.resolution[2] * 4 * sizeof(float);
+	unsigned long long budget = (unsigned long long)std::max(0, m_budgetMB) * 1024 * 1024;
+	return (size_t)std::max(1ULL, budget / std::max(1ULL, entrySize));
+}
+
+void FlowMapCache::AdvanceFlowMap(const AdvectionEngine & engine, AdvectionEngine::FlowMap & map, float intervalStart, float intervalEnd,
+	const float velocityScaling[3])
+{
+	const bool backward = map.endTime < map.startTime;
+	const float h = m_settings.interval;
+	const float tolerance = BOUNDARY_TOLERANCE * h;
+
+	while(!map.Finished() && map.time >= intervalStart && map.time <= intervalEnd) {
+		float limit = backward ? std::max(map.endTime, intervalStart) : std::min(map.endTime, intervalEnd);
+		if(limit == map.time)
+			break;
+
+		// the cache interval the integration continues in, from begin to end in its direction
+		int index = backward ? (int)ceilf(map.time / h - BOUNDARY_TOLERANCE) - 1 : (int)floorf(map.time / h + BOUNDARY_TOLERANCE);
+		float begin = (backward ? index + 1 : index) * h;
+		float end = (backward ? index : index + 1) * h;
+		bool whole = std::abs(map.time - begin) <= tolerance && (backward ? end >= limit - tolerance : end <= limit + tolerance);
+
+		if(whole) {
+			Apply(Find(engine, m_settings.steady ? 0 : index, backward, intervalStart, intervalEnd, velocityScaling), map);
+			map.time = std::abs(end - limit) <= tolerance ? limit : end;
+		}
+		else {
+			// advect up to the next boundary (or the limit) directly
+			float endTime = map.endTime;
+			map.endTime = backward ? std::max(end, limit) : std::min(end, limit);
+			engine.AdvanceFlowMap(map, intervalStart, intervalEnd, velocityScaling);
+			map.endTime = endTime;
+		}
+	}
+}
+
+/**
+	Returns the map of the interval and makes it the most recently used one, on a miss the grid is
+	advected over the interval with the fields of the engine
+*/
+const FlowMapCache::Entry & FlowMapCache::Find(const AdvectionEngine & engine, int index, bool backward, float intervalStart, float intervalEnd,
+	const float velocityScaling[3])
+{
+	for(auto it = m_entries.begin(); it != m_entries.end(); it++) {
+		if(it->index == index && it->backward == backward) {
+			m_entries.splice(m_entries.begin(), m_entries, it);
+			m_hits++;
+			return m_entries.front();
+		}
+	}
+	m_misses++;
+
+	// reuse the storage of the least recently used map if the cache is full
+	std::vector<float> displacements;
+	while(m_entries.size() >= GetMaxEntries()) {
+		if(displacements.empty())
+			displacements.swap(m_entries.back().displacements);
+		m_entries.pop_back();
+	}
+
+	// a steady map is the same for all intervals, so it is advected within the one requested
+	// an unsteady one covers a slice of the timestep pair, which the fields are blended over
+	float begin = backward ? intervalEnd : intervalStart;
+	float end = backward ? begin - m_settings.interval : begin + m_settings.interval;
+	if(!m_settings.steady) {
+		begin = (backward ? index + 1 : index) * m_settings.interval;
+		end = backward ? std::max(intervalStart, begin - m_settings.interval) : std::min(intervalEnd, begin + m_settings.interval);
+		begin = std::min(intervalEnd, std::max(intervalStart, begin));
+	}
+	AdvectionEngine::FlowMap grid;
+	grid.Init(m_settings.resolution, begin, end, m_settings.stepsize);
+	engine.AdvanceFlowMap(grid, m_settings.steady ? std::min(begin, end) : intervalStart,
+		m_settings.steady ? std::max(begin, end) : intervalEnd, velocityScaling);
+
+	const int * res = m_settings.resolution;
+	displacements.resize(grid.Size() * 4);
+	ThreadPool::GetShared().ParallelForRange(0, res[2], [&](int zBegin, int zEnd) {
+		for(int z = zBegin; z < zEnd; z++)
+			for(int y = 0; y < res[1]; y++)
+				for(int x = 0; x < res[0]; x++) {
+					size_t i = ((size_t)z * res[1] + y) * res[0] + x;
+					float * d = &displacements[i * 4];
+					d[0] = grid.x[i] - (x + 0.5f) / res[0];
+					d[1] = grid.y[i] - (y + 0.5f) / res[1];
+					d[2] = grid.z[i] - (z + 0.5f) / res[2];
+					d[3] = 0.f;
+				}
+	}, 1);
+
+	Entry entry = { index, backward, std::vector<float>() };
+	m_entries.push_front(entry);
+	m_entries.front().displacements.swap(displacements);
+	return m_entries.front();
+}
+
+// moves the positions of the map by the interpolated displacements of the entry
+void FlowMapCache::Apply(const Entry & entry, AdvectionEngine::FlowMap & map)
+{
+	m_sampler.SetFields(entry.displacements.data(), 0, nullptr, -1, AdvectionEngine::IF_FLOAT4, m_settings.resolution);
+
+	ThreadPool::GetShared().ParallelForRange(0, (int)map.Size(), [&](int begin, int end) {
+		for(int i = begin; i < end; i++) {
+			float p[3] = { map.x[i], map.y[i], map.z[i] };
+			float d[3];
+			m_sampler.Sample(p, 0.f, d);
+			map.x[i] = p[0] + d[0];
+			map.y[i] = p[1] + d[1];
+			map.z[i] = p[2] + d[2];
+		}
+	}, 4096);
+}
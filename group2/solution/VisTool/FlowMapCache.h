@@ -0,0 +1,74 @@
+#pragma once
+
+#include "AdvectionEngine.h"
+
+#include <list>
+#include <vector>
+
+/*
+	LRU cache of flow maps over short time intervals
+	Time is divided into intervals of a fixed length (a fraction of the timestep). The map of an
+	interval holds the displacement of every grid point (texel centers) after advecting it over
+	the interval, forward and backward maps are kept separately. A flow map that starts on an
+	interval boundary crosses whole intervals by interpolating the cached displacements
+	trilinearly at its positions instead of advecting them again, only the parts before the
+	first and after the last boundary are advected.
+	Coarser grids and longer intervals are cheaper but add interpolation error with every map
+	that is composed. In a steady field all intervals share one map.
+	The number of maps is limited by a memory budget, at least one map is always kept.
+*/
+class FlowMapCache
+{
+public:
+	struct Settings {
+		int		resolution[3];		// of the grid the maps are sampled on
+		float	interval;			// time span of one map, timesteps should be a multiple of it
+		float	stepsize;			// longest RK4 step while computing a map
+		bool	steady;
+
+		bool operator==(const Settings & o) const {
+			return resolution[0] == o.resolution[0] && resolution[1] == o.resolution[1] && resolution[2] == o.resolution[2] &&
+				interval == o.interval && stepsize == o.stepsize && steady == o.steady;
+		};
+	};
+
+	FlowMapCache(void);
+
+	// drops all maps if the settings changed
+	void Configure(const Settings & settings);
+	void Clear(void);
+
+	// like AdvectionEngine::AdvanceFlowMap, the fields of the engine are those of the interval,
+	// missing maps of whole intervals within it are computed with them and added
+	void AdvanceFlowMap(const AdvectionEngine & engine, AdvectionEngine::FlowMap & map, float intervalStart, float intervalEnd,
+		const float velocityScaling[3]);
+
+	void SetBudgetMB(int budgetMB) {		m_budgetMB = budgetMB;		};
+	int GetHits() const {					return m_hits;			};
+	int GetMisses() const {					return m_misses;		};
+	int GetNumEntries() const {				return (int)m_entries.size();	};
+	void ResetCounters() {					m_hits = m_misses = 0;	};
+
+private:
+	// non-copyable since the sampler points into the entries
+	FlowMapCache(const FlowMapCache&);
+	FlowMapCache& operator=(const FlowMapCache&);
+
+	struct Entry {
+		int					index;			// the map spans [index, index + 1] * interval
+		bool				backward;
+		std::vector<float>	displacements;	// xyz0 per grid point, in the layout of IF_FLOAT4 fields
+	};
+
+	const Entry & Find(const AdvectionEngine & engine, int index, bool backward, float intervalStart, float intervalEnd,
+		const float velocityScaling[3]);
+	void Apply(const Entry & entry, AdvectionEngine::FlowMap & map);
+	size_t GetMaxEntries(void) const;
+
+	Settings			m_settings;
+	int					m_budgetMB;
+	std::list<Entry>	m_entries;		// most recently used first
+	AdvectionEngine		m_sampler;		// interpolates the displacements of one entry
+	int					m_hits;
+	int					m_misses;
+};
@@ -0,0 +1,181 @@
+#include "GradientEngine.h"
+
+#include "util/ThreadPool.h"
+
+#include <emmintrin.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+int GradientEngine::GetEncodedSize(Encoding encoding)
+{
+	return encoding == NE_OCTAHEDRAL ? 2 : 4;
+}
+
+DXGI_FORMAT GradientEngine::GetTextureFormat(Encoding encoding)
+{
+	return encoding == NE_OCTAHEDRAL ? DXGI_FORMAT_R8G8_SNORM : DXGI_FORMAT_R8G8B8A8_SNORM;
+}
+
+/*
+	Row layout used by the tiles: the voxels of the row start at index 1, index 0 and everything
+	behind the row repeat the border voxels, so the x differences need no special cases and SSE
+	loads of the last (partial) group stay inside the row.
+*/
+void GradientEngine::ConvertRow(const void * data, VolumeData::DataFormat format, XMINT3 resolution, int y, int z, float * row)
+{
+	int width = (resolution.x + 3) & ~3;
+	size_t offset = ((size_t)z * resolution.y + y) * resolution.x;
+
+	if(format == VolumeData::DF_FLOAT) {
+		memcpy(row + 1, static_cast<const float*>(data) + offset, resolution.x * sizeof(float));
+	}
+	else {
+		const unsigned char * src = static_cast<const unsigned char*>(data) + offset;
+		for(int i = 0; i < resolution.x; i++)
+			row[i + 1] = src[i];
+	}
+
+	row[0] = row[1];
+	for(int i = resolution.x + 1; i < width + 2; i++)
+		row[i] = row[resolution.x];
+}
+
+void GradientEngine::EncodeNormals(__m128 nx, __m128 ny, __m128 nz, Encoding encoding, char * dst)
+{
+	const __m128 scale = _mm_set1_ps(127.f);
+
+	if(encoding == NE_SNORM8) {
+		__m128 nw = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(nx, ny, nz, nw);
+		__m128i v01 = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(nx, scale)), _mm_cvtps_epi32(_mm_mul_ps(ny, scale)));
+		__m128i v23 = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(nz, scale)), _mm_cvtps_epi32(_mm_mul_ps(nw, scale)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_packs_epi16(v01, v23));
+		return;
+	}
+
+	// project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper one
+	const __m128 signMask = _mm_set1_ps(-0.f);
+	const __m128 one = _mm_set1_ps(1.f);
+	__m128 l1 = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(signMask, nx), _mm_andnot_ps(signMask, ny)), _mm_andnot_ps(signMask, nz));
+	l1 = _mm_max_ps(l1, _mm_set1_ps(1e-20f));
+	__m128 px = _mm_div_ps(nx, l1);
+	__m128 py = _mm_div_ps(ny, l1);
+
+	__m128 signX = _mm_or_ps(_mm_and_ps(px, signMask), one);
+	__m128 signY = _mm_or_ps(_mm_and_ps(py, signMask), one);
+	__m128 foldedX = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, py)), signX);
+	__m128 foldedY = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, px)), signY);
+	__m128 lower = _mm_cmplt_ps(nz, _mm_setzero_ps());
+	px = _mm_or_ps(_mm_and_ps(lower, foldedX), _mm_andnot_ps(lower, px));
+	py = _mm_or_ps(_mm_and_ps(lower, foldedY), _mm_andnot_ps(lower, py));
+
+	__m128i xy01 = _mm_cvtps_epi32(_mm_mul_ps(_mm_unpacklo_ps(px, py), scale));
+	__m128i xy23 = _mm_cvtps_epi32(_mm_mul_ps(_mm_unpackhi_ps(px, py), scale));
+	__m128i packed = _mm_packs_epi16(_mm_packs_epi32(xy01, xy23), _mm_setzero_si128());
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), packed);
+}
+
+void GradientEngine::ComputeNormals(const void * data, VolumeData::DataFormat format, XMINT3 resolution, XMFLOAT3 spacing,
+	Stencil stencil, Encoding encoding, void * normals)
+{
+	assert(format == VolumeData::DF_BYTE || format == VolumeData::DF_FLOAT);
+
+	const int width = (resolution.x + 3) & ~3;
+	const int rowLength = width + 2;
+	const int encodedSize = GetEncodedSize(encoding);
+	const int tilesY = (resolution.y + TILE_SIZE - 1) / TILE_SIZE;
+	const int tilesZ = (resolution.z + TILE_SIZE - 1) / TILE_SIZE;
+
+	// the Sobel weights sum up to 16 per axis, the difference spans two voxels
+	float weightSum = stencil == GS_SOBEL ? 16.f : 1.f;
+	// negative so the normals point against the gradient
+	const __m128 invX = _mm_set1_ps(-1.f / (2.f * weightSum * spacing.x));
+	const __m128 invY = _mm_set1_ps(-1.f / (2.f * weightSum * spacing.y));
+	const __m128 invZ = _mm_set1_ps(-1.f / (2.f * weightSum * spacing.z));
+	const __m128 two = _mm_set1_ps(2.f);
+
+	ThreadPool::GetShared().ParallelFor(0, tilesY * tilesZ, [&](int tile) {
+		int y0 = (tile % tilesY) * TILE_SIZE, y1 = std::min(resolution.y, y0 + TILE_SIZE);
+		int z0 = (tile / tilesY) * TILE_SIZE, z1 = std::min(resolution.z, z0 + TILE_SIZE);
+		int haloY = y1 - y0 + 2, haloZ = z1 - z0 + 2;
+
+		// rows of the tile plus a one voxel halo, clamped at the volume borders
+		std::vector<float> rows((size_t)haloY * haloZ * rowLength);
+		for(int hz = 0; hz < haloZ; hz++) {
+			int z = std::max(0, std::min(resolution.z - 1, z0 + hz - 1));
+			for(int hy = 0; hy < haloY; hy++) {
+				int y = std::max(0, std::min(resolution.y - 1, y0 + hy - 1));
+				ConvertRow(data, format, resolution, y, z, &rows[((size_t)hz * haloY + hy) * rowLength]);
+			}
+		}
+		auto row = [&](int hy, int hz) { return &rows[((size_t)hz * haloY + hy) * rowLength]; };
+
+		// the Sobel operator is separable, so the x differences and x smoothed values of every
+		// row are computed once and then combined with the weights (1, 2, 1) along y and z
+		std::vector<float> dx, sx;
+		if(stencil == GS_SOBEL) {
+			dx.resize((size_t)haloY * haloZ * width);
+			sx.resize((size_t)haloY * haloZ * width);
+			for(int h = 0; h < haloY * haloZ; h++) {
+				const float * r = &rows[(size_t)h * rowLength];
+				for(int i = 0; i < width; i += 4) {
+					__m128 l = _mm_loadu_ps(r + i), c = _mm_loadu_ps(r + i + 1), u = _mm_loadu_ps(r + i + 2);
+					_mm_storeu_ps(&dx[(size_t)h * width + i], _mm_sub_ps(u, l));
+					_mm_storeu_ps(&sx[(size_t)h * width + i], _mm_add_ps(_mm_add_ps(l, u), _mm_mul_ps(c, two)));
+				}
+			}
+		}
+		auto dxRow = [&](int hy, int hz) { return &dx[((size_t)hz * haloY + hy) * width]; };
+		auto sxRow = [&](int hy, int hz) { return &sx[((size_t)hz * haloY + hy) * width]; };
+
+		for(int z = z0; z < z1; z++) {
+			int hz = z - z0 + 1;
+			for(int y = y0; y < y1; y++) {
+				int hy = y - y0 + 1;
+				char * dst = static_cast<char*>(normals) + (((size_t)z * resolution.y + y) * resolution.x) * encodedSize;
+
+				for(int i = 0; i < resolution.x; i += 4) {
+					__m128 gx, gy, gz;
+					if(stencil == GS_CENTRAL) {
+						gx = _mm_sub_ps(_mm_loadu_ps(row(hy, hz) + i + 2), _mm_loadu_ps(row(hy, hz) + i));
+						gy = _mm_sub_ps(_mm_loadu_ps(row(hy + 1, hz) + i + 1), _mm_loadu_ps(row(hy - 1, hz) + i + 1));
+						gz = _mm_sub_ps(_mm_loadu_ps(row(hy, hz + 1) + i + 1), _mm_loadu_ps(row(hy, hz - 1) + i + 1));
+					}
+					else {
+						gx = gy = gz = _mm_setzero_ps();
+						for(int d = -1; d <= 1; d++) {
+							__m128 w = _mm_set1_ps(d ? 1.f : 2.f);
+							// gx: x differences smoothed along y and z
+							__m128 s = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(dxRow(hy - 1, hz + d) + i), _mm_loadu_ps(dxRow(hy + 1, hz + d) + i)),
+								_mm_mul_ps(_mm_loadu_ps(dxRow(hy, hz + d) + i), two));
+							gx = _mm_add_ps(gx, _mm_mul_ps(s, w));
+							// gy: y differences of the x smoothed rows, weighted along z
+							gy = _mm_add_ps(gy, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(sxRow(hy + 1, hz + d) + i), _mm_loadu_ps(sxRow(hy - 1, hz + d) + i)), w));
+							// gz: z differences of the x smoothed rows, weighted along y
+							gz = _mm_add_ps(gz, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(sxRow(hy + d, hz + 1) + i), _mm_loadu_ps(sxRow(hy + d, hz - 1) + i)), w));
+						}
+					}
+
+					gx = _mm_mul_ps(gx, invX);
+					gy = _mm_mul_ps(gy, invY);
+					gz = _mm_mul_ps(gz, invZ);
+
+					// normalize, zero gradients stay zero
+					__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy)), _mm_mul_ps(gz, gz));
+					__m128 invLen = _mm_and_ps(_mm_cmpgt_ps(len2, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(len2)));
+
+					if(i + 4 <= resolution.x) {
+						EncodeNormals(_mm_mul_ps(gx, invLen), _mm_mul_ps(gy, invLen), _mm_mul_ps(gz, invLen), encoding, dst + i * encodedSize);
+					}
+					else {
+						char tail[16];
+						EncodeNormals(_mm_mul_ps(gx, invLen), _mm_mul_ps(gy, invLen), _mm_mul_ps(gz, invLen), encoding, tail);
+						memcpy(dst + i * encodedSize, tail, (resolution.x - i) * encodedSize);
+					}
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "VolumeData.h"
+
+#include <xmmintrin.h>
+
+/*
+	CPU normals of scalar volume data
+	The normals point against the gradient (from high to low values) like the ones of the
+	compute shader. Differences are scaled by the voxel spacing, so anisotropic volumes get
+	correct normals. The volume is split into tiles of TILE_SIZE x TILE_SIZE rows on the shared
+	thread pool; every tile converts the rows it needs (including a one voxel halo, clamped at
+	the borders) to floats once and then processes four voxels of a row at a time with SSE.
+*/
+class GradientEngine
+{
+public:
+	enum Stencil {
+		GS_CENTRAL,		// central differences, 6 neighbors
+		GS_SOBEL		// 3x3x3 Sobel operator, smoother on noisy data
+	};
+
+	enum Encoding {
+		NE_SNORM8,		// xyz0 as R8G8B8A8_SNORM, 4 bytes per voxel
+		NE_OCTAHEDRAL	// octahedral projection as R8G8_SNORM, 2 bytes per voxel, needs decoding in the shader
+	};
+
+	static int GetEncodedSize(Encoding encoding);
+	static DXGI_FORMAT GetTextureFormat(Encoding encoding);
+
+	// writes one encoded normal per voxel, tightly packed, to normals
+	// format must be DF_BYTE or DF_FLOAT, spacing is the size of a voxel
+	static void ComputeNormals(const void * data, VolumeData::DataFormat format, XMINT3 resolution, XMFLOAT3 spacing,
+		Stencil stencil, Encoding encoding, void * normals);
+
+private:
+	static const int TILE_SIZE = 8;	// rows per tile in y and z
+
+	static void ConvertRow(const void * data, VolumeData::DataFormat format, XMINT3 resolution, int y, int z, float * row);
+	static void EncodeNormals(__m128 nx, __m128 ny, __m128 nz, Encoding encoding, char * dst);
+};
@@ -0,0 +1,194 @@
+#include "HistogramEngine.h"
+
+#include "util/ThreadPool.h"
+
+#include <DirectXPackedVector.h>
+#include <emmintrin.h>
+
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX::PackedVector;
+
+void HistogramEngine::Compute(const void * data, VolumeData::DataFormat format, int elementStride, unsigned int voxelCount,
+	XMFLOAT2 range, int numBins, float * histogram)
+{
+	assert(numBins > 0 && range.y > range.x);
+
+	const char * bytes = static_cast<const char*>(data);
+	// bytes with one bin per value can be counted directly
+	bool countBytes = format == VolumeData::DF_BYTE && numBins == 256 && range.x == 0.f && range.y == 256.f;
+	float scale = numBins / (range.y - range.x);
+
+	std::vector<unsigned int> counts(numBins, 0);
+	std::mutex countsMutex;
+
+	ThreadPool::GetShared().ParallelForRange(0, (int)voxelCount, [&](int begin, int end) {
+		std::vector<unsigned int> localCounts(numBins, 0);
+
+		if(countBytes) {
+			CountBytes(reinterpret_cast<const unsigned char*>(bytes) + begin, end - begin, localCounts.data());
+		}
+		else {
+			float values[BLOCK_SIZE];
+			for(int b = begin; b < end; b += BLOCK_SIZE) {
+				unsigned int n = std::min(BLOCK_SIZE, end - b);
+				ConvertBlock(bytes + (size_t)b * elementStride, format, elementStride, n, values);
+				BinBlock(values, n, range.x, scale, numBins, localCounts.data());
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(countsMutex);
+		for(int i = 0; i < numBins; i++)
+			counts[i] += localCounts[i];
+	}, CHUNK_SIZE);
+
+	for(int i = 0; i < numBins; i++)
+		histogram[i] = counts[i] / (float)voxelCount;
+}
+
+XMFLOAT2 HistogramEngine::ComputeRange(const void * data, VolumeData::DataFormat format, int elementStride, unsigned int voxelCount)
+{
+	const char * bytes = static_cast<const char*>(data);
+	XMFLOAT2 range(FLT_MAX, -FLT_MAX);
+	std::mutex rangeMutex;
+
+	ThreadPool::GetShared().ParallelForRange(0, (int)voxelCount, [&](int begin, int end) {
+		float values[BLOCK_SIZE];
+		float localMin = FLT_MAX, localMax = -FLT_MAX;
+
+		for(int b = begin; b < end; b += BLOCK_SIZE) {
+			unsigned int n = std::min(BLOCK_SIZE, end - b);
+			ConvertBlock(bytes + (size_t)b * elementStride, format, elementStride, n, values);
+			for(unsigned int i = 0; i < n; i++) {
+				// skip NaNs
+				if(values[i] == values[i]) {
+					localMin = std::min(localMin, values[i]);
+					localMax = std::max(localMax, values[i]);
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(rangeMutex);
+		range.x = std::min(range.x, localMin);
+		range.y = std::max(range.y, localMax);
+	}, CHUNK_SIZE);
+
+	return range;
+}
+
+/**
+	Converts count voxels to their scalar value or magnitude
+*/
+void HistogramEngine::ConvertBlock(const char * data, VolumeData::DataFormat format, int elementStride, unsigned int count, float * values)
+{
+	unsigned int i = 0;
+
+	switch(format) {
+	case VolumeData::DF_BYTE:
+		for(; i < count; i++)
+			values[i] = reinterpret_cast<const unsigned char*>(data)[i * elementStride];
+		break;
+
+	case VolumeData::DF_FLOAT:
+		for(; i < count; i++)
+			values[i] = *reinterpret_cast<const float*>(data + i * elementStride);
+		break;
+
+	case VolumeData::DF_FLOAT3:
+	case VolumeData::DF_FLOAT4:
+		// padded float3 and float4 are 16 byte vectors, transpose four of them at a time
+		if(elementStride == 4 * sizeof(float)) {
+			const float * f = reinterpret_cast<const float*>(data);
+			for(; i + 4 <= count; i += 4) {
+				__m128 x = _mm_loadu_ps(f + 4 * i);
+				__m128 y = _mm_loadu_ps(f + 4 * i + 4);
+				__m128 z = _mm_loadu_ps(f + 4 * i + 8);
+				__m128 w = _mm_loadu_ps(f + 4 * i + 12);
+				_MM_TRANSPOSE4_PS(x, y, z, w);
+				__m128 sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+				_mm_storeu_ps(values + i, _mm_sqrt_ps(sq));
+			}
+		}
+		for(; i < count; i++) {
+			const float * f = reinterpret_cast<const float*>(data + i * elementStride);
+			values[i] = sqrtf(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+		}
+		break;
+
+	case VolumeData::DF_HALF3:
+	case VolumeData::DF_HALF4: {
+		float x[BLOCK_SIZE], y[BLOCK_SIZE], z[BLOCK_SIZE];
+		const HALF * h = reinterpret_cast<const HALF*>(data);
+		XMConvertHalfToFloatStream(x, sizeof(float), h, elementStride, count);
+		XMConvertHalfToFloatStream(y, sizeof(float), h + 1, elementStride, count);
+		XMConvertHalfToFloatStream(z, sizeof(float), h + 2, elementStride, count);
+		for(; i + 4 <= count; i += 4) {
+			__m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+			__m128 sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+			_mm_storeu_ps(values + i, _mm_sqrt_ps(sq));
+		}
+		for(; i < count; i++)
+			values[i] = sqrtf(x[i]*x[i] + y[i]*y[i] + z[i]*z[i]);
+		break;
+	}
+
+	default:
+		std::fill(values, values + count, 0.f);
+	}
+}
+
+void HistogramEngine::BinBlock(const float * values, unsigned int count, float offset, float scale, int numBins, unsigned int * counts)
+{
+	const __m128 vOffset = _mm_set1_ps(offset);
+	const __m128 vScale = _mm_set1_ps(scale);
+	const __m128 vZero = _mm_setzero_ps();
+	const __m128 vLastBin = _mm_set1_ps((float)(numBins - 1));
+
+	unsigned int i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128 bin = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(values + i), vOffset), vScale);
+		// clamp to the border bins, max returns the second operand for NaNs so they end up in bin 0
+		bin = _mm_min_ps(_mm_max_ps(bin, vZero), vLastBin);
+
+		int index[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(index), _mm_cvttps_epi32(bin));
+		counts[index[0]]++;
+		counts[index[1]]++;
+		counts[index[2]]++;
+		counts[index[3]]++;
+	}
+
+	for(; i < count; i++) {
+		float bin = (values[i] - offset) * scale;
+		// clamp in float like above, the conversion of values past the last bin or Inf is undefined
+		// max(0, NaN) returns 0, so NaNs end up in bin 0 as well
+		bin = std::min(std::max(0.f, bin), (float)(numBins - 1));
+		counts[(int)bin]++;
+	}
+}
+
+/**
+	Counts byte values into 256 bins
+	Four sub-histograms are used so consecutive equal values don't stall on the same counter.
+*/
+void HistogramEngine::CountBytes(const unsigned char * data, unsigned int count, unsigned int * counts)
+{
+	std::vector<unsigned int> sub(4 * 256, 0);
+
+	unsigned int i = 0;
+	for(; i + 4 <= count; i += 4) {
+		sub[data[i]]++;
+		sub[256 + data[i + 1]]++;
+		sub[512 + data[i + 2]]++;
+		sub[768 + data[i + 3]]++;
+	}
+	for(; i < count; i++)
+		sub[data[i]]++;
+
+	for(int j = 0; j < 256; j++)
+		counts[j] += sub[j] + sub[256 + j] + sub[512 + j] + sub[768 + j];
+}
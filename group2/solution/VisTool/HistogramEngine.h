@@ -0,0 +1,30 @@
+#pragma once
+
+#include "VolumeData.h"
+
+/*
+	CPU histograms of volume data
+	Scalar formats are binned by value, vector formats by the magnitude of the first three
+	components. The voxels are split into chunks on the shared thread pool; every chunk counts
+	into private bins which are merged at the end, so there is no contention on the counters.
+	Values are converted to floats in small blocks and binned four at a time with SSE.
+*/
+class HistogramEngine
+{
+public:
+	// relative frequencies for numBins bins equally covering [range.x, range.y)
+	// values outside of the range are counted in the first and last bin
+	static void Compute(const void * data, VolumeData::DataFormat format, int elementStride, unsigned int voxelCount,
+		XMFLOAT2 range, int numBins, float * histogram);
+
+	// min and max value (or magnitude) of the data
+	static XMFLOAT2 ComputeRange(const void * data, VolumeData::DataFormat format, int elementStride, unsigned int voxelCount);
+
+private:
+	static const int BLOCK_SIZE = 1024;		// voxels converted to floats at once
+	static const int CHUNK_SIZE = 1 << 16;	// voxels per task
+
+	static void ConvertBlock(const char * data, VolumeData::DataFormat format, int elementStride, unsigned int count, float * values);
+	static void BinBlock(const float * values, unsigned int count, float offset, float scale, int numBins, unsigned int * counts);
+	static void CountBytes(const unsigned char * data, unsigned int count, unsigned int * counts);
+};
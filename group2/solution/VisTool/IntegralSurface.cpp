@@ -0,0 +1,263 @@
+#include "IntegralSurface.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+namespace {
+	// same as CL_STAGNATION_DISTANCE in ParticleTracer.fx
+	const float STAGNATION_DISTANCE = 1e-6f;
+
+	struct FrontVertex {
+		float		pos[3];
+		float		origin[3];	// position on the previous front
+		float		s;			// parameter on the seed line
+		unsigned	index;		// in the mesh, only valid once the front is finished
+		bool		active;		// still moving
+	};
+
+	// like the test in StreamlineStep of ParticleTracer.fx
+	inline bool InsideVolume(const float p[3])
+	{
+		return p[0] > 0.f && p[1] > 0.f && p[2] > 0.f && p[0] <= 1.f && p[1] <= 1.f && p[2] <= 1.f;
+	}
+
+	// difference b - a in model space
+	inline void ModelDelta(const float a[3], const float b[3], const float extent[3], float d[3])
+	{
+		for(int c = 0; c < 3; c++)
+			d[c] = (b[c] - a[c]) * extent[c];
+	}
+
+	inline float Length(const float v[3])
+	{
+		return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	}
+
+	inline float Distance(const float a[3], const float b[3], const float extent[3])
+	{
+		float d[3];
+		ModelDelta(a, b, extent, d);
+		return Length(d);
+	}
+
+	// angle between the edges to the previous and the next vertex, 0 at the ends of the front
+	float Turn(const std::vector<FrontVertex> & front, size_t i, const float extent[3])
+	{
+		if(i == 0 || i + 1 >= front.size())
+			return 0.f;
+		float a[3], b[3];
+		ModelDelta(front[i - 1].pos, front[i].pos, extent, a);
+		ModelDelta(front[i].pos, front[i + 1].pos, extent, b);
+		float la = Length(a), lb = Length(b);
+		if(la == 0.f || lb == 0.f)
+			return 0.f;
+		float cosAngle = (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / (la * lb);
+		return std::acos(std::max(-1.f, std::min(1.f, cosAngle)));
+	}
+
+	// one RK4 step from p, false if the result left the volume or did not move
+	bool Step(const AdvectionEngine & engine, const IntegralSurface::Parameters & params, const float p[3], float next[3])
+	{
+		const float h = params.stepsize;
+		float k[4][3], q[3];
+		engine.Sample(p, params.timestepT, k[0]);
+		for(int c = 0; c < 3; c++)
+			q[c] = p[c] + 0.5f * h * k[0][c] * params.velocityScaling[c];
+		engine.Sample(q, params.timestepT, k[1]);
+		for(int c = 0; c < 3; c++)
+			q[c] = p[c] + 0.5f * h * k[1][c] * params.velocityScaling[c];
+		engine.Sample(q, params.timestepT, k[2]);
+		for(int c = 0; c < 3; c++)
+			q[c] = p[c] + h * k[2][c] * params.velocityScaling[c];
+		engine.Sample(q, params.timestepT, k[3]);
+
+		float step[3];
+		for(int c = 0; c < 3; c++) {
+			step[c] = h / 6.f * (k[0][c] + 2.f * k[1][c] + 2.f * k[2][c] + k[3][c]) * params.velocityScaling[c];
+			next[c] = p[c] + step[c];
+		}
+		return Length(step) >= STAGNATION_DISTANCE && InsideVolume(next);
+	}
+
+	void AddVertex(IntegralSurface::Mesh & mesh, FrontVertex & v, float age)
+	{
+		v.index = (unsigned)mesh.ages.size();
+		mesh.positions.insert(mesh.positions.end(), v.pos, v.pos + 3);
+		mesh.ages.push_back(age);
+	}
+
+	void AddTriangle(IntegralSurface::Mesh & mesh, unsigned a, unsigned b, unsigned c)
+	{
+		// stopped vertices are shared by both fronts
+		if(a == b || b == c || a == c)
+			return;
+		mesh.indices.push_back(a);
+		mesh.indices.push_back(b);
+		mesh.indices.push_back(c);
+	}
+
+	// splits edges of the advanced front until they are short and flat enough
+	void Refine(const AdvectionEngine & engine, const IntegralSurface::Parameters & params, std::vector<FrontVertex> & front)
+	{
+		for(size_t i = 0; i + 1 < front.size() && front.size() < params.maxFrontVertices; ) {
+			const FrontVertex & a = front[i];
+			const FrontVertex & b = front[i + 1];
+			float length = Distance(a.pos, b.pos, params.extent);
+			bool split = a.active && b.active &&
+				(length > params.maxEdge ||
+				(length > 2.f * params.minEdge && std::max(Turn(front, i, params.extent), Turn(front, i + 1, params.extent)) > params.maxAngle));
+			if(!split) {
+				i++;
+				continue;
+			}
+
+			FrontVertex v;
+			for(int c = 0; c < 3; c++)
+				v.origin[c] = 0.5f * (a.origin[c] + b.origin[c]);
+			v.s = 0.5f * (a.s + b.s);
+			v.active = true;
+			if(!Step(engine, params, v.origin, v.pos)) {
+				// the surface ends here, the edge stays
+				i++;
+				continue;
+			}
+			// the new edges are tested again
+			front.insert(front.begin() + i + 1, v);
+		}
+	}
+
+	// removes interior vertices between two short edges where the front is straight
+	void Coarsen(const IntegralSurface::Parameters & params, std::vector<FrontVertex> & front)
+	{
+		for(size_t i = 1; i + 1 < front.size(); ) {
+			bool remove = front[i - 1].active && front[i].active && front[i + 1].active &&
+				Distance(front[i - 1].pos, front[i].pos, params.extent) < params.minEdge &&
+				Distance(front[i].pos, front[i + 1].pos, params.extent) < params.minEdge &&
+				Turn(front, i, params.extent) < 0.5f * params.maxAngle;
+			if(remove)
+				front.erase(front.begin() + i);
+			else
+				i++;
+		}
+	}
+
+	// connects two fronts, taking the next vertex with the smaller seed line parameter
+	void Stitch(const std::vector<FrontVertex> & prev, const std::vector<FrontVertex> & next, IntegralSurface::Mesh & mesh)
+	{
+		size_t i = 0, j = 0;
+		while(i + 1 < prev.size() || j + 1 < next.size()) {
+			if(j + 1 < next.size() && (i + 1 >= prev.size() || next[j + 1].s <= prev[i + 1].s)) {
+				AddTriangle(mesh, prev[i].index, next[j].index, next[j + 1].index);
+				j++;
+			}
+			else {
+				AddTriangle(mesh, prev[i].index, next[j].index, prev[i + 1].index);
+				i++;
+			}
+		}
+	}
+
+	// area weighted vertex normals in model space
+	void ComputeNormals(const float extent[3], IntegralSurface::Mesh & mesh)
+	{
+		mesh.normals.assign(mesh.positions.size(), 0.f);
+		for(size_t t = 0; t < mesh.indices.size(); t += 3) {
+			const float * p0 = &mesh.positions[3 * mesh.indices[t]];
+			const float * p1 = &mesh.positions[3 * mesh.indices[t + 1]];
+			const float * p2 = &mesh.positions[3 * mesh.indices[t + 2]];
+			float e1[3], e2[3];
+			ModelDelta(p0, p1, extent, e1);
+			ModelDelta(p0, p2, extent, e2);
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			for(int k = 0; k < 3; k++)
+				for(int c = 0; c < 3; c++)
+					mesh.normals[3 * mesh.indices[t + k] + c] += n[c];
+		}
+		for(size_t v = 0; v < mesh.normals.size(); v += 3) {
+			float l = Length(&mesh.normals[v]);
+			if(l > 0.f)
+				for(int c = 0; c < 3; c++)
+					mesh.normals[v + c] /= l;
+		}
+	}
+}
+
+IntegralSurface::Parameters::Parameters() :
+	numSeeds(64),
+	stepsize(0.1f),
+	maxFronts(150),
+	maxEdge(0.02f),
+	minEdge(0.005f),
+	maxAngle(0.35f),
+	maxFrontVertices(1024),
+	maxVertices(1 << 18),
+	timestepT(0.f)
+{
+	for(int c = 0; c < 3; c++) {
+		seedStart[c] = 0.5f;
+		seedEnd[c] = 0.5f;
+		velocityScaling[c] = 1.f;
+		extent[c] = 1.f;
+	}
+	seedStart[0] = 0.f;
+	seedEnd[0] = 1.f;
+}
+
+void IntegralSurface::Compute(const AdvectionEngine & engine, const Parameters & params, Mesh & mesh)
+{
+	assert(params.numSeeds >= 2 && params.minEdge <= 0.5f * params.maxEdge);
+
+	mesh.positions.clear();
+	mesh.normals.clear();
+	mesh.ages.clear();
+	mesh.indices.clear();
+	mesh.numFronts = 0;
+
+	std::vector<FrontVertex> front(params.numSeeds);
+	for(int i = 0; i < params.numSeeds; i++) {
+		FrontVertex & v = front[i];
+		v.s = (float)i / (params.numSeeds - 1);
+		for(int c = 0; c < 3; c++)
+			v.pos[c] = v.origin[c] = params.seedStart[c] + v.s * (params.seedEnd[c] - params.seedStart[c]);
+		v.active = InsideVolume(v.pos);
+		AddVertex(mesh, v, 0.f);
+	}
+	mesh.numFronts = 1;
+
+	std::vector<FrontVertex> next;
+	for(int f = 1; f < params.maxFronts; f++) {
+		next = front;
+		bool moving = false;
+		for(auto it = next.begin(); it != next.end(); it++) {
+			if(!it->active)
+				continue;
+			std::copy(it->pos, it->pos + 3, it->origin);
+			it->active = Step(engine, params, it->origin, it->pos);
+			if(!it->active)
+				std::copy(it->origin, it->origin + 3, it->pos);
+			moving |= it->active;
+		}
+		if(!moving)
+			break;
+
+		Refine(engine, params, next);
+		Coarsen(params, next);
+
+		size_t added = 0;
+		for(auto it = next.begin(); it != next.end(); it++)
+			added += it->active;
+		if(mesh.NumVertices() + added > params.maxVertices)
+			break;
+
+		float age = f * params.stepsize;
+		for(auto it = next.begin(); it != next.end(); it++)
+			if(it->active)
+				AddVertex(mesh, *it, age);
+		Stitch(front, next, mesh);
+		front.swap(next);
+		mesh.numFronts++;
+	}
+
+	ComputeNormals(params.extent, mesh);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "AdvectionEngine.h"
+
+#include <vector>
+#include <cstddef>
+
+/*
+	Adaptive stream surfaces by front propagation after Hultquist
+	The surface starts at a seed line and is advanced as a front of vertices, one fixed RK4 step
+	(in texture space) per front. After each step the front is refined: edges that got longer than
+	maxEdge or that lie next to a vertex where the front bends by more than maxAngle are split by
+	advecting the midpoint of the edge on the previous front, interior vertices whose edges both got
+	shorter than minEdge are removed where the front is straight. Consecutive fronts are connected by
+	triangles ordered by the seed line parameter of the vertices, so the mesh is indexed and
+	vertices are shared between the triangles of two strips.
+	Vertices that leave the volume or stagnate stop, the front keeps them so its ends stay in place.
+	Lengths are measured in model space (texture space times extent) so anisotropic volumes are
+	refined evenly.
+*/
+class IntegralSurface
+{
+public:
+	struct Parameters {
+		float	seedStart[3];		// seed line in texture space
+		float	seedEnd[3];
+		int		numSeeds;			// initial front vertices
+		float	stepsize;			// time per front
+		int		maxFronts;			// including the seed line
+		float	maxEdge;			// in model space
+		float	minEdge;			// at most half of maxEdge
+		float	maxAngle;			// in radians
+		size_t	maxFrontVertices;
+		size_t	maxVertices;		// of the mesh, the surface ends before a front would exceed it
+		float	timestepT;			// weight of the second field
+		float	velocityScaling[3];	// from the velocity in the data to texture space
+		float	extent[3];			// of the volume in model space
+
+		Parameters();
+	};
+
+	struct Mesh {
+		std::vector<float>		positions;	// xyz in texture space
+		std::vector<float>		normals;	// xyz in model space, normalized
+		std::vector<float>		ages;		// time since the seed line
+		std::vector<unsigned>	indices;	// triangle list
+		int						numFronts;
+
+		size_t NumVertices() const {	return ages.size();	};
+		size_t NumTriangles() const {	return indices.size() / 3;	};
+	};
+
+	// the engine provides the field, its fields have to be set
+	static void Compute(const AdvectionEngine & engine, const Parameters & params, Mesh & mesh);
+};
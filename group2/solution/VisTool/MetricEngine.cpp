@@ -0,0 +1,267 @@
+#include "MetricEngine.h"
+
+#include "util/ThreadPool.h"
+#include "util/HalfFloat.h"
+
+#include <emmintrin.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+
+static const char * metricNames[MetricEngine::NUM_METRICS] = {
+	"velocity_magnitude",
+	"divergence",
+	"vorticity_magnitude",
+	"q_s",
+	"q_omega",
+	"enstrophy_production",
+	"v_squared",
+	"q",
+	"lambda2",
+	"fourth_component"
+};
+
+const char * MetricEngine::GetMetricName(Metric metric)
+{
+	return metricNames[metric];
+}
+
+bool MetricEngine::GetMetricFromName(const char * name, Metric & metric)
+{
+	for(int i = 0; i < NUM_METRICS; i++) {
+		if(!strcmp(name, metricNames[i])) {
+			metric = (Metric)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+	Closed form solution of the characteristic polynomial (Smith 1961)
+	With q = tr(A)/3 and B = (A - qI)/p, the eigenvalues are q + 2p cos(phi + 2k pi/3) where
+	phi = acos(det(B)/2)/3. This is exact up to rounding, as opposed to the power iteration.
+*/
+void MetricEngine::SymmetricEigenvalues(float a00, float a01, float a02, float a11, float a12, float a22, float eigenvalues[3])
+{
+	double q = (a00 + a11 + a22) / 3.0;
+	double b00 = a00 - q, b11 = a11 - q, b22 = a22 - q;
+	double offDiagonal = (double)a01 * a01 + (double)a02 * a02 + (double)a12 * a12;
+	double p = sqrt((b00 * b00 + b11 * b11 + b22 * b22 + 2.0 * offDiagonal) / 6.0);
+
+	if(p < 1e-30) {
+		eigenvalues[0] = eigenvalues[1] = eigenvalues[2] = (float)q;
+		return;
+	}
+
+	double det = b00 * (b11 * b22 - (double)a12 * a12) - a01 * ((double)a01 * b22 - (double)a12 * a02) + a02 * ((double)a01 * a12 - b11 * a02);
+	double r = std::max(-1.0, std::min(1.0, det / (2.0 * p * p * p)));
+	double phi = acos(r) / 3.0;
+
+	const double twoPiThirds = 2.0943951023931954923;
+	double largest = q + 2.0 * p * cos(phi);
+	double smallest = q + 2.0 * p * cos(phi + twoPiThirds);
+	eigenvalues[0] = (float)largest;
+	eigenvalues[1] = (float)(3.0 * q - largest - smallest);
+	eigenvalues[2] = (float)smallest;
+}
+
+/*
+	Converts row (y, z) to the tile layout: one float row per component, the voxels start at
+	index 1, index 0 and everything behind the row repeat the border voxels
+*/
+void MetricEngine::ConvertRow(const void * data0, const void * data1, InputFormat format, const int resolution[3], float t,
+	int y, int z, float * rows[4])
+{
+	size_t offset = ((size_t)z * resolution[1] + y) * resolution[0] * 4;
+	int width = (resolution[0] + 3) & ~3;
+
+	for(int i = 0; i < resolution[0]; i++) {
+		for(int c = 0; c < 4; c++) {
+			size_t index = offset + (size_t)i * 4 + c;
+			float v0, v1 = 0.f;
+			if(format == IF_FLOAT4) {
+				v0 = static_cast<const float*>(data0)[index];
+				if(t != 0.f)
+					v1 = static_cast<const float*>(data1)[index];
+			}
+			else {
+				v0 = HalfToFloat(static_cast<const uint16_t*>(data0)[index]);
+				if(t != 0.f)
+					v1 = HalfToFloat(static_cast<const uint16_t*>(data1)[index]);
+			}
+			rows[c][i + 1] = t != 0.f ? t * v1 + (1.f - t) * v0 : v0;
+		}
+	}
+
+	for(int c = 0; c < 4; c++) {
+		rows[c][0] = rows[c][1];
+		for(int i = resolution[0] + 1; i < width + 2; i++)
+			rows[c][i] = rows[c][resolution[0]];
+	}
+}
+
+static inline __m128 Length3(__m128 x, __m128 y, __m128 z)
+{
+	return _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+}
+
+void MetricEngine::Compute(Metric metric, const void * data0, const void * data1, InputFormat format, const int resolution[3],
+	const Parameters & params, float * result)
+{
+	assert(params.timestepT == 0.f || data1);
+
+	const int width = (resolution[0] + 3) & ~3;
+	const int rowLength = width + 2;
+	const int tilesY = (resolution[1] + TILE_SIZE - 1) / TILE_SIZE;
+	const int tilesZ = (resolution[2] + TILE_SIZE - 1) / TILE_SIZE;
+	const bool needsJacobian = metric != M_VELOCITY_MAGNITUDE && metric != M_FOURTH_COMPONENT;
+
+	const __m128 metricMin = _mm_set1_ps(params.metricMin);
+	const __m128 metricScale = _mm_set1_ps(1.f / (params.metricMax - params.metricMin));
+	const __m128 half = _mm_set1_ps(0.5f);
+	const float boundaryValue = metric == M_LAMBDA_2 ? 0.f : params.boundaryValue;
+
+	ThreadPool::GetShared().ParallelFor(0, tilesY * tilesZ, [&](int tile) {
+		int y0 = (tile % tilesY) * TILE_SIZE, y1 = std::min(resolution[1], y0 + TILE_SIZE);
+		int z0 = (tile / tilesY) * TILE_SIZE, z1 = std::min(resolution[2], z0 + TILE_SIZE);
+		int haloY = y1 - y0 + 2, haloZ = z1 - z0 + 2;
+
+		// rows of the tile plus a one voxel halo, clamped at the volume borders, SoA per row
+		std::vector<float> rows((size_t)haloY * haloZ * 4 * rowLength);
+		for(int hz = 0; hz < haloZ; hz++) {
+			int z = std::max(0, std::min(resolution[2] - 1, z0 + hz - 1));
+			for(int hy = 0; hy < haloY; hy++) {
+				int y = std::max(0, std::min(resolution[1] - 1, y0 + hy - 1));
+				float * components[4];
+				for(int c = 0; c < 4; c++)
+					components[c] = &rows[(((size_t)hz * haloY + hy) * 4 + c) * rowLength];
+				ConvertRow(data0, data1, format, resolution, params.timestepT, y, z, components);
+			}
+		}
+		auto row = [&](int hy, int hz, int c) { return &rows[(((size_t)hz * haloY + hy) * 4 + c) * rowLength]; };
+
+		for(int z = z0; z < z1; z++) {
+			int hz = z - z0 + 1;
+			for(int y = y0; y < y1; y++) {
+				int hy = y - y0 + 1;
+				float * dst = result + ((size_t)z * resolution[1] + y) * resolution[0];
+
+				for(int i = 0; i < resolution[0]; i += 4) {
+					// J[c][a] is the derivative of component c along axis a
+					__m128 J[3][3];
+					if(needsJacobian) {
+						for(int c = 0; c < 3; c++) {
+							J[c][0] = _mm_sub_ps(_mm_loadu_ps(row(hy, hz, c) + i + 2), _mm_loadu_ps(row(hy, hz, c) + i));
+							J[c][1] = _mm_sub_ps(_mm_loadu_ps(row(hy + 1, hz, c) + i + 1), _mm_loadu_ps(row(hy - 1, hz, c) + i + 1));
+							J[c][2] = _mm_sub_ps(_mm_loadu_ps(row(hy, hz + 1, c) + i + 1), _mm_loadu_ps(row(hy, hz - 1, c) + i + 1));
+						}
+					}
+
+					__m128 curl[3], S[3][3], Omega[3][3];
+					if(needsJacobian) {
+						curl[0] = _mm_sub_ps(J[2][1], J[1][2]);
+						curl[1] = _mm_sub_ps(J[0][2], J[2][0]);
+						curl[2] = _mm_sub_ps(J[1][0], J[0][1]);
+						for(int a = 0; a < 3; a++) {
+							for(int b = 0; b < 3; b++) {
+								S[a][b] = _mm_mul_ps(half, _mm_add_ps(J[a][b], J[b][a]));
+								Omega[a][b] = _mm_mul_ps(half, _mm_sub_ps(J[a][b], J[b][a]));
+							}
+						}
+					}
+
+					__m128 m = _mm_setzero_ps();
+					switch(metric) {
+					case M_VELOCITY_MAGNITUDE:
+						m = Length3(_mm_loadu_ps(row(hy, hz, 0) + i + 1), _mm_loadu_ps(row(hy, hz, 1) + i + 1), _mm_loadu_ps(row(hy, hz, 2) + i + 1));
+						break;
+					case M_FOURTH_COMPONENT:
+						m = _mm_loadu_ps(row(hy, hz, 3) + i + 1);
+						break;
+					case M_DIVERGENCE:
+						m = _mm_add_ps(_mm_add_ps(J[0][0], J[1][1]), J[2][2]);
+						break;
+					case M_VORTICITY_MAGNITUDE:
+						m = Length3(curl[0], curl[1], curl[2]);
+						break;
+					case M_ENSTROPHY_PRODUCTION:
+						// curl^T S curl
+						for(int a = 0; a < 3; a++)
+							for(int b = 0; b < 3; b++)
+								m = _mm_add_ps(m, _mm_mul_ps(_mm_mul_ps(curl[a], S[a][b]), curl[b]));
+						break;
+					case M_V_SQUARED:
+						for(int a = 0; a < 3; a++) {
+							for(int b = 0; b < 3; b++) {
+								__m128 v = _mm_mul_ps(S[a][b], curl[b]);
+								m = _mm_add_ps(m, _mm_mul_ps(v, v));
+							}
+						}
+						break;
+					case M_Q_PARAMETER:
+					case M_Q_S:
+					case M_Q_OMEGA: {
+						// squared Frobenius norms, tr(S^T S) and tr(Omega^T Omega)
+						__m128 normS = _mm_setzero_ps(), normOmega = _mm_setzero_ps();
+						for(int a = 0; a < 3; a++) {
+							for(int b = 0; b < 3; b++) {
+								normS = _mm_add_ps(normS, _mm_mul_ps(S[a][b], S[a][b]));
+								normOmega = _mm_add_ps(normOmega, _mm_mul_ps(Omega[a][b], Omega[a][b]));
+							}
+						}
+						if(metric == M_Q_PARAMETER)
+							m = _mm_mul_ps(half, _mm_sub_ps(_mm_sqrt_ps(normOmega), _mm_sqrt_ps(normS)));
+						else if(metric == M_Q_S)
+							m = _mm_mul_ps(_mm_set1_ps(-0.5f), normS);			// -tr(S^2)/2, S is symmetric
+						else
+							m = _mm_mul_ps(_mm_set1_ps(-0.5f), normOmega);		// tr(Omega^2)/2, Omega is antisymmetric
+						break;
+					}
+					case M_LAMBDA_2: {
+						// A = S^2 + Omega^2 is symmetric, only the upper triangle is needed
+						static const int entries[6][2] = { {0, 0}, {0, 1}, {0, 2}, {1, 1}, {1, 2}, {2, 2} };
+						float A[6][4];
+						for(int e = 0; e < 6; e++) {
+							int a = entries[e][0], b = entries[e][1];
+							__m128 sum = _mm_setzero_ps();
+							for(int k = 0; k < 3; k++)
+								sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(S[a][k], S[k][b]), _mm_mul_ps(Omega[a][k], Omega[k][b])));
+							_mm_storeu_ps(A[e], sum);
+						}
+						float lambda2[4];
+						for(int l = 0; l < 4; l++) {
+							float eigenvalues[3];
+							SymmetricEigenvalues(A[0][l], A[1][l], A[2][l], A[3][l], A[4][l], A[5][l], eigenvalues);
+							lambda2[l] = eigenvalues[1];
+						}
+						m = _mm_loadu_ps(lambda2);
+						break;
+					}
+					default:
+						break;
+					}
+
+					m = _mm_mul_ps(_mm_sub_ps(m, metricMin), metricScale);
+					if(i + 4 <= resolution[0])
+						_mm_storeu_ps(dst + i, m);
+					else {
+						float tail[4];
+						_mm_storeu_ps(tail, m);
+						memcpy(dst + i, tail, (resolution[0] - i) * sizeof(float));
+					}
+				}
+
+				if(params.boundaryFixed) {
+					if(y == 0 || z == 0 || y == resolution[1] - 1 || z == resolution[2] - 1)
+						std::fill(dst, dst + resolution[0], boundaryValue);
+					else
+						dst[0] = dst[resolution[0] - 1] = boundaryValue;
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+	CPU implementation of the vector field metrics of VectorVolumeData.fx
+	The results match the compute shaders: derivatives are differences between the two neighbors
+	(without division by the spacing, clamped at the borders), the time steps are interpolated
+	linearly, and the metric is mapped to [0, 1] by the given range.
+	The volume is processed in tiles of TILE_SIZE x TILE_SIZE rows on the shared thread pool.
+	Each tile converts its rows plus a one voxel halo to a float SoA layout once, the metrics are
+	then evaluated for four voxels of a row at a time with SSE.
+	This only depends on the standard library and the thread pool, so it can be used without a
+	device, e.g. by the MetricBatch command line tool.
+*/
+class MetricEngine
+{
+public:
+	// same order as VectorVolumeData::MetricType
+	enum Metric {
+		M_VELOCITY_MAGNITUDE,
+		M_DIVERGENCE,
+		M_VORTICITY_MAGNITUDE,
+		M_Q_S,
+		M_Q_OMEGA,
+		M_ENSTROPHY_PRODUCTION,
+		M_V_SQUARED,
+		M_Q_PARAMETER,
+		M_LAMBDA_2,
+		M_FOURTH_COMPONENT,
+		NUM_METRICS
+	};
+
+	// four components per voxel, three component data has to be padded
+	enum InputFormat {
+		IF_FLOAT4,
+		IF_HALF4
+	};
+
+	struct Parameters {
+		float	timestepT;			// weight of the second timestep
+		float	metricMin;			// mapped to 0, may be larger than metricMax to reverse the range
+		float	metricMax;			// mapped to 1
+		bool	boundaryFixed;		// write boundaryValue to all border voxels (0 for lambda2)
+		float	boundaryValue;		// written as is, i.e. already mapped
+
+		Parameters() : timestepT(0.f), metricMin(0.f), metricMax(1.f), boundaryFixed(false), boundaryValue(0.f) {}
+	};
+
+	// writes one float per voxel, data1 is only used if timestepT is not 0
+	static void Compute(Metric metric, const void * data0, const void * data1, InputFormat format, const int resolution[3],
+		const Parameters & params, float * result);
+
+	// eigenvalues of the symmetric matrix ((a00 a01 a02) (a01 a11 a12) (a02 a12 a22)) in descending order
+	static void SymmetricEigenvalues(float a00, float a01, float a02, float a11, float a12, float a22, float eigenvalues[3]);
+
+	static const char * GetMetricName(Metric metric);
+	static bool GetMetricFromName(const char * name, Metric & metric);
+
+private:
+	static const int TILE_SIZE = 8;	// rows per tile in y and z
+
+	static void ConvertRow(const void * data0, const void * data1, InputFormat format, const int resolution[3], float t,
+		int y, int z, float * rows[4]);
+};
@@ -0,0 +1,112 @@
+#include "MetricVolumeCache.h"
+
+#include "util/util.h"
+
+#include <algorithm>
+
+MetricVolumeCache::MetricVolumeCache(XMINT3 resolution) :
+	m_resolution(resolution),
+	m_budgetMB(0),
+	m_hits(0),
+	m_misses(0)
+{
+}
+
+MetricVolumeCache::~MetricVolumeCache(void)
+{
+	Clear();
+}
+
+void MetricVolumeCache::ReleaseEntry(Entry & entry)
+{
+	SAFE_RELEASE(entry.pUAV);
+	SAFE_RELEASE(entry.pSRV);
+	SAFE_RELEASE(entry.pTexture);
+}
+
+size_t MetricVolumeCache::GetMaxEntries(void) const
+{
+	unsigned long long entrySize = (unsigned long long)m_resolution.x * m_resolution.y * m_resolution.z * sizeof(float);
+	unsigned long long budget = (unsigned long long)std::max(0, m_budgetMB) * 1024 * 1024;
+	return (size_t)std::max(1ULL, budget / entrySize);
+}
+
+ID3D11ShaderResourceView * MetricVolumeCache::Find(const Key & key)
+{
+	for(auto it = m_entries.begin(); it != m_entries.end(); it++) {
+		if(it->key == key) {
+			m_entries.splice(m_entries.begin(), m_entries, it);
+			m_hits++;
+			return m_entries.front().pSRV;
+		}
+	}
+	m_misses++;
+	return nullptr;
+}
+
+HRESULT MetricVolumeCache::Insert(ID3D11Device * pd3dDevice, const Key & key, ID3D11Texture3D ** ppTexture, ID3D11ShaderResourceView ** ppSRV,
+	ID3D11UnorderedAccessView ** ppUAV)
+{
+	HRESULT hr;
+
+	// reuse the least recently used texture if the cache is full
+	Entry entry = { key, nullptr, nullptr, nullptr };
+	while(m_entries.size() >= GetMaxEntries()) {
+		if(!entry.pTexture)
+			entry = m_entries.back();
+		else
+			ReleaseEntry(m_entries.back());
+		m_entries.pop_back();
+	}
+	entry.key = key;
+
+	if(!entry.pTexture) {
+		D3D11_TEXTURE3D_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Width = m_resolution.x;
+		desc.Height = m_resolution.y;
+		desc.Depth = m_resolution.z;
+		desc.MipLevels = 1;
+		desc.Format = DXGI_FORMAT_R32_FLOAT;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+		desc.CPUAccessFlags = 0;
+		desc.MiscFlags = 0;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC pDesc;
+		ZeroMemory(&pDesc, sizeof(pDesc));
+		pDesc.Format = DXGI_FORMAT_R32_FLOAT;
+		pDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE3D;
+		pDesc.Texture3D.MipLevels = -1;
+		pDesc.Texture3D.MostDetailedMip = 0;
+
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+		ZeroMemory(&uavDesc, sizeof(uavDesc));
+		uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+		uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE3D;
+		uavDesc.Texture3D.MipSlice = 0;
+		uavDesc.Texture3D.FirstWSlice = 0;
+		uavDesc.Texture3D.WSize = m_resolution.z;
+
+		if(FAILED(hr = pd3dDevice->CreateTexture3D(&desc, nullptr, &entry.pTexture)) ||
+			FAILED(hr = pd3dDevice->CreateShaderResourceView(entry.pTexture, &pDesc, &entry.pSRV)) ||
+			FAILED(hr = pd3dDevice->CreateUnorderedAccessView(entry.pTexture, &uavDesc, &entry.pUAV)))
+		{
+			ReleaseEntry(entry);
+			return hr;
+		}
+	}
+
+	m_entries.push_front(entry);
+	*ppTexture = entry.pTexture;
+	*ppSRV = entry.pSRV;
+	*ppUAV = entry.pUAV;
+	return S_OK;
+}
+
+void MetricVolumeCache::Clear(void)
+{
+	for(auto it = m_entries.begin(); it != m_entries.end(); it++)
+		ReleaseEntry(*it);
+	m_entries.clear();
+}
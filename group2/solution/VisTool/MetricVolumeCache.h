@@ -0,0 +1,65 @@
+#pragma once
+
+#include "VolumeData.h"
+
+#include <list>
+
+/*
+	LRU cache of derived metric volumes on the GPU
+	Entries are R32_FLOAT textures holding the raw, unmapped metric values of one metric at one
+	point in time, so changing the metric range or the boundary settings only needs the cheap
+	normalization pass. The number of entries is limited by a memory budget, at least one entry
+	is always kept so the current metric can be renormalized.
+*/
+class MetricVolumeCache
+{
+public:
+	struct Key {
+		int		timestep0;		// timesteps in the volume slots, -1 if unused
+		int		timestep1;
+		float	timestepT;		// weight of timestep1
+		int		metric;
+
+		bool operator==(const Key & o) const {
+			return timestep0 == o.timestep0 && timestep1 == o.timestep1 && timestepT == o.timestepT && metric == o.metric;
+		};
+	};
+
+	MetricVolumeCache(XMINT3 resolution);
+	~MetricVolumeCache(void);
+
+	// returns the raw values of key and makes it the most recently used entry, nullptr on a miss
+	ID3D11ShaderResourceView * Find(const Key & key);
+	// adds an entry for key, evicting the least recently used ones that don't fit into the budget,
+	// the caller writes the raw values through the returned texture or UAV
+	HRESULT Insert(ID3D11Device * pd3dDevice, const Key & key, ID3D11Texture3D ** ppTexture, ID3D11ShaderResourceView ** ppSRV,
+		ID3D11UnorderedAccessView ** ppUAV);
+	void Clear(void);
+
+	void SetBudgetMB(int budgetMB) {		m_budgetMB = budgetMB;		};
+	int GetHits() const {					return m_hits;			};
+	int GetMisses() const {					return m_misses;		};
+	int GetNumEntries() const {				return (int)m_entries.size();	};
+	void ResetCounters() {					m_hits = m_misses = 0;	};
+
+private:
+	// non-copyable since it owns the textures
+	MetricVolumeCache(const MetricVolumeCache&);
+	MetricVolumeCache& operator=(const MetricVolumeCache&);
+
+	struct Entry {
+		Key							key;
+		ID3D11Texture3D				* pTexture;
+		ID3D11ShaderResourceView	* pSRV;
+		ID3D11UnorderedAccessView	* pUAV;
+	};
+
+	static void ReleaseEntry(Entry & entry);
+	size_t GetMaxEntries(void) const;
+
+	XMINT3				m_resolution;
+	int					m_budgetMB;
+	std::list<Entry>	m_entries;		// most recently used first
+	int					m_hits;
+	int					m_misses;
+};
@@ -0,0 +1,273 @@
+#include "PackedVolumeFile.h"
+
+#include "util/util.h"
+#include "util/LZCompression.h"
+#include "util/ThreadPool.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+
+bool PackedVolumeFile::IsPackedFile(const std::string & filename)
+{
+	return filename.size() > 4 && !_stricmp(filename.c_str() + filename.size() - 4, ".vpk");
+}
+
+XMINT3 PackedVolumeFile::GetNumBricks(XMINT3 resolution, int brickSize)
+{
+	return XMINT3((resolution.x + brickSize - 1) / brickSize,
+				  (resolution.y + brickSize - 1) / brickSize,
+				  (resolution.z + brickSize - 1) / brickSize);
+}
+
+/**
+	Converts a sequence of raw files into a container
+	The bricks of one timestep are compressed in parallel on the shared thread pool.
+*/
+bool PackedVolumeFile::Pack(const std::string & packedFileName, const std::vector<std::string> & rawFileNames,
+	VolumeData::DataFormat format, XMINT3 resolution, XMFLOAT3 sliceThickness, float timestep,
+	int brickSize, Compression compression)
+{
+	Header header;
+	ZeroMemory(&header, sizeof(header));
+	memcpy(header.magic, "VPK1", 4);
+	header.version = VERSION;
+	header.resolution[0] = resolution.x;	header.resolution[1] = resolution.y;	header.resolution[2] = resolution.z;
+	header.sliceThickness[0] = sliceThickness.x;	header.sliceThickness[1] = sliceThickness.y;	header.sliceThickness[2] = sliceThickness.z;
+	header.timestep = timestep;
+	header.format = format;
+	header.numTimesteps = (int)rawFileNames.size();
+	header.brickSize = brickSize;
+	header.compression = compression;
+
+	int elementSize = VolumeData::GetElementSize(format);
+	XMINT3 numBricks = GetNumBricks(resolution, brickSize);
+	int bricksPerTimestep = numBricks.x * numBricks.y * numBricks.z;
+	unsigned int timestepSize = resolution.x * resolution.y * resolution.z * elementSize;
+
+	std::ofstream out(packedFileName, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	if(!out.is_open()) {
+		std::cerr << "Could not open \"" << packedFileName << "\" for writing!" << std::endl;
+		return false;
+	}
+
+	// the brick table is written once all sizes are known
+	std::vector<BrickEntry> bricks(header.numTimesteps * bricksPerTimestep);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(bricks.data()), bricks.size() * sizeof(BrickEntry));
+	unsigned long long offset = sizeof(header) + bricks.size() * sizeof(BrickEntry);
+
+	std::vector<char> raw(timestepSize);
+	std::vector<std::vector<unsigned char>> stored(bricksPerTimestep);
+
+	for(int t = 0; t < header.numTimesteps; t++) {
+		std::ifstream in(rawFileNames[t], std::ifstream::in | std::ifstream::binary);
+		if(!in.read(raw.data(), timestepSize)) {
+			std::cerr << "Could not read " << timestepSize << " bytes from \"" << rawFileNames[t] << "\"!" << std::endl;
+			return false;
+		}
+
+		ThreadPool::GetShared().ParallelFor(0, bricksPerTimestep, [&](int b) {
+			XMINT3 origin(b % numBricks.x * brickSize, b / numBricks.x % numBricks.y * brickSize, b / (numBricks.x * numBricks.y) * brickSize);
+			XMINT3 size(std::min(brickSize, resolution.x - origin.x), std::min(brickSize, resolution.y - origin.y), std::min(brickSize, resolution.z - origin.z));
+			unsigned int rowSize = size.x * elementSize;
+			unsigned int rawSize = size.x * size.y * size.z * elementSize;
+
+			// gather the brick from the raw layout
+			std::vector<unsigned char> brick(rawSize);
+			for(int z = 0; z < size.z; z++) {
+				for(int y = 0; y < size.y; y++) {
+					unsigned int src = (((origin.z + z) * resolution.y + origin.y + y) * resolution.x + origin.x) * elementSize;
+					memcpy(&brick[(z * size.y + y) * rowSize], &raw[src], rowSize);
+				}
+			}
+
+			std::vector<unsigned char> & result = stored[b];
+			if(compression == PC_LZ) {
+				std::vector<unsigned char> shuffled(rawSize);
+				ShuffleBytes(brick.data(), shuffled.data(), rawSize, elementSize);
+				result.resize(rawSize);
+				// only keep the compressed version if it is smaller
+				size_t compressedSize = LZCompress(shuffled.data(), rawSize, result.data(), rawSize - 1);
+				if(compressedSize) {
+					result.resize(compressedSize);
+					return;
+				}
+			}
+			result.swap(brick);
+		});
+
+		for(int b = 0; b < bricksPerTimestep; b++) {
+			BrickEntry & e = bricks[t * bricksPerTimestep + b];
+			e.offset = offset;
+			e.storedSize = (unsigned int)stored[b].size();
+			out.write(reinterpret_cast<const char*>(stored[b].data()), stored[b].size());
+			offset += stored[b].size();
+		}
+
+		std::cout << "Packed \"" << GetFilename(rawFileNames[t]) << "\"." << std::endl;
+	}
+
+	out.seekp(sizeof(header));
+	out.write(reinterpret_cast<const char*>(bricks.data()), bricks.size() * sizeof(BrickEntry));
+	if(!out.good()) {
+		std::cerr << "Writing \"" << packedFileName << "\" failed!" << std::endl;
+		return false;
+	}
+
+	std::cout << "Packed " << header.numTimesteps << " timesteps into \"" << packedFileName << "\" (" << offset << " bytes, " 
+		<< (unsigned long long)timestepSize * header.numTimesteps << " bytes raw)." << std::endl;
+	return true;
+}
+
+PackedVolumeFile::PackedVolumeFile(void) :
+	m_hFile(INVALID_HANDLE_VALUE),
+	m_numBricks(0, 0, 0),
+	m_elementSize(0)
+{
+	ZeroMemory(&m_header, sizeof(m_header));
+}
+
+PackedVolumeFile::~PackedVolumeFile(void)
+{
+	Close();
+}
+
+bool PackedVolumeFile::Open(const std::string & filename)
+{
+	Close();
+
+	// no FILE_FLAG_SEQUENTIAL_SCAN, timesteps and bricks are read in any order
+	m_hFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(m_hFile == INVALID_HANDLE_VALUE) {
+		std::cerr << "Could not open \"" << filename << "\"!" << std::endl;
+		return false;
+	}
+	m_filename = filename;
+
+	if(!ReadAt(0, &m_header, sizeof(m_header)) || memcmp(m_header.magic, "VPK1", 4) || m_header.version != VERSION) {
+		std::cerr << "\"" << filename << "\" is not a packed volume file!" << std::endl;
+		Close();
+		return false;
+	}
+
+	m_elementSize = VolumeData::GetElementSize((VolumeData::DataFormat)m_header.format);
+	m_numBricks = GetNumBricks(XMINT3(m_header.resolution[0], m_header.resolution[1], m_header.resolution[2]), m_header.brickSize);
+	m_bricks.resize(m_header.numTimesteps * GetNumBricks());
+	if(!m_elementSize || !ReadAt(sizeof(m_header), m_bricks.data(), (unsigned int)(m_bricks.size() * sizeof(BrickEntry)))) {
+		std::cerr << "Could not read the brick table of \"" << filename << "\"!" << std::endl;
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void PackedVolumeFile::Close(void)
+{
+	if(m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_bricks.clear();
+}
+
+void PackedVolumeFile::GetBrickBounds(int brick, XMINT3 & origin, XMINT3 & size) const
+{
+	int s = m_header.brickSize;
+	origin = XMINT3(brick % m_numBricks.x * s, brick / m_numBricks.x % m_numBricks.y * s, brick / (m_numBricks.x * m_numBricks.y) * s);
+	size = XMINT3(std::min(s, m_header.resolution[0] - origin.x),
+				  std::min(s, m_header.resolution[1] - origin.y),
+				  std::min(s, m_header.resolution[2] - origin.z));
+}
+
+/**
+	Reads size bytes at offset, safe to call from several threads since the file position is not used
+*/
+bool PackedVolumeFile::ReadAt(unsigned long long offset, void * dst, unsigned int size) const
+{
+	OVERLAPPED overlapped;
+	ZeroMemory(&overlapped, sizeof(overlapped));
+	overlapped.Offset = (DWORD)(offset & 0xffffffff);
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+	DWORD bytesRead = 0;
+	return ReadFile(m_hFile, dst, size, &bytesRead, &overlapped) && bytesRead == size;
+}
+
+bool PackedVolumeFile::DecodeBrick(const unsigned char * stored, unsigned int storedSize, unsigned char * dst, unsigned int rawSize) const
+{
+	if(storedSize == rawSize) {
+		memcpy(dst, stored, rawSize);
+		return true;
+	}
+
+	std::vector<unsigned char> shuffled(rawSize);
+	if(!LZDecompress(stored, storedSize, shuffled.data(), rawSize))
+		return false;
+	UnshuffleBytes(shuffled.data(), dst, rawSize, m_elementSize);
+	return true;
+}
+
+bool PackedVolumeFile::ReadBrick(int timestep, int brick, void * dst) const
+{
+	assert(timestep < m_header.numTimesteps && brick < GetNumBricks());
+
+	XMINT3 origin, size;
+	GetBrickBounds(brick, origin, size);
+	unsigned int rawSize = size.x * size.y * size.z * m_elementSize;
+
+	const BrickEntry & e = GetEntry(timestep, brick);
+	if(e.storedSize == rawSize)
+		return ReadAt(e.offset, dst, rawSize);
+
+	std::vector<unsigned char> stored(e.storedSize);
+	if(!ReadAt(e.offset, stored.data(), e.storedSize) || !DecodeBrick(stored.data(), e.storedSize, static_cast<unsigned char*>(dst), rawSize)) {
+		std::cerr << "Brick " << brick << " of timestep " << timestep << " in \"" << m_filename << "\" is corrupt!" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+	Reads all bricks of a timestep with a single read since they are stored back to back,
+	then decodes and scatters them into the raw layout
+*/
+bool PackedVolumeFile::ReadTimestep(int timestep, void * dst) const
+{
+	assert(timestep < m_header.numTimesteps);
+
+	int numBricks = GetNumBricks();
+	const BrickEntry & first = GetEntry(timestep, 0);
+	const BrickEntry & last = GetEntry(timestep, numBricks - 1);
+	unsigned int storedSize = (unsigned int)(last.offset + last.storedSize - first.offset);
+
+	std::vector<unsigned char> stored(storedSize);
+	if(!ReadAt(first.offset, stored.data(), storedSize)) {
+		std::cerr << "Could not read timestep " << timestep << " from \"" << m_filename << "\"!" << std::endl;
+		return false;
+	}
+
+	unsigned char * out = static_cast<unsigned char*>(dst);
+	std::vector<unsigned char> brick(m_header.brickSize * m_header.brickSize * m_header.brickSize * m_elementSize);
+
+	for(int b = 0; b < numBricks; b++) {
+		XMINT3 origin, size;
+		GetBrickBounds(b, origin, size);
+		unsigned int rowSize = size.x * m_elementSize;
+		unsigned int rawSize = size.x * size.y * size.z * m_elementSize;
+
+		const BrickEntry & e = GetEntry(timestep, b);
+		if(!DecodeBrick(&stored[(size_t)(e.offset - first.offset)], e.storedSize, brick.data(), rawSize)) {
+			std::cerr << "Brick " << b << " of timestep " << timestep << " in \"" << m_filename << "\" is corrupt!" << std::endl;
+			return false;
+		}
+
+		for(int z = 0; z < size.z; z++) {
+			for(int y = 0; y < size.y; y++) {
+				size_t d = (((size_t)(origin.z + z) * m_header.resolution[1] + origin.y + y) * m_header.resolution[0] + origin.x) * m_elementSize;
+				memcpy(&out[d], &brick[(z * size.y + y) * rowSize], rowSize);
+			}
+		}
+	}
+	return true;
+}
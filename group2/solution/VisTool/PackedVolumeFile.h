@@ -0,0 +1,90 @@
+#pragma once
+
+#include "VolumeData.h"
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+/*
+	Single file container for a time series of volumes (.vpk)
+	Layout: a fixed size header, a table with offset and size of every brick of every timestep,
+	followed by the brick data. Each timestep is split into cubic bricks of header.brickSize
+	voxels (smaller at the upper borders), stored one after the other in x, y, z order. A brick
+	holds its voxels in the same x-fastest order as the raw files, without padding.
+	With compression, each brick is byte shuffled and LZ compressed on its own; bricks that
+	don't get smaller are stored as they are.
+	Reads use positional I/O and can be issued from several threads at once.
+*/
+class PackedVolumeFile
+{
+public:
+	enum Compression {
+		PC_NONE,
+		PC_LZ
+	};
+
+	struct Header {
+		char	magic[4];			// "VPK1"
+		unsigned int version;
+		int		resolution[3];
+		float	sliceThickness[3];
+		float	timestep;
+		int		format;				// VolumeData::DataFormat
+		int		numTimesteps;
+		int		brickSize;
+		int		compression;
+		unsigned int reserved;
+	};
+
+	struct BrickEntry {
+		unsigned long long offset;
+		unsigned int storedSize;	// equals the raw size if the brick is not compressed
+		unsigned int reserved;
+	};
+
+	static const unsigned int VERSION = 1;
+
+	// containers are recognized by their extension
+	static bool IsPackedFile(const std::string & filename);
+
+	// converts a sequence of raw files (one per timestep) into a container
+	static bool Pack(const std::string & packedFileName, const std::vector<std::string> & rawFileNames,
+		VolumeData::DataFormat format, XMINT3 resolution, XMFLOAT3 sliceThickness, float timestep,
+		int brickSize, Compression compression);
+
+	PackedVolumeFile(void);
+	~PackedVolumeFile(void);
+
+	bool Open(const std::string & filename);
+	void Close(void);
+
+	bool IsOpen() const {				return m_hFile != INVALID_HANDLE_VALUE;	};
+	const Header & GetHeader() const {	return m_header;	};
+	int GetNumBricks() const {			return m_numBricks.x * m_numBricks.y * m_numBricks.z;	};
+	void GetBrickBounds(int brick, XMINT3 & origin, XMINT3 & size) const;
+
+	// reads a whole timestep in raw file layout, dst must hold resolution.x*y*z elements
+	bool ReadTimestep(int timestep, void * dst) const;
+	// reads one brick in brick layout, dst must hold the number of voxels returned by GetBrickBounds
+	bool ReadBrick(int timestep, int brick, void * dst) const;
+
+private:
+	// non-copyable since we own the handle
+	PackedVolumeFile(const PackedVolumeFile&);
+	PackedVolumeFile& operator=(const PackedVolumeFile&);
+
+	bool ReadAt(unsigned long long offset, void * dst, unsigned int size) const;
+	bool DecodeBrick(const unsigned char * stored, unsigned int storedSize, unsigned char * dst, unsigned int rawSize) const;
+	const BrickEntry & GetEntry(int timestep, int brick) const {	return m_bricks[timestep * GetNumBricks() + brick];	};
+
+	static XMINT3 GetNumBricks(XMINT3 resolution, int brickSize);
+
+	HANDLE		m_hFile;
+	std::string	m_filename;
+	Header		m_header;
+	XMINT3		m_numBricks;
+	int			m_elementSize;
+	std::vector<BrickEntry>	m_bricks;
+};
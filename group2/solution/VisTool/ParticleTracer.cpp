@@ -3,12 +3,14 @@
 #include "SimpleMesh.h"
 
 #include "util/util.h"
+#include "StreamlinePlacement.h"
 #include "Globals.h"
 
 #include <iostream>
 #include <random>
 #include <sstream>
 #include <float.h>
+#include <climits>
 
 ID3DX11Effect			* ParticleTracer::pEffect = nullptr;
 ID3DX11EffectTechnique	* ParticleTracer::pTechnique = nullptr;
@@ -30,13 +32,17 @@ char * ParticleTracer::passNames[] = {
 		"PASS_RENDER_TUBE_CYLINDERS",
 		"PASS_RENDER_SURFACE",
 		"PASS_RENDER_SURFACE_WIREFRAME",
+		"PASS_RENDER_ADAPTIVE_SURFACE",
+		"PASS_RENDER_ADAPTIVE_SURFACE_WIREFRAME",
 		"PASS_COMPUTE_STREAMLINE",
 		"PASS_COMPUTE_STREAMRIBBON",
 		"PASS_COMPUTE_STREAKLINE",
 		"PASS_COMPUTE_STREAKRIBBON",
 		"PASS_INIT_CHARACTERISTIC_LINE",
 		"PASS_COMPUTE_SURFACE_VERTEX_METRICS",
-		"PASS_COMPUTE_TRIANGLE_PROPERTIES"
+		"PASS_COMPUTE_TRIANGLE_PROPERTIES",
+		"PASS_COUNT_STREAMLINE",
+		"PASS_SCAN_LINE_LENGTHS"
 };
 
 //Effect Variables
@@ -52,6 +58,7 @@ ID3DX11EffectVectorVariable * ParticleTracer::pCamForwardEV = nullptr;
 
 ID3DX11EffectScalarVariable * ParticleTracer::pTimestepTEV = nullptr;
 ID3DX11EffectScalarVariable * ParticleTracer::pTimeDeltaEV = nullptr;
+ID3DX11EffectScalarVariable * ParticleTracer::pIntegratorEV = nullptr;
 ID3DX11EffectVectorVariable * ParticleTracer::pVelocityScalingEV = nullptr;
 ID3DX11EffectScalarVariable * ParticleTracer::pMaxParticleLifetimeEV = nullptr;
 ID3DX11EffectVectorVariable * ParticleTracer::pRndEV = nullptr;
@@ -74,6 +81,16 @@ ID3DX11EffectScalarVariable	* ParticleTracer::pCLStepsizeEV = nullptr;
 ID3DX11EffectScalarVariable	* ParticleTracer::pCLLengthEV = nullptr;
 ID3DX11EffectScalarVariable	* ParticleTracer::pCLWidthEV = nullptr;
 ID3DX11EffectScalarVariable	* ParticleTracer::pCLReseedIntervalEV = nullptr;
+ID3DX11EffectScalarVariable	* ParticleTracer::pCLAdaptiveEV = nullptr;
+ID3DX11EffectScalarVariable	* ParticleTracer::pCLToleranceEV = nullptr;
+ID3DX11EffectScalarVariable	* ParticleTracer::pCLIntegrationTimeEV = nullptr;
+ID3DX11EffectUnorderedAccessViewVariable	* ParticleTracer::pCLStepCountsRWEV = nullptr;
+ID3DX11EffectScalarVariable	* ParticleTracer::pCLCompactedEV = nullptr;
+ID3DX11EffectScalarVariable	* ParticleTracer::pCLNumVerticesEV = nullptr;
+ID3DX11EffectScalarVariable	* ParticleTracer::pCLQuantizedEV = nullptr;
+ID3DX11EffectUnorderedAccessViewVariable	* ParticleTracer::pCLLineOffsetsRWEV = nullptr;
+ID3DX11EffectScalarVariable	* ParticleTracer::pCLLimitLengthsEV = nullptr;
+ID3DX11EffectShaderResourceVariable	* ParticleTracer::pCLLineLengthLimitsEV = nullptr;
 ID3DX11EffectVectorVariable	* ParticleTracer::pCLRibbonBaseOrientationEV = nullptr;
 
 ID3DX11EffectScalarVariable	* ParticleTracer::pCLEnableSurfaceLighting = nullptr;
@@ -90,6 +107,7 @@ ID3DX11EffectVectorVariable * ParticleTracer::pCLTimeSurfaceOffset = nullptr;
 
 ID3DX11EffectShaderResourceVariable	* ParticleTracer::pTexVolume0EV = nullptr;
 ID3DX11EffectShaderResourceVariable	* ParticleTracer::pTexVolume1EV = nullptr;
+ID3DX11EffectShaderResourceVariable	* ParticleTracer::pJacobianEV[2][2] = {};
 ID3DX11EffectShaderResourceVariable	* ParticleTracer::pParticleBufferEV = nullptr;
 ID3DX11EffectUnorderedAccessViewVariable * ParticleTracer::pParticleBufferRWEV = nullptr;
 
@@ -98,6 +116,8 @@ ID3DX11EffectShaderResourceVariable	* ParticleTracer::pScalarVolumeEV = nullptr;
 
 ID3DX11EffectShaderResourceVariable	* ParticleTracer::pCharacteristicLineBufferEV = nullptr;
 ID3DX11EffectUnorderedAccessViewVariable	* ParticleTracer::pCharacteristicLineBufferRWEV = nullptr;
+ID3DX11EffectShaderResourceVariable	* ParticleTracer::pCharacteristicLineBufferQEV = nullptr;
+ID3DX11EffectUnorderedAccessViewVariable	* ParticleTracer::pCharacteristicLineBufferQRWEV = nullptr;
 ID3DX11EffectShaderResourceVariable	* ParticleTracer::pTrianglePropertiesEV = nullptr;
 ID3DX11EffectUnorderedAccessViewVariable	* ParticleTracer::pTrianglePropertiesRWEV = nullptr;
 
@@ -134,6 +154,7 @@ HRESULT ParticleTracer::Initialize(ID3D11Device * pd3dDevice_, TwBar* pParameter
 
 	SAFE_GET_SCALAR(pEffect, "g_timestepT", pTimestepTEV);
 	SAFE_GET_SCALAR(pEffect, "g_timeDelta", pTimeDeltaEV);
+	SAFE_GET_SCALAR(pEffect, "g_integrator", pIntegratorEV);
 	SAFE_GET_VECTOR(pEffect, "g_velocityScaling", pVelocityScalingEV);
 	SAFE_GET_VECTOR(pEffect, "g_rnd", pRndEV);
 	SAFE_GET_SCALAR(pEffect, "g_maxParticleLifetime", pMaxParticleLifetimeEV);
@@ -154,6 +175,10 @@ HRESULT ParticleTracer::Initialize(ID3D11Device * pd3dDevice_, TwBar* pParameter
 
 	SAFE_GET_RESOURCE(pEffect, "g_flowFieldTex0", pTexVolume0EV);
 	SAFE_GET_RESOURCE(pEffect, "g_flowFieldTex1", pTexVolume1EV);
+	SAFE_GET_RESOURCE(pEffect, "g_jacobianT0A", pJacobianEV[0][0]);
+	SAFE_GET_RESOURCE(pEffect, "g_jacobianT0B", pJacobianEV[0][1]);
+	SAFE_GET_RESOURCE(pEffect, "g_jacobianT1A", pJacobianEV[1][0]);
+	SAFE_GET_RESOURCE(pEffect, "g_jacobianT1B", pJacobianEV[1][1]);
 	SAFE_GET_RESOURCE(pEffect, "g_particleBuffer", pParticleBufferEV);
 	SAFE_GET_UAV(pEffect, "g_particleBufferRW", pParticleBufferRWEV);
 
@@ -165,6 +190,16 @@ HRESULT ParticleTracer::Initialize(ID3D11Device * pd3dDevice_, TwBar* pParameter
 	SAFE_GET_SCALAR(pEffect, "g_clStepsize", pCLStepsizeEV);
 	SAFE_GET_SCALAR(pEffect, "g_clReseedInterval", pCLReseedIntervalEV);
 	SAFE_GET_VECTOR(pEffect, "g_clRibbonBaseOrientation", pCLRibbonBaseOrientationEV);
+	SAFE_GET_SCALAR(pEffect, "g_clAdaptive", pCLAdaptiveEV);
+	SAFE_GET_SCALAR(pEffect, "g_clTolerance", pCLToleranceEV);
+	SAFE_GET_SCALAR(pEffect, "g_clIntegrationTime", pCLIntegrationTimeEV);
+	SAFE_GET_UAV(pEffect, "g_clStepCountsRW", pCLStepCountsRWEV);
+	SAFE_GET_SCALAR(pEffect, "g_clCompacted", pCLCompactedEV);
+	SAFE_GET_SCALAR(pEffect, "g_clNumVertices", pCLNumVerticesEV);
+	SAFE_GET_SCALAR(pEffect, "g_clQuantized", pCLQuantizedEV);
+	SAFE_GET_UAV(pEffect, "g_clLineOffsetsRW", pCLLineOffsetsRWEV);
+	SAFE_GET_SCALAR(pEffect, "g_clLimitLengths", pCLLimitLengthsEV);
+	SAFE_GET_RESOURCE(pEffect, "g_clLineLengthLimits", pCLLineLengthLimitsEV);
 
 	SAFE_GET_SCALAR(pEffect, "g_enableSurfaceLighting", pCLEnableSurfaceLighting);
 	SAFE_GET_SCALAR(pEffect, "g_clEnableAlphaDensity", pCLEnableAlphaDensity);
@@ -180,6 +215,8 @@ HRESULT ParticleTracer::Initialize(ID3D11Device * pd3dDevice_, TwBar* pParameter
 
 	SAFE_GET_RESOURCE(pEffect, "g_characteristicLineBuffer", pCharacteristicLineBufferEV);
 	SAFE_GET_UAV(pEffect, "g_characteristicLineBufferRW", pCharacteristicLineBufferRWEV);
+	SAFE_GET_RESOURCE(pEffect, "g_characteristicLineBufferQ", pCharacteristicLineBufferQEV);
+	SAFE_GET_UAV(pEffect, "g_characteristicLineBufferQRW", pCharacteristicLineBufferQRWEV);
 	SAFE_GET_RESOURCE(pEffect, "g_triangleProperties", pTrianglePropertiesEV);
 	SAFE_GET_UAV(pEffect, "g_trianglePropertiesRW", pTrianglePropertiesRWEV);
 
@@ -204,6 +241,7 @@ void ParticleTracer::SetupTwBar(TwBar * pParametersBar_) {
 	TwType lineModeType = TwDefineEnum("LineModeType", NULL, 0);
 	TwType lineModeDrawType = TwDefineEnum("LineModeDrawType", NULL, 0);
 	TwType seedingType = TwDefineEnum("SeedingType", NULL, 0);
+	TwType integratorType = TwDefineEnum("IntegratorType", NULL, 0);
 
 	// Define a new struct type: light variables are embedded in this structure
     static TwStructMember tracerMembers[] = // array used to describe tweakable variables of the Light structure
@@ -214,14 +252,23 @@ void ParticleTracer::SetupTwBar(TwBar * pParametersBar_) {
         { "Particle Lifetime",			TW_TYPE_FLOAT,		offsetof(ParticleTracer, m_maxParticleLifetime),    "min=0.1 step=0.1" },
 		{ "Color By Metric",			TW_TYPE_BOOLCPP,	offsetof(ParticleTracer, m_colorParticlesByMetricGUI),    "" },
 		{ "Particle Color",				TW_TYPE_COLOR4F,	offsetof(ParticleTracer, m_particleColorGUI), "" },
+		{ "Integrator",					integratorType,		offsetof(ParticleTracer, m_integrator), "enum='0 {Euler}, 1 {RK2}, 2 {RK4}'"},
+		{ "CPU Advection",				TW_TYPE_BOOLCPP,	offsetof(ParticleTracer, m_cpuAdvection), ""},
 		{ "Characteristic Line Mode",	lineModeType,		offsetof(ParticleTracer, m_clModeGUI), "enum='0 {Disabled}, 1 {Pathlines}, 2 {Streaklines}, 3 {Streamlines}'"},
 		{ "Characteristic Line Rendering", lineModeDrawType, offsetof(ParticleTracer, m_clRenderModeGUI), "enum='0 {Lines}, 1 {Ribbons}, 2 {Tubes}, 3 {Surface}'"},
-		{ "Seeding",					seedingType,		offsetof(ParticleTracer, m_seedingModeGUI), "enum='0 {Random}, 1 {Line}, 2 {Time Surface}'"},
+		{ "Seeding",					seedingType,		offsetof(ParticleTracer, m_seedingModeGUI), "enum='0 {Random}, 1 {Line}, 2 {Time Surface}, 3 {Evenly Spaced}'"},
+		{ "Seed Separation",			TW_TYPE_FLOAT,		offsetof(ParticleTracer, m_seedSeparationGUI), "min=0.005 max=0.5 step=0.005"},
 		{ "CL Length",					TW_TYPE_INT32,		offsetof(ParticleTracer, m_clLengthGUI), "min=1 step=10"},
 		{ "CL Width",					TW_TYPE_FLOAT,		offsetof(ParticleTracer, m_clWidthGUI), "min=0.0001 step=0.0001"},
 		{ "CL Stepsize",				TW_TYPE_FLOAT,		offsetof(ParticleTracer, m_clStepsizeGUI), "step=0.0005"},
 		{ "CL Ribbon Orientation",		TW_TYPE_DIR3F,		offsetof(ParticleTracer, m_clRibbonBaseOrientationGUI), ""},
 		{ "CL Reseed Interval",			TW_TYPE_FLOAT,		offsetof(ParticleTracer, m_clReseedIntervalGUI), ""},
+		{ "CL Adaptive Steps (RK45)",	TW_TYPE_BOOLCPP,	offsetof(ParticleTracer, m_clAdaptiveGUI), ""},
+		{ "CL Tolerance",				TW_TYPE_FLOAT,		offsetof(ParticleTracer, m_clToleranceGUI), "min=0.000001 step=0.00001 precision=6"},
+		{ "CL Integration Time",		TW_TYPE_FLOAT,		offsetof(ParticleTracer, m_clIntegrationTimeGUI), "min=0.01 step=0.1"},
+		{ "CL Pathline Start",			TW_TYPE_FLOAT,		offsetof(ParticleTracer, m_clPathlineStartGUI), "min=0 step=0.1"},
+		{ "CL Compact Storage",			TW_TYPE_BOOLCPP,	offsetof(ParticleTracer, m_clCompactGUI), ""},
+		{ "CL Quantized Encoding",		TW_TYPE_BOOLCPP,	offsetof(ParticleTracer, m_clQuantizedGUI), ""},
 		{ "Surface Lighting",			TW_TYPE_BOOLCPP,	offsetof(ParticleTracer, m_clEnableSurfaceLighting), ""},
 		{ "Surface Density Transparency", TW_TYPE_BOOLCPP,	offsetof(ParticleTracer, m_clEnableAlphaDensityGUI), ""},
 		{ "Surface Density Coefficient", TW_TYPE_FLOAT,		offsetof(ParticleTracer, m_clAlphaDensityCoeffGUI), "min=0 step=0.01"},
@@ -233,9 +280,12 @@ void ParticleTracer::SetupTwBar(TwBar * pParametersBar_) {
 		{ "Num. of Time Surfaces",		TW_TYPE_INT32,		offsetof(ParticleTracer, m_numTimeSurfacesGUI), "min=1"},
 		{ "Spawn Region Center",		posType,			offsetof(ParticleTracer, m_spawnRegionBox) + offsetof(BoxManipulationManager::ManipulationBox, center), ""},
 		{ "Spawn Region Size",			posType,			offsetof(ParticleTracer, m_spawnRegionBox) + offsetof(BoxManipulationManager::ManipulationBox, size), ""},
-		{ "Render Surface Wireframe",	TW_TYPE_BOOLCPP,	offsetof(ParticleTracer, m_surfaceWireframe), ""}
+		{ "Render Surface Wireframe",	TW_TYPE_BOOLCPP,	offsetof(ParticleTracer, m_surfaceWireframe), ""},
+		{ "Adaptive Stream Surface",	TW_TYPE_BOOLCPP,	offsetof(ParticleTracer, m_surfaceAdaptiveGUI), ""},
+		{ "Surface Max Edge Ratio",		TW_TYPE_FLOAT,		offsetof(ParticleTracer, m_surfaceEdgeRatioGUI), "min=0.5 max=16 step=0.1"},
+		{ "Surface Max Angle",			TW_TYPE_FLOAT,		offsetof(ParticleTracer, m_surfaceMaxAngleGUI), "min=1 max=90 step=1"}
     };
-    particleTracerType = TwDefineStruct("Particle Tracer", tracerMembers, 26, sizeof(ParticleTracer), NULL, NULL);  // create a new TwType associated to the struct defined by the lightMembers array
+    particleTracerType = TwDefineStruct("Particle Tracer", tracerMembers, 38, sizeof(ParticleTracer), NULL, NULL);  // create a new TwType associated to the struct defined by the lightMembers array
 
 }
 
@@ -280,6 +330,11 @@ void TW_CALL ParticleTracer::RemoveParticleProbeCB(void * clientData)
 	delete me;
 }
 
+void TW_CALL ParticleTracer::DumpStepHistogramCB(void * clientData)
+{
+	reinterpret_cast<ParticleTracer *>(clientData)->DumpStepHistogram();
+}
+
 void ParticleTracer::LoadConfig(SettingsStorage & store, VectorVolumeData & volData)
 {
 	char idBuf[256];
@@ -336,6 +391,8 @@ ParticleTracer::ParticleTracer(VectorVolumeData & volData) :
 	m_particleColor(1,1,1,1), m_particleColorGUI(1,1,1,1),
 	m_probeIndex(instanceCounter++),
 	m_seedingMode(SM_RANDOM), m_seedingModeGUI(SM_RANDOM),
+	m_seedSeparation(0.05f), m_seedSeparationGUI(0.05f),
+	m_seedsOutdated(true),
 	m_clMode(CL_DISABLED),	m_clModeGUI(CL_DISABLED),
 	m_clRenderMode(CLRM_TUBE),	m_clRenderModeGUI(CLRM_TUBE),
 	m_clStepsize(0.1f),
@@ -346,8 +403,24 @@ ParticleTracer::ParticleTracer(VectorVolumeData & volData) :
 	m_clRibbonBaseOrientation(0, 0, 0),
 	m_clRibbonBaseOrientationGUI(0, 0, 0),
 	m_clReseedInterval(.05f), m_clReseedIntervalGUI(.05f),
+	m_clAdaptive(false), m_clAdaptiveGUI(false),
+	m_clTolerance(1e-4f), m_clToleranceGUI(1e-4f),
+	m_clIntegrationTime(15.f), m_clIntegrationTimeGUI(15.f),
+	m_clPathlineStart(0.f), m_clPathlineStartGUI(0.f),
+	m_clCompact(true), m_clCompactGUI(true),
+	m_clNumVertices(0),
+	m_clBufferVertices(0),
+	m_clBufferStride(0),
+	m_clQuantized(false), m_clQuantizedGUI(false),
 
 	m_surfaceWireframe(false),
+	m_surfaceAdaptive(false), m_surfaceAdaptiveGUI(false),
+	m_surfaceEdgeRatio(2.f), m_surfaceEdgeRatioGUI(2.f),
+	m_surfaceMaxAngle(20.f), m_surfaceMaxAngleGUI(20.f),
+	m_surfaceNumIndices(0),
+	m_surfaceIndexCapacity(0),
+	m_integrator(AdvectionEngine::INT_EULER),
+	m_cpuAdvection(false),
 
 	m_pCharacteristicLineBuffer(nullptr),
 	m_pCharacteristicLineBufferSRV(nullptr),
@@ -355,6 +428,14 @@ ParticleTracer::ParticleTracer(VectorVolumeData & volData) :
 	m_pTrianglePropertiesBuffer(nullptr),
 	m_pTrianglePropertiesBufferSRV(nullptr),
 	m_pTrianglePropertiesBufferUAV(nullptr),
+	m_pStepCountBuffer(nullptr),
+	m_pStepCountBufferUAV(nullptr),
+	m_pLineOffsetsBuffer(nullptr),
+	m_pLineOffsetsBufferUAV(nullptr),
+	m_pLineOffsetsStagingBuffer(nullptr),
+	m_pLineLengthLimitBuffer(nullptr),
+	m_pLineLengthLimitBufferSRV(nullptr),
+	m_pSurfaceIndexBuffer(nullptr),
 	
 	m_clEnableAlphaDensity(true), m_clEnableAlphaDensityGUI(true),
 	m_clAlphaDensityCoeff(100), m_clAlphaDensityCoeffGUI(100),
@@ -382,6 +463,7 @@ ParticleTracer::ParticleTracer(VectorVolumeData & volData) :
 	ss << "[" << m_probeIndex << "]";
 	TwAddVarRW(pParametersBar, (std::string("Particle Probe ")  + ss.str()).c_str(), particleTracerType, this, "");
 	//TwAddVarCB(pParametersBar, (std::string("Number of Particles ")  + ss.str()).c_str(), TW_TYPE_INT32, SetNumParticlesCB, GetNumParticlesCB, this, ((std::string("group='Particle Probe ")  + ss.str() + "' min=2 step=100").c_str()));
+	TwAddButton(pParametersBar,(std::string("Print CL Step Histogram ")  + ss.str()).c_str(), DumpStepHistogramCB, this, "");
 	TwAddButton(pParametersBar,(std::string("Remove Probe ")  + ss.str()).c_str(), RemoveParticleProbeCB, this, "");//(std::string("group='Particle Probe ")  + ss.str() + "'").c_str());
 
 	SetNumParticles(m_numParticlesGUI);
@@ -401,6 +483,14 @@ ParticleTracer::~ParticleTracer(void)
 	SAFE_RELEASE(m_pTrianglePropertiesBuffer);
 	SAFE_RELEASE(m_pTrianglePropertiesBufferSRV);
 	SAFE_RELEASE(m_pTrianglePropertiesBufferUAV);
+	SAFE_RELEASE(m_pStepCountBuffer);
+	SAFE_RELEASE(m_pStepCountBufferUAV);
+	SAFE_RELEASE(m_pLineOffsetsBuffer);
+	SAFE_RELEASE(m_pLineOffsetsBufferUAV);
+	SAFE_RELEASE(m_pLineOffsetsStagingBuffer);
+	SAFE_RELEASE(m_pLineLengthLimitBuffer);
+	SAFE_RELEASE(m_pLineLengthLimitBufferSRV);
+	SAFE_RELEASE(m_pSurfaceIndexBuffer);
 
 	std::stringstream ss;
 	ss << "[" << m_probeIndex << "]";
@@ -413,6 +503,7 @@ ParticleTracer::~ParticleTracer(void)
 	TwSetParam(pParametersBar, nullptr, "visible", TW_PARAM_INT32, 1, &visible);
 
 	TwRemoveVar(pParametersBar, (std::string("Particle Probe ") + ss.str()).c_str());
+	TwRemoveVar(pParametersBar, (std::string("Print CL Step Histogram ") + ss.str()).c_str());
 	TwRemoveVar(pParametersBar, (std::string("Remove Probe ") + ss.str()).c_str());
 	m_volumeData.UnregisterObserver(this);
 	g_transferFunctionEditor->UnregisterObserver(this);
@@ -429,9 +520,12 @@ void ParticleTracer::SaveConfig(SettingsStorage &store, std::string id)
 	store.StoreFloat(cfgName + ".particleSize", m_particleSize);
 	store.StoreBool(cfgName + ".colorByMetric", m_colorParticlesByMetric);
 	store.StoreFloat4(cfgName + ".particleColor", &m_particleColor.x);
+	store.StoreInt(cfgName + ".integrator", (int)m_integrator);
+	store.StoreBool(cfgName + ".cpuAdvection", m_cpuAdvection);
 	store.StoreFloat3(cfgName + ".spawnRegion.center", &m_spawnRegionBox.center.x);
 	store.StoreFloat3(cfgName + ".spawnRegion.size", &m_spawnRegionBox.size.x);
 	store.StoreInt(cfgName + ".seedingMode", m_seedingMode);
+	store.StoreFloat(cfgName + ".seedSeparation", m_seedSeparation);
 	store.StoreInt(cfgName + ".characteristicLines.type", (int)m_clMode);
 	store.StoreInt(cfgName + ".characteristicLines.renderMode", (int)m_clRenderMode);
 	store.StoreInt(cfgName + ".characteristicLines.length", m_clLength);
@@ -439,6 +533,12 @@ void ParticleTracer::SaveConfig(SettingsStorage &store, std::string id)
 	store.StoreFloat(cfgName + ".characteristicLines.stepsize", m_clStepsize);
 	store.StoreFloat(cfgName + ".characteristicLines.reseedInterval", m_clReseedInterval);
 	store.StoreFloat3(cfgName + ".characteristicLines.ribbonOrientation", &m_clRibbonBaseOrientation.x);
+	store.StoreBool(cfgName + ".characteristicLines.adaptive", m_clAdaptive);
+	store.StoreFloat(cfgName + ".characteristicLines.tolerance", m_clTolerance);
+	store.StoreFloat(cfgName + ".characteristicLines.integrationTime", m_clIntegrationTime);
+	store.StoreFloat(cfgName + ".characteristicLines.pathlineStart", m_clPathlineStart);
+	store.StoreBool(cfgName + ".characteristicLines.compact", m_clCompact);
+	store.StoreBool(cfgName + ".characteristicLines.quantized", m_clQuantized);
 
 	store.StoreBool(cfgName + ".characteristicLines.surface.enableAlphaDensity", m_clEnableAlphaDensity);
 	store.StoreFloat(cfgName + ".characteristicLines.surface.alphaDensityCoefficient", m_clAlphaDensityCoeffGUI);
@@ -449,6 +549,9 @@ void ParticleTracer::SaveConfig(SettingsStorage &store, std::string id)
 	store.StoreFloat(cfgName + ".characteristicLines.surface.alphaCurvatureCoefficient", m_clAlphaCurvatureCoeff);
 	store.StoreBool(cfgName + ".characteristicLines.surface.enableLighting", m_clEnableSurfaceLighting);
 	store.StoreInt(cfgName + ".characteristicLines.surface.numTimeSurfaces", m_numTimeSurfaces);
+	store.StoreBool(cfgName + ".characteristicLines.surface.adaptive", m_surfaceAdaptive);
+	store.StoreFloat(cfgName + ".characteristicLines.surface.maxEdgeRatio", m_surfaceEdgeRatio);
+	store.StoreFloat(cfgName + ".characteristicLines.surface.maxAngle", m_surfaceMaxAngle);
 }
 
 void ParticleTracer::LoadConfig(SettingsStorage &store, std::string id)
@@ -462,6 +565,10 @@ void ParticleTracer::LoadConfig(SettingsStorage &store, std::string id)
 
 	store.GetBool(cfgName + ".colorByMetric", m_colorParticlesByMetricGUI);
 	store.GetFloat4(cfgName + ".particleColor", &m_particleColorGUI.x);
+	int integrator = m_integrator;
+	store.GetInt(cfgName + ".integrator", integrator);
+	m_integrator = (AdvectionEngine::Integrator)integrator;
+	store.GetBool(cfgName + ".cpuAdvection", m_cpuAdvection);
 	store.GetFloat3(cfgName + ".spawnRegion.center", &m_spawnRegionBox.center.x);
 	store.GetFloat3(cfgName + ".spawnRegion.size", &m_spawnRegionBox.size.x);
 	m_spawnRegionBox.SetChanged();
@@ -469,6 +576,7 @@ void ParticleTracer::LoadConfig(SettingsStorage &store, std::string id)
 	int clMode = m_clMode, clRenderMode = m_clRenderMode, clLength = m_clLength, seedingMode = m_seedingMode;
 	store.GetInt(cfgName + ".seedingMode", seedingMode);
 	m_seedingModeGUI = (SeedingMode)seedingMode;
+	store.GetFloat(cfgName + ".seedSeparation", m_seedSeparationGUI);
 	store.GetInt(cfgName + ".characteristicLines.type", clMode);
 	store.GetInt(cfgName + ".characteristicLines.renderMode", clRenderMode);
 	store.GetInt(cfgName + ".characteristicLines.length", clLength);
@@ -476,6 +584,12 @@ void ParticleTracer::LoadConfig(SettingsStorage &store, std::string id)
 	store.GetFloat(cfgName + ".characteristicLines.stepsize", m_clStepsizeGUI);
 	store.GetFloat3(cfgName + ".characteristicLines.ribbonOrientation", &m_clRibbonBaseOrientation.x);
 	store.GetFloat(cfgName + ".characteristicLines.reseedInterval", m_clReseedIntervalGUI);
+	store.GetBool(cfgName + ".characteristicLines.adaptive", m_clAdaptiveGUI);
+	store.GetFloat(cfgName + ".characteristicLines.tolerance", m_clToleranceGUI);
+	store.GetFloat(cfgName + ".characteristicLines.integrationTime", m_clIntegrationTimeGUI);
+	store.GetFloat(cfgName + ".characteristicLines.pathlineStart", m_clPathlineStartGUI);
+	store.GetBool(cfgName + ".characteristicLines.compact", m_clCompactGUI);
+	store.GetBool(cfgName + ".characteristicLines.quantized", m_clQuantizedGUI);
 
 	store.GetBool(cfgName + ".characteristicLines.surface.enableAlphaDensity", m_clEnableAlphaDensityGUI);
 	store.GetFloat(cfgName + ".characteristicLines.surface.alphaDensityCoefficient", m_clAlphaDensityCoeffGUI);
@@ -486,6 +600,9 @@ void ParticleTracer::LoadConfig(SettingsStorage &store, std::string id)
 	store.GetBool(cfgName + ".characteristicLines.surface.enableAlphaCurvature", m_clEnableAlphaCurvatureGUI);
 	store.GetFloat(cfgName + ".characteristicLines.surface.alphaCurvatureCoefficient", m_clAlphaCurvatureCoeffGUI);
 	store.GetInt(cfgName + ".characteristicLines.surface.numTimeSurfaces", m_numTimeSurfacesGUI);
+	store.GetBool(cfgName + ".characteristicLines.surface.adaptive", m_surfaceAdaptiveGUI);
+	store.GetFloat(cfgName + ".characteristicLines.surface.maxEdgeRatio", m_surfaceEdgeRatioGUI);
+	store.GetFloat(cfgName + ".characteristicLines.surface.maxAngle", m_surfaceMaxAngleGUI);
 
 	m_clModeGUI = (CharacteristicLineMode)clMode;
 	m_clRenderModeGUI = (CharacteristicLineRenderMode)clRenderMode;
@@ -584,11 +701,17 @@ HRESULT ParticleTracer::RenderInstance(ID3D11DeviceContext* pd3dImmediateContext
 		pd3dImmediateContext->Draw(m_numParticles, 0);
 	}
 
-	if(m_clMode == CL_STREAMLINES || m_clMode == CL_STREAKLINES) {
+	if(m_clMode != CL_DISABLED) {
 		pCLLengthEV->SetInt(m_clLength);
 		pCLRibbonBaseOrientationEV->SetFloatVector(&m_clRibbonBaseOrientation.x);
 		pCLWidthEV->SetFloat(m_clWidth);
-		pCharacteristicLineBufferEV->SetResource(m_pCharacteristicLineBufferSRV);
+		pCLCompactedEV->SetBool(m_clNumVertices != 0);
+		pCLNumVerticesEV->SetInt(m_clNumVertices);
+		pCLQuantizedEV->SetBool(IsCLBufferQuantized());
+		if(IsCLBufferQuantized())
+			pCharacteristicLineBufferQEV->SetResource(m_pCharacteristicLineBufferSRV);
+		else
+			pCharacteristicLineBufferEV->SetResource(m_pCharacteristicLineBufferSRV);
 
 		if(m_clRenderMode == CLRM_SURFACE) {
 			if(m_surfaceWireframe) {
@@ -596,9 +719,18 @@ HRESULT ParticleTracer::RenderInstance(ID3D11DeviceContext* pd3dImmediateContext
 				pCLAlphaDensityCoeff->SetFloat(m_clAlphaDensityCoeff);
 				pCLEnableAlphaDensity->SetBool(m_clEnableAlphaDensity);
 				pTrianglePropertiesEV->SetResource(m_pTrianglePropertiesBufferSRV);
-				pPasses[PASS_RENDER_SURFACE_WIREFRAME]->Apply(0, pd3dImmediateContext);
-				pd3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
-				pd3dImmediateContext->Draw((m_numParticles-1) * m_clLength, 0);
+				if(m_surfaceNumIndices) {
+					pPasses[PASS_RENDER_ADAPTIVE_SURFACE_WIREFRAME]->Apply(0, pd3dImmediateContext);
+					pd3dImmediateContext->IASetIndexBuffer(m_pSurfaceIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+					pd3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+					pd3dImmediateContext->DrawIndexed(m_surfaceNumIndices, 0, 0);
+					pd3dImmediateContext->IASetIndexBuffer(nullptr, DXGI_FORMAT_R32_UINT, 0);
+				}
+				else {
+					pPasses[PASS_RENDER_SURFACE_WIREFRAME]->Apply(0, pd3dImmediateContext);
+					pd3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
+					pd3dImmediateContext->Draw((m_numParticles-1) * m_clLength, 0);
+				}
 			}
 		}
 		else {
@@ -611,18 +743,19 @@ HRESULT ParticleTracer::RenderInstance(ID3D11DeviceContext* pd3dImmediateContext
 			}
 
 			pd3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP);
-			pd3dImmediateContext->Draw(m_numParticles * (m_clLength + 1), 0);
+			pd3dImmediateContext->Draw(GetCLDrawVertexCount(), 0);
 		}
 	}
 
 	//remove the mappings from the shader inputs
 	pParticleBufferEV->SetResource(nullptr);
 	pCharacteristicLineBufferEV->SetResource(nullptr);
+	pCharacteristicLineBufferQEV->SetResource(nullptr);
 	pScalarVolumeEV->SetResource(nullptr);
 	pTrianglePropertiesEV->SetResource(nullptr);
 
 	for(int i=0; i < NUM_PASSES; i++) {
-		if(i == PASS_RENDER_SURFACE) continue;
+		if(i == PASS_RENDER_SURFACE || i == PASS_RENDER_ADAPTIVE_SURFACE) continue;
 		pPasses[i]->Apply(0, pd3dImmediateContext);
 	}
 
@@ -652,7 +785,7 @@ HRESULT ParticleTracer::RenderTransparencyInstance(ID3D11DeviceContext* pd3dImme
 	pd3dImmediateContext->IASetInputLayout(nullptr);
 	pd3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
 
-	if(m_clMode == CL_STREAMLINES || m_clMode == CL_STREAKLINES) {
+	if(m_clMode != CL_DISABLED) {
 		pCLLengthEV->SetInt(m_clLength);
 		pCLRibbonBaseOrientationEV->SetFloatVector(&m_clRibbonBaseOrientation.x);
 		pCLWidthEV->SetFloat(m_clWidth);
@@ -662,9 +795,18 @@ HRESULT ParticleTracer::RenderTransparencyInstance(ID3D11DeviceContext* pd3dImme
 			pCLEnableAlphaDensity->SetBool(m_clEnableAlphaDensity);
 			pCLAlphaDensityCoeff->SetFloat(m_clAlphaDensityCoeff);
 			pTrianglePropertiesEV->SetResource(m_pTrianglePropertiesBufferSRV);
-			pPasses[PASS_RENDER_SURFACE]->Apply(0, pd3dImmediateContext);
-			pd3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
-			pd3dImmediateContext->Draw((m_numParticles-1) * m_clLength, 0);
+			if(m_surfaceNumIndices) {
+				pPasses[PASS_RENDER_ADAPTIVE_SURFACE]->Apply(0, pd3dImmediateContext);
+				pd3dImmediateContext->IASetIndexBuffer(m_pSurfaceIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+				pd3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+				pd3dImmediateContext->DrawIndexed(m_surfaceNumIndices, 0, 0);
+				pd3dImmediateContext->IASetIndexBuffer(nullptr, DXGI_FORMAT_R32_UINT, 0);
+			}
+			else {
+				pPasses[PASS_RENDER_SURFACE]->Apply(0, pd3dImmediateContext);
+				pd3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
+				pd3dImmediateContext->Draw((m_numParticles-1) * m_clLength, 0);
+			}
 		}
 	
 	}
@@ -698,6 +840,7 @@ void ParticleTracer::FrameMoveInstance(double dTime, float fElapsedTime, float f
 	pd3dDevice->GetImmediateContext(&pContext);
 
 	pTimeDeltaEV->SetFloat(fElapsedLogicTime);
+	pIntegratorEV->SetInt(m_integrator);
 	pTimestepTEV->SetFloat(m_volumeData.GetCurrentTimestepT());
 	pVelocityScalingEV->SetFloatVector(&m_velocityScaling.x);
 	pMaxParticleLifetimeEV->SetFloat(m_maxParticleLifetime);
@@ -721,7 +864,10 @@ void ParticleTracer::FrameMoveInstance(double dTime, float fElapsedTime, float f
 	pTexVolume1EV->SetResource(m_volumeData.GetTexture1SRV());
 	pParticleBufferRWEV->SetUnorderedAccessView(m_pParticleBufferUAV);
 	
-	if(m_enableParticles) {
+	if(m_enableParticles && m_cpuAdvection && AdvectOnCPU(pContext, fElapsedLogicTime, spawnRegionMin, spawnRegionMax)) {
+		pParticleBufferRWEV->SetUnorderedAccessView(nullptr);
+	}
+	else if(m_enableParticles) {
 		pPasses[PASS_ADVECT]->Apply(0, pContext);
 
 		uint32_t gx = uint32_t(ceilf(m_numParticles/(256.f))),// ceilf(m_numParticles / (32.f*2.f*2.f)),
@@ -736,6 +882,10 @@ void ParticleTracer::FrameMoveInstance(double dTime, float fElapsedTime, float f
 
 	//we don't update streamlines if paused
 	bool needsRecompute = CLRequireRecompute();
+	if(m_seedingMode == SM_EVENLY_SPACED && m_seedsOutdated) {
+		PlaceEvenlySpacedSeeds(pContext);
+		needsRecompute = m_clMode != CL_DISABLED;
+	}
 	if( needsRecompute ) {
 		switch (m_clMode) {
 		case CL_STREAMLINES:
@@ -745,7 +895,7 @@ void ParticleTracer::FrameMoveInstance(double dTime, float fElapsedTime, float f
 			ComputeStreaklines(pContext, fElapsedLogicTime);
 			break;
 		case CL_PATHLINES:
-			std::cout << "Pathlines not implemented!" << std::endl;
+			ComputePathlines(pContext);
 			break;
 		case CL_DISABLED:
 		default:
@@ -758,13 +908,120 @@ void ParticleTracer::FrameMoveInstance(double dTime, float fElapsedTime, float f
 	}
 	// we need to recompute surface properties every frame even if we are paused if we have enabled alphaDensity since
 	// it is view-dependent and we can't detect camera changes lazily (yet)
-	if(m_clRenderMode == CLRM_SURFACE && (needsRecompute || (m_clMode == CL_STREAMLINES && m_clEnableAlphaDensity))) {
+	// the adaptive surface has its normals from IntegralSurface and no triangle properties
+	if(m_clRenderMode == CLRM_SURFACE && !m_surfaceNumIndices && (needsRecompute || (m_clMode == CL_STREAMLINES && m_clEnableAlphaDensity))) {
 		ComputeTriangleProperties(pContext);
 	}
 
 	SAFE_RELEASE(pContext);
 }
 
+// hands the timesteps in the volume slots to the AdvectionEngine, false if the flow field is not in RAM
+bool ParticleTracer::SetAdvectionFields(void)
+{
+	const void * data0 = m_volumeData.GetSlotData(0);
+	const void * data1 = m_volumeData.GetSlotData(1);
+	if(!data0)
+		return false;
+
+	VolumeData::DataFormat format = m_volumeData.GetFormat();
+	AdvectionEngine::InputFormat inputFormat = (format == VolumeData::DF_HALF3 || format == VolumeData::DF_HALF4) ?
+		AdvectionEngine::IF_HALF4 : AdvectionEngine::IF_FLOAT4;
+	const XMINT3 & res = m_volumeData.GetResolution();
+	int resolution[3] = { res.x, res.y, res.z };
+	m_advectionEngine.SetFields(data0, m_volumeData.GetSlotTimestep(0), data1, m_volumeData.GetSlotTimestep(1), inputFormat, resolution);
+	return true;
+}
+
+// advects the particles with the AdvectionEngine and uploads them, false if the flow field is not in RAM
+bool ParticleTracer::AdvectOnCPU(ID3D11DeviceContext * pContext, float timeDelta, const XMFLOAT3 & spawnRegionMin, const XMFLOAT3 & spawnRegionMax)
+{
+	if(m_particles.Size() != m_numParticles || !SetAdvectionFields())
+		return false;
+
+	AdvectionEngine::Parameters params;
+	params.timeDelta = timeDelta;
+	params.timestepT = m_volumeData.GetSlotData(1) ? m_volumeData.GetCurrentTimestepT() : 0.f;
+	params.velocityScaling[0] = m_velocityScaling.x;
+	params.velocityScaling[1] = m_velocityScaling.y;
+	params.velocityScaling[2] = m_velocityScaling.z;
+	params.maxLifetime = m_maxParticleLifetime;
+	params.spawnRegionMin[0] = spawnRegionMin.x;
+	params.spawnRegionMin[1] = spawnRegionMin.y;
+	params.spawnRegionMin[2] = spawnRegionMin.z;
+	params.spawnRegionMax[0] = spawnRegionMax.x;
+	params.spawnRegionMax[1] = spawnRegionMax.y;
+	params.spawnRegionMax[2] = spawnRegionMax.z;
+	params.integrator = m_integrator;
+
+	m_gpuParticles.resize(m_numParticles);
+	m_advectionEngine.Advect(m_particles, params, m_gpuParticles.data());
+	pContext->UpdateSubresource(m_pParticleBuffer, 0, nullptr, m_gpuParticles.data(), 0, 0);
+	return true;
+}
+
+/**
+	Places the streamline seeds with StreamlinePlacement at m_seedSeparation in the current flow field
+	At most m_numParticles lines are placed, the remaining particles repeat the first seed with a single
+	vertex. The vertex counts of the placement become the length limits of the GPU streamlines, so they
+	end where they came too close to another line. The seeds are kept if the field is not in RAM.
+*/
+void ParticleTracer::PlaceEvenlySpacedSeeds(ID3D11DeviceContext * pContext)
+{
+	m_seedsOutdated = false;
+	if(m_particles.Size() != m_numParticles || FAILED(CreateLineLengthLimitBuffer()) || !SetAdvectionFields()) {
+		std::cout << "Evenly spaced seeding needs the flow field in RAM, keeping the seeds." << std::endl;
+		return;
+	}
+
+	StreamlinePlacement::Parameters params;
+	params.separation = m_seedSeparation;
+	params.stepsize = m_clStepsize;
+	params.maxVertices = m_clLength;
+	params.maxLines = m_numParticles;
+	params.timestepT = m_volumeData.GetSlotData(1) ? m_volumeData.GetCurrentTimestepT() : 0.f;
+	params.velocityScaling[0] = m_velocityScaling.x;
+	params.velocityScaling[1] = m_velocityScaling.y;
+	params.velocityScaling[2] = m_velocityScaling.z;
+	for(int c = 0; c < 3; c++) {
+		params.regionMin[c] = (&m_spawnRegionBox.center.x)[c] - 0.5f * (&m_spawnRegionBox.size.x)[c];
+		params.regionMax[c] = (&m_spawnRegionBox.center.x)[c] + 0.5f * (&m_spawnRegionBox.size.x)[c];
+	}
+
+	double startTime = GetTimeMs();
+	StreamlinePlacement::Result placement;
+	StreamlinePlacement::Place(m_advectionEngine, params, placement);
+	std::cout << "Placed " << placement.Size() << " of at most " << m_numParticles << " streamlines in " << GetTimeMs() - startTime << " ms" << std::endl;
+	if(!placement.Size())
+		return;
+
+	// seeds are stored relative to the spawn region, the particles restart at them
+	std::vector<uint32_t> limits(m_numParticles, 1);
+	m_gpuParticles.resize(m_numParticles);
+	for(unsigned int i = 0; i < m_numParticles; i++) {
+		size_t line = i < placement.Size() ? i : 0;
+		if(i < placement.Size())
+			limits[i] = placement.numVertices[i];
+
+		AdvectionEngine::GPUParticle & particle = m_gpuParticles[i];
+		for(int c = 0; c < 3; c++) {
+			particle.pos[c] = placement.seeds[3 * line + c];
+			particle.seedPos[c] = (particle.pos[c] - params.regionMin[c]) / std::max(1e-6f, params.regionMax[c] - params.regionMin[c]);
+		}
+		particle.age = m_particles.age[i];
+		particle.ageSeed = m_particles.ageSeed[i];
+
+		m_particles.x[i] = particle.pos[0];
+		m_particles.y[i] = particle.pos[1];
+		m_particles.z[i] = particle.pos[2];
+		m_particles.seedX[i] = particle.seedPos[0];
+		m_particles.seedY[i] = particle.seedPos[1];
+		m_particles.seedZ[i] = particle.seedPos[2];
+	}
+	pContext->UpdateSubresource(m_pParticleBuffer, 0, nullptr, m_gpuParticles.data(), 0, 0);
+	pContext->UpdateSubresource(m_pLineLengthLimitBuffer, 0, nullptr, limits.data(), 0, 0);
+}
+
 void ParticleTracer::SetNumParticles(unsigned int numParticles)
 {
 	if(m_numParticles == numParticles)
@@ -787,6 +1044,14 @@ void ParticleTracer::SetNumParticles(unsigned int numParticles)
 	SAFE_RELEASE(m_pTrianglePropertiesBufferSRV);
 	SAFE_RELEASE(m_pTrianglePropertiesBufferUAV);
 
+	SAFE_RELEASE(m_pStepCountBuffer);
+	SAFE_RELEASE(m_pStepCountBufferUAV);
+	SAFE_RELEASE(m_pLineOffsetsBuffer);
+	SAFE_RELEASE(m_pLineOffsetsBufferUAV);
+	SAFE_RELEASE(m_pLineOffsetsStagingBuffer);
+	SAFE_RELEASE(m_pLineLengthLimitBuffer);
+	SAFE_RELEASE(m_pLineLengthLimitBufferSRV);
+
 	if(m_clMode != CL_DISABLED) {
 		
 		CreateCharacteristicLineGPUBuffer();
@@ -820,6 +1085,7 @@ HRESULT ParticleTracer::CreateParticleGPUBuffer()
 		return S_OK;
 
 	std::cout << "Creating Particle Buffers..." << std::endl;
+	m_seedsOutdated = true;
 
 	// create and fill the particle buffer on the cpu with meaningful data
 	struct ParticleDescriptor * particleBuffer = new struct ParticleDescriptor[m_numParticles];
@@ -862,7 +1128,8 @@ HRESULT ParticleTracer::CreateParticleGPUBuffer()
 			particleBuffer[i].seedPos[2] = 0.5;
 			particleBuffer[i].seedPos[longestAxis] = (float)i / (m_numParticles-1);
 		}
-		else if(m_seedingMode == SM_RANDOM) {
+		// evenly spaced seeds are placed later in the field, see PlaceEvenlySpacedSeeds
+		else if(m_seedingMode == SM_RANDOM || m_seedingMode == SM_EVENLY_SPACED) {
 			particleBuffer[i].seedPos[0] = dist(g);
 			particleBuffer[i].seedPos[1] = dist(g);
 			particleBuffer[i].seedPos[2] = dist(g);
@@ -894,6 +1161,20 @@ HRESULT ParticleTracer::CreateParticleGPUBuffer()
 
 	V_RETURN(pd3dDevice->CreateBuffer(&desc, &initData, &m_pParticleBuffer));
 
+	// the CPU advection starts from the same particles
+	static_assert(sizeof(AdvectionEngine::GPUParticle) == sizeof(struct ParticleDescriptor), "particle layouts differ");
+	m_particles.Resize(m_numParticles);
+	for(unsigned int i = 0; i < m_numParticles; i++) {
+		m_particles.x[i] = particleBuffer[i].pos[0];
+		m_particles.y[i] = particleBuffer[i].pos[1];
+		m_particles.z[i] = particleBuffer[i].pos[2];
+		m_particles.age[i] = particleBuffer[i].age;
+		m_particles.seedX[i] = particleBuffer[i].seedPos[0];
+		m_particles.seedY[i] = particleBuffer[i].seedPos[1];
+		m_particles.seedZ[i] = particleBuffer[i].seedPos[2];
+		m_particles.ageSeed[i] = particleBuffer[i].ageSeed;
+	}
+
 	delete particleBuffer;
 
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
@@ -960,21 +1241,68 @@ HRESULT ParticleTracer::CreateTrianglePropertiesBuffer()
 	return S_OK;
 }
 
-HRESULT ParticleTracer::CreateCharacteristicLineGPUBuffer()
+// one counter per line for the accepted adaptive streamline steps
+HRESULT ParticleTracer::CreateStepCountBuffer()
 {
 	HRESULT hr;
 	assert(pd3dDevice);
 
-	if(m_pCharacteristicLineBuffer)
+	if(m_pStepCountBuffer)
 		return S_OK;
 
-	std::cout << "Creating CL GPU Buffers..." << std::endl;
+	D3D11_BUFFER_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.ByteWidth = m_numParticles * sizeof(uint32_t);
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	desc.CPUAccessFlags = 0;
+	desc.MiscFlags = 0;
+
+	D3D11_SUBRESOURCE_DATA initData;
+	ZeroMemory(&initData, sizeof(initData));
+	std::vector<uint32_t> zeros(m_numParticles, 0);
+	initData.pSysMem = zeros.data();
+
+	V_RETURN(pd3dDevice->CreateBuffer(&desc, &initData, &m_pStepCountBuffer));
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+	ZeroMemory(&uavDesc, sizeof(uavDesc));
+	uavDesc.Format = DXGI_FORMAT_R32_UINT;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.Flags = 0;
+	uavDesc.Buffer.NumElements = m_numParticles;
+	V_RETURN(pd3dDevice->CreateUnorderedAccessView(m_pStepCountBuffer, &uavDesc, &m_pStepCountBufferUAV));
+
+	return S_OK;
+}
+
+// numVertices is the capacity for compacted streamlines, 0 for the fixed layout of m_clLength vertices per line
+// an existing buffer of a different size is replaced
+HRESULT ParticleTracer::CreateCharacteristicLineGPUBuffer(unsigned int numVertices)
+{
+	HRESULT hr;
+	assert(pd3dDevice);
+
+	bool fixedLayout = numVertices == 0;
+	if(fixedLayout)
+		numVertices = m_numParticles * m_clLength;
+
+	unsigned int stride = GetCLVertexSize();
+	if(m_pCharacteristicLineBuffer && m_clBufferVertices == numVertices && m_clBufferStride == stride)
+		return S_OK;
+
+	SAFE_RELEASE(m_pCharacteristicLineBuffer);
+	SAFE_RELEASE(m_pCharacteristicLineBufferSRV);
+	SAFE_RELEASE(m_pCharacteristicLineBufferUAV);
+
+	std::cout << "Creating CL GPU Buffers (" << numVertices << " vertices, " << stride << " bytes each)..." << std::endl;
 
 	//create the scalar texture
 	D3D11_BUFFER_DESC desc;
 	ZeroMemory(&desc, sizeof(desc));
-	desc.StructureByteStride = sizeof(struct CharacteristicLineVertex);
-	desc.ByteWidth = m_numParticles * m_clLength * desc.StructureByteStride;
+	desc.StructureByteStride = stride;
+	desc.ByteWidth = numVertices * desc.StructureByteStride;
 	desc.Usage = D3D11_USAGE_DEFAULT;
 	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
 	desc.CPUAccessFlags = 0;
@@ -987,7 +1315,7 @@ HRESULT ParticleTracer::CreateCharacteristicLineGPUBuffer()
 	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
 	srvDesc.ViewDimension = D3D_SRV_DIMENSION_BUFFEREX;
 	srvDesc.BufferEx.FirstElement = 0;
-	srvDesc.BufferEx.NumElements = m_numParticles * m_clLength;
+	srvDesc.BufferEx.NumElements = numVertices;
 
 	V_RETURN(pd3dDevice->CreateShaderResourceView(m_pCharacteristicLineBuffer, &srvDesc, &m_pCharacteristicLineBufferSRV));
 
@@ -998,19 +1326,162 @@ HRESULT ParticleTracer::CreateCharacteristicLineGPUBuffer()
 	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
 	uavDesc.Buffer.FirstElement = 0;
 	uavDesc.Buffer.Flags = 0;
-	uavDesc.Buffer.NumElements = m_numParticles * m_clLength;
+	uavDesc.Buffer.NumElements = numVertices;
 	V_RETURN(pd3dDevice->CreateUnorderedAccessView(m_pCharacteristicLineBuffer, &uavDesc, &m_pCharacteristicLineBufferUAV));
+	m_clBufferVertices = numVertices;
+	m_clBufferStride = stride;
 
-	InitCharacteristicLineBuffer();
+	// compacted and quantized lines are written completely by the compute shader or the pathline upload
+	if(fixedLayout && !IsCLBufferQuantized())
+		InitCharacteristicLineBuffer();
+
+	return S_OK;
+}
+
+// per line vertex counts, turned into offsets by the scan, with the total in the last element
+HRESULT ParticleTracer::CreateLineOffsetsBuffer()
+{
+	HRESULT hr;
+	assert(pd3dDevice);
+
+	if(m_pLineOffsetsBuffer)
+		return S_OK;
+
+	D3D11_BUFFER_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.ByteWidth = (m_numParticles + 1) * sizeof(uint32_t);
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	desc.CPUAccessFlags = 0;
+	desc.MiscFlags = 0;
+	V_RETURN(pd3dDevice->CreateBuffer(&desc, nullptr, &m_pLineOffsetsBuffer));
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+	ZeroMemory(&uavDesc, sizeof(uavDesc));
+	uavDesc.Format = DXGI_FORMAT_R32_UINT;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.Flags = 0;
+	uavDesc.Buffer.NumElements = m_numParticles + 1;
+	V_RETURN(pd3dDevice->CreateUnorderedAccessView(m_pLineOffsetsBuffer, &uavDesc, &m_pLineOffsetsBufferUAV));
+
+	desc.ByteWidth = sizeof(uint32_t);
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	V_RETURN(pd3dDevice->CreateBuffer(&desc, nullptr, &m_pLineOffsetsStagingBuffer));
+
+	return S_OK;
+}
+
+// maximum number of vertices per streamline, without limits until the seeds are placed
+HRESULT ParticleTracer::CreateLineLengthLimitBuffer()
+{
+	HRESULT hr;
+	assert(pd3dDevice);
+
+	if(m_pLineLengthLimitBuffer)
+		return S_OK;
+
+	D3D11_BUFFER_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.ByteWidth = m_numParticles * sizeof(uint32_t);
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = 0;
+	desc.MiscFlags = 0;
+
+	D3D11_SUBRESOURCE_DATA initData;
+	ZeroMemory(&initData, sizeof(initData));
+	std::vector<uint32_t> limits(m_numParticles, UINT_MAX);
+	initData.pSysMem = limits.data();
+
+	V_RETURN(pd3dDevice->CreateBuffer(&desc, &initData, &m_pLineLengthLimitBuffer));
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+	ZeroMemory(&srvDesc, sizeof(srvDesc));
+	srvDesc.Format = DXGI_FORMAT_R32_UINT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = m_numParticles;
+	V_RETURN(pd3dDevice->CreateShaderResourceView(m_pLineLengthLimitBuffer, &srvDesc, &m_pLineLengthLimitBufferSRV));
 
 	return S_OK;
 }
 
+// grows the index buffer of the adaptive surface, with some headroom for the next fronts
+HRESULT ParticleTracer::CreateSurfaceIndexBuffer(unsigned int numIndices)
+{
+	HRESULT hr;
+	assert(pd3dDevice);
+
+	if(m_pSurfaceIndexBuffer && m_surfaceIndexCapacity >= numIndices)
+		return S_OK;
+
+	SAFE_RELEASE(m_pSurfaceIndexBuffer);
+	m_surfaceIndexCapacity = numIndices + numIndices / 4;
+
+	D3D11_BUFFER_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.ByteWidth = m_surfaceIndexCapacity * sizeof(uint32_t);
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	desc.CPUAccessFlags = 0;
+	desc.MiscFlags = 0;
+
+	V_RETURN(pd3dDevice->CreateBuffer(&desc, nullptr, &m_pSurfaceIndexBuffer));
+
+	return S_OK;
+}
+
+/**
+	Counts the vertices of every streamline and scans the counts into the line offsets
+	The lines end where they leave the volume or stagnate, so only these vertices are stored.
+	Returns the total number of vertices, which is read back synchronously (4 bytes, only when the
+	lines are recomputed), or 0 on failure. The effect variables have to be set up by the caller.
+*/
+unsigned int ParticleTracer::CountStreamlineVertices(ID3D11DeviceContext * pContext)
+{
+	if(FAILED(CreateLineOffsetsBuffer()))
+		return 0;
+
+	pCLLineOffsetsRWEV->SetUnorderedAccessView(m_pLineOffsetsBufferUAV);
+	pPasses[PASS_COUNT_STREAMLINE]->Apply(0, pContext);
+	pContext->Dispatch(uint32_t(ceilf(m_numParticles/(256.f))), 1, 1);
+	pPasses[PASS_SCAN_LINE_LENGTHS]->Apply(0, pContext);
+	pContext->Dispatch(1, 1, 1);
+
+	D3D11_BOX box;
+	box.left = m_numParticles * sizeof(uint32_t);
+	box.right = box.left + sizeof(uint32_t);
+	box.top = 0;
+	box.bottom = 1;
+	box.front = 0;
+	box.back = 1;
+	pContext->CopySubresourceRegion(m_pLineOffsetsStagingBuffer, 0, 0, 0, 0, m_pLineOffsetsBuffer, 0, &box);
+
+	unsigned int numVertices = 0;
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if(SUCCEEDED(pContext->Map(m_pLineOffsetsStagingBuffer, 0, D3D11_MAP_READ, 0, &mappedResource))) {
+		numVertices = *reinterpret_cast<uint32_t*>(mappedResource.pData);
+		pContext->Unmap(m_pLineOffsetsStagingBuffer, 0);
+	}
+	return numVertices;
+}
+
 void ParticleTracer::ComputeStreamlines(ID3D11DeviceContext * pContext)
 {
 	//std::cout << "Computing streamlines for probe [" << m_probeIndex << "]" << std::endl;
 
-	if(!m_pCharacteristicLineBuffer)
+	m_surfaceNumIndices = 0;
+	if(UseAdaptiveSurface() && ComputeAdaptiveSurface(pContext)) {
+		m_volumeDataChanged = false;
+		return;
+	}
+
+	// before setting the effect variables, InitCharacteristicLineBuffer sets its own
+	bool compact = UseCompactedStreamlines();
+	if(!compact)
 		CreateCharacteristicLineGPUBuffer();
 
 	pCLLengthEV->SetInt(m_clLength);
@@ -1028,12 +1499,35 @@ void ParticleTracer::ComputeStreamlines(ID3D11DeviceContext * pContext)
 	pSpawnRegionMinEV->SetFloatVector(&spawnRegionMin.x);
 	pSpawnRegionMaxEV->SetFloatVector(&spawnRegionMax.x);
 	
-	pMaxParticleLifetimeEV->SetFloat((m_clLength - 1) * m_clStepsize);
+	// adaptive streamlines store the integration time as age
+	pMaxParticleLifetimeEV->SetFloat(GetStreamlineLifetime());
+	pCLAdaptiveEV->SetBool(UseAdaptiveStreamlines());
+	pCLToleranceEV->SetFloat(m_clTolerance);
+	pCLIntegrationTimeEV->SetFloat(m_clIntegrationTime);
+	if(UseAdaptiveStreamlines() && SUCCEEDED(CreateStepCountBuffer()))
+		pCLStepCountsRWEV->SetUnorderedAccessView(m_pStepCountBufferUAV);
 	
 	pTexVolume0EV->SetResource(m_volumeData.GetTexture0SRV());
 	pTexVolume1EV->SetResource(m_volumeData.GetTexture1SRV());
 	pParticleBufferEV->SetResource(m_pParticleBufferSRV);
-	pCharacteristicLineBufferRWEV->SetUnorderedAccessView(m_pCharacteristicLineBufferUAV);
+	SetJacobianResources(m_clRenderMode == CLRM_RIBBON);
+	pCLLimitLengthsEV->SetBool(m_seedingMode == SM_EVENLY_SPACED && m_pLineLengthLimitBufferSRV);
+	pCLLineLengthLimitsEV->SetResource(m_pLineLengthLimitBufferSRV);
+
+	// the compacted buffer grows with some headroom and only shrinks if less than half of it is used
+	m_clNumVertices = compact ? CountStreamlineVertices(pContext) : 0;
+	if(m_clNumVertices) {
+		unsigned int capacity = m_pCharacteristicLineBuffer ? m_clBufferVertices : 0;
+		if(capacity < m_clNumVertices || capacity / 2 > m_clNumVertices)
+			capacity = std::min(m_clNumVertices + m_clNumVertices / 4, m_numParticles * m_clLength);
+		CreateCharacteristicLineGPUBuffer(capacity);
+	}
+	pCLCompactedEV->SetBool(m_clNumVertices != 0);
+	pCLQuantizedEV->SetBool(IsCLBufferQuantized());
+	if(IsCLBufferQuantized())
+		pCharacteristicLineBufferQRWEV->SetUnorderedAccessView(m_pCharacteristicLineBufferUAV);
+	else
+		pCharacteristicLineBufferRWEV->SetUnorderedAccessView(m_pCharacteristicLineBufferUAV);
 
 	pCLTimeSurfaceOffset->SetFloatVector(&m_timeSurfaceOffsetDirection.x);
 	pCLNumTimeSurfaces->SetInt(m_numTimeSurfaces);
@@ -1056,9 +1550,14 @@ void ParticleTracer::ComputeStreamlines(ID3D11DeviceContext * pContext)
 	pContext->Dispatch(gx, gy, gz);
 
 	pCharacteristicLineBufferRWEV->SetUnorderedAccessView(nullptr);
+	pCharacteristicLineBufferQRWEV->SetUnorderedAccessView(nullptr);
+	pCLStepCountsRWEV->SetUnorderedAccessView(nullptr);
+	pCLLineOffsetsRWEV->SetUnorderedAccessView(nullptr);
+	pCLLineLengthLimitsEV->SetResource(nullptr);
 	pParticleBufferEV->SetResource(nullptr);
 	pScalarVolumeEV->SetResource(nullptr);
 	pTransferFunctionEV->SetResource(nullptr);
+	SetJacobianResources(false);
 	if(m_clRenderMode == CLRM_LINEPRIMITIVE)
 		pPasses[PASS_COMPUTE_STREAMLINE]->Apply(0, pContext);
 	else
@@ -1067,12 +1566,194 @@ void ParticleTracer::ComputeStreamlines(ID3D11DeviceContext * pContext)
 	m_volumeDataChanged = false;
 }
 
+/**
+	Builds the stream surface from the seed line on the CPU with IntegralSurface
+	The front starts with m_numParticles vertices on the line of SM_LINE seeding and takes up to
+	m_clLength - 1 steps of m_clStepsize. Edges are split above m_surfaceEdgeRatio times the seed
+	spacing and where the front bends by more than m_surfaceMaxAngle, and the mesh gets at most the
+	vertices of the fixed triangulation. The vertices go to the characteristic line buffer with the
+	normal in dir (scaled so that g_modelWorld maps it to world space), the triangles to the index buffer.
+	Returns false if the field is not in RAM or the surface is empty, the GPU surface is used then.
+*/
+bool ParticleTracer::ComputeAdaptiveSurface(ID3D11DeviceContext * pContext)
+{
+	m_surfaceNumIndices = 0;
+	if(!SetAdvectionFields())
+		return false;
+
+	XMFLOAT3 bbox = m_volumeData.GetBoundingBox();
+	int axis = m_spawnRegionBox.longestAxis;
+	IntegralSurface::Parameters params;
+	for(int c = 0; c < 3; c++) {
+		params.seedStart[c] = params.seedEnd[c] = (&m_spawnRegionBox.center.x)[c];
+		params.velocityScaling[c] = (&m_velocityScaling.x)[c];
+		params.extent[c] = (&bbox.x)[c];
+	}
+	params.seedStart[axis] -= 0.5f * (&m_spawnRegionBox.size.x)[axis];
+	params.seedEnd[axis] += 0.5f * (&m_spawnRegionBox.size.x)[axis];
+	params.numSeeds = m_numParticles;
+	params.stepsize = m_clStepsize;
+	params.maxFronts = m_clLength;
+	params.maxEdge = m_surfaceEdgeRatio * (&m_spawnRegionBox.size.x)[axis] * params.extent[axis] / (m_numParticles - 1);
+	params.minEdge = 0.25f * params.maxEdge;
+	params.maxAngle = m_surfaceMaxAngle * XM_PI / 180.f;
+	params.maxFrontVertices = 4 * m_numParticles;
+	params.maxVertices = m_numParticles * m_clLength;
+	params.timestepT = m_volumeData.GetSlotData(1) ? m_volumeData.GetCurrentTimestepT() : 0.f;
+
+	double startTime = GetTimeMs();
+	IntegralSurface::Compute(m_advectionEngine, params, m_surfaceMesh);
+	std::cout << "Adaptive surface with " << m_surfaceMesh.numFronts << " fronts, " << m_surfaceMesh.NumVertices() << " vertices and "
+		<< m_surfaceMesh.NumTriangles() << " triangles in " << GetTimeMs() - startTime << " ms" << std::endl;
+	if(!m_surfaceMesh.NumTriangles())
+		return false;
+
+	// the fade is kept in size for the colors from the transfer function, see vsAdaptiveSurface
+	unsigned int numVertices = (unsigned int)m_surfaceMesh.NumVertices();
+	float lifetime = std::max(1e-6f, (m_clLength - 1) * m_clStepsize);
+	std::vector<struct CharacteristicLineVertex> vertices(numVertices);
+	for(unsigned int i=0; i < numVertices; i++) {
+		CharacteristicLineVertex & clv = vertices[i];
+		float fade = m_clEnableAlphaFade ? 1.f - m_surfaceMesh.ages[i] / lifetime : 1.f;
+		for(int c=0; c < 3; c++) {
+			clv.pos[c] = m_surfaceMesh.positions[3 * i + c];
+			clv.tangent[c] = m_surfaceMesh.normals[3 * i + c] / params.extent[c];
+		}
+		memcpy(clv.color, &m_particleColor.x, sizeof(clv.color));
+		clv.color[3] *= fade;
+		clv.age = m_surfaceMesh.ages[i];
+		clv.size = fade;
+	}
+
+	unsigned int numIndices = (unsigned int)m_surfaceMesh.indices.size();
+	if(FAILED(CreateCharacteristicLineGPUBuffer((unsigned int)params.maxVertices)) || FAILED(CreateSurfaceIndexBuffer(numIndices)))
+		return false;
+
+	D3D11_BOX box;
+	box.left = 0;
+	box.right = numVertices * sizeof(struct CharacteristicLineVertex);
+	box.top = 0;
+	box.bottom = 1;
+	box.front = 0;
+	box.back = 1;
+	pContext->UpdateSubresource(m_pCharacteristicLineBuffer, 0, &box, vertices.data(), 0, 0);
+	box.right = numIndices * sizeof(uint32_t);
+	pContext->UpdateSubresource(m_pSurfaceIndexBuffer, 0, &box, m_surfaceMesh.indices.data(), 0, 0);
+
+	m_surfaceNumIndices = numIndices;
+	return true;
+}
+
+/**
+	Integrates the pathlines on the CPU through the time-dependent field
+	The lines start at the seeds at m_clPathlineStart and take m_clLength - 1 steps of m_clStepsize seconds.
+	The timesteps are streamed in order through VolumeData::StreamTimesteps, so only a small window of
+	them has to be in RAM, and all lines are advanced in parallel for each pair of timesteps.
+*/
+void ParticleTracer::ComputePathlines(ID3D11DeviceContext * pContext)
+{
+	CreateCharacteristicLineGPUBuffer();
+	m_clNumVertices = 0;
+	m_surfaceNumIndices = 0;
+	m_volumeDataChanged = false;
+	if(m_particles.Size() != m_numParticles)
+		return;
+
+	std::cout << "Computing pathlines for probe [" << m_probeIndex << "]..." << std::endl;
+	double startTime = GetTimeMs();
+
+	XMFLOAT3 spawnRegionMin(m_spawnRegionBox.center.x - 0.5f*m_spawnRegionBox.size.x, 
+		m_spawnRegionBox.center.y - 0.5f*m_spawnRegionBox.size.y, 
+		m_spawnRegionBox.center.z - 0.5f*m_spawnRegionBox.size.z);
+	std::vector<float> seeds(m_numParticles * 3);
+	for(unsigned int i=0; i < m_numParticles; i++) {
+		seeds[3 * i] = m_particles.seedX[i] * m_spawnRegionBox.size.x + spawnRegionMin.x;
+		seeds[3 * i + 1] = m_particles.seedY[i] * m_spawnRegionBox.size.y + spawnRegionMin.y;
+		seeds[3 * i + 2] = m_particles.seedZ[i] * m_spawnRegionBox.size.z + spawnRegionMin.z;
+	}
+	m_pathlines.Init(seeds.data(), m_numParticles, m_clLength, m_clPathlineStart, m_clStepsize);
+
+	VolumeData::DataFormat format = m_volumeData.GetFormat();
+	AdvectionEngine::InputFormat inputFormat = (format == VolumeData::DF_HALF3 || format == VolumeData::DF_HALF4) ?
+		AdvectionEngine::IF_HALF4 : AdvectionEngine::IF_FLOAT4;
+	const XMINT3 & res = m_volumeData.GetResolution();
+	int resolution[3] = { res.x, res.y, res.z };
+	float velocityScaling[3] = { m_velocityScaling.x, m_velocityScaling.y, m_velocityScaling.z };
+
+	if(!m_volumeData.GetTimeSequenceLength()) {
+		// a steady field, the pathlines are streamlines
+		const void * data = m_volumeData.GetSlotData(0);
+		if(data) {
+			m_advectionEngine.SetFields(data, 0, nullptr, -1, inputFormat, resolution);
+			m_advectionEngine.AdvancePathlines(m_pathlines, m_pathlines.startTime, m_pathlines.GetEndTime(), velocityScaling);
+		}
+	}
+	else {
+		float timestep = m_volumeData.GetTimestep();
+		int first = (int)(m_pathlines.startTime / timestep);
+		int last = (int)ceilf(m_pathlines.GetEndTime() / timestep);
+		m_volumeData.StreamTimesteps(first, last, [&](int t, const void * data0, const void * data1) {
+			m_advectionEngine.SetFields(data0, t, data1, t + 1, inputFormat, resolution);
+			m_advectionEngine.AdvancePathlines(m_pathlines, t * timestep, (t + 1) * timestep, velocityScaling);
+			return !m_pathlines.Finished();
+		});
+	}
+
+	// same layout as the streamlines: the seed is the last vertex of a line, lines that left the volume
+	// or the time series repeat their last vertex
+	std::vector<struct CharacteristicLineVertex> vertices(m_numParticles * m_clLength);
+	for(unsigned int i=0; i < m_numParticles; i++) {
+		const float * line = &m_pathlines.vertices[i * m_clLength * 3];
+		for(unsigned int v=0; v < m_clLength; v++) {
+			unsigned int e = std::min(v, (unsigned int)m_pathlines.numEmitted - 1);
+			unsigned int next = std::min(e + 1, (unsigned int)m_pathlines.numEmitted - 1);
+			unsigned int prev = e ? e - 1 : 0;
+			CharacteristicLineVertex & clv = vertices[(i + 1) * m_clLength - 1 - v];
+			float length = 0;
+			for(int c=0; c < 3; c++) {
+				clv.pos[c] = line[e * 3 + c];
+				clv.tangent[c] = line[next * 3 + c] - line[prev * 3 + c];
+				length += clv.tangent[c] * clv.tangent[c];
+			}
+			for(int c=0; c < 3 && length > 0; c++)
+				clv.tangent[c] /= sqrtf(length);
+			memcpy(clv.color, &m_particleColor.x, sizeof(clv.color));
+			clv.age = v * m_clStepsize;
+			clv.size = 0;
+		}
+	}
+	if(IsCLBufferQuantized()) {
+		// the lines have the uniform color, the ages are relative to the duration of the lines
+		float ageScale = (m_clLength - 1) * m_clStepsize;
+		std::vector<CompactEncoding::LineVertex> quantized(vertices.size());
+		for(size_t i=0; i < vertices.size(); i++)
+			quantized[i] = CompactEncoding::EncodeLineVertex(vertices[i].pos, vertices[i].tangent, vertices[i].age, ageScale, -1.f);
+		pContext->UpdateSubresource(m_pCharacteristicLineBuffer, 0, nullptr, quantized.data(), 0, 0);
+	}
+	else
+		pContext->UpdateSubresource(m_pCharacteristicLineBuffer, 0, nullptr, vertices.data(), 0, 0);
+
+	std::cout << "Pathlines done after " << GetTimeMs() - startTime << " ms, reached t = " << m_pathlines.time << std::endl;
+}
+
+// the ribbons are oriented along the vorticity, which comes from the Jacobians cached by the volume
+void ParticleTracer::SetJacobianResources(bool bind)
+{
+	if(bind)
+		m_volumeData.UpdateJacobians();
+	for(int slot=0; slot < 2; slot++) {
+		for(int i=0; i < 2; i++)
+			pJacobianEV[slot][i]->SetResource(bind ? m_volumeData.GetJacobianSRV(slot, i) : nullptr);
+	}
+}
+
 void ParticleTracer::ComputeStreaklines(ID3D11DeviceContext * pContext, float fElapsedTime)
 {
 	//std::cout << "Computing streaklines for probe [" << m_probeIndex << "]" << std::endl;
 
-	if(!m_pCharacteristicLineBuffer)
-		CreateCharacteristicLineGPUBuffer();
+	CreateCharacteristicLineGPUBuffer();
+	m_clNumVertices = 0;
+	m_surfaceNumIndices = 0;
 
 	pCLLengthEV->SetInt(m_clLength);
 	pCLStepsizeEV->SetFloat(m_clStepsize);
@@ -1103,6 +1784,7 @@ void ParticleTracer::ComputeStreaklines(ID3D11DeviceContext * pContext, float fE
 	pTexVolume1EV->SetResource(m_volumeData.GetTexture1SRV());
 	pParticleBufferEV->SetResource(m_pParticleBufferSRV);
 	pCharacteristicLineBufferRWEV->SetUnorderedAccessView(m_pCharacteristicLineBufferUAV);
+	SetJacobianResources(m_clRenderMode == CLRM_RIBBON);
 
 	if(m_colorParticlesByMetric) {
 		pScalarVolumeEV->SetResource(m_volumeData.GetScalarMetricVolume()->GetTexture0SRV());
@@ -1125,7 +1807,11 @@ void ParticleTracer::ComputeStreaklines(ID3D11DeviceContext * pContext, float fE
 	pParticleBufferEV->SetResource(nullptr);
 	pScalarVolumeEV->SetResource(nullptr);
 	pTransferFunctionEV->SetResource(nullptr);
-	pPasses[PASS_COMPUTE_STREAKLINE]->Apply(0, pContext);
+	SetJacobianResources(false);
+	if(m_clRenderMode != CLRM_RIBBON)
+		pPasses[PASS_COMPUTE_STREAKLINE]->Apply(0, pContext);
+	else
+		pPasses[PASS_COMPUTE_STREAKRIBBON]->Apply(0, pContext);
 
 	m_volumeDataChanged = false;
 }
@@ -1134,8 +1820,7 @@ void ParticleTracer::ComputeTriangleProperties(ID3D11DeviceContext * pContext)
 {
 	//std::cout << "Computing Triangle properties for probe [" << m_probeIndex << "]" << std::endl;
 
-	if(!m_pCharacteristicLineBuffer)
-		CreateCharacteristicLineGPUBuffer();
+	CreateCharacteristicLineGPUBuffer();
 	if(!m_pTrianglePropertiesBuffer)
 		CreateTrianglePropertiesBuffer();
 
@@ -1156,8 +1841,8 @@ void ParticleTracer::ComputeTriangleProperties(ID3D11DeviceContext * pContext)
 	if(m_clModeGUI == CL_STREAKLINES) {
 		pMaxParticleLifetimeEV->SetFloat((m_clLength - 1) * m_clReseedInterval);
 	}
-	if(m_clMode == CL_STREAMLINES) {
-		pMaxParticleLifetimeEV->SetFloat((m_clLength - 1) * m_clStepsize);
+	if(m_clMode == CL_STREAMLINES || m_clMode == CL_PATHLINES) {
+		pMaxParticleLifetimeEV->SetFloat(GetStreamlineLifetime());
 	}
 	if(m_seedingMode == SM_SURFACE)
 		pMaxParticleLifetimeEV->SetFloat(m_maxParticleLifetime);
@@ -1206,6 +1891,10 @@ void ParticleTracer::InitCharacteristicLineBuffer(void)
 		CreateParticleGPUBuffer();
 	if(!m_pCharacteristicLineBuffer)
 		CreateCharacteristicLineGPUBuffer();
+	if(IsCLBufferQuantized()) {
+		SAFE_RELEASE(pContext);
+		return;
+	}
 	
 
 	if(m_seedingMode == SM_SURFACE)
@@ -1252,7 +1941,7 @@ void ParticleTracer::InitCharacteristicLineBuffer(void)
 bool ParticleTracer::CLRequireRecompute(void) {
 
 	// for convenience, we disable some parameter combinations 
-	if(m_clRenderModeGUI == CLRM_SURFACE && m_seedingModeGUI == SM_RANDOM)
+	if(m_clRenderModeGUI == CLRM_SURFACE && (m_seedingModeGUI == SM_RANDOM || m_seedingModeGUI == SM_EVENLY_SPACED))
 		m_seedingModeGUI = SM_LINE;
 	if(m_seedingModeGUI == SM_SURFACE) {
 		m_clRenderModeGUI = CLRM_SURFACE;
@@ -1269,11 +1958,18 @@ bool ParticleTracer::CLRequireRecompute(void) {
 	bool recompute =	m_numParticles != m_numParticlesGUI ||
 						m_clMode != m_clModeGUI || 
 						m_clMode == CL_STREAKLINES || 
+						(m_clMode == CL_PATHLINES && m_clPathlineStart != m_clPathlineStartGUI) ||
 						m_colorParticlesByMetric != m_colorParticlesByMetricGUI ||
 						m_clLength != m_clLengthGUI || 
 						m_clRenderMode != m_clRenderModeGUI ||
 						(m_clRenderMode != CLRM_LINEPRIMITIVE && m_clWidth != m_clWidthGUI) ||
 						m_clStepsize != m_clStepsizeGUI ||
+						m_clAdaptive != m_clAdaptiveGUI ||
+						m_clCompact != m_clCompactGUI ||
+						m_clQuantized != m_clQuantizedGUI ||
+						m_surfaceAdaptive != m_surfaceAdaptiveGUI ||
+						(m_surfaceAdaptive && (m_surfaceEdgeRatio != m_surfaceEdgeRatioGUI || m_surfaceMaxAngle != m_surfaceMaxAngleGUI)) ||
+						(m_clAdaptive && (m_clTolerance != m_clToleranceGUI || m_clIntegrationTime != m_clIntegrationTimeGUI)) ||
 						m_seedingMode != m_seedingModeGUI ||
 						m_clReseedInterval != m_clReseedIntervalGUI ||
 
@@ -1288,9 +1984,16 @@ bool ParticleTracer::CLRequireRecompute(void) {
 
 						!XMFLOAT3_EQUAL(m_clRibbonBaseOrientation, m_clRibbonBaseOrientationGUI) || 
 						(!XMFLOAT4_EQUAL(m_particleColor, m_particleColorGUI) && !m_colorParticlesByMetric) ||
-						m_volumeDataChanged || 
+						// pathlines cover a fixed time span and don't follow the playback
+						(m_volumeDataChanged && m_clMode != CL_PATHLINES) || 
 						m_spawnRegionBox.changed;
 
+	// evenly spaced seeds depend on the field and the line parameters
+	if(m_seedingMode == SM_EVENLY_SPACED && (m_seedSeparation != m_seedSeparationGUI || m_spawnRegionBox.changed ||
+		m_clStepsize != m_clStepsizeGUI || m_clLength != m_clLengthGUI || m_volumeDataChanged))
+		m_seedsOutdated = true;
+	m_seedSeparation = m_seedSeparationGUI;
+
 	if(m_numParticles != m_numParticlesGUI ||
 		m_seedingMode != m_seedingModeGUI ||
 		(m_seedingMode != SM_RANDOM && m_spawnRegionBox.axisSurfaceChanged)  ||
@@ -1346,6 +2049,15 @@ bool ParticleTracer::CLRequireRecompute(void) {
 	m_clWidth = m_clWidthGUI;
 	m_clRenderMode = m_clRenderModeGUI;
 	m_clStepsize = m_clStepsizeGUI;
+	m_clAdaptive = m_clAdaptiveGUI;
+	m_clTolerance = m_clToleranceGUI;
+	m_clIntegrationTime = m_clIntegrationTimeGUI;
+	m_clPathlineStart = m_clPathlineStartGUI;
+	m_clCompact = m_clCompactGUI;
+	m_clQuantized = m_clQuantizedGUI;
+	m_surfaceAdaptive = m_surfaceAdaptiveGUI;
+	m_surfaceEdgeRatio = m_surfaceEdgeRatioGUI;
+	m_surfaceMaxAngle = m_surfaceMaxAngleGUI;
 	m_clRibbonBaseOrientation = m_clRibbonBaseOrientationGUI;
 	return recompute && m_clMode != CL_DISABLED;
 }
@@ -1410,14 +2122,15 @@ void ParticleTracer::DumpStreaklineInfo(unsigned int particles)
 
 	HRESULT hr;
 	unsigned int numParticles = std::min(particles, m_numParticles);
+	if(!m_pCharacteristicLineBuffer)
+		return;
+
+	// CopyResource needs the same size, compacted lines use m_clBufferVertices instead of m_clLength per line
 	D3D11_BUFFER_DESC desc;
-	ZeroMemory(&desc, sizeof(desc));
-	desc.StructureByteStride = sizeof(struct CharacteristicLineVertex);
-	desc.ByteWidth = m_numParticles * m_clLength * desc.StructureByteStride;
+	m_pCharacteristicLineBuffer->GetDesc(&desc);
 	desc.Usage = D3D11_USAGE_STAGING;
 	desc.BindFlags = 0;
 	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
 
 	ID3D11Buffer * pDLBuffer;
 	if(!SUCCEEDED(pd3dDevice->CreateBuffer(&desc, nullptr, &pDLBuffer)))
@@ -1431,23 +2144,59 @@ void ParticleTracer::DumpStreaklineInfo(unsigned int particles)
 	pd3dDevice->GetImmediateContext(&pContext);
 
 	pContext->CopyResource(pDLBuffer, m_pCharacteristicLineBuffer);
+
+	// first vertex of every line and the total at m_numParticles, from the last CountStreamlineVertices
+	std::vector<uint32_t> lineOffsets(m_numParticles + 1);
+	for(unsigned int i = 0; i <= m_numParticles; i++)
+		lineOffsets[i] = i * m_clLength;
+	if(m_clNumVertices && m_pLineOffsetsBuffer) {
+		D3D11_BUFFER_DESC offsetsDesc;
+		m_pLineOffsetsBuffer->GetDesc(&offsetsDesc);
+		offsetsDesc.Usage = D3D11_USAGE_STAGING;
+		offsetsDesc.BindFlags = 0;
+		offsetsDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+		ID3D11Buffer * pOffsetsBuffer;
+		D3D11_MAPPED_SUBRESOURCE offsets;
+		if(SUCCEEDED(pd3dDevice->CreateBuffer(&offsetsDesc, nullptr, &pOffsetsBuffer))) {
+			pContext->CopyResource(pOffsetsBuffer, m_pLineOffsetsBuffer);
+			if(SUCCEEDED(pContext->Map(pOffsetsBuffer, 0, D3D11_MAP_READ, 0, &offsets))) {
+				const uint32_t * o = static_cast<const uint32_t*>(offsets.pData);
+				lineOffsets.assign(o, o + m_numParticles + 1);
+				pContext->Unmap(pOffsetsBuffer, 0);
+			}
+			SAFE_RELEASE(pOffsetsBuffer);
+		}
+	}
 	
 	D3D11_MAPPED_SUBRESOURCE ms;
 	
 	hr = pContext->Map(pDLBuffer, NULL, D3D11_MAP_READ, NULL, &ms);
 	if(!SUCCEEDED(hr)) {
 		std::cout << "Mapping Unsuccessful!" << std::endl;
+		SAFE_RELEASE(pContext);
+		SAFE_RELEASE(pDLBuffer);
 		return;
 	}
 	
-	struct CharacteristicLineVertex * par = static_cast<struct CharacteristicLineVertex*>(ms.pData);
+	const struct CharacteristicLineVertex * vertices = static_cast<const struct CharacteristicLineVertex*>(ms.pData);
+	const CompactEncoding::LineVertex * quantized = static_cast<const CompactEncoding::LineVertex*>(ms.pData);
+	unsigned int bufferVertices = desc.ByteWidth / m_clBufferStride;
 	//dump particles to console
 	
 	std::cout << "Dumping first " << numParticles << " particles..." << std::endl;
 	for(unsigned int i=0; i < numParticles; i++) {
-		for(unsigned int j=0; j < m_clLength; j++) {
-			std::cout << "Pos: " << par->pos[0] << " " << par->pos[1] << " " << par->pos[2] << " | Age: " << par->age << " ++ ";
-			par++;
+		unsigned int end = std::min(lineOffsets[i + 1], bufferVertices);
+		for(unsigned int j = lineOffsets[i]; j < end; j++) {
+			if(IsCLBufferQuantized()) {
+				// quantized ages are relative to the lifetime of the lines
+				float pos[3], tangent[3], age, tfCoordinate;
+				CompactEncoding::DecodeLineVertex(quantized[j], 1.f, pos, tangent, age, tfCoordinate);
+				std::cout << "Pos: " << pos[0] << " " << pos[1] << " " << pos[2] << " | Age: " << age << " ++ ";
+				continue;
+			}
+			const struct CharacteristicLineVertex & v = vertices[j];
+			std::cout << "Pos: " << v.pos[0] << " " << v.pos[1] << " " << v.pos[2] << " | Age: " << v.age << " ++ ";
 		}
 		std::cout << std::endl;
 	}
@@ -1455,4 +2204,65 @@ void ParticleTracer::DumpStreaklineInfo(unsigned int particles)
 	pContext->Unmap(pDLBuffer, NULL);
 	SAFE_RELEASE(pContext);
 	SAFE_RELEASE(pDLBuffer);
+}
+
+// reads back the step counts of the last adaptive streamline computation and prints their histogram
+void ParticleTracer::DumpStepHistogram(void)
+{
+	if(!m_pStepCountBuffer) {
+		std::cout << "No adaptive streamlines computed yet!" << std::endl;
+		return;
+	}
+
+	D3D11_BUFFER_DESC desc;
+	m_pStepCountBuffer->GetDesc(&desc);
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+	ID3D11Buffer * pDLBuffer;
+	if(!SUCCEEDED(pd3dDevice->CreateBuffer(&desc, nullptr, &pDLBuffer)))
+	{
+		std::cout << "Buffer Creation unsuccessful!" << std::endl;
+		return;
+	}
+
+	ID3D11DeviceContext * pContext;
+	pd3dDevice->GetImmediateContext(&pContext);
+	pContext->CopyResource(pDLBuffer, m_pStepCountBuffer);
+
+	D3D11_MAPPED_SUBRESOURCE ms;
+	if(!SUCCEEDED(pContext->Map(pDLBuffer, NULL, D3D11_MAP_READ, NULL, &ms))) {
+		std::cout << "Mapping Unsuccessful!" << std::endl;
+		SAFE_RELEASE(pContext);
+		SAFE_RELEASE(pDLBuffer);
+		return;
+	}
+
+	// at most clLength - 1 steps fit into a line
+	const unsigned int numBins = 10;
+	unsigned int maxSteps = std::max(1u, m_clLength - 1);
+	unsigned int bins[numBins] = {0};
+	unsigned int minCount = UINT_MAX, maxCount = 0;
+	double sum = 0;
+	const uint32_t * counts = static_cast<const uint32_t*>(ms.pData);
+	unsigned int numLines = desc.ByteWidth / sizeof(uint32_t);
+	for(unsigned int i=0; i < numLines; i++) {
+		unsigned int c = std::min(counts[i], maxSteps);
+		bins[std::min(numBins - 1, c * numBins / maxSteps)]++;
+		minCount = std::min(minCount, c);
+		maxCount = std::max(maxCount, c);
+		sum += c;
+	}
+	pContext->Unmap(pDLBuffer, NULL);
+
+	std::cout << "Accepted steps of " << numLines << " streamlines (min " << minCount << ", avg " << sum / numLines << ", max " << maxCount 
+		<< ", " << m_clLength - 1 << " possible):" << std::endl;
+	for(unsigned int b=0; b < numBins; b++)
+		std::cout << "  [" << b * maxSteps / numBins << ", " << (b + 1) * maxSteps / numBins << (b == numBins - 1 ? "]: " : "): ") << bins[b] << std::endl;
+	if(bins[numBins - 1])
+		std::cout << "  lines in the last bin may be cut off, increase CL Length or the tolerance" << std::endl;
+
+	SAFE_RELEASE(pContext);
+	SAFE_RELEASE(pDLBuffer);
 }
\ No newline at end of file
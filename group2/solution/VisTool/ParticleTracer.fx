@@ -39,6 +39,7 @@ cbuffer cbParticleTracer
 	float4		g_particleColor;
 
 	bool		g_colorParticles;
+	uint		g_integrator;		// 0 Euler, 1 RK2 (midpoint), 2 RK4, same as AdvectionEngine
 };
 
 struct Particle {
@@ -51,6 +52,12 @@ struct Particle {
 Texture3D<float3> g_flowFieldTex0;
 Texture3D<float3> g_flowFieldTex1;
 
+// first eight entries of the cached Jacobians of VectorVolumeData, (00 01 02 10) and (11 12 20 21)
+Texture3D<float4> g_jacobianT0A;
+Texture3D<float4> g_jacobianT0B;
+Texture3D<float4> g_jacobianT1A;
+Texture3D<float4> g_jacobianT1B;
+
 Texture3D<float> g_scalarVolume;
 Texture1D<float4> g_transferFunction;
 
@@ -120,7 +127,20 @@ void CSAdvect(uint3 threadID: SV_DispatchThreadID)
 		g_particleBufferRW[pId].age = fmod(g_particleBufferRW[pId].age, g_maxParticleLifetime) + g_particleBufferRW[pId].ageSeed * g_maxParticleLifetime;
 	}
 
-	g_particleBufferRW[pId].pos = g_particleBufferRW[pId].pos + g_timeDelta * SampleFlowField(g_particleBufferRW[pId].pos) * g_velocityScaling;
+	float3 pos = g_particleBufferRW[pId].pos;
+	float3 h = g_timeDelta * g_velocityScaling;
+	if(g_integrator == 0)
+		pos += h * SampleFlowField(pos);
+	else if(g_integrator == 1)
+		pos += h * SampleFlowField(pos + 0.5 * h * SampleFlowField(pos));
+	else {
+		float3 k1 = SampleFlowField(pos);
+		float3 k2 = SampleFlowField(pos + 0.5 * h * k1);
+		float3 k3 = SampleFlowField(pos + 0.5 * h * k2);
+		float3 k4 = SampleFlowField(pos + h * k3);
+		pos += h / 6. * (k1 + 2. * (k2 + k3) + k4);
+	}
+	g_particleBufferRW[pId].pos = pos;
 	g_particleBufferRW[pId].age += g_timeDelta;
 }
 
@@ -144,8 +164,21 @@ cbuffer cbCharacteristicLine {
 	bool		g_enableSurfaceLighting;
 	bool		g_enableTimeSurfaces;
 	uint		g_numTimeSurfaces;
+	bool		g_clAdaptive;			// Dormand-Prince steps with error control for streamlines
+	float		g_clTolerance;			// allowed position error per step in texture space
+	float		g_clIntegrationTime;	// length of adaptive streamlines in integration time
+	bool		g_clCompacted;			// lines stored back to back, see CSCountStreamline
+	uint		g_clNumVertices;		// total number of vertices in the compacted layout
+	bool		g_clQuantized;			// lines in g_characteristicLineBufferQ, see LoadCLVertex
+	bool		g_clLimitLengths;		// streamlines end at g_clLineLengthLimits (evenly spaced seeding)
 };
 
+// number of rejected steps after which an adaptive step is taken anyway
+#define CL_MAX_STEP_TRIES 8
+// streamlines end where a nominal step would move less than this in texture space
+#define CL_STAGNATION_DISTANCE 1e-6
+#define CL_SCAN_GROUP_SIZE 1024
+
 struct CLVertex {
 	float3 pos;
 	float3 dir; //for ribbons, this is the tangent; for surfaces, this is the normal
@@ -157,6 +190,86 @@ struct CLVertex {
 StructuredBuffer<CLVertex> g_characteristicLineBuffer;
 RWStructuredBuffer<CLVertex> g_characteristicLineBufferRW;
 
+// quantized layout of CompactEncoding::LineVertex for streamlines and pathlines drawn as lines or tubes:
+// x | y << 16 and z | age << 16 as unorm16 (the age relative to the lifetime of the lines), the octahedral
+// tangent as snorm16 u | v << 16 and the transfer function coordinate | CL_COLOR_FROM_TF or 0 for g_particleColor
+#define CL_COLOR_FROM_TF (1u << 16)
+StructuredBuffer<uint4> g_characteristicLineBufferQ;
+RWStructuredBuffer<uint4> g_characteristicLineBufferQRW;
+RWBuffer<uint> g_clStepCountsRW;	// accepted adaptive steps per line
+RWBuffer<uint> g_clLineOffsetsRW;	// compacted layout: first vertex of every line, the total at g_numParticles
+Buffer<uint> g_clLineLengthLimits;	// maximum number of vertices per line
+groupshared uint gs_clScan[CL_SCAN_GROUP_SIZE];
+
+uint PackUnit2(float2 v)
+{
+	uint2 q = (uint2)round(saturate(v) * 65535);
+	return q.x | q.y << 16;
+}
+
+float2 UnpackUnit2(uint q)
+{
+	return float2(q & 0xffff, q >> 16) / 65535;
+}
+
+uint EncodeOctahedral(float3 n)
+{
+	float l1 = dot(abs(n), 1);
+	float2 e = l1 > 0 ? n.xy / l1 : (float2)0;
+	if(n.z < 0)
+		e = (1 - abs(e.yx)) * (e >= 0 ? 1 : -1);
+	int2 s = (int2)round(clamp(e, -1, 1) * 32767);
+	return ((uint)s.x & 0xffff) | (uint)s.y << 16;
+}
+
+float3 DecodeOctahedral(uint e)
+{
+	float2 f = max(float2((int)(e << 16) >> 16, (int)e >> 16) / 32767, -1);
+	float3 n = float3(f, 1 - abs(f.x) - abs(f.y));
+	if(n.z < 0)
+		n.xy = (1 - abs(f.yx)) * (f >= 0 ? 1 : -1);
+	return normalize(n);
+}
+
+// reads a vertex from the buffer of the bound layout, quantized ages are relative and only good for ordering
+CLVertex LoadCLVertex(uint index)
+{
+	if(!g_clQuantized)
+		return g_characteristicLineBuffer[index];
+
+	uint4 q = g_characteristicLineBufferQ[index];
+	float2 zAge = UnpackUnit2(q.y);
+	CLVertex v;
+	v.pos = float3(UnpackUnit2(q.x), zAge.x);
+	v.dir = DecodeOctahedral(q.z);
+	if(q.w & CL_COLOR_FROM_TF)
+		v.color = g_transferFunction.SampleLevel(samLinear, (q.w & 0xffff) / 65535.0, 0);
+	else
+		v.color = g_particleColor;
+	v.age = zAge.y;
+	v.size = 0;
+	return v;
+}
+
+// writes a streamline vertex in the bound layout, the quantized age is relative to g_maxParticleLifetime
+void StoreStreamlineVertex(uint index, float3 pos, float age)
+{
+	if(g_clQuantized) {
+		uint color = 0;
+		if(g_colorParticles)
+			color = (uint)round(saturate(g_scalarVolume.SampleLevel(samLinear, pos, 0)) * 65535) | CL_COLOR_FROM_TF;
+		g_characteristicLineBufferQRW[index] = uint4(PackUnit2(pos.xy), PackUnit2(float2(pos.z, age / g_maxParticleLifetime)), 0, color);
+		return;
+	}
+
+	g_characteristicLineBufferRW[index].pos = pos;
+	g_characteristicLineBufferRW[index].age = age;
+	if(g_colorParticles)
+		g_characteristicLineBufferRW[index].color = g_transferFunction.SampleLevel(samLinear, g_scalarVolume.SampleLevel(samLinear, pos, 0), 0);
+	else
+		g_characteristicLineBufferRW[index].color = g_particleColor;
+}
+
 struct PSIn_CharacteristicLineVertex {
 	float4 pos : SV_POSITION;
 	float3 col : COLOR;
@@ -175,18 +288,33 @@ struct PSIn_CharacteristicRibbon {
 	float3 nor : NORMAL;
 };
 
+// the line draw calls use g_clLength + 1 vertex ids per line in the fixed layout, the last one ends the strip
+// in the compacted layout the ids are the buffer indices and lines are only separated by the age test
+uint CLLineId(uint vertexID)
+{
+	return g_clCompacted ? 0 : vertexID / (g_clLength + 1);
+}
+
+// buffer index of the vertex offset positions after vertexID, wrapping within the line or clamped to the buffer
+uint CLVertexIndex(uint vertexID, int offset)
+{
+	if(g_clCompacted)
+		return (uint)clamp((int)vertexID + offset, 0, (int)g_clNumVertices - 1);
+	int vIdx = vertexID % (g_clLength + 1);
+	return CLLineId(vertexID) * g_clLength + (uint)(vIdx + offset + (int)g_clLength) % g_clLength;
+}
+
 PSIn_CharacteristicLineVertex vsCharacteristicLine(uint vertexID : SV_VertexID)
 {
-	uint lineId = vertexID / (g_clLength + 1);
-	uint vIdx = vertexID % (g_clLength + 1);
-	uint clVertexIndex = lineId * g_clLength + (vIdx % g_clLength);
+	uint clVertexIndex = CLVertexIndex(vertexID, 0);
+	bool hasNext = g_clCompacted ? vertexID + 1 < g_clNumVertices : vertexID % (g_clLength + 1) != g_clLength;
 
 	PSIn_CharacteristicLineVertex clv;
-	float3 v = g_characteristicLineBuffer[clVertexIndex].pos;
+	CLVertex v = LoadCLVertex(clVertexIndex);
 	
-	clv.pos = mul(float4(v, 1), g_modelWorldViewProj);
-	clv.col = g_characteristicLineBuffer[clVertexIndex].color.rgb;
-	clv.sameStrip = vIdx != g_clLength && (g_characteristicLineBuffer[clVertexIndex].age > g_characteristicLineBuffer[clVertexIndex+1].age);
+	clv.pos = mul(float4(v.pos, 1), g_modelWorldViewProj);
+	clv.col = v.color.rgb;
+	clv.sameStrip = hasNext && (v.age > LoadCLVertex(CLVertexIndex(vertexID, 1)).age);
 	
 	return clv;
 }
@@ -208,13 +336,12 @@ GSIn_CharacteristicRibbon vsCharacteristicRibbon(uint vertexID : SV_VertexID)
 
 [maxvertexcount(4)] 
 void gsExtrudeRibbon(line GSIn_CharacteristicRibbon gsIn[2], inout TriangleStream<PSIn_CharacteristicRibbon> stream) {
-	uint lineId1 = gsIn[0].vertexID / (g_clLength + 1);
-	uint lineId2 = gsIn[1].vertexID / (g_clLength + 1);
-	uint vIdx1 = gsIn[0].vertexID % (g_clLength + 1);
-	uint clVertexIndex0 = lineId1 * g_clLength + ((vIdx1 - 1 + g_clLength) % g_clLength);
-	uint clVertexIndex1 = lineId1 * g_clLength +  (vIdx1 % g_clLength);
-	uint clVertexIndex2 = lineId1 * g_clLength + ((vIdx1 + 1) % g_clLength);
-	uint clVertexIndex3 = lineId1 * g_clLength + ((vIdx1 + 2) % g_clLength);
+	uint lineId1 = CLLineId(gsIn[0].vertexID);
+	uint lineId2 = CLLineId(gsIn[1].vertexID);
+	uint clVertexIndex0 = CLVertexIndex(gsIn[0].vertexID, -1);
+	uint clVertexIndex1 = CLVertexIndex(gsIn[0].vertexID, 0);
+	uint clVertexIndex2 = CLVertexIndex(gsIn[0].vertexID, 1);
+	uint clVertexIndex3 = CLVertexIndex(gsIn[0].vertexID, 2);
 
 	CLVertex v0 = g_characteristicLineBuffer[clVertexIndex0];
 	CLVertex v1 = g_characteristicLineBuffer[clVertexIndex1];
@@ -313,14 +440,13 @@ GSIn_CamOrientedSprite vsTubeEndCap(uint vertexID : SV_VertexID)
 [maxvertexcount(36)]
 void gsExtrudeBBox(line GSIn_CharacteristicRibbon gsIn[2], inout TriangleStream<PSIn_RTPill> stream)
 {
-	uint lineId0 = gsIn[0].vertexID / (g_clLength + 1);
-	uint lineId1 = gsIn[1].vertexID / (g_clLength + 1);
-	uint vIdx0 = gsIn[0].vertexID % (g_clLength + 1);
-	uint clVertexIndex0 = lineId0 * g_clLength + (vIdx0 % g_clLength);
-	uint clVertexIndex1 = lineId0 * g_clLength + ((vIdx0 + 1) % g_clLength);
+	uint lineId0 = CLLineId(gsIn[0].vertexID);
+	uint lineId1 = CLLineId(gsIn[1].vertexID);
+	uint clVertexIndex0 = CLVertexIndex(gsIn[0].vertexID, 0);
+	uint clVertexIndex1 = CLVertexIndex(gsIn[0].vertexID, 1);
 
-	CLVertex v0 = g_characteristicLineBuffer[clVertexIndex0];
-	CLVertex v1 = g_characteristicLineBuffer[clVertexIndex1];
+	CLVertex v0 = LoadCLVertex(clVertexIndex0);
+	CLVertex v1 = LoadCLVertex(clVertexIndex1);
 
 	//we don't want to connect different lines
 	if(lineId0 != lineId1)
@@ -643,21 +769,53 @@ float4 psSurfaceSolid(PSIn_CharacteristicSurface v) : SV_Target
 	return v.col;
 }
 
-/////////////////////////////////////////////////////////
-//		Characteristic Line Compute Shaders
-/////////////////////////////////////////////////////////
-float3 SampleVectorDeriv(float3 pos, float3 step)
+// the adaptive surface from IntegralSurface is drawn indexed straight from the characteristic line buffer,
+// dir is the normal scaled such that g_modelWorld maps it to world space and size is the fade
+PSIn_CharacteristicSurface vsAdaptiveSurface(uint vertexID : SV_VertexID)
 {
-	return SampleFlowField(pos + step) - SampleFlowField(pos - step);
+	CLVertex v = g_characteristicLineBuffer[vertexID];
+
+	PSIn_CharacteristicSurface o;
+	o.pos = mul(float4(v.pos, 1), g_modelWorldViewProj);
+	o.worldPos = mul(float4(v.pos, 1), g_modelWorld);
+	o.worldPos /= o.worldPos.w;
+	o.nor = normalize(mul(float4(v.dir, 0), g_modelWorld).xyz);
+	if(g_colorParticles) {
+		o.col = g_transferFunction.SampleLevel(samLinear, g_scalarVolume.SampleLevel(samLinear, v.pos, 0), 0);
+		o.col.w *= v.size;
+	}
+	else
+		o.col = v.color;
+#if ALPHA_DENSITY_PER_PIXEL
+	o.invMaxArea = 0;
+#endif
+#if SURFACE_CLIPPING_PER_PIXEL
+	o.volPos = v.pos;
+#endif
+	return o;
 }
 
+RasterizerState WireframeCullNone
+{
+	CullMode = None;
+	FillMode = Wireframe;
+};
+
+/////////////////////////////////////////////////////////
+//		Characteristic Line Compute Shaders
+/////////////////////////////////////////////////////////
+// curl from the interpolated Jacobian, only the direction is used for the ribbons
 float3 SampleVorticity(float3 pos)
 {
-	float3 ux = SampleVectorDeriv(pos, float3(1, 0, 0));
-	float3 uy = SampleVectorDeriv(pos, float3(0, 1, 0));
-	float3 uz = SampleVectorDeriv(pos, float3(0, 0, 1));
+	float4 a = g_jacobianT0A.SampleLevel(samLinear, pos, 0);
+	float4 b = g_jacobianT0B.SampleLevel(samLinear, pos, 0);
+	if(g_timestepT != 0) {
+		a = lerp(a, g_jacobianT1A.SampleLevel(samLinear, pos, 0), g_timestepT);
+		b = lerp(b, g_jacobianT1B.SampleLevel(samLinear, pos, 0), g_timestepT);
+	}
 	
-	return float3(uz.y - uy.z, ux.z - uz.x, uy.x - ux.y);
+	// (J21 - J12, J02 - J20, J10 - J01)
+	return float3(b.w - b.y, a.z - b.z, a.w - a.y);
 }
 
 [numthreads(256,1,1)]	
@@ -679,36 +837,169 @@ void CSInitCharacteristicLine(uint3 threadID: SV_DispatchThreadID)
 	g_characteristicLineBufferRW[pId].color = g_particleColor;
 }
 
+float3 StreamlineVelocity(float3 pos)
+{
+	return SampleFlowField(pos) * g_velocityScaling;
+}
+
+// one Dormand-Prince 5(4) step of size h starting with the velocity k1 at pos
+// returns the 5th order position, k7 is the velocity there (first stage of the next step)
+// and error the largest component of the difference to the embedded 4th order solution
+float3 DormandPrinceStep(float3 pos, float3 k1, float h, out float3 k7, out float error)
+{
+	float3 k2 = StreamlineVelocity(pos + h * (1./5. * k1));
+	float3 k3 = StreamlineVelocity(pos + h * (3./40. * k1 + 9./40. * k2));
+	float3 k4 = StreamlineVelocity(pos + h * (44./45. * k1 - 56./15. * k2 + 32./9. * k3));
+	float3 k5 = StreamlineVelocity(pos + h * (19372./6561. * k1 - 25360./2187. * k2 + 64448./6561. * k3 - 212./729. * k4));
+	float3 k6 = StreamlineVelocity(pos + h * (9017./3168. * k1 - 355./33. * k2 + 46732./5247. * k3 + 49./176. * k4 - 5103./18656. * k5));
+	float3 next = pos + h * (35./384. * k1 + 500./1113. * k3 + 125./192. * k4 - 2187./6784. * k5 + 11./84. * k6);
+	k7 = StreamlineVelocity(next);
+
+	float3 e = h * (71./57600. * k1 - 71./16695. * k3 + 71./1920. * k4 - 17253./339200. * k5 + 22./525. * k6 - 1./40. * k7);
+	error = max(abs(e.x), max(abs(e.y), abs(e.z)));
+	return next;
+}
+
+// advances a streamline to its next vertex, k1 is the velocity at pos, h, t and steps the adaptive state
+// returns false and leaves the state unchanged if the line ends: outside the volume, at a stagnation point
+// or (adaptive) at g_clIntegrationTime
+bool StreamlineStep(inout float3 pos, inout float3 k1, inout float h, inout float t, inout uint steps)
+{
+	bool inside = all(max(pos, float3(0,0,0))) 
+		&& !any(max(pos, float3(1,1,1)) - float3(1,1,1));
+	if(!inside || length(k1) * g_clStepsize < CL_STAGNATION_DISTANCE)
+		return false;
+
+	if(!g_clAdaptive) {
+		pos = pos + g_clStepsize * k1;
+		k1 = StreamlineVelocity(pos);
+		return true;
+	}
+
+	if(t >= g_clIntegrationTime)
+		return false;
+	float hMin = 0.01 * g_clStepsize;
+	[loop]
+	for(uint tries=0; tries < CL_MAX_STEP_TRIES; tries++) {
+		h = min(h, g_clIntegrationTime - t);
+		float3 k7;
+		float error;
+		float3 next = DormandPrinceStep(pos, k1, h, k7, error);
+		float scale = 0.9 * pow(g_clTolerance / max(error, 1e-12), 0.2);
+		if(error <= g_clTolerance || h <= hMin || tries == CL_MAX_STEP_TRIES - 1) {
+			pos = next;
+			k1 = k7;
+			t += h;
+			steps++;
+			h = max(hMin, h * min(scale, 5.));
+			break;
+		}
+		h = max(hMin, h * max(scale, 0.2));
+	}
+	return true;
+}
+
+uint StreamlineMaxVertices(uint pId)
+{
+	return g_clLimitLengths ? min(g_clLength, g_clLineLengthLimits[pId]) : g_clLength;
+}
+
+// first pass of the compacted storage: number of vertices of every streamline
 [numthreads(256,1,1)]	
-void CSComputeStreamline(uint3 threadID: SV_DispatchThreadID)
+void CSCountStreamline(uint3 threadID: SV_DispatchThreadID)
 {
 	uint pId = threadID.x;
 	if(pId >= g_numParticles)
 		return;
 
-	uint pOffset = (pId+1) * g_clLength - 1;
 	float3 pos = g_particleBuffer[pId].seedPos*(g_spawnRegionMax - g_spawnRegionMin) + g_spawnRegionMin;
-	g_characteristicLineBufferRW[pOffset].pos = pos;
-	g_characteristicLineBufferRW[pOffset].age = 0;
-	if(g_colorParticles)
-		g_characteristicLineBufferRW[pOffset].color = g_transferFunction.SampleLevel(samLinear, g_scalarVolume.SampleLevel(samLinear, pos, 0), 0);
-	else
-		g_characteristicLineBufferRW[pOffset].color = g_particleColor;
+	float3 k1 = StreamlineVelocity(pos);
+	float h = g_clStepsize;
+	float t = 0;
+	uint steps = 0;
+	uint maxVertices = StreamlineMaxVertices(pId);
+	uint numVertices = 1;
+	[loop]
+	while(numVertices < maxVertices && StreamlineStep(pos, k1, h, t, steps))
+		numVertices++;
+
+	g_clLineOffsetsRW[pId] = numVertices;
+}
 
-	for(unsigned int i=1; i < g_clLength; i++) {
-		if(all(max(pos, float3(0,0,0))) 
-			&& !any(max(pos, float3(1,1,1)) - float3(1,1,1)))
-				pos = pos + g_clStepsize * SampleFlowField(pos) * g_velocityScaling;	
+// second pass: exclusive prefix sum over the line lengths in g_clLineOffsetsRW, run as a single group
+// every thread sums a contiguous chunk of lines, the chunk sums are scanned in shared memory
+// g_clLineOffsetsRW[g_numParticles] receives the total number of vertices
+[numthreads(CL_SCAN_GROUP_SIZE,1,1)]
+void CSScanLineLengths(uint3 threadID: SV_GroupThreadID)
+{
+	uint chunk = (g_numParticles + CL_SCAN_GROUP_SIZE - 1) / CL_SCAN_GROUP_SIZE;
+	uint begin = min(threadID.x * chunk, g_numParticles);
+	uint end = min(begin + chunk, g_numParticles);
+
+	uint sum = 0;
+	for(uint i = begin; i < end; i++)
+		sum += g_clLineOffsetsRW[i];
+	gs_clScan[threadID.x] = sum;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for(uint d = 1; d < CL_SCAN_GROUP_SIZE; d <<= 1) {
+		uint partial = threadID.x >= d ? gs_clScan[threadID.x - d] : 0;
+		GroupMemoryBarrierWithGroupSync();
+		gs_clScan[threadID.x] += partial;
+		GroupMemoryBarrierWithGroupSync();
+	}
 
-		g_characteristicLineBufferRW[pOffset - i].pos = pos;		
-		g_characteristicLineBufferRW[pOffset - i].age = g_maxParticleLifetime * (float)i/(float)g_clLength;
+	uint offset = gs_clScan[threadID.x] - sum;
+	for(uint j = begin; j < end; j++) {
+		uint lineLength = g_clLineOffsetsRW[j];
+		g_clLineOffsetsRW[j] = offset;
+		offset += lineLength;
+	}
+	if(threadID.x == CL_SCAN_GROUP_SIZE - 1)
+		g_clLineOffsetsRW[g_numParticles] = gs_clScan[threadID.x];
+}
 
-		if(g_colorParticles)
-			g_characteristicLineBufferRW[pOffset - i].color = g_transferFunction.SampleLevel(samLinear, g_scalarVolume.SampleLevel(samLinear, pos, 0), 0);
-		else
-			g_characteristicLineBufferRW[pOffset - i].color = g_particleColor;
+// fixed layout: g_clLength vertices per line, a line that ended repeats its last vertex
+// compacted layout (third pass): only the vertices counted by CSCountStreamline at the scanned offset
+// both store a line from its end to the seed, so the age decreases along the buffer within a line
+[numthreads(256,1,1)]	
+void CSComputeStreamline(uint3 threadID: SV_DispatchThreadID)
+{
+	uint pId = threadID.x;
+	if(pId >= g_numParticles)
+		return;
+
+	uint numVertices = g_clLength;
+	uint maxVertices = StreamlineMaxVertices(pId);
+	uint pOffset = (pId+1) * g_clLength - 1;
+	if(g_clCompacted) {
+		numVertices = g_clLineOffsetsRW[pId + 1] - g_clLineOffsetsRW[pId];
+		pOffset = g_clLineOffsetsRW[pId] + numVertices - 1;
 	}
 
+	float3 pos = g_particleBuffer[pId].seedPos*(g_spawnRegionMax - g_spawnRegionMin) + g_spawnRegionMin;
+	StoreStreamlineVertex(pOffset, pos, 0);
+
+	// adaptive state: the step size is kept between vertices, only accepted steps become vertices
+	float h = g_clStepsize;
+	float t = 0;
+	uint steps = 0;
+	float3 k1 = StreamlineVelocity(pos);
+	float age = 0;
+
+	for(unsigned int i=1; i < numVertices; i++) {
+		// beyond the length limit the last vertex is repeated with the same age, which hides these segments
+		if(i < maxVertices) {
+			StreamlineStep(pos, k1, h, t, steps);
+			age = g_clAdaptive ? t : g_maxParticleLifetime * (float)i/(float)g_clLength;
+		}
+
+		StoreStreamlineVertex(pOffset - i, pos, age);
+	}
+
+	if(g_clAdaptive)
+		g_clStepCountsRW[pId] = steps;
 }
 
 [numthreads(256,1,1)]	
@@ -1170,6 +1461,26 @@ technique11 ParticleTracer
 		SetBlendState(BlendDisable, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF);
 	}
 
+	pass PASS_RENDER_ADAPTIVE_SURFACE
+	{
+		SetVertexShader(CompileShader(vs_5_0, vsAdaptiveSurface()));
+		SetGeometryShader(NULL);
+		SetPixelShader(CompileShader(ps_5_0, psSurface()));
+		SetRasterizerState(CullNone);
+		SetDepthStencilState(SURFACE_DEPTH_TEST, 0);
+		SetBlendState(BlendDisableAll, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF);
+	}
+
+	pass PASS_RENDER_ADAPTIVE_SURFACE_WIREFRAME
+	{
+		SetVertexShader(CompileShader(vs_5_0, vsAdaptiveSurface()));
+		SetGeometryShader(NULL);
+		SetPixelShader(CompileShader(ps_5_0, psSurfaceSolid()));
+		SetRasterizerState(WireframeCullNone);
+		SetDepthStencilState(DepthDefault, 0);
+		SetBlendState(BlendDisable, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF);
+	}
+
 	pass PASS_ADVECT
 	{
 		SetComputeShader(CompileShader(cs_5_0, CSAdvect()));
@@ -1178,6 +1489,14 @@ technique11 ParticleTracer
 	{
 		SetComputeShader(CompileShader(cs_5_0, CSComputeStreamline()));
 	}
+	pass PASS_COUNT_STREAMLINE
+	{
+		SetComputeShader(CompileShader(cs_5_0, CSCountStreamline()));
+	}
+	pass PASS_SCAN_LINE_LENGTHS
+	{
+		SetComputeShader(CompileShader(cs_5_0, CSScanLineLengths()));
+	}
 	pass PASS_COMPUTE_STREAMRIBBON
 	{
 		SetComputeShader(CompileShader(cs_5_0, CSComputeStreamRibbon()));
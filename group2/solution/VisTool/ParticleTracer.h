@@ -7,6 +7,9 @@
 #include "SettingsStorage.h"
 #include "VectorVolumeData.h"
 #include "BoxManipulationManager.h"
+#include "AdvectionEngine.h"
+#include "IntegralSurface.h"
+#include "CompactEncoding.h"
 #include "TransferFunctionEditor\TransferFunctionEditor.h"
 
 #include <DirectXMath.h>
@@ -18,6 +21,7 @@ using namespace DirectX;
 #include "AntTweakBar.h"
 
 #include <list>
+#include <vector>
 
 extern TransferFunctionEditor	* g_transferFunctionEditor;
 extern BoxManipulationManager	* g_boxManipulationManager;
@@ -36,6 +40,8 @@ public:
 		PASS_RENDER_TUBE_CYLINDERS,
 		PASS_RENDER_SURFACE,
 		PASS_RENDER_SURFACE_WIREFRAME,
+		PASS_RENDER_ADAPTIVE_SURFACE,
+		PASS_RENDER_ADAPTIVE_SURFACE_WIREFRAME,
 		PASS_COMPUTE_STREAMLINE,
 		PASS_COMPUTE_STREAMRIBBON,
 		PASS_COMPUTE_STREAKLINE,
@@ -43,6 +49,8 @@ public:
 		PASS_INIT_CHARACTERISTIC_LINE,
 		PASS_COMPUTE_SURFACE_VERTEX_METRICS,
 		PASS_COMPUTE_TRIANGLE_PROPERTIES,
+		PASS_COUNT_STREAMLINE,
+		PASS_SCAN_LINE_LENGTHS,
 		NUM_PASSES
 	};
 	enum CharacteristicLineMode {
@@ -60,7 +68,8 @@ public:
 	enum SeedingMode {
 		SM_RANDOM,
 		SM_LINE,
-		SM_SURFACE
+		SM_SURFACE,
+		SM_EVENLY_SPACED	// streamlines at m_seedSeparation, see StreamlinePlacement
 	};
 
 	// static variables
@@ -83,6 +92,7 @@ public:
 	// methods
 	void DumpParticleInfo(unsigned int numParticles);	//Debugging helper
 	void DumpStreaklineInfo(unsigned int numParticles);	//Debugging helper
+	void DumpStepHistogram(void);						//prints the accepted steps per adaptive streamline
 	virtual void notify(Observable * volumeData);
 	
 	// accessors
@@ -120,6 +130,7 @@ protected:
 	static void TW_CALL SetCLLengthCB(const void *value, void *clientData);
 	static void TW_CALL GetCLLengthCB(void *value, void *clientData);
 	static void TW_CALL RemoveParticleProbeCB(void * clientData);
+	static void TW_CALL DumpStepHistogramCB(void * clientData);
 	static void SetupTwBar(TwBar* pParametersBar);
 
 	// statics
@@ -145,6 +156,7 @@ protected:
 
 	static ID3DX11EffectScalarVariable	* pTimestepTEV;
 	static ID3DX11EffectScalarVariable	* pTimeDeltaEV;
+	static ID3DX11EffectScalarVariable	* pIntegratorEV;
 	static ID3DX11EffectVectorVariable	* pVelocityScalingEV;
 	static ID3DX11EffectVectorVariable	* pRndEV;
 	static ID3DX11EffectScalarVariable	* pMaxParticleLifetimeEV;
@@ -168,6 +180,16 @@ protected:
 	static ID3DX11EffectScalarVariable	* pCLWidthEV;
 	static ID3DX11EffectVectorVariable	* pCLRibbonBaseOrientationEV;
 	static ID3DX11EffectScalarVariable	* pCLReseedIntervalEV;
+	static ID3DX11EffectScalarVariable	* pCLAdaptiveEV;
+	static ID3DX11EffectScalarVariable	* pCLToleranceEV;
+	static ID3DX11EffectScalarVariable	* pCLIntegrationTimeEV;
+	static ID3DX11EffectUnorderedAccessViewVariable	* pCLStepCountsRWEV;
+	static ID3DX11EffectScalarVariable	* pCLCompactedEV;
+	static ID3DX11EffectScalarVariable	* pCLNumVerticesEV;
+	static ID3DX11EffectScalarVariable	* pCLQuantizedEV;
+	static ID3DX11EffectUnorderedAccessViewVariable	* pCLLineOffsetsRWEV;
+	static ID3DX11EffectScalarVariable	* pCLLimitLengthsEV;
+	static ID3DX11EffectShaderResourceVariable	* pCLLineLengthLimitsEV;
 
 	static ID3DX11EffectScalarVariable	* pCLEnableSurfaceLighting;
 	static ID3DX11EffectScalarVariable	* pCLEnableAlphaDensity;
@@ -183,10 +205,13 @@ protected:
 
 	static ID3DX11EffectShaderResourceVariable	* pTexVolume0EV;
 	static ID3DX11EffectShaderResourceVariable	* pTexVolume1EV;
+	static ID3DX11EffectShaderResourceVariable	* pJacobianEV[2][2];
 	static ID3DX11EffectShaderResourceVariable	* pParticleBufferEV;
 	static ID3DX11EffectUnorderedAccessViewVariable	* pParticleBufferRWEV;
 	static ID3DX11EffectShaderResourceVariable	* pCharacteristicLineBufferEV;
 	static ID3DX11EffectUnorderedAccessViewVariable	* pCharacteristicLineBufferRWEV;
+	static ID3DX11EffectShaderResourceVariable	* pCharacteristicLineBufferQEV;
+	static ID3DX11EffectUnorderedAccessViewVariable	* pCharacteristicLineBufferQRWEV;
 	static ID3DX11EffectShaderResourceVariable	* pTrianglePropertiesEV;
 	static ID3DX11EffectUnorderedAccessViewVariable	* pTrianglePropertiesRWEV;
 	
@@ -197,19 +222,42 @@ protected:
 
 	// methods
 	HRESULT CreateParticleGPUBuffer();
-	HRESULT CreateCharacteristicLineGPUBuffer();
+	HRESULT CreateCharacteristicLineGPUBuffer(unsigned int numVertices = 0);
 	HRESULT CreateTrianglePropertiesBuffer();
+	HRESULT CreateStepCountBuffer();
+	HRESULT CreateLineOffsetsBuffer();
+	HRESULT CreateLineLengthLimitBuffer();
+	HRESULT CreateSurfaceIndexBuffer(unsigned int numIndices);
 	void SaveConfig(SettingsStorage &store, std::string id);
 	void LoadConfig(SettingsStorage &store, std::string id);
 	HRESULT RenderInstance(ID3D11DeviceContext* pd3dImmediateContext, RenderTransformations sceneMtcs);
 	HRESULT RenderTransparencyInstance(ID3D11DeviceContext* pd3dImmediateContext, RenderTransformations sceneMtcs);
 	void PrepareRenderEnvironment(ID3D11DeviceContext* pd3dImmediateContext, RenderTransformations sceneMtcs);
 	void FrameMoveInstance(double dTime, float fElapsedTime, float fElapsedLogicTime);
+	bool SetAdvectionFields(void);
+	bool AdvectOnCPU(ID3D11DeviceContext * pContext, float timeDelta, const XMFLOAT3 & spawnRegionMin, const XMFLOAT3 & spawnRegionMax);
+	void PlaceEvenlySpacedSeeds(ID3D11DeviceContext * pContext);
 	void ComputeStreamlines(ID3D11DeviceContext * pContext);
+	bool ComputeAdaptiveSurface(ID3D11DeviceContext * pContext);
+	unsigned int CountStreamlineVertices(ID3D11DeviceContext * pContext);
 	void ComputeStreaklines(ID3D11DeviceContext * pContext, float fElapsedTime);
+	void ComputePathlines(ID3D11DeviceContext * pContext);
+	void SetJacobianResources(bool bind);
 	void ComputeTriangleProperties(ID3D11DeviceContext * pContext);
 	void InitCharacteristicLineBuffer(void);
 	bool CLRequireRecompute(void);
+	// ribbons advect two points per vertex and always use fixed steps
+	bool UseAdaptiveStreamlines(void) {	return m_clMode == CL_STREAMLINES && m_clAdaptive && m_clRenderMode != CLRM_RIBBON;	};
+	float GetStreamlineLifetime(void) {	return UseAdaptiveStreamlines() ? m_clIntegrationTime : (m_clLength - 1) * m_clStepsize;	};
+	// ribbons and surfaces need the fixed layout of m_clLength vertices per line
+	bool UseCompactedStreamlines(void) {	return m_clMode == CL_STREAMLINES && m_clCompact && (m_clRenderMode == CLRM_LINEPRIMITIVE || m_clRenderMode == CLRM_TUBE);	};
+	// stream surfaces from the seed line, streak surfaces keep the fixed triangulation
+	bool UseAdaptiveSurface(void) {	return m_clMode == CL_STREAMLINES && m_clRenderMode == CLRM_SURFACE && m_seedingMode == SM_LINE && m_surfaceAdaptive;	};
+	// the quantized layout of CompactEncoding, ribbons need the full tangents and streak lines and surfaces are advanced in place
+	bool UseQuantizedLines(void) {	return m_clQuantized && (m_clMode == CL_STREAMLINES || m_clMode == CL_PATHLINES) && (m_clRenderMode == CLRM_LINEPRIMITIVE || m_clRenderMode == CLRM_TUBE);	};
+	unsigned int GetCLVertexSize(void) {	return UseQuantizedLines() ? sizeof(CompactEncoding::LineVertex) : sizeof(struct CharacteristicLineVertex);	};
+	bool IsCLBufferQuantized(void) {	return m_pCharacteristicLineBuffer && m_clBufferStride == sizeof(CompactEncoding::LineVertex);	};
+	unsigned int GetCLDrawVertexCount(void) {	return m_clNumVertices ? m_clNumVertices : m_numParticles * (m_clLength + 1);	};
 
 	// members
 	unsigned int	m_probeIndex;
@@ -226,7 +274,22 @@ protected:
 	XMMATRIX		m_texToNDCSpace;
 	bool			m_volumeDataChanged;	//signals that volume data and current visualization are out of sync and should be updated
 	SeedingMode		m_seedingMode, m_seedingModeGUI;
+	float			m_seedSeparation, m_seedSeparationGUI;	// distance of evenly spaced streamlines in texture space
+	bool			m_seedsOutdated;		// the evenly spaced seeds have to be placed again
 	bool			m_surfaceWireframe;
+	bool			m_surfaceAdaptive, m_surfaceAdaptiveGUI;	// front propagation with IntegralSurface
+	float			m_surfaceEdgeRatio, m_surfaceEdgeRatioGUI;	// longest edge relative to the seed spacing
+	float			m_surfaceMaxAngle, m_surfaceMaxAngleGUI;	// in degrees
+	unsigned int	m_surfaceNumIndices;	// of the adaptive surface, 0 for the fixed triangulation
+	unsigned int	m_surfaceIndexCapacity;
+	IntegralSurface::Mesh m_surfaceMesh;
+	AdvectionEngine::Integrator m_integrator;
+	bool			m_cpuAdvection;		// advect the particles with the AdvectionEngine instead of the compute shader
+
+	AdvectionEngine	m_advectionEngine;
+	AdvectionEngine::Particles m_particles;		// CPU copy of the particle buffer
+	std::vector<AdvectionEngine::GPUParticle> m_gpuParticles;
+	AdvectionEngine::Pathlines m_pathlines;
 
 	CharacteristicLineMode m_clMode, m_clModeGUI; 
 	CharacteristicLineRenderMode m_clRenderMode, m_clRenderModeGUI;
@@ -235,6 +298,15 @@ protected:
 	float			m_clWidth, m_clWidthGUI;
 	XMFLOAT3		m_clRibbonBaseOrientation, m_clRibbonBaseOrientationGUI;
 	float			m_clReseedInterval, m_clReseedIntervalGUI;
+	bool			m_clAdaptive, m_clAdaptiveGUI;
+	float			m_clTolerance, m_clToleranceGUI;
+	float			m_clIntegrationTime, m_clIntegrationTimeGUI;
+	float			m_clPathlineStart, m_clPathlineStartGUI;	// time at which the pathlines are seeded
+	bool			m_clCompact, m_clCompactGUI;	// store streamlines back to back with their actual lengths
+	unsigned int	m_clNumVertices;		// vertices of the compacted lines, 0 for the fixed layout
+	unsigned int	m_clBufferVertices;		// capacity of the characteristic line buffer
+	unsigned int	m_clBufferStride;		// vertex size of the characteristic line buffer
+	bool			m_clQuantized, m_clQuantizedGUI;	// 16 byte vertices for lines and tubes, see CompactEncoding
 	bool			m_clEnableSurfaceLighting;
 	int				m_numTimeSurfaces, m_numTimeSurfacesGUI;
 	XMFLOAT3		m_timeSurfaceOffsetDirection;
@@ -258,5 +330,17 @@ protected:
 	ID3D11Buffer				* m_pTrianglePropertiesBuffer;
 	ID3D11ShaderResourceView	* m_pTrianglePropertiesBufferSRV;
 	ID3D11UnorderedAccessView	* m_pTrianglePropertiesBufferUAV;
+
+	ID3D11Buffer				* m_pStepCountBuffer;
+	ID3D11UnorderedAccessView	* m_pStepCountBufferUAV;
+
+	ID3D11Buffer				* m_pLineOffsetsBuffer;
+	ID3D11UnorderedAccessView	* m_pLineOffsetsBufferUAV;
+	ID3D11Buffer				* m_pLineOffsetsStagingBuffer;	// receives the total number of vertices
+
+	ID3D11Buffer				* m_pLineLengthLimitBuffer;
+	ID3D11ShaderResourceView	* m_pLineLengthLimitBufferSRV;
+
+	ID3D11Buffer				* m_pSurfaceIndexBuffer;
 };
 
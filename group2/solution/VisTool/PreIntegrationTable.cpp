@@ -0,0 +1,89 @@
+#include "PreIntegrationTable.h"
+
+#include "util/ThreadPool.h"
+
+#include <xmmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	// alpha * rgb and alpha of an entry of the transfer function
+	inline __m128 Weighted(const float * rgba)
+	{
+		// the alpha channel itself stays unweighted
+		return _mm_mul_ps(_mm_loadu_ps(rgba), _mm_set_ps(1.f, rgba[3], rgba[3], rgba[3]));
+	}
+
+	inline void Texel(float coord, int size, int & i0, int & i1, float & f)
+	{
+		float x = std::max(0.f, std::min((float)(size - 1), coord * size - 0.5f));
+		i0 = std::min((int)x, std::max(0, size - 2));
+		i1 = std::min(i0 + 1, size - 1);
+		f = x - i0;
+	}
+}
+
+PreIntegrationTable::PreIntegrationTable(void) :
+	m_size(0)
+{
+}
+
+void PreIntegrationTable::Build(const float * tf, int size)
+{
+	m_size = size;
+	m_table.resize(4 * (size_t)size * size);
+	if(size == 0)
+		return;
+
+	// integral of the weighted transfer function from texel center 0 to texel center i
+	std::vector<float> weighted(4 * size), prefix(4 * size);
+	const __m128 half = _mm_set1_ps(0.5f);
+	__m128 sum = _mm_setzero_ps();
+	__m128 prev = Weighted(tf);
+	for(int i = 0; i < size; i++) {
+		__m128 w = Weighted(tf + 4 * i);
+		sum = _mm_add_ps(sum, _mm_mul_ps(half, _mm_add_ps(prev, w)));
+		_mm_storeu_ps(&weighted[4 * i], w);
+		_mm_storeu_ps(&prefix[4 * i], sum);
+		prev = w;
+	}
+
+	ThreadPool::GetShared().ParallelFor(0, size, [&](int back) {
+		float * row = &m_table[4 * (size_t)back * size];
+		__m128 end = _mm_loadu_ps(&prefix[4 * back]);
+		for(int front = 0; front < size; front++) {
+			__m128 entry;
+			if(front == back)
+				entry = _mm_loadu_ps(&weighted[4 * back]);
+			else {
+				// (P(back) - P(front)) / (back - front), the mean for either order
+				__m128 difference = _mm_sub_ps(end, _mm_loadu_ps(&prefix[4 * front]));
+				entry = _mm_mul_ps(difference, _mm_set1_ps(1.f / (back - front)));
+			}
+			_mm_storeu_ps(row + 4 * front, entry);
+		}
+	});
+}
+
+void PreIntegrationTable::Sample(float front, float back, float entry[4]) const
+{
+	int x0, x1, y0, y1;
+	float fx, fy;
+	Texel(front, m_size, x0, x1, fx);
+	Texel(back, m_size, y0, y1, fy);
+	const float * r0 = &m_table[4 * (size_t)y0 * m_size];
+	const float * r1 = &m_table[4 * (size_t)y1 * m_size];
+	for(int c = 0; c < 4; c++) {
+		float c0 = r0[4 * x0 + c] + fx * (r0[4 * x1 + c] - r0[4 * x0 + c]);
+		float c1 = r1[4 * x0 + c] + fx * (r1[4 * x1 + c] - r1[4 * x0 + c]);
+		entry[c] = c0 + fy * (c1 - c0);
+	}
+}
+
+void PreIntegrationTable::Segment(const float entry[4], float length, float alphaScale, float color[4])
+{
+	for(int c = 0; c < 3; c++)
+		color[c] = entry[3] > 0.f ? entry[c] / entry[3] : 0.f;
+	color[3] = 1.f - std::exp(-entry[3] * alphaScale * length);
+}
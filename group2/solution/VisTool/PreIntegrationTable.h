@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+/*
+	Pre-integrated transfer function for a ray segment between a front and a back sample
+	Entry (front, back) holds the mean of alpha * rgb and of alpha of the linearly interpolated
+	transfer function over the values between the two samples, with the same texel centers as the 1D
+	texture, so the table can be sampled linearly at (front, back) like the transfer function at s.
+	Since the means do not depend on the length of the segment, Segment turns an entry into the color
+	and opacity of a segment of any length: alpha is taken as extinction per voxel, which matches
+	alpha * step of the point sampled ray for short steps and stays exact for long ones.
+	The entries are differences of prefix sums (trapezoids between texel centers, all four channels in
+	one SSE register), rows are filled on the shared thread pool.
+*/
+class PreIntegrationTable
+{
+public:
+	PreIntegrationTable(void);
+
+	// tf are size RGBA entries, rebuilds the table
+	void Build(const float * tf, int size);
+
+	// linearly filtered entry like the 2D texture, values are in [0, 1]
+	void Sample(float front, float back, float entry[4]) const;
+	// color (not premultiplied) and opacity of a segment of length voxels from a sampled entry
+	static void Segment(const float entry[4], float length, float alphaScale, float color[4]);
+
+	bool IsEmpty() const {				return m_table.empty();	};
+	int GetSize() const {				return m_size;	};
+	// size * size RGBA entries, front sample fastest
+	const float * GetData() const {		return m_table.data();	};
+
+private:
+	int					m_size;
+	std::vector<float>	m_table;
+};
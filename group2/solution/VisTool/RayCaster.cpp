@@ -2,8 +2,12 @@
 
 #include "util/util.h"
 #include "Globals.h"
+#include "SoftwareRayCaster.h"
 
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
 
 ID3DX11Effect			* RayCaster::pEffect = nullptr;
 ID3DX11EffectTechnique	* RayCaster::pTechnique = nullptr;
@@ -47,12 +51,25 @@ ID3DX11EffectScalarVariable	* RayCaster::pDiffuseEV = nullptr;
 ID3DX11EffectScalarVariable	* RayCaster::pSpecularEV = nullptr;
 ID3DX11EffectScalarVariable	* RayCaster::pSpecularExpEV = nullptr;
 ID3DX11EffectScalarVariable	* RayCaster::pDVRLightingEV = nullptr;
+ID3DX11EffectScalarVariable	* RayCaster::pNormalsTEV = nullptr;
+ID3DX11EffectScalarVariable	* RayCaster::pOctahedralNormalsEV = nullptr;
+ID3DX11EffectScalarVariable	* RayCaster::pEmptySpaceSkippingEV = nullptr;
+ID3DX11EffectVectorVariable	* RayCaster::pBrickExtentEV = nullptr;
+ID3DX11EffectVectorVariable	* RayCaster::pNumBricksEV = nullptr;
+ID3DX11EffectScalarVariable	* RayCaster::pPreIntegrationEV = nullptr;
+ID3DX11EffectScalarVariable	* RayCaster::pAdaptiveSamplingEV = nullptr;
+ID3DX11EffectScalarVariable	* RayCaster::pSamplingToleranceEV = nullptr;
+ID3DX11EffectScalarVariable	* RayCaster::pMaxStepFactorEV = nullptr;
 
 ID3DX11EffectShaderResourceVariable	* RayCaster::pTexVolumeEV = nullptr;
 ID3DX11EffectShaderResourceVariable	* RayCaster::pTexNormalVolumeEV = nullptr;
+ID3DX11EffectShaderResourceVariable	* RayCaster::pTexNormalVolume1EV = nullptr;
 ID3DX11EffectShaderResourceVariable	* RayCaster::pDepthBufferEV = nullptr;
 ID3DX11EffectShaderResourceVariable	* RayCaster::pRayEntryPointsEV = nullptr;
 ID3DX11EffectShaderResourceVariable	* RayCaster::pTransferFunctionEV = nullptr;
+ID3DX11EffectShaderResourceVariable	* RayCaster::pBrickDistanceEV = nullptr;
+ID3DX11EffectShaderResourceVariable	* RayCaster::pPreIntegrationTableEV = nullptr;
+ID3DX11EffectShaderResourceVariable	* RayCaster::pSamplingRateEV = nullptr;
 
 ID3D11Buffer			* RayCaster::pBoxIndexBuffer = nullptr;
 ID3D11Buffer			* RayCaster::pBoxVertexBuffer = nullptr;
@@ -128,12 +145,25 @@ HRESULT RayCaster::Initialize(ID3D11Device * pd3dDevice_, TwBar* pParametersBar_
 	SAFE_GET_SCALAR(pEffect, "g_DVRLighting", pDVRLightingEV);
 	SAFE_GET_SCALAR(pEffect, "g_terminationAlphaThreshold", pTerminationAlphaEV);
 	SAFE_GET_SCALAR(pEffect, "g_globalAlphaScale", pGlobalAlphaScaleEV);
+	SAFE_GET_SCALAR(pEffect, "g_normalsT", pNormalsTEV);
+	SAFE_GET_SCALAR(pEffect, "g_octahedralNormals", pOctahedralNormalsEV);
+	SAFE_GET_SCALAR(pEffect, "g_emptySpaceSkipping", pEmptySpaceSkippingEV);
+	SAFE_GET_VECTOR(pEffect, "g_brickExtent", pBrickExtentEV);
+	SAFE_GET_VECTOR(pEffect, "g_numBricks", pNumBricksEV);
+	SAFE_GET_SCALAR(pEffect, "g_preIntegration", pPreIntegrationEV);
+	SAFE_GET_SCALAR(pEffect, "g_adaptiveSampling", pAdaptiveSamplingEV);
+	SAFE_GET_SCALAR(pEffect, "g_samplingTolerance", pSamplingToleranceEV);
+	SAFE_GET_SCALAR(pEffect, "g_maxStepFactor", pMaxStepFactorEV);
 
 	SAFE_GET_RESOURCE(pEffect, "g_texVolume", pTexVolumeEV);
 	SAFE_GET_RESOURCE(pEffect, "g_texVolumeNormals", pTexNormalVolumeEV);
+	SAFE_GET_RESOURCE(pEffect, "g_texVolumeNormals1", pTexNormalVolume1EV);
 	SAFE_GET_RESOURCE(pEffect, "g_depthBuffer", pDepthBufferEV);
 	SAFE_GET_RESOURCE(pEffect, "g_rayEntryPoints", pRayEntryPointsEV);
 	SAFE_GET_RESOURCE(pEffect, "g_transferFunction", pTransferFunctionEV);
+	SAFE_GET_RESOURCE(pEffect, "g_brickDistance", pBrickDistanceEV);
+	SAFE_GET_RESOURCE(pEffect, "g_preIntegrationTable", pPreIntegrationTableEV);
+	SAFE_GET_RESOURCE(pEffect, "g_samplingRate", pSamplingRateEV);
 
 	SAFE_GET_VECTOR(pEffect, "g_lightColor", pLightColorEV);
 	SAFE_GET_SCALAR(pEffect, "k_a", pAmbientEV);
@@ -295,7 +325,27 @@ RayCaster::RayCaster(ScalarVolumeData & volData) :
 	m_surfaceColor2(XMFLOAT4(.5f, .5f, 1, .5)),
 	m_DVRlighting(false),
 	m_raycastClippingBox(XMFLOAT3(0.5f, 0.5f, 0.5f), XMFLOAT3(1.f, 1.f, 1.f), true, true, true),
-	m_boxLocked(true)
+	m_boxLocked(true),
+	m_lastCamPos(0.f, 0.f, 0.f),
+	m_cpuImageCount(0),
+	m_emptySpaceSkipping(true),
+	m_occupancyPass(-1),
+	m_occupancyTFTimestamp(-1),
+	m_occupancyIsoValues(0.f, 0.f),
+	m_occupancyTimesteps(-1, -1),
+	m_pDistanceTexture(nullptr),
+	m_pDistanceSRV(nullptr),
+	m_preIntegration(false),
+	m_preIntegrationTFTimestamp(-1),
+	m_pPreIntegrationTexture(nullptr),
+	m_pPreIntegrationSRV(nullptr),
+	m_adaptiveSampling(false),
+	m_samplingTolerance(0.05f),
+	m_maxStepFactor(4.f),
+	m_samplingRatesTFTimestamp(-1),
+	m_samplingRatesTimesteps(-1, -1),
+	m_pSamplingRateTexture(nullptr),
+	m_pSamplingRateSRV(nullptr)
 {
 	m_volumeData.RegisterObserver(this);
 
@@ -307,6 +357,7 @@ RayCaster::RayCaster(ScalarVolumeData & volData) :
 	XMFLOAT3 bbox = m_volumeData.GetBoundingBox();
 
 	m_modelTransform = XMMatrixScaling(bbox.x, bbox.y, bbox.z);
+	XMStoreFloat4x4(&m_lastWorldViewProjInv, XMMatrixIdentity());
 
 	g_globals.showTransferFunctionEditor = true;
 
@@ -321,9 +372,15 @@ RayCaster::RayCaster(ScalarVolumeData & volData) :
 	TwAddVarRW(pParametersBar, "Termination Alpha", TW_TYPE_FLOAT, &m_rayTerminationAlpha, "min=0.8 max=1.0 step=0.05");
 	TwAddVarRW(pParametersBar, "Transparency Factor", TW_TYPE_FLOAT, &m_globalAlphaScale, "min=0.001 max=2.0 step=0.005");
 	TwAddVarRW(pParametersBar, "DVR Lighting", TW_TYPE_BOOLCPP, &m_DVRlighting, "");
+	TwAddVarRW(pParametersBar, "Empty Space Skipping", TW_TYPE_BOOLCPP, &m_emptySpaceSkipping, "help='Leaps over bricks that are transparent for the transfer function or contain no isovalue (DVR and iso passes).'");
+	TwAddVarRW(pParametersBar, "Pre-Integration", TW_TYPE_BOOLCPP, &m_preIntegration, "help='DVR integrates the transfer function between successive samples, which allows larger step sizes.'");
+	TwAddVarRW(pParametersBar, "Adaptive Sampling", TW_TYPE_BOOLCPP, &m_adaptiveSampling, "help='DVR takes longer steps in bricks where the transfer function of the data changes slowly.'");
+	TwAddVarRW(pParametersBar, "Sampling Tolerance", TW_TYPE_FLOAT, &m_samplingTolerance, "min=0.001 max=1 step=0.005 help='Change of the classified color allowed per adaptive step.'");
+	TwAddVarRW(pParametersBar, "Max Step Factor", TW_TYPE_FLOAT, &m_maxStepFactor, "min=1 max=8 step=1 help='Longest adaptive step in units of the step size.'");
 	TwAddVarRW(pParametersBar, "Show TF Editor", TW_TYPE_BOOLCPP, &g_globals.showTransferFunctionEditor, "");
 	TwAddVarRW(pParametersBar, "Surface Color (2)", TW_TYPE_COLOR4F, &m_surfaceColor2.x, "");
 	TwAddVarRW(pParametersBar, "Iso Value (2)", TW_TYPE_FLOAT, &m_isoValue2, "min=0 max=1 step=0.01");
+	TwAddButton(pParametersBar, "[Render on CPU]", RenderOnCPUCB, this, "help='Renders the current pass with the software raycaster and writes it as .ppm to the working directory.'");
 
 	SetCurrentPassCB(&m_currentPassSelection, this);
 	int visible = 1;
@@ -356,9 +413,15 @@ RayCaster::~RayCaster(void)
 	TwRemoveVar(pParametersBar, "Termination Alpha");
 	TwRemoveVar(pParametersBar, "Transparency Factor");
 	TwRemoveVar(pParametersBar, "DVR Lighting");
+	TwRemoveVar(pParametersBar, "Empty Space Skipping");
+	TwRemoveVar(pParametersBar, "Pre-Integration");
+	TwRemoveVar(pParametersBar, "Adaptive Sampling");
+	TwRemoveVar(pParametersBar, "Sampling Tolerance");
+	TwRemoveVar(pParametersBar, "Max Step Factor");
 	TwRemoveVar(pParametersBar, "Show TF Editor");
 	TwRemoveVar(pParametersBar, "Surface Color (2)");
 	TwRemoveVar(pParametersBar, "Iso Value (2)");
+	TwRemoveVar(pParametersBar, "[Render on CPU]");
 
 	
 	int visible = 0;
@@ -366,6 +429,13 @@ RayCaster::~RayCaster(void)
 	m_volumeData.UnregisterObserver(this);
 	
 	g_boxManipulationManager->RemoveBox(&m_raycastClippingBox);
+
+	SAFE_RELEASE(m_pDistanceSRV);
+	SAFE_RELEASE(m_pDistanceTexture);
+	SAFE_RELEASE(m_pPreIntegrationSRV);
+	SAFE_RELEASE(m_pPreIntegrationTexture);
+	SAFE_RELEASE(m_pSamplingRateSRV);
+	SAFE_RELEASE(m_pSamplingRateTexture);
 }
 
 void RayCaster::SaveConfig(SettingsStorage &store)
@@ -380,6 +450,11 @@ void RayCaster::SaveConfig(SettingsStorage &store)
 	store.StoreFloat4("raycaster.surfaceColor", &m_surfaceColor.x);
 	store.StoreFloat4("raycaster.surfaceColor2", &m_surfaceColor2.x);
 	store.StoreBool("raycaster.DVRlighting", m_DVRlighting);
+	store.StoreBool("raycaster.emptySpaceSkipping", m_emptySpaceSkipping);
+	store.StoreBool("raycaster.preIntegration", m_preIntegration);
+	store.StoreBool("raycaster.adaptiveSampling", m_adaptiveSampling);
+	store.StoreFloat("raycaster.samplingTolerance", m_samplingTolerance);
+	store.StoreFloat("raycaster.maxStepFactor", m_maxStepFactor);
 
 }
 
@@ -398,6 +473,11 @@ void RayCaster::LoadConfig(SettingsStorage &store)
 	store.GetFloat4("raycaster.surfaceColor", &m_surfaceColor.x);
 	store.GetFloat4("raycaster.surfaceColor2", &m_surfaceColor2.x);
 	store.GetBool("raycaster.DVRlighting", m_DVRlighting);
+	store.GetBool("raycaster.emptySpaceSkipping", m_emptySpaceSkipping);
+	store.GetBool("raycaster.preIntegration", m_preIntegration);
+	store.GetBool("raycaster.adaptiveSampling", m_adaptiveSampling);
+	store.GetFloat("raycaster.samplingTolerance", m_samplingTolerance);
+	store.GetFloat("raycaster.maxStepFactor", m_maxStepFactor);
 }
 
 // The opaque render pass actually just saves the transformation matrix for the bounding box
@@ -419,12 +499,14 @@ HRESULT RayCaster::RenderTransparency(ID3D11DeviceContext* pd3dImmediateContext,
 
 	XMStoreFloat4x4(&mModelWorldViewProjInv, modelMtcs.modelWorldViewProjInv);
 	pWorldViewProjInvEV->SetMatrix((float*)mModelWorldViewProjInv.m);
+	m_lastWorldViewProjInv = mModelWorldViewProjInv;
 
 	//calculate camera position in object space
 	XMVECTOR p = XMLoadFloat4(&XMFLOAT4(0, 0, 0, 1));
 	auto camPos = XMVector4Transform(p, modelMtcs.modelWorldViewInv);
 	pCamPosEV->SetFloatVector(camPos.m128_f32);
 	pLightPosEV->SetFloatVector(camPos.m128_f32);
+	XMStoreFloat3(&m_lastCamPos, camPos);
 	//std::cout << camPos.m128_f32[0] << " " << camPos.m128_f32[1] << " " << camPos.m128_f32[2] <<  " " << camPos.m128_f32[3] << std::endl;
 
 	XMINT3 res = m_volumeData.GetResolution();
@@ -463,10 +545,40 @@ HRESULT RayCaster::RenderTransparency(ID3D11DeviceContext* pd3dImmediateContext,
 
 		m_volumeData.SetNormalsRequired(true);
 		pTexNormalVolumeEV->SetResource(m_volumeData.GetNormalTextureSRV());
+		pTexNormalVolume1EV->SetResource(m_volumeData.GetNormalTexture1SRV());
+		pNormalsTEV->SetFloat(m_volumeData.GetNormalsT());
+		pOctahedralNormalsEV->SetBool(m_volumeData.HasOctahedralNormals());
 	}
 	else
 		m_volumeData.SetNormalsRequired(false);
 
+	bool skipping = UpdateOccupancy();
+	bool adaptive = UpdateSamplingRates();
+	pEmptySpaceSkippingEV->SetBool(skipping);
+	pAdaptiveSamplingEV->SetBool(adaptive);
+	if(skipping || adaptive) {
+		// both are per brick of level 0 of the pyramid
+		const BrickPyramid::Level & bricks = m_volumeData.GetBrickPyramid()->GetLevel(0);
+		float brickExtent[3] = { (float)bricks.brickSize / res.x, (float)bricks.brickSize / res.y, (float)bricks.brickSize / res.z };
+		pBrickExtentEV->SetFloatVector(brickExtent);
+		pNumBricksEV->SetIntVector(bricks.numBricks);
+	}
+	if(skipping)
+		pBrickDistanceEV->SetResource(m_pDistanceSRV);
+	if(adaptive) {
+		pSamplingRateEV->SetResource(m_pSamplingRateSRV);
+		pSamplingToleranceEV->SetFloat(m_samplingTolerance);
+		// the sampling rates hold for the neighbouring bricks, a step must not leave them
+		const BrickPyramid::Level & bricks = m_volumeData.GetBrickPyramid()->GetLevel(0);
+		float stepVoxels = raycastStepRel * std::max(res.x, std::max(res.y, res.z));
+		pMaxStepFactorEV->SetFloat(std::max(1.f, std::min(m_maxStepFactor, std::floor(bricks.brickSize / stepVoxels))));
+	}
+
+	bool preIntegration = UpdatePreIntegration();
+	pPreIntegrationEV->SetBool(preIntegration);
+	if(preIntegration)
+		pPreIntegrationTableEV->SetResource(m_pPreIntegrationSRV);
+
 	UINT stride=sizeof(float[4]);
 	UINT offset=0;
 
@@ -532,7 +644,11 @@ HRESULT RayCaster::RenderTransparency(ID3D11DeviceContext* pd3dImmediateContext,
 	//remove the mappings from the shader inputs
 	pTexVolumeEV->SetResource(nullptr);
 	pTexNormalVolumeEV->SetResource(nullptr);
+	pTexNormalVolume1EV->SetResource(nullptr);
 	pRayEntryPointsEV->SetResource(nullptr);
+	pBrickDistanceEV->SetResource(nullptr);
+	pPreIntegrationTableEV->SetResource(nullptr);
+	pSamplingRateEV->SetResource(nullptr);
 
 	if(m_currentPassSelection == PASS_ISOSURFACE_ALPHA_GLOBAL)
 		transparencyEnvironment.EndTransparency(pd3dImmediateContext, pPasses[PASS_ISOSURFACE_ALPHA_GLOBAL]);
@@ -561,4 +677,280 @@ void RayCaster::FrameMove(double dTime, float fElapsedTime, float fElapsedLogicT
 	}
 	m_raycastClippingBox.moveable = !m_boxLocked;
 	m_raycastClippingBox.scalable = !m_boxLocked;
-}
\ No newline at end of file
+}
+
+/**
+	Classifies the bricks of the volume for the current pass and uploads their distance field
+	This is only redone if the transfer function, the isovalues, the pass or the timesteps changed,
+	and only the lines of the distance field affected by bricks whose occupancy changed are updated.
+	Returns false if the pass does not skip empty space.
+*/
+bool RayCaster::UpdateOccupancy(void)
+{
+	bool iso = m_currentPassSelection == PASS_ISOSURFACE || m_currentPassSelection == PASS_ISOSURFACE_ALPHA
+		|| m_currentPassSelection == PASS_ISOSURFACE_ALPHA_GLOBAL || m_currentPassSelection == PASS_DUAL_ISOSURFACE;
+	if(!m_emptySpaceSkipping || !(iso || m_currentPassSelection == PASS_DVR))
+		return false;
+	const BrickPyramid * pyramid = m_volumeData.GetBrickPyramid();
+	if(!pyramid)
+		return false;
+
+	XMFLOAT2 isoValues(m_isoValue, m_currentPassSelection == PASS_DUAL_ISOSURFACE ? m_isoValue2 : m_isoValue);
+	XMINT2 timesteps(m_volumeData.GetSlotTimestep(0), m_volumeData.GetSlotTimestep(1));
+	int tfTimestamp = g_transferFunctionEditor->getTimestamp();
+	bool changed = m_occupancyPass != m_currentPassSelection
+		|| m_occupancyTimesteps.x != timesteps.x || m_occupancyTimesteps.y != timesteps.y
+		|| (iso ? m_occupancyIsoValues.x != isoValues.x || m_occupancyIsoValues.y != isoValues.y : m_occupancyTFTimestamp != tfTimestamp);
+	if(!changed)
+		return true;
+
+	if(iso)
+		pyramid->ClassifyIsoValues(&isoValues.x, 2, m_occupancy);
+	else
+		pyramid->ClassifyTransferFunction(g_transferFunctionEditor->getTfData(), g_transferFunctionEditor->getTfSize(), m_occupancy);
+	m_occupancyPass = m_currentPassSelection;
+	m_occupancyTFTimestamp = tfTimestamp;
+	m_occupancyIsoValues = isoValues;
+	m_occupancyTimesteps = timesteps;
+
+	const BrickPyramid::Level & bricks = pyramid->GetLevel(0);
+	const int * numCells = m_distanceField.GetNumCells();
+	if(m_distanceField.IsEmpty() || numCells[0] != bricks.numBricks[0] || numCells[1] != bricks.numBricks[1] || numCells[2] != bricks.numBricks[2]) {
+		const XMINT3 & res = m_volumeData.GetResolution();
+		float cellExtent[3] = { (float)bricks.brickSize / res.x, (float)bricks.brickSize / res.y, (float)bricks.brickSize / res.z };
+		m_distanceField.Compute(m_occupancy.levels[0].data(), bricks.numBricks, cellExtent);
+	}
+	else
+		m_distanceField.Update(m_occupancy.levels[0].data());
+
+	if(!m_pDistanceTexture) {
+		D3D11_TEXTURE3D_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Width = bricks.numBricks[0];
+		desc.Height = bricks.numBricks[1];
+		desc.Depth = bricks.numBricks[2];
+		desc.MipLevels = 1;
+		desc.Format = DXGI_FORMAT_R8_UINT;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		if(FAILED(pd3dDevice->CreateTexture3D(&desc, nullptr, &m_pDistanceTexture))
+			|| FAILED(pd3dDevice->CreateShaderResourceView(m_pDistanceTexture, nullptr, &m_pDistanceSRV))) {
+			SAFE_RELEASE(m_pDistanceTexture);
+			m_occupancyPass = -1;
+			return false;
+		}
+	}
+
+	ID3D11DeviceContext * pContext;
+	pd3dDevice->GetImmediateContext(&pContext);
+	pContext->UpdateSubresource(m_pDistanceTexture, 0, nullptr, m_distanceField.GetDistances(),
+		bricks.numBricks[0], bricks.numBricks[0] * bricks.numBricks[1]);
+	SAFE_RELEASE(pContext);
+	return true;
+}
+
+/**
+	Rebuilds the pre-integration table and its texture when the transfer function changed
+	Returns false if the pass does not use it.
+*/
+bool RayCaster::UpdatePreIntegration(void)
+{
+	if(!m_preIntegration || m_currentPassSelection != PASS_DVR)
+		return false;
+	int tfTimestamp = g_transferFunctionEditor->getTimestamp();
+	if(m_preIntegrationTFTimestamp == tfTimestamp)
+		return true;
+
+	int size = g_transferFunctionEditor->getTfSize();
+	m_preIntegrationTable.Build(g_transferFunctionEditor->getTfData(), size);
+	m_preIntegrationTFTimestamp = tfTimestamp;
+
+	if(!m_pPreIntegrationTexture) {
+		D3D11_TEXTURE2D_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Width = size;
+		desc.Height = size;
+		desc.MipLevels = 1;
+		desc.ArraySize = 1;
+		desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		if(FAILED(pd3dDevice->CreateTexture2D(&desc, nullptr, &m_pPreIntegrationTexture))
+			|| FAILED(pd3dDevice->CreateShaderResourceView(m_pPreIntegrationTexture, nullptr, &m_pPreIntegrationSRV))) {
+			SAFE_RELEASE(m_pPreIntegrationTexture);
+			m_preIntegrationTFTimestamp = -1;
+			return false;
+		}
+	}
+
+	ID3D11DeviceContext * pContext;
+	pd3dDevice->GetImmediateContext(&pContext);
+	pContext->UpdateSubresource(m_pPreIntegrationTexture, 0, nullptr, m_preIntegrationTable.GetData(),
+		size * sizeof(float[4]), 0);
+	SAFE_RELEASE(pContext);
+	return true;
+}
+
+/**
+	Classifies the sampling rates of the bricks for DVR and uploads them
+	This is redone when the transfer function or the timesteps changed; the classification runs over
+	rows of bricks on the thread pool and takes far less time than the pyramid it reads.
+	Returns false if the pass does not take adaptive steps.
+*/
+bool RayCaster::UpdateSamplingRates(void)
+{
+	if(!m_adaptiveSampling || m_currentPassSelection != PASS_DVR)
+		return false;
+	const BrickPyramid * pyramid = m_volumeData.GetBrickPyramid();
+	if(!pyramid)
+		return false;
+
+	XMINT2 timesteps(m_volumeData.GetSlotTimestep(0), m_volumeData.GetSlotTimestep(1));
+	int tfTimestamp = g_transferFunctionEditor->getTimestamp();
+	if(m_samplingRatesTFTimestamp == tfTimestamp && m_samplingRatesTimesteps.x == timesteps.x && m_samplingRatesTimesteps.y == timesteps.y)
+		return true;
+
+	pyramid->ClassifySamplingRate(g_transferFunctionEditor->getTfData(), g_transferFunctionEditor->getTfSize(), m_samplingRates);
+	m_samplingRatesTFTimestamp = tfTimestamp;
+	m_samplingRatesTimesteps = timesteps;
+
+	const BrickPyramid::Level & bricks = pyramid->GetLevel(0);
+	if(!m_pSamplingRateTexture) {
+		D3D11_TEXTURE3D_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Width = bricks.numBricks[0];
+		desc.Height = bricks.numBricks[1];
+		desc.Depth = bricks.numBricks[2];
+		desc.MipLevels = 1;
+		desc.Format = DXGI_FORMAT_R32_FLOAT;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		if(FAILED(pd3dDevice->CreateTexture3D(&desc, nullptr, &m_pSamplingRateTexture))
+			|| FAILED(pd3dDevice->CreateShaderResourceView(m_pSamplingRateTexture, nullptr, &m_pSamplingRateSRV))) {
+			SAFE_RELEASE(m_pSamplingRateTexture);
+			m_samplingRatesTFTimestamp = -1;
+			return false;
+		}
+	}
+
+	ID3D11DeviceContext * pContext;
+	pd3dDevice->GetImmediateContext(&pContext);
+	pContext->UpdateSubresource(m_pSamplingRateTexture, 0, nullptr, m_samplingRates.data(),
+		bricks.numBricks[0] * sizeof(float), bricks.numBricks[0] * bricks.numBricks[1] * sizeof(float));
+	SAFE_RELEASE(pContext);
+	return true;
+}
+
+void TW_CALL RayCaster::RenderOnCPUCB(void *clientData)
+{
+	reinterpret_cast<RayCaster*>(clientData)->RenderOnCPU();
+}
+
+/**
+	The volume the shaders sample as floats, x fastest
+	Bytes are normalized like the UNORM texture, time series are interpolated like the interpolated
+	texture. Data that only lives on the GPU is read back.
+*/
+bool RayCaster::GetVolumeOnCPU(std::vector<float> & volume)
+{
+	const XMINT3 & res = m_volumeData.GetResolution();
+	const size_t voxels = (size_t)res.x * res.y * res.z;
+	const void * data0 = m_volumeData.GetSlotData(0);
+	if(!data0) {
+		if(m_volumeData.GetFormat() != VolumeData::DF_FLOAT)
+			return false;
+		return m_volumeData.ReadbackVolume(volume);
+	}
+	const void * data1 = m_volumeData.GetSlotData(1);
+	const float t = data1 ? m_volumeData.GetCurrentTimestepT() : 0.f;
+
+	volume.resize(voxels);
+	if(m_volumeData.GetFormat() == VolumeData::DF_BYTE) {
+		const unsigned char * b0 = static_cast<const unsigned char*>(data0);
+		const unsigned char * b1 = data1 ? static_cast<const unsigned char*>(data1) : b0;
+		for(size_t i = 0; i < voxels; i++)
+			volume[i] = ((1.f - t) * b0[i] + t * b1[i]) / 255.f;
+	}
+	else if(m_volumeData.GetFormat() == VolumeData::DF_FLOAT) {
+		const float * f0 = static_cast<const float*>(data0);
+		const float * f1 = data1 ? static_cast<const float*>(data1) : f0;
+		for(size_t i = 0; i < voxels; i++)
+			volume[i] = (1.f - t) * f0[i] + t * f1[i];
+	}
+	else
+		return false;
+	return true;
+}
+
+// renders the current view with the SoftwareRayCaster at the size of the back buffer
+void RayCaster::RenderOnCPU(void)
+{
+	std::vector<float> volume;
+	if(!GetVolumeOnCPU(volume)) {
+		std::cerr << "Raycaster: the volume is not available on the CPU" << std::endl;
+		return;
+	}
+
+	SoftwareRayCaster::Parameters params;
+	params.mode = static_cast<SoftwareRayCaster::Mode>(m_currentPassSelection);
+	params.width = DXUTGetDXGIBackBufferSurfaceDesc()->Width;
+	params.height = DXUTGetDXGIBackBufferSurfaceDesc()->Height;
+	memcpy(params.worldViewProjInv, m_lastWorldViewProjInv.m, sizeof(params.worldViewProjInv));
+
+	const float * center = &m_raycastClippingBox.center.x;
+	const float * size = &m_raycastClippingBox.size.x;
+	for(int c = 0; c < 3; c++) {
+		params.boxMin[c] = center[c] - 0.5f * std::abs(size[c]);
+		params.boxMax[c] = center[c] + 0.5f * std::abs(size[c]);
+	}
+
+	XMINT3 res = m_volumeData.GetResolution();
+	float avgResolution = (res.x + res.y + res.z)/3.0f;
+	params.stepsize = m_raycastStepsize / avgResolution;
+	params.pixelStepsize = m_raycastStepsize;
+	params.terminationAlpha = m_rayTerminationAlpha;
+	params.globalAlphaScale = m_globalAlphaScale;
+	params.binSearchSteps = m_binSearchSteps;
+	params.isoValue = m_isoValue;
+	params.isoValue2 = m_isoValue2;
+	memcpy(params.surfaceColor, &m_surfaceColor.x, sizeof(params.surfaceColor));
+	memcpy(params.surfaceColor2, &m_surfaceColor2.x, sizeof(params.surfaceColor2));
+	params.dvrLighting = m_DVRlighting;
+	memcpy(params.spacing, &m_volumeData.GetSliceThickness().x, sizeof(params.spacing));
+	memcpy(params.lightPos, &m_lastCamPos.x, sizeof(params.lightPos));
+	memcpy(params.lightColor, &g_globals.lightColor.x, sizeof(params.lightColor));
+	params.ambient = g_globals.mat_ambient;
+	params.diffuse = g_globals.mat_diffuse;
+	params.specular = g_globals.mat_specular;
+	params.specularExp = g_globals.mat_specular_exp;
+	if(UpdateOccupancy()) {
+		params.bricks = m_volumeData.GetBrickPyramid();
+		params.occupancy = &m_occupancy;
+		params.distances = &m_distanceField;
+	}
+	if(UpdatePreIntegration())
+		params.preIntegration = &m_preIntegrationTable;
+	if(UpdateSamplingRates()) {
+		params.bricks = m_volumeData.GetBrickPyramid();
+		params.samplingRates = &m_samplingRates;
+		params.samplingTolerance = m_samplingTolerance;
+		params.maxStepFactor = m_maxStepFactor;
+	}
+
+	SoftwareRayCaster::Image image;
+	SoftwareRayCaster::Statistics stats = SoftwareRayCaster::Render(volume.data(), &res.x,
+		g_transferFunctionEditor->getTfData(), g_transferFunctionEditor->getTfSize(), params, image);
+
+	std::stringstream fileName;
+	fileName << "raycaster_cpu_" << std::setfill('0') << std::setw(3) << m_cpuImageCount++ << ".ppm";
+	bool written = SoftwareRayCaster::WritePPM(fileName.str(), image, &g_globals.backgroundColor.x);
+
+	std::cout << "CPU raycast (" << passNames[m_currentPassSelection] << ", " << params.width << "x" << params.height << ") in "
+		<< stats.milliseconds << " ms: " << stats.rays << " rays, " << stats.RaysPerSecond() / 1e6 << " Mrays/s, "
+		<< stats.samples << " samples" << std::endl;
+	if(written)
+		std::cout << "Written to " << fileName.str() << std::endl;
+	else
+		std::cerr << "Raycaster: could not write " << fileName.str() << std::endl;
+}
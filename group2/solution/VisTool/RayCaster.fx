@@ -28,13 +28,26 @@ cbuffer cbRayCaster
 	float4		g_surfaceColor2;	//color for second iso surface
 	float		g_terminationAlphaThreshold = 1;
 	float		g_globalAlphaScale = 1.0;
+	float		g_normalsT = 0;		//interpolation weight of the normals of the second timestep
+	bool		g_octahedralNormals = false;
+	bool		g_emptySpaceSkipping = false;
+	float3		g_brickExtent;		//size of a brick of the occupancy in texture space
+	int3		g_numBricks;
+	bool		g_preIntegration = false;	//DVR integrates the segments between samples
+	bool		g_adaptiveSampling = false;	//DVR steps depend on g_samplingRate
+	float		g_samplingTolerance = 0.05;	//change of the classified color allowed per step
+	float		g_maxStepFactor = 4;		//longest step in units of g_raycastStepsize, at most a brick
 };
 
 Texture3D<float> g_texVolume;
 Texture3D<float3> g_texVolumeNormals;
+Texture3D<float3> g_texVolumeNormals1;	//normals of the second timestep
 Texture2D<float> g_depthBuffer;
 Texture2D<float3> g_rayEntryPoints;
 Texture1D<float4> g_transferFunction;
+Texture2D<float4> g_preIntegrationTable;	//mean of alpha * rgb and alpha between the front (x) and back (y) value
+Texture3D<float> g_samplingRate;	//bound of the change of the classified color per voxel in and around a brick
+Texture3D<uint> g_brickDistance;	//Chebyshev distance to the nearest brick that may contribute for the current transfer function or isovalues, 0 for those
 
 struct SimpleVertex
 {
@@ -60,8 +73,19 @@ float SampleVolume(float3 p, int3 offset) {
 float SampleVolume(float3 p) {
 	return g_texVolume.SampleLevel(samLinear, p, 0.0);
 }
+// normals are either stored directly or as octahedral projection in xy
+float3 DecodeNormal(float3 e) {
+	if(!g_octahedralNormals)
+		return e;
+	float3 n = float3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += (n.xy >= 0.0) ? -t : t;
+	return n;
+}
 float3 SampleVolumeNormals(float3 p) {
-	return normalize(g_texVolumeNormals.SampleLevel(samLinear, p, 0.0));
+	float3 n0 = DecodeNormal(g_texVolumeNormals.SampleLevel(samLinear, p, 0.0));
+	float3 n1 = DecodeNormal(g_texVolumeNormals1.SampleLevel(samLinear, p, 0.0));
+	return normalize(lerp(n0, n1, g_normalsT));
 }
 
 
@@ -105,6 +129,26 @@ float4 psEntryPoint(PSIn_EntryPoint pse) : SV_Target
 	return float4(pse.tex, 1);
 }
 
+// distance along the ray from pos to the exit of the empty cube of bricks around it, 0 if the brick is occupied
+// a brick at distance d is the center of 2d - 1 empty bricks in every direction
+// cubes touching the border extend to infinity since the volume is sampled clamped
+float EmptySpace(float3 pos, float3 dir)
+{
+	if(!g_emptySpaceSkipping)
+		return 0;
+	int3 brick = clamp(int3(floor(pos / g_brickExtent)), 0, g_numBricks - 1);
+	int d = g_brickDistance.Load(int4(brick, 0));
+	if(d == 0)
+		return 0;
+
+	int3 first = brick - (d - 1);
+	int3 last = brick + d;
+	float3 lo = (first <= 0) ? -1e30 : first * g_brickExtent;
+	float3 hi = (last >= g_numBricks) ? 1e30 : last * g_brickExtent;
+	float3 tExit = (dir == 0) ? 1e30 : ((dir > 0) ? hi - pos : lo - pos) / dir;
+	return min(tExit.x, min(tExit.y, tExit.z));
+}
+
 // determines the entry point for a ray in direction exiting a unit box at
 // exitPoint with direction dir
 // returned value is float2(t_entry, t_exit)
@@ -185,7 +229,11 @@ float4 findFirstHit(float3 org, float3 dir, float tstart, float tmax, float outs
 			}
 			return float4(pos, t);
 		}
-			
+
+		// no sample in an empty brick is a hit either, continue with the last one inside
+		float skip = EmptySpace(pos, dir);
+		if(skip > 0)
+			tnew += floor(skip / g_raycastStepsize) * g_raycastStepsize;
 		t = tnew;
 	}
 	return float4(0, 0, 0, tmax + 1);
@@ -215,7 +263,11 @@ float4 findFirstHitSurface(float3 org, float3 dir, float tstart, float tmax, flo
 			}
 			return float4(pos, t);
 		}
-			
+
+		// no sample in an empty brick is a hit either, continue with the last one inside
+		float skip = EmptySpace(pos, dir);
+		if(skip > 0)
+			tnew += floor(skip / g_raycastStepsize) * g_raycastStepsize;
 		t = tnew;
 	}
 	return float4(0, 0, 0, tmax + 1);
@@ -446,6 +498,24 @@ float4 psDualIsoSurface(PSBoxIn input) : SV_Target
 	return float4(c_acc_premult, alpha_acc);
 }
 
+// color and opacity of the ray segment between two samples, alpha of the transfer function is extinction per voxel
+float4 PreIntegratedSegment(float sFront, float sBack, float length)
+{
+	float4 P = g_preIntegrationTable.SampleLevel(samLinear, float2(sFront, sBack), 0.0);
+	float3 color = P.w > 0 ? P.xyz / P.w : 0;
+	return float4(color, 1 - exp(-P.w * g_globalAlphaScale * length));
+}
+
+// length of the next step in units of g_raycastStepsize, longer where the brick at pos is smooth for the transfer function
+float StepFactor(float3 pos)
+{
+	if(!g_adaptiveSampling)
+		return 1;
+	int3 brick = clamp(int3(floor(pos / g_brickExtent)), 0, g_numBricks - 1);
+	float rate = g_samplingRate.Load(int4(brick, 0));
+	return clamp(floor(g_samplingTolerance / (rate * g_raycastPixelStepsize)), 1, g_maxStepFactor);
+}
+
 float4 psDVR(PSBoxIn input) : SV_Target
 {
 	float3 org = g_rayEntryPoints[uint2(input.pos.xy)];//g_camPosInObjectSpace;
@@ -474,17 +544,44 @@ float4 psDVR(PSBoxIn input) : SV_Target
 	//trace the ray through the volume
 	float3 c_acc_premult = float3(0, 0, 0);
 	float alpha_acc = 0;
-	for(float t = 0; t < tMax; t += g_raycastStepsize) {
+	float sFront = -1;	//value of the previous sample, negative if it was not taken
+	bool frontEmpty = true;	//the previous sample was in an empty brick
+	float step = 1;		//from the previous sample in units of g_raycastStepsize
+	for(float t = 0; t < tMax; t += step * g_raycastStepsize) {
 		float3 pos = org + t * dir;
+
+		// the samples up to the exit of an empty brick are transparent
+		// pre-integrated, the segment from an occupied brick into an empty one is integrated first
+		float skip = EmptySpace(pos, dir);
+		if(skip > 0 && (!g_preIntegration || frontEmpty)) {
+			t += floor(skip / g_raycastStepsize) * g_raycastStepsize;
+			sFront = -1;
+			step = 1;
+			continue;
+		}
+
 		float s = SampleVolume(pos);
-		float4 C_a = g_transferFunction.SampleLevel(samLinear, s, 0.0);
+		float4 C_a;
+		if(g_preIntegration) {
+			// behind an empty brick the segment still starts at the previous sample position
+			if(sFront < 0)
+				sFront = t > 0 ? SampleVolume(pos - step * g_raycastStepsize * dir) : s;
+			C_a = PreIntegratedSegment(sFront, s, step * g_raycastPixelStepsize);
+			sFront = s;
+			frontEmpty = skip > 0;
+		}
+		else {
+			C_a = g_transferFunction.SampleLevel(samLinear, s, 0.0);
+			C_a.w *= g_globalAlphaScale * g_raycastPixelStepsize;
+			// a long step is as opaque as that many steps of the same sample
+			if(step > 1)
+				C_a.w = 1 - pow(1 - saturate(C_a.w), step);
+		}
 		
 		//lighting
 		if(g_DVRLighting && C_a.w > 0)
 			C_a.xyz = volumeLighting(C_a.xyz, pos);
-		
 
-		C_a.w *= g_globalAlphaScale * g_raycastPixelStepsize;
 		float oneminusalpha = (1. - alpha_acc);
 		c_acc_premult =  c_acc_premult + oneminusalpha * C_a.w * C_a.xyz;
 		alpha_acc = alpha_acc + oneminusalpha * C_a.w;
@@ -495,6 +592,8 @@ float4 psDVR(PSBoxIn input) : SV_Target
 			alpha_acc = 1.;
 			break;
 		}
+
+		step = StepFactor(pos);
 	}
 
 	return float4(c_acc_premult, alpha_acc);
@@ -10,6 +10,9 @@
 #include "SimpleMesh.h"
 
 #include "BoxManipulationManager.h"
+#include "BrickPyramid.h"
+#include "DistanceField.h"
+#include "PreIntegrationTable.h"
 
 #include "TransferFunctionEditor\TransferFunctionEditor.h"
 
@@ -66,8 +69,16 @@ protected:
 	// static functions
 	static void TW_CALL SetCurrentPassCB(const void *value, void *clientData);
 	static void TW_CALL GetCurrentPassCB(void *value, void *clientData);
+	static void TW_CALL RenderOnCPUCB(void *clientData);
 	static HRESULT CreateBoxVertexIndexBuffer();
 
+	// methods
+	bool GetVolumeOnCPU(std::vector<float> & volume);
+	bool UpdateOccupancy(void);
+	bool UpdatePreIntegration(void);
+	bool UpdateSamplingRates(void);
+	void RenderOnCPU(void);
+
 	// static variables
 	static ID3DX11Effect * pEffect;
 	static ID3DX11EffectTechnique * pTechnique;
@@ -95,12 +106,25 @@ protected:
 	static ID3DX11EffectScalarVariable	* pSpecularEV;
 	static ID3DX11EffectScalarVariable	* pSpecularExpEV;
 	static ID3DX11EffectScalarVariable	* pDVRLightingEV;
+	static ID3DX11EffectScalarVariable	* pNormalsTEV;
+	static ID3DX11EffectScalarVariable	* pOctahedralNormalsEV;
+	static ID3DX11EffectScalarVariable	* pEmptySpaceSkippingEV;
+	static ID3DX11EffectVectorVariable	* pBrickExtentEV;
+	static ID3DX11EffectVectorVariable	* pNumBricksEV;
+	static ID3DX11EffectScalarVariable	* pPreIntegrationEV;
+	static ID3DX11EffectScalarVariable	* pAdaptiveSamplingEV;
+	static ID3DX11EffectScalarVariable	* pSamplingToleranceEV;
+	static ID3DX11EffectScalarVariable	* pMaxStepFactorEV;
 
 	static ID3DX11EffectShaderResourceVariable	* pTexVolumeEV;
 	static ID3DX11EffectShaderResourceVariable	* pTexNormalVolumeEV;
+	static ID3DX11EffectShaderResourceVariable	* pTexNormalVolume1EV;
 	static ID3DX11EffectShaderResourceVariable	* pDepthBufferEV;
 	static ID3DX11EffectShaderResourceVariable	* pRayEntryPointsEV;
 	static ID3DX11EffectShaderResourceVariable	* pTransferFunctionEV;
+	static ID3DX11EffectShaderResourceVariable	* pBrickDistanceEV;
+	static ID3DX11EffectShaderResourceVariable	* pPreIntegrationTableEV;
+	static ID3DX11EffectShaderResourceVariable	* pSamplingRateEV;
 
 	static ID3D11Buffer				* pBoxIndexBuffer;
 	static ID3D11Buffer				* pBoxVertexBuffer;
@@ -130,5 +154,34 @@ protected:
 	ScalarVolumeData & m_volumeData;
 
 	XMMATRIX m_modelTransform;
+
+	XMFLOAT4X4		m_lastWorldViewProjInv;	// of the last frame, for rendering on the CPU
+	XMFLOAT3		m_lastCamPos;			// in texture space
+	int				m_cpuImageCount;		// number of images written by RenderOnCPU
+
+	bool			m_emptySpaceSkipping;
+	BrickPyramid::Occupancy m_occupancy;	// of the brick pyramid for the current pass
+	int				m_occupancyPass;		// what m_occupancy was classified for, -1 if nothing
+	int				m_occupancyTFTimestamp;
+	XMFLOAT2		m_occupancyIsoValues;
+	XMINT2			m_occupancyTimesteps;
+	DistanceField	m_distanceField;		// of level 0 of m_occupancy
+	ID3D11Texture3D * m_pDistanceTexture;	// m_distanceField on the GPU
+	ID3D11ShaderResourceView * m_pDistanceSRV;
+
+	bool			m_preIntegration;
+	PreIntegrationTable m_preIntegrationTable;
+	int				m_preIntegrationTFTimestamp;	// what the table was built for, -1 if nothing
+	ID3D11Texture2D * m_pPreIntegrationTexture;
+	ID3D11ShaderResourceView * m_pPreIntegrationSRV;
+
+	bool			m_adaptiveSampling;
+	float			m_samplingTolerance;	// change of the classified color allowed per step
+	float			m_maxStepFactor;		// longest step in units of m_raycastStepsize
+	std::vector<float> m_samplingRates;		// BrickPyramid::ClassifySamplingRate of level 0
+	int				m_samplingRatesTFTimestamp;	// what m_samplingRates were classified for, -1 if nothing
+	XMINT2			m_samplingRatesTimesteps;
+	ID3D11Texture3D * m_pSamplingRateTexture;
+	ID3D11ShaderResourceView * m_pSamplingRateSRV;
 };
 
@@ -1,6 +1,7 @@
 #include "ScalarVolumeData.h"
 
 #include "util/util.h"
+#include "HistogramEngine.h"
 
 #include <iostream>
 #include <fstream>
@@ -21,6 +22,10 @@ ID3DX11EffectScalarVariable					* ScalarVolumeData::pTimestepTEV = nullptr;
 ID3DX11EffectUnorderedAccessViewVariable	* ScalarVolumeData::pMinMaxTextureEV = nullptr;
 ID3DX11EffectVectorVariable					* ScalarVolumeData::pVolumeResEV = nullptr;
 
+GradientEngine::Stencil		ScalarVolumeData::normalStencil = GradientEngine::GS_CENTRAL;
+GradientEngine::Encoding	ScalarVolumeData::normalEncoding = GradientEngine::NE_SNORM8;
+int							ScalarVolumeData::normalCacheSize = 8;
+
 
 HRESULT ScalarVolumeData::Initialize(ID3D11Device * pd3dDevice_, TwBar* pParametersBar_)
 {
@@ -48,6 +53,13 @@ HRESULT ScalarVolumeData::Initialize(ID3D11Device * pd3dDevice_, TwBar* pParamet
 	SAFE_GET_VECTOR(pEffect, "g_volumeRes", pVolumeResEV);
 	SAFE_GET_UAV(pEffect, "g_minMaxTexture", pMinMaxTextureEV);
 
+	// the normal settings go to the bar of the other loader settings
+	TwType stencilType = TwDefineEnumFromString("NormalStencil", "Central Differences,Sobel");
+	TwAddVarRW(pParametersBar, "Normal Stencil", stencilType, &normalStencil, "help='Takes effect for the next loaded data set.'");
+	TwType encodingType = TwDefineEnumFromString("NormalEncoding", "RGBA8,Octahedral RG8");
+	TwAddVarRW(pParametersBar, "Normal Encoding", encodingType, &normalEncoding, "help='Octahedral normals need half the memory but show slight artifacts where the filtering crosses the folds. Takes effect for the next loaded data set.'");
+	TwAddVarRW(pParametersBar, "Normal Cache Size", TW_TYPE_INT32, &normalCacheSize, "min=2 max=1024 help='Number of timesteps whose normals are kept in RAM.'");
+
 	return S_OK;
 }
 
@@ -60,8 +72,26 @@ HRESULT ScalarVolumeData::Release(void)
 	return S_OK;
 }
 
-ScalarVolumeData::ScalarVolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution, float timestep, XMINT3 timestepIndices) :
-	VolumeData(objectFileName, format, sliceThickness, resolution, timestep, timestepIndices),
+void ScalarVolumeData::SaveNormalConfig(SettingsStorage &store)
+{
+	store.StoreInt("scalarvolumedata.normals.stencil", normalStencil);
+	store.StoreInt("scalarvolumedata.normals.encoding", normalEncoding);
+	store.StoreInt("scalarvolumedata.normals.cachesize", normalCacheSize);
+}
+
+void ScalarVolumeData::LoadNormalConfig(SettingsStorage &store)
+{
+	int stencil = normalStencil;
+	store.GetInt("scalarvolumedata.normals.stencil", stencil);
+	normalStencil = (GradientEngine::Stencil)stencil;
+	int encoding = normalEncoding;
+	store.GetInt("scalarvolumedata.normals.encoding", encoding);
+	normalEncoding = (GradientEngine::Encoding)encoding;
+	store.GetInt("scalarvolumedata.normals.cachesize", normalCacheSize);
+}
+
+ScalarVolumeData::ScalarVolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution, float timestep, XMINT3 timestepIndices, std::string metadataFileName) :
+	VolumeData(objectFileName, format, sliceThickness, resolution, timestep, timestepIndices, metadataFileName),
 	m_pNormalTexture(nullptr),
 	m_pInterpolatedTexture(nullptr),
 	m_pInterpolatedTextureSRV(nullptr),
@@ -71,9 +101,19 @@ ScalarVolumeData::ScalarVolumeData(std::string objectFileName, DataFormat format
 	m_pMinMaxTexture(nullptr),
 	m_pMinMaxTextureDownload(nullptr),
 	m_pMinMaxTextureUAV(nullptr),
-	m_normalsRequired(false)
+	m_pNormalTexture1(nullptr),
+	m_pNormalTexture1SRV(nullptr),
+	m_normalsRequired(false),
+	m_normalStencil(normalStencil),
+	m_normalEncoding(normalEncoding),
+	m_numCachedNormals(0),
+	m_normalTimestep0(-1),
+	m_normalTimestep1(-1),
+	m_brickPyramidTimestep0(-1),
+	m_brickPyramidTimestep1(-1)
 {
 	LoadDataFiles(objectFileName);
+	m_normals.resize(m_data.size(), nullptr);
 	TwAddVarRO(pParametersBar, "Scalar Volume Data", volumeDataType, this, "");
 }
 
@@ -92,7 +132,16 @@ ScalarVolumeData::ScalarVolumeData(ID3D11ShaderResourceView * pVolumeDataSRV, Da
 	m_pMinMaxTexture(nullptr),
 	m_pMinMaxTextureDownload(nullptr),
 	m_pMinMaxTextureUAV(nullptr),
-	m_normalsRequired(false)
+	m_pNormalTexture1(nullptr),
+	m_pNormalTexture1SRV(nullptr),
+	m_normalsRequired(false),
+	m_normalStencil(normalStencil),
+	m_normalEncoding(normalEncoding),
+	m_numCachedNormals(0),
+	m_normalTimestep0(-1),
+	m_normalTimestep1(-1),
+	m_brickPyramidTimestep0(-1),
+	m_brickPyramidTimestep1(-1)
 {
 	m_pVolumeData0SRV = pVolumeDataSRV;
 	m_externalData = true;
@@ -100,42 +149,20 @@ ScalarVolumeData::ScalarVolumeData(ID3D11ShaderResourceView * pVolumeDataSRV, Da
 
 ScalarVolumeData::~ScalarVolumeData(void)
 {
-	// free each of the allocated arrays
-	std::for_each(m_data.begin(), m_data.end(), [](void* p) {if(p) delete[] p;});
-	std::for_each(m_histogram.begin(), m_histogram.end(), [](float* p) {delete[] p;});
-
 	ReleaseGPUBuffers();
 
+	for(auto it = m_normals.begin(); it != m_normals.end(); it++)
+		delete[] *it;
+
 	if(!m_externalData)
 		TwRemoveVar(pParametersBar, "Scalar Volume Data");
 }
 
-unsigned char ScalarVolumeData::SampleVolume(int volumeIdx, XMINT3 pos) {
-	assert(!m_externalData);
-	assert(m_format == DF_BYTE);
-
-	unsigned int elemPitch = sizeof(char);
-	unsigned int rowPitch = m_resolution.x * elemPitch;
-	unsigned int slicePitch = m_resolution.y * rowPitch;
-
-	pos.x = std::max(0, std::min(m_resolution.x - 1, pos.x));
-	pos.y = std::max(0, std::min(m_resolution.y - 1, pos.y));
-	pos.z = std::max(0, std::min(m_resolution.z - 1, pos.z));
-
-	return static_cast<unsigned char*>(m_data[volumeIdx])[pos.x * elemPitch + pos.y * rowPitch + pos.z * slicePitch];
-}
-
-XMVECTOR ScalarVolumeData::GetGradient(int volumeIdx, XMINT3 pos) {
-	assert(!m_externalData);
-	XMFLOAT3 grad;
-
-	grad.x = (float) SampleVolume(volumeIdx,XMINT3(pos.x + 1, pos.y, pos.z)) - SampleVolume(volumeIdx,XMINT3(pos.x - 1, pos.y, pos.z));
-	grad.y = (float) SampleVolume(volumeIdx,XMINT3(pos.x, pos.y + 1, pos.z)) - SampleVolume(volumeIdx,XMINT3(pos.x, pos.y - 1, pos.z));
-	grad.z = (float) SampleVolume(volumeIdx,XMINT3(pos.x, pos.y, pos.z + 1)) - SampleVolume(volumeIdx,XMINT3(pos.x, pos.y, pos.z - 1));
-	
-	return XMLoadFloat3(&grad);
-}
-
+/*
+	Computes the normals of the interpolated volume with a compute shader
+	This is only used for externally managed data, which never is in RAM. The normals of our own
+	data are computed on the CPU once per timestep, see UpdateNormals.
+*/
 void ScalarVolumeData::CalculateVolumeNormals() {
 	//std::cout << "Calculating Volume Normals..." << std::endl;
 
@@ -224,7 +251,7 @@ HRESULT ScalarVolumeData::CreateGPUBuffers(void)
 		desc.MiscFlags = 0;
 
 
-		initialData.pSysMem = m_data[0];
+		initialData.pSysMem = GetTimestepData(0);
 		initialData.SysMemPitch = m_resolution.x * m_elementSize;
 		initialData.SysMemSlicePitch = m_resolution.x * m_resolution.y * m_elementSize;
 
@@ -252,7 +279,7 @@ HRESULT ScalarVolumeData::CreateGPUBuffers(void)
 			desc.MiscFlags = 0;
 
 			ZeroMemory(&initialData, sizeof(initialData));
-			initialData.pSysMem = m_data[1];
+			initialData.pSysMem = GetTimestepData(1);
 			initialData.SysMemPitch = m_resolution.x * m_elementSize;
 			initialData.SysMemSlicePitch = m_resolution.x * m_resolution.y * m_elementSize;
 
@@ -316,6 +343,42 @@ HRESULT ScalarVolumeData::CreateNormalDataGPUBuffers(void)
 	if(m_pNormalTexture)
 		return S_OK;
 
+	if(!m_externalData) {
+		// the normals are uploaded from the CPU, one texture per timestep slot
+		DXGI_FORMAT fmt = GradientEngine::GetTextureFormat(m_normalEncoding);
+
+		D3D11_TEXTURE3D_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Width = m_resolution.x;
+		desc.Height = m_resolution.y;
+		desc.Depth = m_resolution.z;
+		desc.MipLevels = 1;
+		desc.Format = fmt;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.CPUAccessFlags = 0;
+		desc.MiscFlags = 0;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC pDesc;
+		ZeroMemory(&pDesc, sizeof(pDesc));
+		pDesc.Format = fmt;
+		pDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE3D;
+		pDesc.Texture3D.MipLevels = -1;
+		pDesc.Texture3D.MostDetailedMip = 0;
+
+		V_RETURN(pd3dDevice->CreateTexture3D(&desc, nullptr, &m_pNormalTexture));
+		V_RETURN(pd3dDevice->CreateShaderResourceView(m_pNormalTexture, &pDesc, &m_pNormalTextureSRV));
+		if(m_timeSequenceLength) {
+			V_RETURN(pd3dDevice->CreateTexture3D(&desc, nullptr, &m_pNormalTexture1));
+			V_RETURN(pd3dDevice->CreateShaderResourceView(m_pNormalTexture1, &pDesc, &m_pNormalTexture1SRV));
+		}
+
+		m_normalTimestep0 = -1;
+		m_normalTimestep1 = -1;
+		UpdateNormals();
+		return S_OK;
+	}
+
 	//create the normals texture
 	D3D11_TEXTURE3D_DESC desc;
 	ZeroMemory(&desc, sizeof(desc));
@@ -412,20 +475,20 @@ HRESULT ScalarVolumeData::CreateHistoGPUBuffers(void)
 	// create resources for the histogram
 	D3D11_TEXTURE1D_DESC hdesc;
 	ZeroMemory(&hdesc, sizeof(hdesc));
-	hdesc.Width = 255;
+	hdesc.Width = m_histogramBins;
 	hdesc.MipLevels = 1;					
-	hdesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	hdesc.Format = DXGI_FORMAT_R32_FLOAT;
 	hdesc.Usage = D3D11_USAGE_DEFAULT;
 	hdesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 	hdesc.CPUAccessFlags = 0;
 	hdesc.MiscFlags = 0;
 	hdesc.ArraySize = 1;
 
-	if(m_histogram.size()) {
+	if(m_histogram.size() && GetTimestepHistogram(0)) {
 		D3D11_SUBRESOURCE_DATA initialData;
 		ZeroMemory(&initialData, sizeof(initialData));
-		initialData.pSysMem = m_histogram[0];
-		initialData.SysMemPitch = 255 * 4 * sizeof(float);
+		initialData.pSysMem = GetTimestepHistogram(0);
+		initialData.SysMemPitch = m_histogramBins * sizeof(float);
 		initialData.SysMemSlicePitch = 0;
 
 		V_RETURN(pd3dDevice->CreateTexture1D(&hdesc, &initialData, &m_pHistoTexture));
@@ -435,7 +498,7 @@ HRESULT ScalarVolumeData::CreateHistoGPUBuffers(void)
 
 	D3D11_SHADER_RESOURCE_VIEW_DESC pHistoDesc;
 	ZeroMemory(&pHistoDesc, sizeof(pHistoDesc));
-	pHistoDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	pHistoDesc.Format = DXGI_FORMAT_R32_FLOAT;
 	pHistoDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE1D;
 	pHistoDesc.Texture1D.MipLevels = -1;
 	pHistoDesc.Texture1D.MostDetailedMip = 0;
@@ -460,6 +523,8 @@ void ScalarVolumeData::ReleaseGPUBuffers() {
 	SAFE_RELEASE(m_pInterpolatedTextureUAV);
 	SAFE_RELEASE(m_pNormalTextureSRV);
 	SAFE_RELEASE(m_pNormalTextureUAV);
+	SAFE_RELEASE(m_pNormalTexture1);
+	SAFE_RELEASE(m_pNormalTexture1SRV);
 
 	SAFE_RELEASE(m_pMinMaxTexture);
 	SAFE_RELEASE(m_pMinMaxTextureDownload);
@@ -476,6 +541,139 @@ ID3D11ShaderResourceView * ScalarVolumeData::GetNormalTextureSRV() {
 	return m_pNormalTextureSRV;
 };
 
+ID3D11ShaderResourceView * ScalarVolumeData::GetNormalTexture1SRV() {
+	// without a second timestep both slots show the same normals
+	if(!m_pNormalTexture1SRV)
+		return GetNormalTextureSRV();
+
+	return m_pNormalTexture1SRV;
+}
+
+float ScalarVolumeData::GetNormalsT() {
+	return m_pNormalTexture1SRV ? m_currentTimestepT : 0.f;
+}
+
+bool ScalarVolumeData::HasOctahedralNormals() {
+	return !m_externalData && m_normalEncoding == GradientEngine::NE_OCTAHEDRAL;
+}
+
+/*
+	Makes sure the normal textures hold the normals of the two timesteps currently on the GPU
+	The raycaster interpolates between them, so nothing has to be done as long as the timesteps
+	don't change, and a static volume gets its normals exactly once.
+*/
+void ScalarVolumeData::UpdateNormals(void)
+{
+	assert(!m_externalData);
+
+	int timestep0 = m_timeSequenceLength ? m_currentDatasetSlot0 : 0;
+	int timestep1 = m_timeSequenceLength ? m_currentDatasetSlot1 : -1;
+
+	// the textures are swapped around just like the volume SRVs when playing on
+	if(m_pNormalTexture1 && (m_normalTimestep1 == timestep0 || m_normalTimestep0 == timestep1)) {
+		std::swap(m_pNormalTexture, m_pNormalTexture1);
+		std::swap(m_pNormalTextureSRV, m_pNormalTexture1SRV);
+		std::swap(m_normalTimestep0, m_normalTimestep1);
+	}
+
+	int encodedSize = GradientEngine::GetEncodedSize(m_normalEncoding);
+	ID3D11DeviceContext * pContext;
+	pd3dDevice->GetImmediateContext(&pContext);
+
+	if(m_normalTimestep0 != timestep0) {
+		pContext->UpdateSubresource(m_pNormalTexture, 0, nullptr, GetTimestepNormals(timestep0),
+			m_resolution.x * encodedSize, m_resolution.x * m_resolution.y * encodedSize);
+		m_normalTimestep0 = timestep0;
+	}
+	if(m_pNormalTexture1 && m_normalTimestep1 != timestep1) {
+		pContext->UpdateSubresource(m_pNormalTexture1, 0, nullptr, GetTimestepNormals(timestep1),
+			m_resolution.x * encodedSize, m_resolution.x * m_resolution.y * encodedSize);
+		m_normalTimestep1 = timestep1;
+	}
+	SAFE_RELEASE(pContext);
+
+	EnforceNormalCacheSize(timestep0);
+}
+
+const char * ScalarVolumeData::GetTimestepNormals(int timestep)
+{
+	assert(timestep >= 0 && timestep < (int)m_normals.size());
+
+	if(!m_normals[timestep]) {
+		double start = GetTimeMs();
+		size_t voxels = (size_t)m_resolution.x * m_resolution.y * m_resolution.z;
+		m_normals[timestep] = new char[voxels * GradientEngine::GetEncodedSize(m_normalEncoding)];
+		GradientEngine::ComputeNormals(GetTimestepData(timestep), m_format, m_resolution, m_sliceThickness,
+			m_normalStencil, m_normalEncoding, m_normals[timestep]);
+		m_numCachedNormals++;
+		std::cout << "Normals of timestep " << timestep << " computed in " << GetTimeMs() - start << " ms" << std::endl;
+	}
+
+	return m_normals[timestep];
+}
+
+/**
+	Min/max brick pyramid of the volume the raycaster currently samples
+	The pyramids are kept per timestep, they only take a fraction of the data. After the first call
+	the prefetcher builds them along with the timesteps, only timesteps that were already resident
+	or not prefetched in time are built here. For time series the ranges of both timesteps are merged,
+	so they hold for every interpolation weight. Returns nullptr for data that is not in RAM.
+*/
+const BrickPyramid * ScalarVolumeData::GetBrickPyramid(void)
+{
+	if(m_externalData)
+		return nullptr;
+	m_buildBrickPyramids = true;
+
+	int timestep0 = GetSlotTimestep(0);
+	int timestep1 = GetSlotTimestep(1);
+	if(timestep1 < 0 || timestep1 == timestep0)
+		return GetTimestepBrickPyramid(timestep0);
+
+	if(timestep0 != m_brickPyramidTimestep0 || timestep1 != m_brickPyramidTimestep1) {
+		m_interpolatedBrickPyramid.Merge(*GetTimestepBrickPyramid(timestep0), *GetTimestepBrickPyramid(timestep1));
+		m_brickPyramidTimestep0 = timestep0;
+		m_brickPyramidTimestep1 = timestep1;
+	}
+	return &m_interpolatedBrickPyramid;
+}
+
+const BrickPyramid * ScalarVolumeData::GetTimestepBrickPyramid(int timestep)
+{
+	assert(timestep >= 0 && timestep < (int)m_brickPyramids.size());
+
+	if(!m_brickPyramids[timestep]) {
+		double start = GetTimeMs();
+		int resolution[3] = { m_resolution.x, m_resolution.y, m_resolution.z };
+		m_brickPyramids[timestep] = new BrickPyramid();
+		m_brickPyramids[timestep]->Build(GetTimestepData(timestep), m_format == DF_BYTE ? BrickPyramid::IF_BYTE : BrickPyramid::IF_FLOAT, resolution);
+		std::cout << "Brick pyramid of timestep " << timestep << " built in " << GetTimeMs() - start << " ms" << std::endl;
+	}
+
+	return m_brickPyramids[timestep];
+}
+
+// drops the cached normals farthest away from the current timestep until the cache fits
+void ScalarVolumeData::EnforceNormalCacheSize(int timestep0)
+{
+	int maxCached = std::max(2, normalCacheSize);
+	while(m_numCachedNormals > maxCached) {
+		int victim = -1;
+		for(int i = 0; i < (int)m_normals.size(); i++) {
+			if(!m_normals[i] || i == m_normalTimestep0 || i == m_normalTimestep1)
+				continue;
+			if(victim < 0 || abs(i - timestep0) > abs(victim - timestep0))
+				victim = i;
+		}
+		if(victim < 0)
+			break;
+
+		delete[] m_normals[victim];
+		m_normals[victim] = nullptr;
+		m_numCachedNormals--;
+	}
+}
+
 ID3D11ShaderResourceView * ScalarVolumeData::GetInterpolatedTextureSRV(void)
 {
 	if(m_timeSequenceLength)
@@ -489,25 +687,88 @@ void ScalarVolumeData::UpdateHistogram(int timestep0, int timestep1, float times
 		CreateHistoGPUBuffers();
 
 	//std::cout << "Histo Timestep: " << timestepT << std::endl;
-	float combinedHisto[4 * 256];
+	std::vector<float> combinedHisto(m_histogramBins, 0.f);
 	if(m_externalData) {
-		//we don't have a solution for histograms for metrics so we just set everything to a fixed value
-		for(int i=0; i < 256; i++) {
-			combinedHisto[4 * i] = .3f;
-		}
+		//generated volumes only live on the GPU, so we have to read them back
+		if(!ReadbackHistogram(combinedHisto.data()))
+			return;
 	}
 	else {
-		for(int i=0; i < 256; i++) {
-			combinedHisto[4 * i] = (1.f - timestepT) * m_histogram[timestep0][4*i] + timestepT * m_histogram[timestep1][4*i];
+		float * histo0 = GetTimestepHistogram(timestep0);
+		float * histo1 = GetTimestepHistogram(timestep1);
+		for(int i=0; i < m_histogramBins; i++) {
+			combinedHisto[i] = (1.f - timestepT) * histo0[i] + timestepT * histo1[i];
 		}
 	}
 	//update the texture
 	ID3D11DeviceContext * pContext;
 	pd3dDevice->GetImmediateContext(&pContext);
-	pContext->UpdateSubresource(m_pHistoTexture, 0, nullptr, combinedHisto, 256 * 4 * sizeof(float), 0);
+	pContext->UpdateSubresource(m_pHistoTexture, 0, nullptr, combinedHisto.data(), m_histogramBins * sizeof(float), 0);
 	SAFE_RELEASE(pContext);
 }
 
+/**
+	Computes the histogram of an externally managed volume, which is normalized to [0, 1]
+*/
+bool ScalarVolumeData::ReadbackHistogram(float * histogram)
+{
+	std::vector<float> values;
+	if(!ReadbackVolume(values))
+		return false;
+
+	HistogramEngine::Compute(values.data(), DF_FLOAT, sizeof(float), (unsigned int)values.size(), XMFLOAT2(0.f, 1.f), m_histogramBins, histogram);
+	return true;
+}
+
+/**
+	Copies a float volume that only lives on the GPU back to RAM through a staging texture
+	This stalls until the GPU has finished writing the volume, so it should not be done every frame.
+*/
+bool ScalarVolumeData::ReadbackVolume(std::vector<float> & values)
+{
+	assert(m_format == DF_FLOAT);
+	HRESULT hr;
+
+	ID3D11Resource * pResource;
+	m_pVolumeData0SRV->GetResource(&pResource);
+
+	D3D11_TEXTURE3D_DESC desc;
+	static_cast<ID3D11Texture3D*>(pResource)->GetDesc(&desc);
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc.MiscFlags = 0;
+
+	ID3D11Texture3D * pStaging = nullptr;
+	if(FAILED(hr = pd3dDevice->CreateTexture3D(&desc, nullptr, &pStaging))) {
+		SAFE_RELEASE(pResource);
+		return false;
+	}
+
+	ID3D11DeviceContext * pContext;
+	pd3dDevice->GetImmediateContext(&pContext);
+	pContext->CopyResource(pStaging, pResource);
+
+	// the mapped rows are padded, pack them tightly
+	values.resize(m_resolution.x * m_resolution.y * m_resolution.z);
+	D3D11_MAPPED_SUBRESOURCE ms;
+	if(SUCCEEDED(hr = pContext->Map(pStaging, 0, D3D11_MAP_READ, 0, &ms))) {
+		for(int z = 0; z < m_resolution.z; z++) {
+			for(int y = 0; y < m_resolution.y; y++) {
+				const char * row = static_cast<const char*>(ms.pData) + z * ms.DepthPitch + y * ms.RowPitch;
+				memcpy(&values[(z * m_resolution.y + y) * m_resolution.x], row, m_resolution.x * sizeof(float));
+			}
+		}
+		pContext->Unmap(pStaging, 0);
+	}
+
+	SAFE_RELEASE(pContext);
+	SAFE_RELEASE(pStaging);
+	SAFE_RELEASE(pResource);
+
+	return SUCCEEDED(hr);
+}
+
 void ScalarVolumeData::SetTime(float currentTime) 
 {
 	reinterpret_cast<VolumeData*>(this)->SetTime(currentTime);
@@ -515,17 +776,24 @@ void ScalarVolumeData::SetTime(float currentTime)
 	if(!m_externalData)
 		InterpolateTimesteps();
 
-	if(m_normalsRequired)
-		CalculateVolumeNormals();
+	if(m_normalsRequired && m_pNormalTexture) {
+		if(m_externalData)
+			CalculateVolumeNormals();
+		else
+			UpdateNormals();
+	}
 }
 
 void ScalarVolumeData::SetNormalsRequired(bool required)
 {
 	m_normalsRequired = required;
 	if(!required) {
+		// the cached normals are kept, so switching back only costs an upload
 		SAFE_RELEASE(m_pNormalTexture);
 		SAFE_RELEASE(m_pNormalTextureSRV);
 		SAFE_RELEASE(m_pNormalTextureUAV);
+		SAFE_RELEASE(m_pNormalTexture1);
+		SAFE_RELEASE(m_pNormalTexture1SRV);
 	}
 	else
 		//assure the buffers exist
@@ -543,6 +811,15 @@ void ScalarVolumeData::LoadConfig(SettingsStorage &store)
 
 XMFLOAT2 ScalarVolumeData::GetMinMax(void)
 {
+	// the interpolated volume lies within the range of both timesteps, so we can skip the reduction
+	XMFLOAT2 cachedRange;
+	if(GetCachedValueRange(m_currentDatasetSlot0, m_currentDatasetSlot1, cachedRange)) {
+		// byte textures are sampled as UNORM
+		if(m_format == DF_BYTE)
+			return XMFLOAT2(cachedRange.x / 255.f, cachedRange.y / 255.f);
+		return cachedRange;
+	}
+
 	if(!m_pMinMaxTexture)
 		CreateMinMaxGPUBuffers();
 
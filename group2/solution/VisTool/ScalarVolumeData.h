@@ -1,6 +1,8 @@
 #pragma once
 
 #include "VolumeData.h"
+#include "GradientEngine.h"
+#include "BrickPyramid.h"
 
 #include "SettingsStorage.h"
 
@@ -10,9 +12,15 @@ public:
 	// statics
 	static HRESULT Initialize(ID3D11Device * pd3dDevice, TwBar* pParametersBar);
 	static HRESULT Release(void);
+	static void SaveNormalConfig(SettingsStorage &store);
+	static void LoadNormalConfig(SettingsStorage &store);
+
+	static GradientEngine::Stencil normalStencil;		// normal settings, apply to data sets loaded after changing them
+	static GradientEngine::Encoding normalEncoding;
+	static int normalCacheSize;		// number of timesteps whose normals are kept in RAM
 
 	// ctors, dtor
-	ScalarVolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution, float timestep = 1.f, XMINT3 timestepIndices = XMINT3(0, 0, 1));
+	ScalarVolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution, float timestep = 1.f, XMINT3 timestepIndices = XMINT3(0, 0, 1), std::string metadataFileName = "");
 	ScalarVolumeData(ID3D11ShaderResourceView * pVolumeDataSRV, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution);
 	~ScalarVolumeData(void);
 
@@ -29,9 +37,14 @@ public:
 	virtual void UpdateHistogram(int timestep0, int timestep1, float timestepT) override;
 	void CalculateVolumeNormals(void);
 	XMFLOAT2 GetMinMax(void);
+	bool ReadbackVolume(std::vector<float> & values);
+	const BrickPyramid * GetBrickPyramid(void);
 
 	// accessors
 	ID3D11ShaderResourceView * GetNormalTextureSRV();
+	ID3D11ShaderResourceView * GetNormalTexture1SRV();
+	float GetNormalsT();
+	bool HasOctahedralNormals();
 	ID3D11ShaderResourceView * GetInterpolatedTextureSRV();
 
 protected:
@@ -54,11 +67,23 @@ protected:
 
 	// methods
 	void InterpolateTimesteps(void);
-	XMVECTOR GetGradient(int volumeIdx, XMINT3 pos);
-	unsigned char SampleVolume(int volumeIdx, XMINT3 pos);
+	bool ReadbackHistogram(float * histogram);
+	void UpdateNormals(void);
+	const char * GetTimestepNormals(int timestep);
+	void EnforceNormalCacheSize(int timestep0);
+	const BrickPyramid * GetTimestepBrickPyramid(int timestep);
 	
 	// members
 	bool m_normalsRequired;
+	GradientEngine::Stencil m_normalStencil;
+	GradientEngine::Encoding m_normalEncoding;
+	std::vector<char *> m_normals;	// encoded normals per timestep, nullptr if not computed yet
+	int m_numCachedNormals;
+	int m_normalTimestep0;			// the timestep currently loaded to m_pNormalTexture, -1 if none
+	int m_normalTimestep1;			// - " - of m_pNormalTexture1
+	BrickPyramid m_interpolatedBrickPyramid;	// union of the two timesteps on the GPU
+	int m_brickPyramidTimestep0;	// the timesteps m_interpolatedBrickPyramid was merged from, -1 if none
+	int m_brickPyramidTimestep1;
 
 	// dx resources
 	ID3D11Texture3D * m_pNormalTexture;
@@ -67,6 +92,8 @@ protected:
 	ID3D11UnorderedAccessView * m_pInterpolatedTextureUAV;
 	ID3D11ShaderResourceView * m_pNormalTextureSRV;
 	ID3D11UnorderedAccessView * m_pNormalTextureUAV;
+	ID3D11Texture3D * m_pNormalTexture1;			// normals of the second timestep, only for time series
+	ID3D11ShaderResourceView * m_pNormalTexture1SRV;
 
 	ID3D11Texture2D * m_pMinMaxTexture;
 	ID3D11Texture2D * m_pMinMaxTextureDownload;
@@ -8,6 +8,7 @@
 #include "SettingsStorage.h"
 #include "SliceVisualizer.h"
 #include "BoxManipulationManager.h"
+#include "PackedVolumeFile.h"
 
 #include "../../../external/rply-1.1.3/rply.h"
 
@@ -118,6 +119,12 @@ void TW_CALL Scene::CreateSliceVisualizerCB(void *clientData)
 	new SliceVisualizer(me->m_scalarVolumeData, me->m_vectorVolumeData);
 }
 
+void TW_CALL Scene::PackVolumeDataCB(void *clientData)
+{ 
+	Scene * me = static_cast<Scene*>(clientData);
+	me->PackVolumeData();
+}
+
 Scene::Scene(std::string sceneDatFile) :
 	m_sceneDatFile(sceneDatFile),
 	m_objectFileName(""),
@@ -188,6 +195,7 @@ Scene::~Scene(void)
 	TwRemoveVar(RayCaster::pParametersBar, "Ray Caster Enabled");
 	TwRemoveVar(pParametersBar, "Create Slice Visualization");
 	TwRemoveVar(SliceVisualizer::pParametersBar, "Create Slice Visualization");
+	TwRemoveVar(pParametersBar, "Pack Volume Data");
 	if(m_vectorVolumeData) {
 		TwRemoveVar(pParametersBar, "Glyph Rendering Enabled");
 		TwRemoveVar(GlyphVisualizer::pParametersBar, "Glyph Rendering Enabled");
@@ -302,6 +310,21 @@ void Scene::LoadSceneDatFile(std::string sceneDatFile)
 		datFile.getline(comment, sizeof(comment));
 	}
 
+	//a packed container describes itself, settings from the .dat file are overridden
+	if(PackedVolumeFile::IsPackedFile(m_objectFileName)) {
+		PackedVolumeFile packedFile;
+		if(packedFile.Open(m_objectFileName)) {
+			const PackedVolumeFile::Header & h = packedFile.GetHeader();
+			std::copy(h.resolution, h.resolution + 3, m_resolution);
+			std::copy(h.sliceThickness, h.sliceThickness + 3, m_sliceThickness);
+			m_objectFileFormat = (VolumeData::DataFormat)h.format;
+			volumeTimestep = h.timestep;
+			m_objectIndices[0] = 0;
+			m_objectIndices[1] = h.numTimesteps - 1;
+			m_objectIndices[2] = 1;
+		}
+	}
+
 	//calculate object size
 	m_boundingBoxSize[0] = m_resolution[0] * m_sliceThickness[0];
 	m_boundingBoxSize[1] = m_resolution[1] * m_sliceThickness[1];
@@ -319,10 +342,13 @@ void Scene::LoadSceneDatFile(std::string sceneDatFile)
 	TwAddVarCB(RayCaster::pParametersBar, "Ray Caster Enabled", TW_TYPE_BOOLCPP, SetRaycasterEnabledCB, GetRaycasterEnabledCB, this, "");
 	TwAddButton(pParametersBar, "Create Slice Visualization", CreateSliceVisualizerCB, this, "");
 	TwAddButton(SliceVisualizer::pParametersBar, "Create Slice Visualization", CreateSliceVisualizerCB, this, "");
+	TwAddButton(pParametersBar, "Pack Volume Data", PackVolumeDataCB, this, "help='Converts the raw timestep files into a single .vpk container next to the .dat file and writes a matching _packed.dat.'");
 
 	//load volume data
 	if(!m_objectFileName.empty())
 	{
+		//statistics of the data set are cached next to the .dat file
+		std::string metadataFileName = filepath + GetFilename(sceneDatFile, true) + ".vmeta";
 		//
 		switch(m_objectFileFormat) {
 		case VolumeData::DF_BYTE:
@@ -334,7 +360,8 @@ void Scene::LoadSceneDatFile(std::string sceneDatFile)
 					XMFLOAT3(m_sliceThickness[0], m_sliceThickness[1], m_sliceThickness[2]),
 					XMINT3(m_resolution[0], m_resolution[1], m_resolution[2]), 
 					volumeTimestep,
-					XMINT3(m_objectIndices[0], m_objectIndices[1], m_objectIndices[2]));
+					XMINT3(m_objectIndices[0], m_objectIndices[1], m_objectIndices[2]),
+					metadataFileName);
 
 				if(g_globals.volumeData)	delete g_globals.volumeData;
 				g_globals.volumeData = m_scalarVolumeData;
@@ -362,7 +389,8 @@ void Scene::LoadSceneDatFile(std::string sceneDatFile)
 					XMFLOAT3(m_sliceThickness[0], m_sliceThickness[1], m_sliceThickness[2]),
 					XMINT3(m_resolution[0], m_resolution[1], m_resolution[2]), 
 					volumeTimestep,
-					XMINT3(m_objectIndices[0], m_objectIndices[1], m_objectIndices[2]));
+					XMINT3(m_objectIndices[0], m_objectIndices[1], m_objectIndices[2]),
+					metadataFileName);
 				if(g_globals.volumeData)
 					delete g_globals.volumeData;
 				g_globals.volumeData = m_vectorVolumeData;
@@ -385,6 +413,32 @@ void Scene::LoadSceneDatFile(std::string sceneDatFile)
 	m_globalTransform = XMMatrixScaling(s, s, s) * XMMatrixTranslation(-0.5f*m_boundingBoxSize[0]*s, -0.5f*m_boundingBoxSize[1]*s, -0.5f*m_boundingBoxSize[2]*s);
 }
 
+/**
+	Packs the loaded time series into <scene>.vpk and writes <scene>_packed.dat referring to it
+*/
+void Scene::PackVolumeData()
+{
+	VolumeData * volumeData = m_scalarVolumeData ? static_cast<VolumeData*>(m_scalarVolumeData) : m_vectorVolumeData;
+	if(!volumeData)
+		return;
+
+	std::string datPath = GetPath(m_sceneDatFile);
+	std::string datName = GetFilename(m_sceneDatFile, true);
+	std::string packedFileName = datName + ".vpk";
+
+	if(!volumeData->PackTimeSeries(datPath + packedFileName))
+		return;
+
+	std::ofstream datFile(datPath + datName + "_packed.dat");
+	char absoluteMeshFile[1024];
+	CHAR relativeMeshFile[MAX_PATH];
+	if(!m_meshFileName.empty() && _fullpath(absoluteMeshFile, m_meshFileName.c_str(), 1024) &&
+		PathRelativePathToA(relativeMeshFile, datPath.c_str(), FILE_ATTRIBUTE_DIRECTORY, absoluteMeshFile, FILE_ATTRIBUTE_NORMAL))
+		datFile << "MeshFileName: " << relativeMeshFile << std::endl;
+	datFile << "ObjectFileName: " << packedFileName << std::endl;
+	std::cout << "Wrote \"" << datPath << datName << "_packed.dat\"." << std::endl;
+}
+
 void Scene::SaveConfig(SettingsStorage &store)
 {
 	CHAR relativeDatFile[MAX_PATH];
@@ -62,6 +62,7 @@ private:
 	static void TW_CALL GetGlyphVisualizerCB(void *value, void *clientData);
 	static void TW_CALL CreateParticleTracerCB(void *clientData);
 	static void TW_CALL CreateSliceVisualizerCB(void *clientData);
+	static void TW_CALL PackVolumeDataCB(void *clientData);
 
 	// static variables
 	static ID3D11Device * pd3dDevice;
@@ -70,6 +71,7 @@ private:
 	//methods
 	void loadPly(std::string scenePlyFile);	
 	void SetupTwBar(TwBar * pParametersBar);
+	void PackVolumeData();
 
 	// members
 
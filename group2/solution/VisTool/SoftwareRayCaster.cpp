@@ -0,0 +1,599 @@
+#include "SoftwareRayCaster.h"
+
+#include "util/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <fstream>
+
+static const char * modeNames[SoftwareRayCaster::NUM_MODES] = {
+	"box",
+	"front",
+	"back",
+	"basic_raycast",
+	"isosurface",
+	"isosurface_alpha",
+	"dvr",
+	"mip",
+	"dual_isosurface",
+	"isosurface_alpha_global",
+	"mip2"
+};
+
+namespace {
+	inline float Saturate(float x)
+	{
+		return std::max(0.f, std::min(1.f, x));
+	}
+
+	inline float Dot(const float a[3], const float b[3])
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	inline void Normalize(float v[3])
+	{
+		float l = std::sqrt(Dot(v, v));
+		if(l > 0.f)
+			for(int c = 0; c < 3; c++)
+				v[c] /= l;
+	}
+
+	// texel index and weight of the linear interpolation along one axis, clamped at the borders
+	inline void Texel(float coord, int resolution, int & i0, int & i1, float & f)
+	{
+		float x = std::max(0.f, std::min((float)(resolution - 1), coord * resolution - 0.5f));
+		i0 = std::min((int)x, std::max(0, resolution - 2));
+		i1 = std::min(i0 + 1, resolution - 1);
+		f = x - i0;
+	}
+
+	// marches one ray, every thread has its own for the sample counter
+	class Tracer
+	{
+	public:
+		Tracer(const float * volume, const int resolution[3], const float * tf, int tfSize, const SoftwareRayCaster::Parameters & params) :
+			samples(0), m_volume(volume), m_tf(tf), m_tfSize(tfSize), m_params(params), m_maxStepFactor(1.f)
+		{
+			std::copy(resolution, resolution + 3, m_resolution);
+			// the sampling rates hold for the neighbouring bricks, a step must not leave them
+			if(params.samplingRates) {
+				const BrickPyramid::Level & level = params.bricks->GetLevel(0);
+				int maxResolution = std::max(resolution[0], std::max(resolution[1], resolution[2]));
+				m_maxStepFactor = std::max(1.f, std::min(params.maxStepFactor, std::floor(level.brickSize / (params.stepsize * maxResolution))));
+				for(int c = 0; c < 3; c++)
+					m_bricksPerTexel[c] = (float)resolution[c] / level.brickSize;
+			}
+		}
+
+		// result is premultiplied RGBA, the ray is in texture space
+		void Trace(const float org[3], const float dir[3], float tMax, float result[4]);
+
+		size_t samples;
+
+	private:
+		float SampleVolume(const float p[3]);
+		float EmptySpace(const float pos[3], const float dir[3]) const;
+		float StepFactor(const float pos[3]) const;
+		void SampleTF(float s, float color[4]) const;
+		void VolumeLighting(const float surfaceColor[3], const float pos[3], float color[3]);
+		float FindFirstHit(const float org[3], const float dir[3], float tStart, float tMax, float outside, float surface, float pos[3]);
+		void Blend(const float color[4], float acc[4]) const;
+
+		void TraceIsoSurface(const float org[3], const float dir[3], float tMax, float result[4]);
+		void TraceIsoSurfaceAlpha(const float org[3], const float dir[3], float tMax, float terminationAlpha, float result[4]);
+		void TraceDualIsoSurface(const float org[3], const float dir[3], float tMax, float result[4]);
+		void TraceDVR(const float org[3], const float dir[3], float tMax, float result[4]);
+		void TraceMIP(const float org[3], const float dir[3], float tMax, bool byOpacity, float result[4]);
+
+		const float *	m_volume;
+		int				m_resolution[3];
+		const float *	m_tf;
+		int				m_tfSize;
+		const SoftwareRayCaster::Parameters & m_params;
+		float			m_maxStepFactor;		// params.maxStepFactor limited to steps within a brick
+		float			m_bricksPerTexel[3];
+	};
+
+	float Tracer::SampleVolume(const float p[3])
+	{
+		samples++;
+		int x0, x1, y0, y1, z0, z1;
+		float fx, fy, fz;
+		Texel(p[0], m_resolution[0], x0, x1, fx);
+		Texel(p[1], m_resolution[1], y0, y1, fy);
+		Texel(p[2], m_resolution[2], z0, z1, fz);
+
+		const size_t rx = m_resolution[0], slice = rx * m_resolution[1];
+		const float * s0 = m_volume + z0 * slice;
+		const float * s1 = m_volume + z1 * slice;
+		float c00 = s0[y0 * rx + x0] + fx * (s0[y0 * rx + x1] - s0[y0 * rx + x0]);
+		float c10 = s0[y1 * rx + x0] + fx * (s0[y1 * rx + x1] - s0[y1 * rx + x0]);
+		float c01 = s1[y0 * rx + x0] + fx * (s1[y0 * rx + x1] - s1[y0 * rx + x0]);
+		float c11 = s1[y1 * rx + x0] + fx * (s1[y1 * rx + x1] - s1[y1 * rx + x0]);
+		float c0 = c00 + fy * (c10 - c00);
+		float c1 = c01 + fy * (c11 - c01);
+		return c0 + fz * (c1 - c0);
+	}
+
+	// distance along the ray to the exit of the empty region around pos, 0 if the brick at pos is occupied
+	float Tracer::EmptySpace(const float pos[3], const float dir[3]) const
+	{
+		float nodeMin[3], nodeMax[3];
+		bool empty = m_params.distances ? m_params.distances->FindEmptyRegion(pos, nodeMin, nodeMax)
+			: m_params.bricks && m_params.occupancy && m_params.bricks->FindEmptyNode(*m_params.occupancy, pos, nodeMin, nodeMax);
+		if(!empty)
+			return 0.f;
+		float t = FLT_MAX;
+		for(int c = 0; c < 3; c++) {
+			if(dir[c] > 0.f)
+				t = std::min(t, (nodeMax[c] - pos[c]) / dir[c]);
+			else if(dir[c] < 0.f)
+				t = std::min(t, (nodeMin[c] - pos[c]) / dir[c]);
+		}
+		return t;
+	}
+
+	// StepFactor of RayCaster.fx, the brick containing pos sets the length of the next DVR step
+	float Tracer::StepFactor(const float pos[3]) const
+	{
+		if(!m_params.samplingRates)
+			return 1.f;
+		const BrickPyramid::Level & level = m_params.bricks->GetLevel(0);
+		int brick[3];
+		for(int c = 0; c < 3; c++) {
+			// truncation is floor after the clamping
+			brick[c] = std::max(0, std::min(level.numBricks[c] - 1, (int)(pos[c] * m_bricksPerTexel[c])));
+		}
+		float rate = (*m_params.samplingRates)[level.Index(brick[0], brick[1], brick[2])];
+		float factor = m_params.samplingTolerance / (rate * m_params.pixelStepsize);
+		if(!(factor < m_maxStepFactor))
+			return m_maxStepFactor;
+		return std::max(1.f, (float)(int)factor);
+	}
+
+	void Tracer::SampleTF(float s, float color[4]) const
+	{
+		int i0, i1;
+		float f;
+		Texel(s, m_tfSize, i0, i1, f);
+		for(int c = 0; c < 4; c++)
+			color[c] = m_tf[4 * i0 + c] + f * (m_tf[4 * i1 + c] - m_tf[4 * i0 + c]);
+	}
+
+	// volumeLighting of RayCaster.fx with the normal computed on the fly
+	void Tracer::VolumeLighting(const float surfaceColor[3], const float pos[3], float color[3])
+	{
+		float n[3];
+		for(int c = 0; c < 3; c++) {
+			float p[3] = { pos[0], pos[1], pos[2] };
+			float h = 1.f / m_resolution[c];
+			p[c] = pos[c] + h;
+			float s1 = SampleVolume(p);
+			p[c] = pos[c] - h;
+			float s0 = SampleVolume(p);
+			n[c] = (s0 - s1) / (2.f * m_params.spacing[c]);
+		}
+		Normalize(n);
+
+		float l[3];
+		for(int c = 0; c < 3; c++)
+			l[c] = m_params.lightPos[c] - pos[c];
+		Normalize(l);
+		// the viewer is at the light, so v = l
+		float dotNL = Dot(n, l);
+		float rl[3];
+		for(int c = 0; c < 3; c++)
+			rl[c] = 2.f * dotNL * n[c] - l[c];
+		float specular = dotNL > 0.f ? std::pow(Saturate(Dot(rl, l)), m_params.specularExp) : 0.f;
+		dotNL = Saturate(dotNL);
+
+		for(int c = 0; c < 3; c++)
+			color[c] = m_params.specular * m_params.lightColor[c] * specular
+				+ m_params.diffuse * m_params.lightColor[c] * surfaceColor[c] * dotNL
+				+ m_params.ambient * surfaceColor[c];
+	}
+
+	// findFirstHitSurface of RayCaster.fx, returns the ray parameter (tMax + 1 if there is no hit)
+	float Tracer::FindFirstHit(const float org[3], const float dir[3], float tStart, float tMax, float outside, float surface, float pos[3])
+	{
+		for(float t = tStart; t < tMax; t += m_params.stepsize) {
+			float tNew = t + m_params.stepsize;
+			for(int c = 0; c < 3; c++)
+				pos[c] = org[c] + tNew * dir[c];
+			if(outside * SampleVolume(pos) > outside * surface) {
+				// binary search to refine the intersection point
+				float t1 = t, t2 = tNew;
+				for(int i = 0; i < m_params.binSearchSteps; i++) {
+					float tMid = 0.5f * (t1 + t2);
+					float p[3] = { org[0] + tMid * dir[0], org[1] + tMid * dir[1], org[2] + tMid * dir[2] };
+					if(outside * SampleVolume(p) < outside * surface)
+						t1 = tMid;
+					else
+						t2 = tMid;
+					for(int c = 0; c < 3; c++)
+						pos[c] = p[c];
+				}
+				return t;
+			}
+
+			// no sample in an empty node is a hit either, continue with the last one inside
+			float skip = EmptySpace(pos, dir);
+			if(skip > 0.f)
+				t = tNew + std::floor(skip / m_params.stepsize) * m_params.stepsize - m_params.stepsize;
+		}
+		return tMax + 1.f;
+	}
+
+	// front to back blending of a non-premultiplied color
+	void Tracer::Blend(const float color[4], float acc[4]) const
+	{
+		float oneMinusAlpha = 1.f - acc[3];
+		for(int c = 0; c < 3; c++)
+			acc[c] += oneMinusAlpha * color[3] * color[c];
+		acc[3] += oneMinusAlpha * color[3];
+	}
+
+	void Tracer::TraceIsoSurface(const float org[3], const float dir[3], float tMax, float result[4])
+	{
+		float outside = SampleVolume(org) < m_params.isoValue ? 1.f : -1.f;
+		float pos[3];
+		if(FindFirstHit(org, dir, 0.f, tMax, outside, m_params.isoValue, pos) > tMax)
+			return;
+		VolumeLighting(m_params.surfaceColor, pos, result);
+		result[3] = 1.f;
+	}
+
+	void Tracer::TraceIsoSurfaceAlpha(const float org[3], const float dir[3], float tMax, float terminationAlpha, float result[4])
+	{
+		float outside = SampleVolume(org) < m_params.isoValue ? 1.f : -1.f;
+		float pos[3];
+		float t = FindFirstHit(org, dir, 0.f, tMax, outside, m_params.isoValue, pos);
+		while(t < tMax) {
+			float color[4];
+			VolumeLighting(m_params.surfaceColor, pos, color);
+			color[3] = m_params.surfaceColor[3];
+			Blend(color, result);
+
+			//early ray termination
+			if(result[3] >= terminationAlpha) {
+				result[3] = 1.f;
+				break;
+			}
+
+			//now we're on the other side of the surface
+			outside = -outside;
+			t = FindFirstHit(org, dir, t + m_params.stepsize, tMax, outside, m_params.isoValue, pos);
+		}
+	}
+
+	void Tracer::TraceDualIsoSurface(const float org[3], const float dir[3], float tMax, float result[4])
+	{
+		const float * isoValues[2] = { &m_params.isoValue, &m_params.isoValue2 };
+		const float * colors[2] = { m_params.surfaceColor, m_params.surfaceColor2 };
+
+		float v = SampleVolume(org);
+		float outside[2], t[2], pos[2][3];
+		for(int s = 0; s < 2; s++) {
+			outside[s] = v < *isoValues[s] ? 1.f : -1.f;
+			t[s] = FindFirstHit(org, dir, 0.f, tMax, outside[s], *isoValues[s], pos[s]);
+		}
+
+		while(t[0] <= tMax || t[1] <= tMax) {
+			int s = t[0] < t[1] ? 0 : 1;
+			float color[4];
+			VolumeLighting(colors[s], pos[s], color);
+			color[3] = colors[s][3];
+			Blend(color, result);
+
+			//early ray termination
+			if(result[3] >= m_params.terminationAlpha) {
+				result[3] = 1.f;
+				break;
+			}
+
+			outside[s] = -outside[s];
+			t[s] = FindFirstHit(org, dir, t[s] + m_params.stepsize, tMax, outside[s], *isoValues[s], pos[s]);
+		}
+	}
+
+	void Tracer::TraceDVR(const float org[3], const float dir[3], float tMax, float result[4])
+	{
+		const PreIntegrationTable * table = m_params.preIntegration;
+		float sFront = -1.f;		// value of the previous sample, negative if it was not taken
+		bool frontEmpty = true;		// the previous sample was in an empty node
+		float step = 1.f;			// from the previous sample in units of the step size
+		for(float t = 0.f; t < tMax; t += step * m_params.stepsize) {
+			float pos[3] = { org[0] + t * dir[0], org[1] + t * dir[1], org[2] + t * dir[2] };
+
+			// the samples up to the exit of an empty node are transparent
+			// pre-integrated, the segment from an occupied node into an empty one is integrated first
+			float skip = EmptySpace(pos, dir);
+			if(skip > 0.f && (!table || frontEmpty)) {
+				t += std::floor(skip / m_params.stepsize) * m_params.stepsize;
+				sFront = -1.f;
+				step = 1.f;
+				continue;
+			}
+
+			float s = SampleVolume(pos);
+			float color[4];
+			if(table) {
+				// behind an empty node the segment still starts at the previous sample position
+				if(sFront < 0.f) {
+					float back = step * m_params.stepsize;
+					float prev[3] = { pos[0] - back * dir[0], pos[1] - back * dir[1], pos[2] - back * dir[2] };
+					sFront = t > 0.f ? SampleVolume(prev) : s;
+				}
+				float entry[4];
+				table->Sample(sFront, s, entry);
+				PreIntegrationTable::Segment(entry, step * m_params.pixelStepsize, m_params.globalAlphaScale, color);
+				sFront = s;
+				frontEmpty = skip > 0.f;
+			}
+			else {
+				SampleTF(s, color);
+				color[3] *= m_params.globalAlphaScale * m_params.pixelStepsize;
+				// a long step is as opaque as that many steps of the same sample
+				if(step > 1.f)
+					color[3] = 1.f - std::pow(1.f - std::min(color[3], 1.f), step);
+			}
+
+			if(m_params.dvrLighting && color[3] > 0.f)
+				VolumeLighting(color, pos, color);
+
+			Blend(color, result);
+
+			//early ray termination
+			if(result[3] >= m_params.terminationAlpha) {
+				result[3] = 1.f;
+				break;
+			}
+
+			step = StepFactor(pos);
+		}
+	}
+
+	// byOpacity selects psMIP2, which takes the sample with the highest opacity instead of value
+	void Tracer::TraceMIP(const float org[3], const float dir[3], float tMax, bool byOpacity, float result[4])
+	{
+		float maximum = 0.f;
+		float color[4] = { 0.f, 0.f, 0.f, 0.f };
+		for(float t = 0.f; t < tMax; t += m_params.stepsize) {
+			float pos[3] = { org[0] + t * dir[0], org[1] + t * dir[1], org[2] + t * dir[2] };
+			float s = SampleVolume(pos);
+			if(byOpacity) {
+				float c[4];
+				SampleTF(s, c);
+				if(maximum < c[3]) {
+					maximum = c[3];
+					std::copy(c, c + 4, color);
+				}
+			}
+			else
+				maximum = std::max(maximum, s);
+		}
+		if(!byOpacity)
+			SampleTF(maximum, color);
+
+		for(int c = 0; c < 3; c++)
+			result[c] = color[c] * color[3];
+		result[3] = color[3];
+	}
+
+	void Tracer::Trace(const float org[3], const float dir[3], float tMax, float result[4])
+	{
+		switch(m_params.mode) {
+		case SoftwareRayCaster::MODE_ISOSURFACE:
+			TraceIsoSurface(org, dir, tMax, result);
+			break;
+		case SoftwareRayCaster::MODE_ISOSURFACE_ALPHA:
+			TraceIsoSurfaceAlpha(org, dir, tMax, m_params.terminationAlpha, result);
+			break;
+		case SoftwareRayCaster::MODE_ISOSURFACE_ALPHA_GLOBAL:
+			// all fragments are blended, there is no termination
+			TraceIsoSurfaceAlpha(org, dir, tMax, 2.f, result);
+			break;
+		case SoftwareRayCaster::MODE_DUAL_ISOSURFACE:
+			TraceDualIsoSurface(org, dir, tMax, result);
+			break;
+		case SoftwareRayCaster::MODE_DVR:
+			TraceDVR(org, dir, tMax, result);
+			break;
+		case SoftwareRayCaster::MODE_MIP:
+		case SoftwareRayCaster::MODE_MIP2:
+			TraceMIP(org, dir, tMax, m_params.mode == SoftwareRayCaster::MODE_MIP2, result);
+			break;
+		default:
+			break;
+		}
+	}
+
+	// NDC to texture space
+	void Unproject(const float m[16], float x, float y, float z, float p[3])
+	{
+		float in[4] = { x, y, z, 1.f };
+		float out[4];
+		for(int j = 0; j < 4; j++)
+			out[j] = in[0] * m[j] + in[1] * m[4 + j] + in[2] * m[8 + j] + in[3] * m[12 + j];
+		for(int c = 0; c < 3; c++)
+			p[c] = out[c] / out[3];
+	}
+
+	// intersects the segment from a to a + d (t in [0, 1]) with the box
+	bool ClipSegment(const float a[3], const float d[3], const float boxMin[3], const float boxMax[3], float & tEntry, float & tExit)
+	{
+		tEntry = 0.f;
+		tExit = 1.f;
+		for(int c = 0; c < 3; c++) {
+			if(d[c] == 0.f) {
+				if(a[c] < boxMin[c] || a[c] > boxMax[c])
+					return false;
+				continue;
+			}
+			float t0 = (boxMin[c] - a[c]) / d[c];
+			float t1 = (boxMax[c] - a[c]) / d[c];
+			if(t0 > t1)
+				std::swap(t0, t1);
+			tEntry = std::max(tEntry, t0);
+			tExit = std::min(tExit, t1);
+		}
+		return tEntry < tExit;
+	}
+}
+
+SoftwareRayCaster::Parameters::Parameters() :
+	mode(MODE_DVR),
+	width(512),
+	height(512),
+	stepsize(1.f / 256.f),
+	pixelStepsize(1.f),
+	terminationAlpha(0.95f),
+	globalAlphaScale(1.f),
+	binSearchSteps(5),
+	isoValue(0.5f),
+	isoValue2(0.7f),
+	dvrLighting(false),
+	ambient(0.1f),
+	diffuse(0.7f),
+	specular(0.2f),
+	specularExp(20.f),
+	tileSize(16),
+	bricks(nullptr),
+	occupancy(nullptr),
+	distances(nullptr),
+	preIntegration(nullptr),
+	samplingRates(nullptr),
+	samplingTolerance(0.05f),
+	maxStepFactor(4.f)
+{
+	for(int i = 0; i < 16; i++)
+		worldViewProjInv[i] = i % 5 ? 0.f : 1.f;
+	for(int c = 0; c < 3; c++) {
+		boxMin[c] = 0.f;
+		boxMax[c] = 1.f;
+		spacing[c] = 1.f;
+		lightPos[c] = 0.f;
+		lightColor[c] = 1.f;
+	}
+	for(int c = 0; c < 4; c++) {
+		surfaceColor[c] = 1.f;
+		surfaceColor2[c] = 1.f;
+	}
+}
+
+SoftwareRayCaster::Statistics SoftwareRayCaster::Render(const float * volume, const int resolution[3], const float * tf, int tfSize,
+	const Parameters & params, Image & image)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	image.width = params.width;
+	image.height = params.height;
+	image.rgba.assign(4 * (size_t)params.width * params.height, 0.f);
+
+	const int tilesX = (params.width + params.tileSize - 1) / params.tileSize;
+	const int tilesY = (params.height + params.tileSize - 1) / params.tileSize;
+	std::atomic<size_t> rays(0), samples(0);
+
+	ThreadPool::GetShared().ParallelForRange(0, tilesX * tilesY, [&](int begin, int end) {
+		Tracer tracer(volume, resolution, tf, tfSize, params);
+		size_t tileRays = 0;
+		for(int tile = begin; tile < end; tile++) {
+			int x0 = (tile % tilesX) * params.tileSize;
+			int y0 = (tile / tilesX) * params.tileSize;
+			int x1 = std::min(x0 + params.tileSize, params.width);
+			int y1 = std::min(y0 + params.tileSize, params.height);
+			for(int y = y0; y < y1; y++) {
+				for(int x = x0; x < x1; x++) {
+					// ray through the pixel center from the near to the far plane
+					float ndcX = (x + 0.5f) / params.width * 2.f - 1.f;
+					float ndcY = 1.f - (y + 0.5f) / params.height * 2.f;
+					float nearPos[3], farPos[3], d[3];
+					Unproject(params.worldViewProjInv, ndcX, ndcY, 0.f, nearPos);
+					Unproject(params.worldViewProjInv, ndcX, ndcY, 1.f, farPos);
+					for(int c = 0; c < 3; c++)
+						d[c] = farPos[c] - nearPos[c];
+
+					float tEntry, tExit;
+					if(!ClipSegment(nearPos, d, params.boxMin, params.boxMax, tEntry, tExit))
+						continue;
+					tileRays++;
+
+					float entry[3], exit[3], dir[3];
+					for(int c = 0; c < 3; c++) {
+						entry[c] = nearPos[c] + tEntry * d[c];
+						exit[c] = nearPos[c] + tExit * d[c];
+						dir[c] = exit[c] - entry[c];
+					}
+					float rayLength = std::sqrt(Dot(dir, dir));
+					for(int c = 0; c < 3; c++)
+						dir[c] /= rayLength;
+
+					float * result = &image.rgba[4 * ((size_t)y * params.width + x)];
+					switch(params.mode) {
+					case MODE_BOX:
+					case MODE_FRONT:
+					case MODE_BASIC_RAYCAST:
+						std::copy(entry, entry + 3, result);
+						result[3] = 1.f;
+						break;
+					case MODE_BACK:
+						std::copy(exit, exit + 3, result);
+						result[3] = 1.f;
+						break;
+					default:
+						tracer.Trace(entry, dir, rayLength, result);
+						break;
+					}
+				}
+			}
+		}
+		rays += tileRays;
+		samples += tracer.samples;
+	});
+
+	Statistics stats;
+	stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	stats.rays = rays;
+	stats.samples = samples;
+	return stats;
+}
+
+const char * SoftwareRayCaster::GetModeName(Mode mode)
+{
+	return modeNames[mode];
+}
+
+bool SoftwareRayCaster::GetModeFromName(const char * name, Mode & mode)
+{
+	for(int i = 0; i < NUM_MODES; i++) {
+		if(!strcmp(name, modeNames[i])) {
+			mode = (Mode)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SoftwareRayCaster::WritePPM(const std::string & fileName, const Image & image, const float background[3])
+{
+	std::ofstream out(fileName, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	if(!out)
+		return false;
+
+	out << "P6\n" << image.width << " " << image.height << "\n255\n";
+	std::vector<unsigned char> row(3 * image.width);
+	for(int y = 0; y < image.height; y++) {
+		for(int x = 0; x < image.width; x++) {
+			const float * p = &image.rgba[4 * ((size_t)y * image.width + x)];
+			for(int c = 0; c < 3; c++)
+				row[3 * x + c] = (unsigned char)(Saturate(p[c] + (1.f - p[3]) * background[c]) * 255.f + 0.5f);
+		}
+		out.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+	return out.good();
+}
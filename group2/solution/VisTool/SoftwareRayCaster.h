@@ -0,0 +1,103 @@
+#pragma once
+
+#include "BrickPyramid.h"
+#include "DistanceField.h"
+#include "PreIntegrationTable.h"
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+/*
+	CPU volume raycaster implementing the passes of RayCaster.fx
+	Rays are set up like on the GPU: the clipping box (in texture space) is intersected with the ray
+	through the pixel center, the ray is marched from the entry to the exit point with the same step
+	size, opacity scaling, early ray termination and binary search as the pixel shaders. The volume
+	and the transfer function are sampled trilinearly/linearly at texel centers, clamped at the
+	borders. Normals are central differences of the sampled volume (one voxel apart, scaled by the
+	voxel spacing) pointing against the gradient like those of the GradientEngine. There is no depth
+	buffer, rays always end at the box; the global alpha iso pass blends all hits in order, which is
+	what the transparency module ends up doing.
+	Given a brick pyramid with its occupancy for the pass, the DVR and iso passes leap over empty
+	nodes to the first sample behind them, so they take the same samples as without up to rounding.
+	A distance field over the occupied bricks replaces the nodes by the empty cube around the sample.
+	With a pre-integration table DVR composites the segments between samples like psDVR does.
+	Given the sampling rates of the bricks, DVR takes steps of whole multiples of the step size
+	where the classified color changes slowly.
+	The image is split into square tiles which are rendered on the shared thread pool. Besides
+	that it only uses the other headless modules above, the RaycastBatch command line tool renders
+	with it on machines without a GPU, e.g. for regression images or as a performance reference.
+*/
+class SoftwareRayCaster
+{
+public:
+	// same values as RayCaster::PassType
+	enum Mode {
+		MODE_BOX,
+		MODE_FRONT,			// texture coordinates of the entry point
+		MODE_BACK,			// - " - of the exit point
+		MODE_BASIC_RAYCAST,	// like front
+		MODE_ISOSURFACE,
+		MODE_ISOSURFACE_ALPHA,
+		MODE_DVR,
+		MODE_MIP,
+		MODE_DUAL_ISOSURFACE,
+		MODE_ISOSURFACE_ALPHA_GLOBAL,
+		MODE_MIP2,
+		NUM_MODES
+	};
+
+	struct Parameters {
+		Mode	mode;
+		int		width, height;			// of the image
+		float	worldViewProjInv[16];	// NDC to texture space, row-major for row vectors like XMFLOAT4X4
+		float	boxMin[3], boxMax[3];	// clipping box in texture space
+		float	stepsize;				// in texture space, g_raycastStepsize
+		float	pixelStepsize;			// opacity scaling of a step, g_raycastPixelStepsize
+		float	terminationAlpha;
+		float	globalAlphaScale;
+		int		binSearchSteps;
+		float	isoValue, isoValue2;
+		float	surfaceColor[4], surfaceColor2[4];
+		bool	dvrLighting;
+		float	spacing[3];				// voxel size for the normals
+		float	lightPos[3];			// in texture space, the light is also the viewer
+		float	lightColor[3];
+		float	ambient, diffuse, specular, specularExp;
+		int		tileSize;				// in pixels
+		const BrickPyramid * bricks;	// for empty-space skipping and adaptive steps
+		const BrickPyramid::Occupancy * occupancy;	// classified for the mode, nullptr disables skipping
+		const DistanceField * distances;	// of the occupancy, used instead of the pyramid if set
+		const PreIntegrationTable * preIntegration;	// of tf for DVR, nullptr samples tf at the points
+		const std::vector<float> * samplingRates;	// ClassifySamplingRate of bricks for DVR, nullptr for a fixed step
+		float	samplingTolerance;		// change of the classified color allowed per step
+		float	maxStepFactor;			// longest DVR step in units of stepsize
+
+		Parameters();
+	};
+
+	// premultiplied RGBA per pixel, rows top to bottom
+	struct Image {
+		int					width, height;
+		std::vector<float>	rgba;
+	};
+
+	struct Statistics {
+		double	milliseconds;
+		size_t	rays;		// pixels whose ray hit the clipping box
+		size_t	samples;	// volume samples taken, including the binary search and normals
+
+		double RaysPerSecond() const {	return milliseconds > 0. ? rays * 1000. / milliseconds : 0.;	};
+	};
+
+	// volume are float values (x fastest), tf are tfSize RGBA entries
+	static Statistics Render(const float * volume, const int resolution[3], const float * tf, int tfSize,
+		const Parameters & params, Image & image);
+
+	// lower case names without the prefix, e.g. "dvr"
+	static const char * GetModeName(Mode mode);
+	static bool GetModeFromName(const char * name, Mode & mode);
+
+	// composites the image over the background and writes it as binary PPM
+	static bool WritePPM(const std::string & fileName, const Image & image, const float background[3]);
+};
@@ -0,0 +1,234 @@
+#include "StreamlinePlacement.h"
+
+#include <deque>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+namespace {
+	// same as CL_STAGNATION_DISTANCE in ParticleTracer.fx
+	const float STAGNATION_DISTANCE = 1e-6f;
+
+	// uniform grid over texture space, the cells are hashed into a fixed number of buckets
+	class HashGrid {
+	public:
+		HashGrid(float cellSize, size_t numBuckets) :
+			m_invCellSize(1.f / cellSize),
+			m_buckets(numBuckets),
+			m_mask(numBuckets - 1)
+		{
+			assert((numBuckets & m_mask) == 0);
+		}
+
+		void Insert(const float p[3])
+		{
+			Point point = { p[0], p[1], p[2] };
+			m_buckets[Hash(Cell(p[0]), Cell(p[1]), Cell(p[2]))].push_back(point);
+		}
+
+		// radius must not exceed the cell size
+		bool HasPointWithin(const float p[3], float radius) const
+		{
+			int cx = Cell(p[0]), cy = Cell(p[1]), cz = Cell(p[2]);
+			float radius2 = radius * radius;
+			for(int z = cz - 1; z <= cz + 1; z++)
+				for(int y = cy - 1; y <= cy + 1; y++)
+					for(int x = cx - 1; x <= cx + 1; x++) {
+						// other cells in the same bucket are farther away and fail the distance test
+						const std::vector<Point> & bucket = m_buckets[Hash(x, y, z)];
+						for(auto it = bucket.begin(); it != bucket.end(); it++) {
+							float dx = it->x - p[0], dy = it->y - p[1], dz = it->z - p[2];
+							if(dx * dx + dy * dy + dz * dz < radius2)
+								return true;
+						}
+					}
+			return false;
+		}
+
+	private:
+		struct Point {
+			float x, y, z;
+		};
+
+		int Cell(float x) const {	return (int)std::floor(x * m_invCellSize);	}
+		size_t Hash(int x, int y, int z) const {
+			return ((unsigned)x * 73856093u ^ (unsigned)y * 19349663u ^ (unsigned)z * 83492791u) & m_mask;
+		}
+
+		float								m_invCellSize;
+		std::vector<std::vector<Point>>		m_buckets;
+		size_t								m_mask;
+	};
+
+	inline float Length(const float v[3])
+	{
+		return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	}
+
+	// like the test in StreamlineStep of ParticleTracer.fx
+	inline bool InsideVolume(const float p[3])
+	{
+		return p[0] > 0.f && p[1] > 0.f && p[2] > 0.f && p[0] <= 1.f && p[1] <= 1.f && p[2] <= 1.f;
+	}
+
+	inline bool InsideRegion(const float p[3], const float regionMin[3], const float regionMax[3])
+	{
+		for(int c = 0; c < 3; c++)
+			if(p[c] < regionMin[c] || p[c] > regionMax[c])
+				return false;
+		return true;
+	}
+
+	// fixed steps from the seed until the line leaves the volume, stagnates or comes closer than
+	// testDistance to an accepted line, the vertices are appended as xyz
+	void Integrate(const AdvectionEngine & engine, const StreamlinePlacement::Parameters & params, const HashGrid & grid,
+		const float seed[3], float testDistance, std::vector<float> & vertices)
+	{
+		float p[3] = { seed[0], seed[1], seed[2] };
+		vertices.assign(p, p + 3);
+		for(int i = 1; i < params.maxVertices && InsideVolume(p); i++) {
+			float v[3];
+			engine.Sample(p, params.timestepT, v);
+			float step[3];
+			for(int c = 0; c < 3; c++)
+				step[c] = params.stepsize * v[c] * params.velocityScaling[c];
+			if(Length(step) < STAGNATION_DISTANCE)
+				break;
+
+			float next[3] = { p[0] + step[0], p[1] + step[1], p[2] + step[2] };
+			if(grid.HasPointWithin(next, testDistance))
+				break;
+			vertices.insert(vertices.end(), next, next + 3);
+			std::copy(next, next + 3, p);
+		}
+	}
+
+	// two unit vectors perpendicular to t and to each other
+	void PerpendicularBasis(const float t[3], float n1[3], float n2[3])
+	{
+		// cross t with the axis it is least aligned with
+		int axis = 0;
+		for(int c = 1; c < 3; c++)
+			if(std::abs(t[c]) < std::abs(t[axis]))
+				axis = c;
+		float a[3] = { 0.f, 0.f, 0.f };
+		a[axis] = 1.f;
+
+		n1[0] = t[1] * a[2] - t[2] * a[1];
+		n1[1] = t[2] * a[0] - t[0] * a[2];
+		n1[2] = t[0] * a[1] - t[1] * a[0];
+		float l = Length(n1);
+		for(int c = 0; c < 3; c++)
+			n1[c] /= l;
+
+		n2[0] = t[1] * n1[2] - t[2] * n1[1];
+		n2[1] = t[2] * n1[0] - t[0] * n1[2];
+		n2[2] = t[0] * n1[1] - t[1] * n1[0];
+	}
+}
+
+StreamlinePlacement::Parameters::Parameters() :
+	separation(0.05f),
+	testRatio(0.5f),
+	stepsize(0.1f),
+	maxVertices(150),
+	maxLines(1000),
+	timestepT(0.f)
+{
+	for(int c = 0; c < 3; c++) {
+		velocityScaling[c] = 1.f;
+		regionMin[c] = 0.f;
+		regionMax[c] = 1.f;
+	}
+}
+
+void StreamlinePlacement::Place(const AdvectionEngine & engine, const Parameters & params, Result & result)
+{
+	assert(params.separation > 0.f && params.testRatio > 0.f && params.testRatio <= 1.f);
+
+	result.seeds.clear();
+	result.numVertices.clear();
+
+	const float separation = params.separation;
+	const float testDistance = params.testRatio * separation;
+	// samples of the accepted lines are at most half the test distance apart
+	const float sampleSpacing = 0.5f * testDistance;
+
+	// one bucket per cell of the volume, limited to 2^20
+	float cellsPerAxis = std::ceil(1.f / separation);
+	size_t numBuckets = 1024;
+	while(numBuckets < (1 << 20) && numBuckets < cellsPerAxis * cellsPerAxis * cellsPerAxis)
+		numBuckets *= 2;
+	HashGrid grid(separation, numBuckets);
+
+	// candidates next to the accepted lines come first, the lattice over the region covers the
+	// parts that are not reached from there
+	std::deque<float> candidates;
+	for(int c = 0; c < 3; c++)
+		candidates.push_back(0.5f * (params.regionMin[c] + params.regionMax[c]));
+	int latticeSize[3];
+	for(int c = 0; c < 3; c++)
+		latticeSize[c] = std::max(1, (int)std::ceil((params.regionMax[c] - params.regionMin[c]) / separation));
+	size_t latticeIndex = 0, latticeCount = (size_t)latticeSize[0] * latticeSize[1] * latticeSize[2];
+
+	std::vector<float> vertices;
+	while(result.Size() < params.maxLines) {
+		float seed[3];
+		if(!candidates.empty()) {
+			for(int c = 0; c < 3; c++) {
+				seed[c] = candidates.front();
+				candidates.pop_front();
+			}
+		}
+		else if(latticeIndex < latticeCount) {
+			size_t i = latticeIndex++;
+			int l[3] = { (int)(i % latticeSize[0]), (int)(i / latticeSize[0] % latticeSize[1]), (int)(i / latticeSize[0] / latticeSize[1]) };
+			for(int c = 0; c < 3; c++)
+				seed[c] = std::min(params.regionMax[c], params.regionMin[c] + (l[c] + 0.5f) * separation);
+		}
+		else
+			break;
+
+		// candidates lie exactly separation away from their line, so they are tested like the vertices
+		if(!InsideRegion(seed, params.regionMin, params.regionMax) || !InsideVolume(seed) || grid.HasPointWithin(seed, testDistance))
+			continue;
+
+		Integrate(engine, params, grid, seed, testDistance, vertices);
+		size_t numVertices = vertices.size() / 3;
+		if(numVertices < 2)
+			continue;
+
+		result.seeds.insert(result.seeds.end(), seed, seed + 3);
+		result.numVertices.push_back((unsigned)numVertices);
+
+		// sample the line densely enough for the distance tests and queue new seeds every separation
+		float sinceCandidate = separation;
+		grid.Insert(&vertices[0]);
+		for(size_t i = 0; i + 1 < numVertices; i++) {
+			const float * p0 = &vertices[3 * i];
+			const float * p1 = &vertices[3 * i + 3];
+			float t[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float length = Length(t);
+			int samples = std::max(1, (int)std::ceil(length / sampleSpacing));
+			for(int s = 1; s <= samples; s++) {
+				float w = (float)s / samples;
+				float p[3] = { p0[0] + w * t[0], p0[1] + w * t[1], p0[2] + w * t[2] };
+				grid.Insert(p);
+			}
+
+			if(sinceCandidate >= separation) {
+				sinceCandidate = 0.f;
+				for(int c = 0; c < 3; c++)
+					t[c] /= length;
+				float n[2][3];
+				PerpendicularBasis(t, n[0], n[1]);
+				for(int k = 0; k < 4; k++) {
+					float side = k & 1 ? -separation : separation;
+					for(int c = 0; c < 3; c++)
+						candidates.push_back(p0[c] + side * n[k >> 1][c]);
+				}
+			}
+			sinceCandidate += length;
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "AdvectionEngine.h"
+
+#include <vector>
+#include <cstddef>
+
+/*
+	Evenly spaced streamline seeding after Jobard and Lefer
+	Streamlines are integrated like CSComputeStreamline integrates fixed steps (Euler, in texture space)
+	and accepted one after another. New seeds are taken at the separation distance perpendicular to
+	the accepted lines, so the separation sets how far apart lines start. A seed is accepted if no
+	accepted line is closer than the test distance (the candidates lie exactly at the separation from
+	their own line), and a line ends where it comes closer than the test distance to another one
+	while it is integrated. The samples of the accepted lines are kept in a uniform spatial hash grid
+	with cells of the separation size, so each test only looks at the 27 neighbouring cells.
+	The lines only run forward from their seeds since the GPU streamlines do the same.
+*/
+class StreamlinePlacement
+{
+public:
+	struct Parameters {
+		float	separation;			// seed distance in texture space
+		float	testRatio;			// lines end at testRatio * separation to other lines
+		float	stepsize;			// time per vertex
+		int		maxVertices;		// per line, including the seed
+		size_t	maxLines;
+		float	timestepT;			// weight of the second field
+		float	velocityScaling[3];	// from the velocity in the data to texture space
+		float	regionMin[3];		// seeds are placed in this box, the lines run through the whole volume
+		float	regionMax[3];
+
+		Parameters();
+	};
+
+	struct Result {
+		std::vector<float>		seeds;			// xyz in texture space
+		std::vector<unsigned>	numVertices;	// vertices of every line until it came too close to another one
+
+		size_t Size() const {	return numVertices.size();	};
+	};
+
+	// the engine provides the field, its fields have to be set
+	static void Place(const AdvectionEngine & engine, const Parameters & params, Result & result);
+};
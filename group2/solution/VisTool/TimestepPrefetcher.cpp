@@ -0,0 +1,91 @@
+#include "TimestepPrefetcher.h"
+
+#include "VolumeData.h"
+#include "BrickPyramid.h"
+
+#include <iostream>
+
+TimestepPrefetcher::TimestepPrefetcher(VolumeData & volumeData) :
+	m_volumeData(volumeData),
+	m_hThread(NULL),
+	m_stop(0)
+{
+	m_hRequestEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	m_hResultEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	m_hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+	if(!m_hThread)
+		std::cerr << "Could not create the timestep prefetch thread!" << std::endl;
+}
+
+TimestepPrefetcher::~TimestepPrefetcher(void)
+{
+	InterlockedExchange(&m_stop, 1);
+	SetEvent(m_hRequestEvent);
+	if(m_hThread) {
+		WaitForSingleObject(m_hThread, INFINITE);
+		CloseHandle(m_hThread);
+	}
+
+	// free everything that has been prepared but never picked up
+	Result r;
+	while(m_results.Read(&r, sizeof(r))) {
+		delete[] static_cast<char*>(r.data);
+		delete[] r.histogram;
+		delete r.bricks;
+	}
+
+	CloseHandle(m_hRequestEvent);
+	CloseHandle(m_hResultEvent);
+}
+
+bool TimestepPrefetcher::Request(int timestep, bool buildBricks)
+{
+	Job job = { timestep, buildBricks };
+	if(!m_hThread || !m_requests.Write(&job, sizeof(job)))
+		return false;
+
+	SetEvent(m_hRequestEvent);
+	return true;
+}
+
+bool TimestepPrefetcher::GetResult(Result & result)
+{
+	return m_results.Read(&result, sizeof(result));
+}
+
+void TimestepPrefetcher::WaitForResult(DWORD milliseconds)
+{
+	WaitForSingleObject(m_hResultEvent, milliseconds);
+}
+
+DWORD WINAPI TimestepPrefetcher::ThreadProc(LPVOID param)
+{
+	static_cast<TimestepPrefetcher*>(param)->Run();
+	return 0;
+}
+
+void TimestepPrefetcher::Run(void)
+{
+	while(!m_stop) {
+		WaitForSingleObject(m_hRequestEvent, INFINITE);
+
+		Job job;
+		while(!m_stop && m_requests.Read(&job, sizeof(job))) {
+			Result r;
+			r.timestep = job.timestep;
+			m_volumeData.PrepareTimestep(job.timestep, job.buildBricks, r.data, r.histogram, r.bricks);
+
+			// the result pipe is bounded, wait until the render thread has picked up older results
+			while(!m_results.Write(&r, sizeof(r))) {
+				if(m_stop) {
+					delete[] static_cast<char*>(r.data);
+					delete[] r.histogram;
+					delete r.bricks;
+					return;
+				}
+				Sleep(1);
+			}
+			SetEvent(m_hResultEvent);
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <DXUTLockFreePipe.h>
+
+#include <windows.h>
+
+class VolumeData;
+class BrickPyramid;
+
+/*
+	Background thread that prepares timesteps of a VolumeData (reading from disk, padding,
+	histogram, brick pyramid) ahead of playback.
+	Communication with the render thread happens through two single producer/single consumer
+	pipes: the render thread writes timestep indices into the request pipe, the worker writes
+	the prepared data into the result pipe. The VolumeData installs the results on the render
+	thread, so the worker never touches its members directly.
+*/
+class TimestepPrefetcher
+{
+public:
+	// a prepared timestep, ownership of the buffers moves to whoever reads it from the pipe
+	struct Result {
+		int		timestep;
+		void	* data;			// padded copy of the timestep or nullptr if the data can be used as is
+		float	* histogram;	// nullptr if the format has no histogram
+		BrickPyramid * bricks;	// nullptr if not needed (yet)
+	};
+
+	TimestepPrefetcher(VolumeData & volumeData);
+	~TimestepPrefetcher(void);
+
+	// render thread side
+	// buildBricks is decided here, the worker does not look at the pyramids of the VolumeData
+	bool Request(int timestep, bool buildBricks);	// returns false if the request pipe is full
+	bool GetResult(Result & result);	// returns false if nothing has arrived yet
+	void WaitForResult(DWORD milliseconds);
+
+private:
+	struct Job {
+		int		timestep;
+		bool	buildBricks;	// also build the brick pyramid of the timestep
+	};
+
+	static DWORD WINAPI ThreadProc(LPVOID param);
+	void Run(void);
+
+	VolumeData		& m_volumeData;
+
+	HANDLE			m_hThread;
+	HANDLE			m_hRequestEvent;	// signaled when new requests are in the pipe (or on shutdown)
+	HANDLE			m_hResultEvent;		// signaled when a new result has been written
+	volatile LONG	m_stop;
+
+	DXUTLockFreePipe<8>		m_requests;	// 256 bytes, i.e. 32 pending jobs
+	DXUTLockFreePipe<10>	m_results;	// 1kB of prepared timesteps
+};
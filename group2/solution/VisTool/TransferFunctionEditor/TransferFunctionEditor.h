@@ -43,6 +43,9 @@ public:
     // Access to the transfer function texture/SRV
 	ID3D11Texture1D*			getTexture() const { return pTfTex_; }
 	ID3D11ShaderResourceView*	getSRV() const { return pTfSRV_; }
+	// CPU copy of the texture, getTfSize() RGBA entries
+	const float*				getTfData() const { return pTexData_; }
+	int							getTfSize() const { return v2iSizeTfEdt_.x; }
 
     // Loading and saving of transfer functions to files
 	void						saveTransferFunction();
@@ -1,11 +1,19 @@
 #include "VectorVolumeData.h"
 
 #include "util/util.h"
+#include "VolumeMetadataCache.h"
+#include "MetricEngine.h"
+#include "FTLEEngine.h"
+#include "util/ThreadPool.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 const XMFLOAT3 VectorVolumeData::CSGroupSize = XMFLOAT3(32, 2, 2);
 
+static_assert((int)VectorVolumeData::NUM_SHADER_METRICS == (int)MetricEngine::NUM_METRICS, "the metrics of the MetricEngine have to match MetricType");
+
 char * VectorVolumeData::metricPassNames[] = {
 	"PASS_VELOCITY_MAGNITUDE",
 	"PASS_DIVERGENCE",
@@ -19,11 +27,25 @@ char * VectorVolumeData::metricPassNames[] = {
 	"PASS_FOURTH_COMPONENT"
 };
 
+char * VectorVolumeData::jacobianTextureNames[2][3] = {
+	{ "g_jacobianT0A", "g_jacobianT0B", "g_jacobianT0C" },
+	{ "g_jacobianT1A", "g_jacobianT1B", "g_jacobianT1C" }
+};
+
+char * VectorVolumeData::jacobianUAVNames[3] = { "g_jacobianA", "g_jacobianB", "g_jacobianC" };
+
 ID3DX11Effect			* VectorVolumeData::pEffect = nullptr;
 ID3DX11EffectTechnique	* VectorVolumeData::pTechnique = nullptr;
-ID3DX11EffectPass		* VectorVolumeData::pMetricPasses[VectorVolumeData::NUM_METRICS] = {};
+ID3DX11EffectPass		* VectorVolumeData::pMetricPasses[VectorVolumeData::NUM_SHADER_METRICS] = {};
+ID3DX11EffectTechnique	* VectorVolumeData::pJacobianTechnique = nullptr;
+ID3DX11EffectPass		* VectorVolumeData::pJacobianPass = nullptr;
+ID3DX11EffectTechnique	* VectorVolumeData::pNormalizeTechnique = nullptr;
+ID3DX11EffectPass		* VectorVolumeData::pNormalizePass = nullptr;
 
 ID3DX11EffectUnorderedAccessViewVariable * VectorVolumeData::pScalarMetricEV = nullptr;
+ID3DX11EffectShaderResourceVariable * VectorVolumeData::pRawMetricEV = nullptr;
+ID3DX11EffectShaderResourceVariable * VectorVolumeData::pJacobianEV[2][3] = {};
+ID3DX11EffectUnorderedAccessViewVariable * VectorVolumeData::pJacobianRWEV[3] = {};
 ID3DX11EffectShaderResourceVariable * VectorVolumeData::pVectorVolume0EV = nullptr;
 ID3DX11EffectShaderResourceVariable * VectorVolumeData::pVectorVolume1EV = nullptr;
 
@@ -45,10 +67,20 @@ HRESULT VectorVolumeData::Initialize(ID3D11Device * pd3dDevice_, TwBar* pParamet
 	}
 
 	SAFE_GET_TECHNIQUE(pEffect, "Metrics", pTechnique);
-	for(int i=0; i < NUM_METRICS; i++) {
+	for(int i=0; i < NUM_SHADER_METRICS; i++) {
 		SAFE_GET_PASS(pTechnique, metricPassNames[i], pMetricPasses[i]);
 	}
+	SAFE_GET_TECHNIQUE(pEffect, "Jacobian", pJacobianTechnique);
+	SAFE_GET_PASS(pJacobianTechnique, "PASS_JACOBIAN", pJacobianPass);
+	SAFE_GET_TECHNIQUE(pEffect, "Normalize", pNormalizeTechnique);
+	SAFE_GET_PASS(pNormalizeTechnique, "PASS_NORMALIZE", pNormalizePass);
 	SAFE_GET_UAV(pEffect, "g_metricTexture", pScalarMetricEV);
+	SAFE_GET_RESOURCE(pEffect, "g_rawMetricTexture", pRawMetricEV);
+	for(int i=0; i < 3; i++) {
+		SAFE_GET_RESOURCE(pEffect, jacobianTextureNames[0][i], pJacobianEV[0][i]);
+		SAFE_GET_RESOURCE(pEffect, jacobianTextureNames[1][i], pJacobianEV[1][i]);
+		SAFE_GET_UAV(pEffect, jacobianUAVNames[i], pJacobianRWEV[i]);
+	}
 	SAFE_GET_RESOURCE(pEffect, "g_vectorTexture0", pVectorVolume0EV);
 	SAFE_GET_RESOURCE(pEffect, "g_vectorTexture1", pVectorVolume1EV);
 
@@ -67,9 +99,13 @@ HRESULT VectorVolumeData::Release(void)
 {
 
 	SAFE_RELEASE(pTechnique);
-	for(int i=0; i < NUM_METRICS; i++) {
+	for(int i=0; i < NUM_SHADER_METRICS; i++) {
 		SAFE_RELEASE(pMetricPasses[i]);
 	}
+	SAFE_RELEASE(pJacobianPass);
+	SAFE_RELEASE(pJacobianTechnique);
+	SAFE_RELEASE(pNormalizePass);
+	SAFE_RELEASE(pNormalizeTechnique);
 
 	SAFE_RELEASE(pEffect);
 	return S_OK;
@@ -84,13 +120,7 @@ void TW_CALL VectorVolumeData::OnComputeMinMaxCB(void* clientData)
 	VectorVolumeData * me = reinterpret_cast<VectorVolumeData*>(clientData);
 	XMFLOAT2 minMax = me->GetScalarMetricVolume()->GetMinMax();
 
-	XMFLOAT3 actualMetricMinMax;
-	if(!me->m_reverseMetricRange)
-		actualMetricMinMax = me->m_metricMinMax;
-	else
-		//reversing actually just means switch max and min
-		actualMetricMinMax = XMFLOAT3(me->m_metricMinMax.y, me->m_metricMinMax.x, 0);
-	actualMetricMinMax.z = (actualMetricMinMax.y - actualMetricMinMax.x);
+	XMFLOAT3 actualMetricMinMax = me->GetActualMetricMinMax();
 
 	float newMin = minMax.x * actualMetricMinMax.z + actualMetricMinMax.x;
 	float newMax = minMax.y * actualMetricMinMax.z + actualMetricMinMax.x;
@@ -110,13 +140,134 @@ void TW_CALL VectorVolumeData::OnComputeMinMaxCB(void* clientData)
 		me->m_metricMinMax.x = newMin;
 		me->m_metricMinMax.y = newMax;
 	}
+
+	// the FTLE range depends on its settings, so it is not cached
+	if(me->m_metadataCache && me->m_metricType != MT_FTLE)
+		me->m_metadataCache->SetMetricRange(me->m_metricType, XMFLOAT2(std::min(newMin, newMax), std::max(newMin, newMax)));
+}
+
+/**
+	Computes the raw values of the current metric with the shader and on the CPU and prints the differences
+*/
+void TW_CALL VectorVolumeData::OnValidateMetricCB(void* clientData)
+{
+	VectorVolumeData * me = reinterpret_cast<VectorVolumeData*>(clientData);
+	if(me->m_metricType == MT_FTLE) {
+		std::cout << "The FTLE is only computed on the CPU." << std::endl;
+		return;
+	}
+	ScalarVolumeData * metricVolume = me->GetScalarMetricVolume();
+	float timestepT = me->GetMetricCacheKey().timestepT;
+
+	// the metric volume is used as scratch texture to read the shader result back
+	std::vector<float> gpuValues, cpuValues;
+	me->DispatchMetricShader(me->m_pScalarMetricUAV, timestepT);
+	bool readBack = metricVolume->ReadbackVolume(gpuValues);
+
+	// restore the mapped metric
+	me->m_displayedMetricValid = false;
+	me->UpdateScalarMetric();
+
+	if(!readBack) {
+		std::cerr << "Could not read back the metric volume!" << std::endl;
+		return;
+	}
+
+	double start = GetTimeMs();
+	me->ComputeMetricOnCPU(cpuValues, timestepT);
+	double cpuTime = GetTimeMs() - start;
+
+	double maxError = 0, sumError = 0;
+	for(size_t i = 0; i < gpuValues.size(); i++) {
+		double error = fabs((double)gpuValues[i] - cpuValues[i]);
+		maxError = std::max(maxError, error);
+		sumError += error;
+	}
+
+	std::cout << "Metric " << MetricEngine::GetMetricName((MetricEngine::Metric)me->m_metricType) << " on the CPU took " << cpuTime << " ms, "
+			  << "difference to the shader: max " << maxError << ", mean " << sumError / gpuValues.size() << " (unmapped)" << std::endl;
+}
+
+/**
+	Computes the FTLE at the current time with 1, 2, 4, ... threads up to the number of hardware threads
+	and prints the timings without the disk I/O, the shared thread pool is reset to its default size afterwards
+*/
+void TW_CALL VectorVolumeData::OnFTLEScalingCB(void* clientData)
+{
+	VectorVolumeData * me = reinterpret_cast<VectorVolumeData*>(clientData);
+	MetricVolumeCache::Key key = me->GetMetricCacheKey();
+	unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<float> values;
+	double singleThreadTime = 0;
+	for(unsigned int numThreads = 1; ; numThreads = std::min(2 * numThreads, maxThreads)) {
+		ThreadPool::SetSharedNumThreads(numThreads);
+		// every run computes the same flow maps
+		me->m_flowMapCache.Clear();
+		double time = me->ComputeFTLE(values, key);
+		if(numThreads == 1)
+			singleThreadTime = time;
+		std::cout << "FTLE with " << numThreads << " threads: " << time << " ms, speedup " << singleThreadTime / time
+				  << ", efficiency " << singleThreadTime / time / numThreads << std::endl;
+		if(numThreads == maxThreads)
+			break;
+	}
+	ThreadPool::SetSharedNumThreads(0);
+}
+
+void TW_CALL VectorVolumeData::GetFlowMapCacheHitsCB(void *value, void *clientData)
+{ 
+	*(int *)value = static_cast<VectorVolumeData*>(clientData)->m_flowMapCache.GetHits();
+}
+
+void TW_CALL VectorVolumeData::GetFlowMapCacheMissesCB(void *value, void *clientData)
+{ 
+	*(int *)value = static_cast<VectorVolumeData*>(clientData)->m_flowMapCache.GetMisses();
+}
+
+void TW_CALL VectorVolumeData::OnClearMetricCacheCB(void* clientData)
+{
+	VectorVolumeData * me = reinterpret_cast<VectorVolumeData*>(clientData);
+	me->m_metricCache.Clear();
+	me->m_metricCache.ResetCounters();
+	me->m_flowMapCache.Clear();
+	me->m_flowMapCache.ResetCounters();
+	me->m_displayedMetricValid = false;
+}
+
+void TW_CALL VectorVolumeData::GetMetricCacheHitsCB(void *value, void *clientData)
+{ 
+	*(int *)value = static_cast<VectorVolumeData*>(clientData)->m_metricCache.GetHits();
+}
+
+void TW_CALL VectorVolumeData::GetMetricCacheMissesCB(void *value, void *clientData)
+{ 
+	*(int *)value = static_cast<VectorVolumeData*>(clientData)->m_metricCache.GetMisses();
+}
+
+/**
+	Sets the metric limits from the metadata cache, returns false if the metric has not been cached yet
+*/
+bool VectorVolumeData::ApplyCachedMetricRange()
+{
+	XMFLOAT2 range;
+	if(!m_metadataCache || m_metricType == MT_FTLE || !m_metadataCache->GetMetricRange(m_metricType, range))
+		return false;
+
+	std::cout << "Cached Metric Limits are: [" << range.x << "," << range.y << "]" << std::endl;
+	if(m_reverseMetricRange)
+		m_metricMinMax = XMFLOAT3(range.y, range.x, 0);
+	else
+		m_metricMinMax = XMFLOAT3(range.x, range.y, 0);
+	return true;
 }
 
 void TW_CALL VectorVolumeData::SetMetricCB(const void *value, void *clientData)
 { 
 	VectorVolumeData * me = static_cast<VectorVolumeData*>(clientData);
 	me->m_metricType = *(const MetricType *)value;
-	OnComputeMinMaxCB(clientData);
+	if(!me->ApplyCachedMetricRange())
+		OnComputeMinMaxCB(clientData);
 }
 
 void TW_CALL VectorVolumeData::GetMetricCB(void *value, void *clientData)
@@ -124,8 +275,8 @@ void TW_CALL VectorVolumeData::GetMetricCB(void *value, void *clientData)
     *(unsigned int *)value = static_cast<VectorVolumeData*>(clientData)->m_metricType;
 }
 
-VectorVolumeData::VectorVolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution, float timestep, XMINT3 timestepIndices) :
-	VolumeData(objectFileName, format, sliceThickness, resolution, timestep, timestepIndices),
+VectorVolumeData::VectorVolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution, float timestep, XMINT3 timestepIndices, std::string metadataFileName) :
+	VolumeData(objectFileName, format, sliceThickness, resolution, timestep, timestepIndices, metadataFileName),
 	m_scalarMetricData(nullptr),
 	m_pScalarMetricUAV(nullptr),
 	m_pScalarMetricSRV(nullptr),
@@ -134,20 +285,59 @@ VectorVolumeData::VectorVolumeData(std::string objectFileName, DataFormat format
 	m_metricType(MT_VELOCITY_MAGNITUDE), 
 	m_lastMetricType(MT_VELOCITY_MAGNITUDE),
 	m_reverseMetricRange(false),
+	m_cpuMetrics(false),
 	m_boundaryMetricFixed(false),
 	m_boundaryMetricValue(0),
-	m_lastMetricUpdateTime(-1)
+	m_lastMetricUpdateTime(-1),
+	m_metricHistogramValid(false),
+	m_halfPrecisionJacobian(false),
+	m_jacobianBuffersHalf(false),
+	m_pJacobianTextures(),
+	m_pJacobianSRVs(),
+	m_pJacobianUAVs(),
+	m_metricCache(resolution),
+	m_metricCacheBudgetMB(256),
+	m_metricCacheTimeSteps(8),
+	m_flowMapCacheBudgetMB(256),
+	m_displayedMetricValid(false)
 {
+	m_jacobianTimestep[0] = m_jacobianTimestep[1] = -1;
+	m_ftle.gridDivisor = 2;
+	m_ftle.integrationTime = 1.f;
+	m_ftle.stepsize = 0.05f;
+	m_ftle.flowMapCache = false;
+	m_ftle.flowMapGridDivisor = 2;
+	m_ftle.flowMapsPerTimestep = 1;
+	m_cachedFTLE = m_ftle;
+
 	LoadDataFiles(objectFileName);
 
 	TwType metricType; 
-	metricType = TwDefineEnumFromString("MetricType", "Velocity Magnitude,Divergence,Vorticity Magnitude,Q_S,Q_Omega,Enstrophy Production,V^2,Q Parameter,Lambda2,Fourth Vector Component");
+	metricType = TwDefineEnumFromString("MetricType", "Velocity Magnitude,Divergence,Vorticity Magnitude,Q_S,Q_Omega,Enstrophy Production,V^2,Q Parameter,Lambda2,Fourth Vector Component,FTLE");
 	
 	TwAddVarCB(pParametersBar, "Metric", metricType, SetMetricCB, GetMetricCB, this, "group='Vector Volume'");
 	TwAddVarRW(pParametersBar, "Metric Min", TW_TYPE_FLOAT, &m_metricMinMax.x, "group='Vector Volume'");
 	TwAddVarRW(pParametersBar, "Metric Max", TW_TYPE_FLOAT, &m_metricMinMax.y, "group='Vector Volume'");
 	TwAddButton(pParametersBar, "[Get Min and Max]", OnComputeMinMaxCB, this, "group='Vector Volume'");
 	TwAddVarRW(pParametersBar, "Reverse Range", TW_TYPE_BOOLCPP, &m_reverseMetricRange, "group='Vector Volume'");
+	TwAddVarRW(pParametersBar, "Compute Metric on CPU", TW_TYPE_BOOLCPP, &m_cpuMetrics, "group='Vector Volume'");
+	TwAddButton(pParametersBar, "[Validate Metric]", OnValidateMetricCB, this, "group='Vector Volume' help='Compares the CPU metric to the shader result.'");
+	TwAddVarRW(pParametersBar, "Metric Cache (MB)", TW_TYPE_INT32, &m_metricCacheBudgetMB, "group='Vector Volume' min=0 help='GPU memory for the metric volumes of previous times, so looping playback reuses them. 0 keeps only the current one.'");
+	TwAddVarRW(pParametersBar, "Metric Steps per Timestep", TW_TYPE_INT32, &m_metricCacheTimeSteps, "group='Vector Volume' min=0 max=256 help='Number of points between two timesteps the metric is evaluated at, 0 evaluates it at every frame (and never reuses it during playback).'");
+	TwAddVarCB(pParametersBar, "Metric Cache Hits", TW_TYPE_INT32, nullptr, GetMetricCacheHitsCB, this, "group='Vector Volume'");
+	TwAddVarCB(pParametersBar, "Metric Cache Misses", TW_TYPE_INT32, nullptr, GetMetricCacheMissesCB, this, "group='Vector Volume'");
+	TwAddButton(pParametersBar, "[Clear Metric Cache]", OnClearMetricCacheCB, this, "group='Vector Volume'");
+	TwAddVarRW(pParametersBar, "Half Precision Jacobian", TW_TYPE_BOOLCPP, &m_halfPrecisionJacobian, "group='Vector Volume' help='Stores the cached velocity gradients as 16 bit floats, halves their memory.'");
+	TwAddVarRW(pParametersBar, "FTLE Grid Divisor", TW_TYPE_INT32, &m_ftle.gridDivisor, "group='Vector Volume' min=1 max=16 help='The flow map for the FTLE is advected on the volume resolution divided by this.'");
+	TwAddVarRW(pParametersBar, "FTLE Integration Time", TW_TYPE_FLOAT, &m_ftle.integrationTime, "group='Vector Volume' step=0.1 help='Time span the flow map is advected over from the current time, negative values give the backward FTLE.'");
+	TwAddVarRW(pParametersBar, "FTLE Stepsize", TW_TYPE_FLOAT, &m_ftle.stepsize, "group='Vector Volume' min=0.0001 step=0.01 help='Longest RK4 step of the flow map advection.'");
+	TwAddVarRW(pParametersBar, "FTLE from Flow Map Cache", TW_TYPE_BOOLCPP, &m_ftle.flowMapCache, "group='Vector Volume' help='Composes the flow map from cached maps between timesteps instead of advecting the whole time span, repeated integrations over the same timesteps get much faster but less accurate.'");
+	TwAddVarRW(pParametersBar, "Flow Map Grid Divisor", TW_TYPE_INT32, &m_ftle.flowMapGridDivisor, "group='Vector Volume' min=1 max=16 help='The cached flow maps are sampled on the volume resolution divided by this, coarser grids interpolate less accurately.'");
+	TwAddVarRW(pParametersBar, "Flow Maps per Timestep", TW_TYPE_INT32, &m_ftle.flowMapsPerTimestep, "group='Vector Volume' min=1 max=64 help='Number of cached flow maps between two timesteps. More maps cover more start times exactly but add interpolation error with every map composed.'");
+	TwAddVarRW(pParametersBar, "Flow Map Cache (MB)", TW_TYPE_INT32, &m_flowMapCacheBudgetMB, "group='Vector Volume' min=0 help='RAM for the cached flow maps, at least one is always kept.'");
+	TwAddVarCB(pParametersBar, "Flow Map Cache Hits", TW_TYPE_INT32, nullptr, GetFlowMapCacheHitsCB, this, "group='Vector Volume'");
+	TwAddVarCB(pParametersBar, "Flow Map Cache Misses", TW_TYPE_INT32, nullptr, GetFlowMapCacheMissesCB, this, "group='Vector Volume'");
+	TwAddButton(pParametersBar, "[FTLE Thread Scaling]", OnFTLEScalingCB, this, "group='Vector Volume' help='Times the FTLE at the current time with an increasing number of threads.'");
 	TwAddVarRW(pParametersBar, "Metric Fixed at boundary", TW_TYPE_BOOLCPP, &m_boundaryMetricFixed, "group='Vector Volume'");
 	TwAddVarRW(pParametersBar, "Metric Value at boundary (if fixed)", TW_TYPE_FLOAT, &m_boundaryMetricValue, "group='Vector Volume'");
 	TwAddVarRO(pParametersBar, "Volume Data", volumeDataType, this, "group='Vector Volume'");
@@ -165,9 +355,9 @@ VectorVolumeData::~VectorVolumeData(void)
 	SAFE_RELEASE(m_pScalarMetricSRV);
 	SAFE_RELEASE(m_pScalarMetricTexture);
 
+	ReleaseJacobianBuffers();
+
 	if(m_scalarMetricData) delete m_scalarMetricData;
-	std::for_each(m_data.begin(), m_data.end(), [](void* p) {if(p) delete[] p;});
-	std::for_each(m_histogram.begin(), m_histogram.end(), [](float* p) {if(p) delete[] p;});
 
 	TwRemoveVar(pParametersBar, "Vector Volume");
 }
@@ -178,8 +368,19 @@ void VectorVolumeData::SaveConfig(SettingsStorage &store)
 	store.StoreFloat("vectorvolume.metric.min", m_metricMinMax.x);
 	store.StoreFloat("vectorvolume.metric.max", m_metricMinMax.y);
 	store.StoreBool("vectorvolume.metric.reverse", m_reverseMetricRange);
+	store.StoreBool("vectorvolume.metric.cpu", m_cpuMetrics);
 	store.StoreBool("vectorvolume.metric.boundaryFixed", m_boundaryMetricFixed);
 	store.StoreFloat("vectorvolume.metric.boundaryValue", m_boundaryMetricValue);
+	store.StoreBool("vectorvolume.jacobian.half", m_halfPrecisionJacobian);
+	store.StoreInt("vectorvolume.metric.cache.budgetMB", m_metricCacheBudgetMB);
+	store.StoreInt("vectorvolume.metric.cache.steps", m_metricCacheTimeSteps);
+	store.StoreInt("vectorvolume.ftle.gridDivisor", m_ftle.gridDivisor);
+	store.StoreFloat("vectorvolume.ftle.integrationTime", m_ftle.integrationTime);
+	store.StoreFloat("vectorvolume.ftle.stepsize", m_ftle.stepsize);
+	store.StoreBool("vectorvolume.flowmap.enabled", m_ftle.flowMapCache);
+	store.StoreInt("vectorvolume.flowmap.gridDivisor", m_ftle.flowMapGridDivisor);
+	store.StoreInt("vectorvolume.flowmap.perTimestep", m_ftle.flowMapsPerTimestep);
+	store.StoreInt("vectorvolume.flowmap.budgetMB", m_flowMapCacheBudgetMB);
 }
 
 void VectorVolumeData::LoadConfig(SettingsStorage &store)
@@ -190,8 +391,19 @@ void VectorVolumeData::LoadConfig(SettingsStorage &store)
 	store.GetFloat("vectorvolume.metric.min", m_metricMinMax.x);
 	store.GetFloat("vectorvolume.metric.max", m_metricMinMax.y);
 	store.GetBool("vectorvolume.metric.reverse", m_reverseMetricRange);
+	store.GetBool("vectorvolume.metric.cpu", m_cpuMetrics);
 	store.GetBool("vectorvolume.metric.boundaryFixed", m_boundaryMetricFixed);
 	store.GetFloat("vectorvolume.metric.boundaryvalue", m_boundaryMetricValue);
+	store.GetBool("vectorvolume.jacobian.half", m_halfPrecisionJacobian);
+	store.GetInt("vectorvolume.metric.cache.budgetMB", m_metricCacheBudgetMB);
+	store.GetInt("vectorvolume.metric.cache.steps", m_metricCacheTimeSteps);
+	store.GetInt("vectorvolume.ftle.gridDivisor", m_ftle.gridDivisor);
+	store.GetFloat("vectorvolume.ftle.integrationTime", m_ftle.integrationTime);
+	store.GetFloat("vectorvolume.ftle.stepsize", m_ftle.stepsize);
+	store.GetBool("vectorvolume.flowmap.enabled", m_ftle.flowMapCache);
+	store.GetInt("vectorvolume.flowmap.gridDivisor", m_ftle.flowMapGridDivisor);
+	store.GetInt("vectorvolume.flowmap.perTimestep", m_ftle.flowMapsPerTimestep);
+	store.GetInt("vectorvolume.flowmap.budgetMB", m_flowMapCacheBudgetMB);
 }
 
 void VectorVolumeData::SetTime(float currentTime) 
@@ -213,7 +425,8 @@ void VectorVolumeData::SetTime(float currentTime)
 				m_lastMetricUpdateTime != m_currentTime ||
 				m_lastMetricType != m_metricType ||
 				m_lastMetricMinMax.x != m_metricMinMax.x ||
-				m_lastMetricMinMax.y != m_metricMinMax.y) 
+				m_lastMetricMinMax.y != m_metricMinMax.y ||
+				(m_metricType == MT_FTLE && !(m_ftle == m_cachedFTLE)))
 			)
 		{
 			UpdateScalarMetric();
@@ -254,7 +467,7 @@ HRESULT VectorVolumeData::CreateGPUBuffers(void)
 	desc.MiscFlags = 0;
 
 	D3D11_SUBRESOURCE_DATA initialData;
-	initialData.pSysMem = m_data[0];
+	initialData.pSysMem = GetTimestepData(0);
 	initialData.SysMemPitch = m_resolution.x * (m_elementSize + m_elementPadding);
 	initialData.SysMemSlicePitch = m_resolution.x * m_resolution.y * (m_elementSize + m_elementPadding);
 
@@ -282,7 +495,7 @@ HRESULT VectorVolumeData::CreateGPUBuffers(void)
 		desc.MiscFlags = 0;
 
 		ZeroMemory(&initialData, sizeof(initialData));
-		initialData.pSysMem = m_data[1];
+		initialData.pSysMem = GetTimestepData(1);
 		initialData.SysMemPitch = m_resolution.x * (m_elementSize + m_elementPadding);
 		initialData.SysMemSlicePitch = m_resolution.x * m_resolution.y * (m_elementSize + m_elementPadding);
 
@@ -315,6 +528,10 @@ void VectorVolumeData::ReleaseGPUBuffers(void) {
 	SAFE_RELEASE(m_pScalarMetricSRV);
 	SAFE_RELEASE(m_pScalarMetricTexture);
 
+	ReleaseJacobianBuffers();
+	m_metricCache.Clear();
+	m_displayedMetricValid = false;
+
 	if(m_scalarMetricData) {
 		delete m_scalarMetricData;
 		m_scalarMetricData = nullptr;
@@ -328,7 +545,7 @@ ScalarVolumeData * VectorVolumeData::GetScalarMetricVolume()
 		return m_scalarMetricData;
 
 	// if we don't have a min and max set, we set to default values and then recalculate afterwards using OnComputeMinMaxCB
-	bool noMinMax = (m_metricMinMax.x == m_metricMinMax.y);
+	bool noMinMax = (m_metricMinMax.x == m_metricMinMax.y) && !ApplyCachedMetricRange();
 	if(noMinMax) {
 		m_metricMinMax.x = 0;
 		m_metricMinMax.y = 1;
@@ -336,12 +553,12 @@ ScalarVolumeData * VectorVolumeData::GetScalarMetricVolume()
 
 	CreateScalarMetricBuffers();
 	m_scalarMetricData = new ScalarVolumeData(m_pScalarMetricSRV, VolumeData::DF_FLOAT, m_sliceThickness, m_resolution);
+	m_metricHistogramValid = false;
+	m_displayedMetricValid = false;
 	
 	TwAddVarRO(pParametersBar, "Metric Volume Data", volumeDataType, m_scalarMetricData, "group='Vector Volume'");
 
 	UpdateScalarMetric();
-	// we do this only once at creation because we don't recalculate histograms for generated scalar volumes
-	m_scalarMetricData->UpdateHistogram(0, 0, 0.f);
 
 	if(noMinMax) {
 		OnComputeMinMaxCB(this); //calculate min and max if we just created the metric
@@ -349,16 +566,109 @@ ScalarVolumeData * VectorVolumeData::GetScalarMetricVolume()
 	return m_scalarMetricData;
 }
 
+/**
+	Updates the metric volume from the metric cache, the raw values are only computed on a cache miss
+*/
 void VectorVolumeData::UpdateScalarMetric(void) 
 {
 	assert(pd3dDevice);
 
-	pScalarMetricEV->SetUnorderedAccessView(m_pScalarMetricUAV);
-	pVectorVolume0EV->SetResource(m_pVolumeData0SRV);
-	pVectorVolume1EV->SetResource(m_pVolumeData1SRV);
+	// the cached metrics were derived from Jacobians of the other precision
+	if(m_pJacobianTextures[0][0] && m_jacobianBuffersHalf != m_halfPrecisionJacobian) {
+		m_metricCache.Clear();
+		m_displayedMetricValid = false;
+	}
 
-	pBoundaryMetricFixedEV->SetBool(m_boundaryMetricFixed);
+	// the cached FTLE volumes were advected with other settings
+	if(m_metricType == MT_FTLE && !(m_ftle == m_cachedFTLE)) {
+		m_metricCache.Clear();
+		m_displayedMetricValid = false;
+		m_cachedFTLE = m_ftle;
+	}
+
+	MetricVolumeCache::Key key = GetMetricCacheKey();
+	XMFLOAT3 actualMetricMinMax = GetActualMetricMinMax();
 
+	// the time changed within the same metric step
+	if(m_displayedMetricValid && m_displayedMetricKey == key &&
+		m_displayedMetricMinMax.x == actualMetricMinMax.x && m_displayedMetricMinMax.y == actualMetricMinMax.y &&
+		m_displayedBoundaryFixed == m_boundaryMetricFixed && m_displayedBoundaryValue == m_boundaryMetricValue)
+	{
+		m_lastMetricUpdateTime = m_currentTime;
+		m_lastMetricType = m_metricType;
+		m_lastMetricMinMax = m_metricMinMax;
+		return;
+	}
+
+	m_metricCache.SetBudgetMB(m_metricCacheBudgetMB);
+	ID3D11ShaderResourceView * pRawSRV = m_metricCache.Find(key);
+	if(!pRawSRV) {
+		ID3D11Texture3D * pRawTexture;
+		ID3D11UnorderedAccessView * pRawUAV;
+		if(FAILED(m_metricCache.Insert(pd3dDevice, key, &pRawTexture, &pRawSRV, &pRawUAV))) {
+			std::cerr << "Could not create a metric cache entry!" << std::endl;
+			return;
+		}
+
+		if(m_cpuMetrics || m_metricType == MT_FTLE) {
+			std::vector<float> values;
+			if(m_metricType == MT_FTLE)
+				ComputeFTLE(values, key);
+			else
+				ComputeMetricOnCPU(values, key.timestepT);
+
+			ID3D11DeviceContext * pContext;
+			pd3dDevice->GetImmediateContext(&pContext);
+			pContext->UpdateSubresource(pRawTexture, 0, nullptr, values.data(),
+				m_resolution.x * sizeof(float), m_resolution.x * m_resolution.y * sizeof(float));
+			SAFE_RELEASE(pContext);
+		}
+		else
+			DispatchMetricShader(pRawUAV, key.timestepT);
+	}
+
+	NormalizeMetric(pRawSRV);
+	m_displayedMetricKey = key;
+	m_displayedMetricMinMax = actualMetricMinMax;
+	m_displayedBoundaryFixed = m_boundaryMetricFixed;
+	m_displayedBoundaryValue = m_boundaryMetricValue;
+	m_displayedMetricValid = true;
+
+	// reading the metric back stalls the GPU, so its histogram is only refreshed when the metric
+	// or its range changes and not during playback
+	if(!m_metricHistogramValid || m_lastMetricType != m_metricType || m_lastMetricMinMax.x != m_metricMinMax.x || m_lastMetricMinMax.y != m_metricMinMax.y) {
+		m_scalarMetricData->UpdateHistogram(0, 0, 0.f);
+		m_metricHistogramValid = true;
+	}
+
+	m_lastMetricUpdateTime = m_currentTime;
+	m_lastMetricType = m_metricType;
+	m_lastMetricMinMax = m_metricMinMax;
+
+	m_scalarMetricData->NotifyAll();
+	
+	std::cout << "Metric updated." << std::endl;
+}
+
+/**
+	The point in time the metric is evaluated at, the weight of the second timestep is rounded to
+	m_metricCacheTimeSteps steps so playback hits the same cache entries in every loop
+*/
+MetricVolumeCache::Key VectorVolumeData::GetMetricCacheKey(void)
+{
+	MetricVolumeCache::Key key;
+	key.timestep0 = m_timeSequenceLength ? (int)m_currentDatasetSlot0 : 0;
+	key.timestep1 = m_timeSequenceLength ? (int)m_currentDatasetSlot1 : -1;
+	key.timestepT = m_timeSequenceLength ? m_currentTimestepT : 0.f;
+	if(m_metricCacheTimeSteps > 0)
+		key.timestepT = floorf(key.timestepT * m_metricCacheTimeSteps + 0.5f) / m_metricCacheTimeSteps;
+	key.metric = m_metricType;
+	return key;
+}
+
+// the range the metric is mapped to [0, 1] from, z = max - min
+XMFLOAT3 VectorVolumeData::GetActualMetricMinMax(void)
+{
 	XMFLOAT3 actualMetricMinMax;
 	if(!m_reverseMetricRange)
 		actualMetricMinMax = m_metricMinMax;
@@ -366,11 +676,33 @@ void VectorVolumeData::UpdateScalarMetric(void)
 		//reversing actually just means switch max and min
 		actualMetricMinMax = XMFLOAT3(m_metricMinMax.y, m_metricMinMax.x, 0);
 	actualMetricMinMax.z = (actualMetricMinMax.y - actualMetricMinMax.x);
-	pMetricMinMaxEV->SetFloatVector(&actualMetricMinMax.x);
-	pBoundaryMetricValueEV->SetFloat((m_boundaryMetricValue - actualMetricMinMax.x)/actualMetricMinMax.z);
+	return actualMetricMinMax;
+}
+
+// writes the raw values of the current metric to pTarget
+void VectorVolumeData::DispatchMetricShader(ID3D11UnorderedAccessView * pTarget, float timestepT)
+{
+	// all metrics but the velocity and the fourth component are derived from the cached Jacobians
+	bool usesJacobian = m_metricType != MT_VELOCITY_MAGNITUDE && m_metricType != MT_FOURTH_COMPONENT;
+	if(usesJacobian) {
+		UpdateJacobians();
+		for(int i=0; i < 3; i++) {
+			pJacobianEV[0][i]->SetResource(m_pJacobianSRVs[0][i]);
+			pJacobianEV[1][i]->SetResource(m_pJacobianSRVs[1][i]);
+		}
+	}
+
+	pScalarMetricEV->SetUnorderedAccessView(pTarget);
+	pVectorVolume0EV->SetResource(m_pVolumeData0SRV);
+	pVectorVolume1EV->SetResource(m_pVolumeData1SRV);
+
+	// identity mapping and no boundary, these are applied by NormalizeMetric
+	XMFLOAT3 identityMinMax(0.f, 1.f, 1.f);
+	pMetricMinMaxEV->SetFloatVector(&identityMinMax.x);
+	pBoundaryMetricFixedEV->SetBool(false);
 	XMUINT3 maxIndices = XMUINT3(m_resolution.x-1, m_resolution.y-1, m_resolution.z-1);
 	pVolumeResEV->SetIntVector((int*)&maxIndices.x);
-	pTimestepTEV->SetFloat(m_currentTimestepT);
+	pTimestepTEV->SetFloat(timestepT);
 
 	ID3D11DeviceContext * pContext;	
 	pd3dDevice->GetImmediateContext(&pContext);
@@ -382,18 +714,208 @@ void VectorVolumeData::UpdateScalarMetric(void)
 	pContext->Dispatch(gx, gy, gz);
 
 	pScalarMetricEV->SetUnorderedAccessView(nullptr);
+	for(int i=0; i < 3; i++) {
+		pJacobianEV[0][i]->SetResource(nullptr);
+		pJacobianEV[1][i]->SetResource(nullptr);
+	}
 	pMetricPasses[m_metricType]->Apply(0, pContext);
 	SAFE_RELEASE(pContext);
+}
 
-	m_lastMetricUpdateTime = m_currentTime;
-	m_lastMetricType = m_metricType;
-	m_lastMetricMinMax = m_metricMinMax;
+// maps raw metric values to [0, 1] into the metric volume
+void VectorVolumeData::NormalizeMetric(ID3D11ShaderResourceView * pRawSRV)
+{
+	pScalarMetricEV->SetUnorderedAccessView(m_pScalarMetricUAV);
+	pRawMetricEV->SetResource(pRawSRV);
 
-	m_scalarMetricData->NotifyAll();
-	
-	std::cout << "Metric updated." << std::endl;
+	XMFLOAT3 actualMetricMinMax = GetActualMetricMinMax();
+	pMetricMinMaxEV->SetFloatVector(&actualMetricMinMax.x);
+	pBoundaryMetricFixedEV->SetBool(m_boundaryMetricFixed);
+	// lambda2 is always 0 at a fixed boundary
+	float boundaryValue = m_metricType == MT_LAMBDA_2 ? 0.f : (m_boundaryMetricValue - actualMetricMinMax.x)/actualMetricMinMax.z;
+	pBoundaryMetricValueEV->SetFloat(boundaryValue);
+	XMUINT3 maxIndices = XMUINT3(m_resolution.x-1, m_resolution.y-1, m_resolution.z-1);
+	pVolumeResEV->SetIntVector((int*)&maxIndices.x);
+
+	ID3D11DeviceContext * pContext;	
+	pd3dDevice->GetImmediateContext(&pContext);
+	pNormalizePass->Apply(0, pContext);
+	uint32_t	gx = static_cast<uint32_t>(ceilf(m_resolution.x / CSGroupSize.x)),
+				gy = static_cast<uint32_t>(ceilf(m_resolution.y / CSGroupSize.y)), 
+				gz = static_cast<uint32_t>(ceilf(m_resolution.z / CSGroupSize.z));
+	pContext->Dispatch(gx, gy, gz);
+
+	pScalarMetricEV->SetUnorderedAccessView(nullptr);
+	pRawMetricEV->SetResource(nullptr);
+	pNormalizePass->Apply(0, pContext);
+	SAFE_RELEASE(pContext);
 }
 
+/**
+	Makes sure the Jacobian buffers hold the velocity gradients of the two timesteps in the volume slots
+	The volume slots are swapped during playback, so the Jacobians are swapped along with them and
+	only the new timestep is differentiated. Switching the metric does not recompute anything.
+*/
+void VectorVolumeData::UpdateJacobians(void)
+{
+	assert(pd3dDevice);
+
+	if(m_pJacobianTextures[0][0] && m_jacobianBuffersHalf != m_halfPrecisionJacobian)
+		ReleaseJacobianBuffers();
+
+	if(!m_pJacobianTextures[0][0] && FAILED(CreateJacobianBuffers())) {
+		std::cerr << "Could not create the Jacobian buffers!" << std::endl;
+		ReleaseJacobianBuffers();
+		return;
+	}
+
+	int requiredTimesteps[2] = { (int)m_currentDatasetSlot0, m_pVolumeData1SRV ? (int)m_currentDatasetSlot1 : -1 };
+	ID3D11ShaderResourceView * volumeSRVs[2] = { m_pVolumeData0SRV, m_pVolumeData1SRV };
+
+	int kept = (m_jacobianTimestep[0] == requiredTimesteps[0]) + (m_jacobianTimestep[1] == requiredTimesteps[1]);
+	int keptSwapped = (m_jacobianTimestep[1] == requiredTimesteps[0]) + (m_jacobianTimestep[0] == requiredTimesteps[1]);
+	if(keptSwapped > kept) {
+		std::swap(m_pJacobianTextures[0], m_pJacobianTextures[1]);
+		std::swap(m_pJacobianSRVs[0], m_pJacobianSRVs[1]);
+		std::swap(m_pJacobianUAVs[0], m_pJacobianUAVs[1]);
+		std::swap(m_jacobianTimestep[0], m_jacobianTimestep[1]);
+	}
+
+	for(int slot=0; slot < 2; slot++) {
+		if(requiredTimesteps[slot] >= 0 && m_jacobianTimestep[slot] != requiredTimesteps[slot]) {
+			ComputeJacobian(slot, volumeSRVs[slot]);
+			m_jacobianTimestep[slot] = requiredTimesteps[slot];
+		}
+	}
+}
+
+void VectorVolumeData::ComputeJacobian(int slot, ID3D11ShaderResourceView * pVolumeSRV)
+{
+	pVectorVolume0EV->SetResource(pVolumeSRV);
+	for(int i=0; i < 3; i++)
+		pJacobianRWEV[i]->SetUnorderedAccessView(m_pJacobianUAVs[slot][i]);
+	XMUINT3 maxIndices = XMUINT3(m_resolution.x-1, m_resolution.y-1, m_resolution.z-1);
+	pVolumeResEV->SetIntVector((int*)&maxIndices.x);
+
+	ID3D11DeviceContext * pContext;	
+	pd3dDevice->GetImmediateContext(&pContext);
+	pJacobianPass->Apply(0, pContext);
+	uint32_t	gx = static_cast<uint32_t>(ceilf(m_resolution.x / CSGroupSize.x)),
+				gy = static_cast<uint32_t>(ceilf(m_resolution.y / CSGroupSize.y)), 
+				gz = static_cast<uint32_t>(ceilf(m_resolution.z / CSGroupSize.z));
+	pContext->Dispatch(gx, gy, gz);
+
+	for(int i=0; i < 3; i++)
+		pJacobianRWEV[i]->SetUnorderedAccessView(nullptr);
+	pVectorVolume0EV->SetResource(nullptr);
+	pJacobianPass->Apply(0, pContext);
+	SAFE_RELEASE(pContext);
+}
+
+/**
+	Computes the raw values of the current metric like DispatchMetricShader
+	The vector data in RAM is padded to four components, so it can be passed on directly.
+*/
+void VectorVolumeData::ComputeMetricOnCPU(std::vector<float> & values, float timestepT)
+{
+	MetricEngine::Parameters params;
+	params.timestepT = timestepT;
+
+	MetricEngine::InputFormat format = (m_format == DF_HALF3 || m_format == DF_HALF4) ? MetricEngine::IF_HALF4 : MetricEngine::IF_FLOAT4;
+	const void * data0 = GetTimestepData(m_timeSequenceLength ? m_currentDatasetSlot0 : 0);
+	const void * data1 = m_timeSequenceLength ? GetTimestepData(m_currentDatasetSlot1) : nullptr;
+
+	values.resize(m_resolution.x * m_resolution.y * m_resolution.z);
+	MetricEngine::Compute((MetricEngine::Metric)m_metricType, data0, data1, format, &m_resolution.x, params, values.data());
+}
+
+/**
+	Computes the FTLE starting at the time of the metric cache key, resampled to the volume resolution
+	The flow map is advected through the timesteps the integration time spans, time series stop at
+	their first or last timestep and the FTLE is taken over the time that was actually covered.
+	With the flow map cache, whole cache intervals are composed from the cached maps.
+	Returns the time spent computing in ms, reading the timesteps is not included.
+*/
+double VectorVolumeData::ComputeFTLE(std::vector<float> & values, const MetricVolumeCache::Key & key)
+{
+	double start = GetTimeMs();
+
+	float startTime = m_timeSequenceLength ? (key.timestep0 + key.timestepT) * m_timestep : 0.f;
+	float endTime = startTime + m_ftle.integrationTime;
+	if(m_timeSequenceLength)
+		endTime = std::max(0.f, std::min(m_timeSequenceLength, endTime));
+
+	int divisor = std::max(1, m_ftle.gridDivisor);
+	int gridResolution[3] = {
+		std::max(2, (m_resolution.x + divisor - 1) / divisor),
+		std::max(2, (m_resolution.y + divisor - 1) / divisor),
+		std::max(2, (m_resolution.z + divisor - 1) / divisor)
+	};
+	AdvectionEngine::FlowMap map;
+	map.Init(gridResolution, startTime, endTime, std::max(1e-4f, m_ftle.stepsize));
+
+	AdvectionEngine::InputFormat format = (m_format == DF_HALF3 || m_format == DF_HALF4) ? AdvectionEngine::IF_HALF4 : AdvectionEngine::IF_FLOAT4;
+	XMFLOAT3 bbox = GetBoundingBox();
+	float extent[3] = { bbox.x, bbox.y, bbox.z };
+	float velocityScaling[3] = { 1.f / bbox.x, 1.f / bbox.y, 1.f / bbox.z };
+
+	if(m_ftle.flowMapCache) {
+		int flowMapDivisor = std::max(1, m_ftle.flowMapGridDivisor);
+		FlowMapCache::Settings settings;
+		settings.resolution[0] = std::max(2, (m_resolution.x + flowMapDivisor - 1) / flowMapDivisor);
+		settings.resolution[1] = std::max(2, (m_resolution.y + flowMapDivisor - 1) / flowMapDivisor);
+		settings.resolution[2] = std::max(2, (m_resolution.z + flowMapDivisor - 1) / flowMapDivisor);
+		settings.interval = m_timestep / std::max(1, m_ftle.flowMapsPerTimestep);
+		settings.stepsize = map.stepsize;
+		settings.steady = !m_timeSequenceLength;
+		m_flowMapCache.Configure(settings);
+		m_flowMapCache.SetBudgetMB(m_flowMapCacheBudgetMB);
+	}
+	// only the advection is timed, not the streaming of the timesteps
+	double advectionTime = 0;
+	auto advance = [&](float intervalStart, float intervalEnd) {
+		double advanceStart = GetTimeMs();
+		if(m_ftle.flowMapCache)
+			m_flowMapCache.AdvanceFlowMap(m_ftleAdvection, map, intervalStart, intervalEnd, velocityScaling);
+		else
+			m_ftleAdvection.AdvanceFlowMap(map, intervalStart, intervalEnd, velocityScaling);
+		advectionTime += GetTimeMs() - advanceStart;
+	};
+	int flowMapHits = m_flowMapCache.GetHits(), flowMapMisses = m_flowMapCache.GetMisses();
+
+	if(!m_timeSequenceLength) {
+		m_ftleAdvection.SetFields(GetTimestepData(0), 0, nullptr, -1, format, &m_resolution.x);
+		advance(std::min(startTime, endTime), std::max(startTime, endTime));
+	}
+	else {
+		auto visit = [&](int t, const void * data0, const void * data1) {
+			m_ftleAdvection.SetFields(data0, t, data1, t + 1, format, &m_resolution.x);
+			advance(t * m_timestep, (t + 1) * m_timestep);
+			return !map.Finished();
+		};
+		int first = (int)floorf(std::min(startTime, endTime) / m_timestep);
+		int last = (int)ceilf(std::max(startTime, endTime) / m_timestep);
+		StreamTimesteps(first, last, visit, endTime < startTime);
+	}
+	double streamingTime = GetTimeMs() - start - advectionTime;
+
+	double gradientStart = GetTimeMs();
+	std::vector<float> ftle(map.Size());
+	FTLEEngine::Compute(map, extent, ftle.data());
+	values.resize(m_resolution.x * m_resolution.y * m_resolution.z);
+	FTLEEngine::Resample(ftle.data(), gridResolution, &m_resolution.x, values.data());
+	double gradientTime = GetTimeMs() - gradientStart;
+
+	std::cout << "FTLE over " << map.time - map.startTime << " on a " << gridResolution[0] << "x" << gridResolution[1] << "x" << gridResolution[2]
+			  << " grid took " << advectionTime + gradientTime << " ms: advection " << advectionTime << " ms ("
+			  << map.Size() * map.numSteps / std::max(advectionTime, 1e-3) / 1000.0 << " M RK4 steps/s), gradient and resampling "
+			  << gradientTime << " ms, " << ThreadPool::GetShared().GetNumThreads() << " threads; reading the timesteps took another "
+			  << streamingTime << " ms" << std::endl;
+	if(m_ftle.flowMapCache)
+		std::cout << "Flow maps composed: " << m_flowMapCache.GetHits() - flowMapHits << " cached, "
+				  << m_flowMapCache.GetMisses() - flowMapMisses << " computed" << std::endl;
+	return advectionTime + gradientTime;
+}
 
 HRESULT VectorVolumeData::CreateScalarMetricBuffers(void)
 {
@@ -434,4 +956,72 @@ HRESULT VectorVolumeData::CreateScalarMetricBuffers(void)
 	pd3dDevice->CreateUnorderedAccessView(m_pScalarMetricTexture, &uavDesc, &m_pScalarMetricUAV);
 
 	return S_OK;
-}
\ No newline at end of file
+}
+
+/**
+	Creates the Jacobian buffers for both volume slots (only one if there is a single timestep)
+	Each slot holds the nine entries in a four, a four and a one component texture, which takes
+	36 bytes per voxel as float and 18 bytes as half.
+*/
+HRESULT VectorVolumeData::CreateJacobianBuffers(void)
+{
+	assert(pd3dDevice);
+
+	HRESULT hr;
+	DXGI_FORMAT formats[3];
+	formats[0] = formats[1] = m_halfPrecisionJacobian ? DXGI_FORMAT_R16G16B16A16_FLOAT : DXGI_FORMAT_R32G32B32A32_FLOAT;
+	formats[2] = m_halfPrecisionJacobian ? DXGI_FORMAT_R16_FLOAT : DXGI_FORMAT_R32_FLOAT;
+
+	int numSlots = m_pVolumeData1SRV ? 2 : 1;
+	for(int slot=0; slot < numSlots; slot++) {
+		for(int i=0; i < 3; i++) {
+			D3D11_TEXTURE3D_DESC desc;
+			ZeroMemory(&desc, sizeof(desc));
+			desc.Width = m_resolution.x;
+			desc.Height = m_resolution.y;
+			desc.Depth = m_resolution.z;
+			desc.MipLevels = 1;
+			desc.Format = formats[i];
+			desc.Usage = D3D11_USAGE_DEFAULT;
+			desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+			desc.CPUAccessFlags = 0;
+			desc.MiscFlags = 0;
+
+			V_RETURN(pd3dDevice->CreateTexture3D(&desc, nullptr, &m_pJacobianTextures[slot][i]));
+
+			D3D11_SHADER_RESOURCE_VIEW_DESC pDesc;
+			ZeroMemory(&pDesc, sizeof(pDesc));
+			pDesc.Format = formats[i];
+			pDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE3D;
+			pDesc.Texture3D.MipLevels = -1;
+			pDesc.Texture3D.MostDetailedMip = 0;
+
+			V_RETURN(pd3dDevice->CreateShaderResourceView(m_pJacobianTextures[slot][i], &pDesc, &m_pJacobianSRVs[slot][i]));
+
+			D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+			ZeroMemory(&uavDesc, sizeof(uavDesc));
+			uavDesc.Format = formats[i];
+			uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE3D;
+			uavDesc.Texture3D.MipSlice = 0;
+			uavDesc.Texture3D.FirstWSlice = 0;
+			uavDesc.Texture3D.WSize = m_resolution.z;
+			V_RETURN(pd3dDevice->CreateUnorderedAccessView(m_pJacobianTextures[slot][i], &uavDesc, &m_pJacobianUAVs[slot][i]));
+		}
+		m_jacobianTimestep[slot] = -1;
+	}
+	m_jacobianBuffersHalf = m_halfPrecisionJacobian;
+
+	return S_OK;
+}
+
+void VectorVolumeData::ReleaseJacobianBuffers(void)
+{
+	for(int slot=0; slot < 2; slot++) {
+		for(int i=0; i < 3; i++) {
+			SAFE_RELEASE(m_pJacobianUAVs[slot][i]);
+			SAFE_RELEASE(m_pJacobianSRVs[slot][i]);
+			SAFE_RELEASE(m_pJacobianTextures[slot][i]);
+		}
+		m_jacobianTimestep[slot] = -1;
+	}
+}
@@ -3,9 +3,22 @@
 */
 
 RWTexture3D<float> g_metricTexture;
+Texture3D<float> g_rawMetricTexture;
 Texture3D<float4> g_vectorTexture0;
 Texture3D<float4> g_vectorTexture1;
 
+// Jacobian of the two timesteps, the nine entries row by row in A = (00 01 02 10), B = (11 12 20 21), C = 22
+Texture3D<float4> g_jacobianT0A;
+Texture3D<float4> g_jacobianT0B;
+Texture3D<float> g_jacobianT0C;
+Texture3D<float4> g_jacobianT1A;
+Texture3D<float4> g_jacobianT1B;
+Texture3D<float> g_jacobianT1C;
+
+RWTexture3D<float4> g_jacobianA;
+RWTexture3D<float4> g_jacobianB;
+RWTexture3D<float> g_jacobianC;
+
 cbuffer cbVectorVolume {
 	float  g_timestepT = 0;
 	float3 g_metricMinMax;	//x ^= min, y ^= max, z = (max - min)
@@ -27,36 +40,78 @@ float4 SampleVectorVolume(uint3 pos)
 		return g_timestepT * g_vectorTexture1[pos] + (1. - g_timestepT) * g_vectorTexture0[pos];
 }
 
-uint3 clampPos(uint3 pos)
+// signed, pos - 1 wrapped around to the upper border with uints
+uint3 clampPos(int3 pos)
 {
-	return min(g_volumeRes, max(uint3(0,0,0), pos));
+	return uint3(clamp(pos, int3(0,0,0), int3(g_volumeRes)));
 }
 
-float4 SampleVectorDeriv(uint3 pos, uint3 step)
+// derivatives of a single timestep, the difference of the two neighbors as in the metrics before
+float4 SampleVectorDeriv(uint3 pos, int3 step)
 {
-	return SampleVectorVolume(clampPos(pos + step)) - SampleVectorVolume(clampPos(pos - step));
+	return g_vectorTexture0[clampPos(int3(pos) + step)] - g_vectorTexture0[clampPos(int3(pos) - step)];
 }
 
-float3x3 SampleJacobian(uint3 pos) 
+// J[i][j] = du_i/dx_j
+float3x3 ComputeJacobian(uint3 pos) 
 {
-	float3 ux = SampleVectorDeriv(pos, uint3(1, 0, 0)).xyz;
-	float3 uy = SampleVectorDeriv(pos, uint3(0, 1, 0)).xyz;
-	float3 uz = SampleVectorDeriv(pos, uint3(0, 0, 1)).xyz;
+	float3 ux = SampleVectorDeriv(pos, int3(1, 0, 0)).xyz;
+	float3 uy = SampleVectorDeriv(pos, int3(0, 1, 0)).xyz;
+	float3 uz = SampleVectorDeriv(pos, int3(0, 0, 1)).xyz;
 	
 	float3x3 jacobian = {
 		ux.x, uy.x, uz.x,
 		ux.y, uy.y, uz.y,
 		ux.z, uy.z, uz.z
 	};
-	/*
+	return jacobian;
+}
+
+float3x3 UnpackJacobian(float4 a, float4 b, float c)
+{
 	float3x3 jacobian = {
-		ux.x, ux.y, ux.z,
-		uy.x, uy.y, uy.z,
-		uz.x, uz.y, uz.z
-	};*/
+		a.x, a.y, a.z,
+		a.w, b.x, b.y,
+		b.z, b.w, c
+	};
 	return jacobian;
 }
 
+// the Jacobian at the current time from the cached fields, derivatives are linear so interpolating
+// the Jacobians of the timesteps is the same as differentiating the interpolated vectors
+float3x3 SampleJacobian(uint3 pos)
+{
+	float3x3 J = UnpackJacobian(g_jacobianT0A[pos], g_jacobianT0B[pos], g_jacobianT0C[pos]);
+	if(g_timestepT == 0)
+		return J;
+	else
+		return lerp(J, UnpackJacobian(g_jacobianT1A[pos], g_jacobianT1B[pos], g_jacobianT1C[pos]), g_timestepT);
+}
+
+// stores the Jacobian of g_vectorTexture0, run once per timestep
+[numthreads(32,2,2)]
+void CSJacobian(uint3 threadID: SV_DispatchThreadID)
+{
+	if(any(threadID > g_volumeRes))
+		return;
+
+	float3x3 J = ComputeJacobian(threadID);
+	g_jacobianA[threadID] = float4(J._m00, J._m01, J._m02, J._m10);
+	g_jacobianB[threadID] = float4(J._m11, J._m12, J._m20, J._m21);
+	g_jacobianC[threadID] = J._m22;
+}
+
+// maps the raw values of a cached metric volume to the metric range
+[numthreads(32,2,2)]
+void CSNormalizeMetric(uint3 threadID: SV_DispatchThreadID)
+{
+	if(g_boundaryMetricFixed && (!all(threadID) || !all(threadID - g_volumeRes))) {
+		g_metricTexture[threadID] = g_boundaryMetricValue;
+		return;
+	}
+	g_metricTexture[threadID] = constrainMetric(g_rawMetricTexture[threadID]);
+}
+
 [numthreads(32,2,2)]	
 void CSFourthComponent(uint3 threadID: SV_DispatchThreadID)
 {
@@ -148,9 +203,9 @@ void CSVSquared(uint3 threadID: SV_DispatchThreadID)
 	float3 curl = float3(J._m21 - J._m12, J._m02 - J._m20, J._m10 - J._m01);
 
 	float V2 = 0;
-	// no loop unrolling - who cares about performance anyway...
-	for(int i=0; i < 2; i++)
-		for(int j=0; j < 2; j++)
+	[unroll]
+	for(int i=0; i < 3; i++)
+		for(int j=0; j < 3; j++)
 			V2 += S[i][j]*curl[j]*S[i][j]*curl[j];
 
 	g_metricTexture[threadID] = constrainMetric(V2);
@@ -228,53 +283,39 @@ void CSLambda2(uint3 threadID: SV_DispatchThreadID)
 
 	float3x3 A = OmegaSquared + SSquared;
 	
-/*
-// Analytical Eigenvalues of 3x3 matrices:
-// http://www.wolframalpha.com/input/?i=det+[[a_0+-+l%2Ca_1%2C+a_2]%2C[b_0%2Cb_1-l%2Cb_2]%2C[c_0%2Cc_1%2Cc_2-l]]
-// and http://www.wolframalpha.com/input/?i=l^3+%2B+c_2+*+l^2+%2B+c_1+*+l+%2B+c_0+%3D+0+solve+for+l
-	float c2 = - A._m00 - A._m11 - A._m22;
-	float c1 = - ( -A._m11*A._m22 + A._m12*A._m21 - A._m00*A._m22 + A._m02*A._m20 - A._m00*A._m11 + A._m01*A._m10);
-	float c0 = - ( -A._m02*A._m11*A._m20 + A._m01*A._m12*A._m20  + A._m02*A._m10*A._m21 - A._m00*A._m12*A._m21 - A._m01*A._m10*A._m22 + A._m00*A._m11*A._m22);
-
-	float k1 = -2.*c2*c2 + 9.*c1*c2 - 27.*c0;
-	float k2 = 3.*c1 - c2*c2;
-	float s = sqrt(4.*k2*k2*k2 + k1*k1);
-
-	float s2 = pow(k1 + s, 1./3.);
-
-	float twopowonethird = 1.2599210498948731647672106072782283505;
-	float lambda2 = -c2/3. + s2 / (3.*twopowonethird) - twopowonethird*k2/(3.*s2);
-*/	
+	// closed form eigenvalues of the symmetric matrix A (Smith 1961), same as MetricEngine on the CPU
+	// with q = tr(A)/3 and B = (A - qI)/p the eigenvalues are q + 2p cos(phi + 2k pi/3), phi = acos(det(B)/2)/3
+	float q = (A._m00 + A._m11 + A._m22) / 3.;
+	float offDiagonal = A._m01*A._m01 + A._m02*A._m02 + A._m12*A._m12;
+	float3 d = float3(A._m00, A._m11, A._m22) - q;
+	float p = sqrt((dot(d, d) + 2. * offDiagonal) / 6.);
+
+	float lambda2 = q;
+	if(p > 1e-30) {
+		float3x3 B = A;
+		B._m00 = d.x; B._m11 = d.y; B._m22 = d.z;
+		float r = clamp(determinant(B) / (2. * p * p * p), -1., 1.);
+		float phi = acos(r) / 3.;
+		float largest = q + 2. * p * cos(phi);
+		float smallest = q + 2. * p * cos(phi + 2.0943951023931954923);
+		lambda2 = 3. * q - largest - smallest;
+	}
 
-	// power iteration for approximation of first eigenvector
-	float3 w, x1 = float3(1,1,1);
+	g_metricTexture[threadID] = constrainMetric(lambda2);;
+}
 
-	[unroll]
-	for(int i=0; i < 15; i++) {
-		w = mul(x1, A);
-		x1 = normalize(w);
+technique11 Jacobian
+{
+	pass PASS_JACOBIAN	{
+		SetComputeShader(CompileShader(cs_5_0, CSJacobian()));
 	}
-	float lambda1 = dot(x1, mul(x1, A));
-
-	// compute new matrix where second eigenvalue of A is now largest eigenvalue
-	// N = x1 * x1^T
-	float3x3 N = {x1.x*x1.x, x1.x*x1.y, x1.x*x1.z, 
-				  x1.y*x1.x, x1.y*x1.y, x1.y*x1.z,
-				  x1.z*x1.x, x1.z*x1.y, x1.z*x1.z};
-	float3x3 A2 = A - lambda1 * N;
-	
-	// repeated power iteration yields (approximation of) second eigenvector
-	float3 x2 = float3(1,1,1);
+}
 
-	[unroll]
-	for(int j=0; j < 15; j++) {
-		w = mul(x2, A2);
-		x2 = normalize(w);
+technique11 Normalize
+{
+	pass PASS_NORMALIZE	{
+		SetComputeShader(CompileShader(cs_5_0, CSNormalizeMetric()));
 	}
-
-	float lambda2 = dot(x2, mul(x2, A)); // rayleigh quotient yields eigenvalue
-
-	g_metricTexture[threadID] = constrainMetric(lambda2);;
 }
 
 technique11 Metrics
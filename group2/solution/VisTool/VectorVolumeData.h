@@ -3,6 +3,9 @@
 
 #include "VolumeData.h"
 #include "ScalarVolumeData.h"
+#include "MetricVolumeCache.h"
+#include "AdvectionEngine.h"
+#include "FlowMapCache.h"
 #include "SettingsStorage.h"
 
 class VectorVolumeData :
@@ -21,8 +24,10 @@ public:
 		MT_Q_PARAMETER,
 		MT_LAMBDA_2,
 		MT_FOURTH_COMPONENT,
+		MT_FTLE,	// computed on the CPU from the flow map, there is no shader pass for it
 		NUM_METRICS	// not a real metric
 	};
+	static const int NUM_SHADER_METRICS = MT_FTLE;
 	
 	//statics 
 	static HRESULT Initialize(ID3D11Device * pd3dDevice, TwBar* pParametersBar);
@@ -30,7 +35,7 @@ public:
 
 
 	// ctor, dtor
-	VectorVolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution, float timestep = 1.f, XMINT3 timestepIndices = XMINT3(0, 0, 1));
+	VectorVolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution, float timestep = 1.f, XMINT3 timestepIndices = XMINT3(0, 0, 1), std::string metadataFileName = "");
 	~VectorVolumeData(void);
 
 	// methods
@@ -39,25 +44,44 @@ public:
 	void SetTime(float currentTime);
 	void SaveConfig(SettingsStorage &store);
 	void LoadConfig(SettingsStorage &store);
+	void UpdateJacobians();
 
 	// accessors
 	ScalarVolumeData * GetScalarMetricVolume();
+	// part 0 to 2 of the cached Jacobian of texture slot 0 or 1, packed as described in VectorVolumeData.fx
+	ID3D11ShaderResourceView * GetJacobianSRV(int slot, int part) {	return m_pJacobianSRVs[slot][part];	};
 	void SetMetric(MetricType m) {		m_metricType = m;	};
 
 private:
 	// static functions
 	static void SetupTwBar(TwBar * pParametersBar);
 	static void TW_CALL OnComputeMinMaxCB(void* clientData);
+	static void TW_CALL OnValidateMetricCB(void* clientData);
+	static void TW_CALL OnClearMetricCacheCB(void* clientData);
+	static void TW_CALL GetMetricCacheHitsCB(void* value, void* clientData);
+	static void TW_CALL GetMetricCacheMissesCB(void* value, void* clientData);
 	static void TW_CALL GetMetricCB(void* value, void* clientData);
 	static void TW_CALL SetMetricCB(const void* value, void* clientData);
+	static void TW_CALL OnFTLEScalingCB(void* clientData);
+	static void TW_CALL GetFlowMapCacheHitsCB(void* value, void* clientData);
+	static void TW_CALL GetFlowMapCacheMissesCB(void* value, void* clientData);
 
 	// static variables
 	static const XMFLOAT3 CSGroupSize;				//size of the compute shader groups
-	static char * metricPassNames[NUM_METRICS];
+	static char * metricPassNames[NUM_SHADER_METRICS];
+	static char * jacobianTextureNames[2][3];
+	static char * jacobianUAVNames[3];
 	static ID3DX11Effect			* pEffect;
 	static ID3DX11EffectTechnique	* pTechnique;
-	static ID3DX11EffectPass		* pMetricPasses[NUM_METRICS];
+	static ID3DX11EffectPass		* pMetricPasses[NUM_SHADER_METRICS];
+	static ID3DX11EffectTechnique	* pJacobianTechnique;
+	static ID3DX11EffectPass		* pJacobianPass;
+	static ID3DX11EffectTechnique	* pNormalizeTechnique;
+	static ID3DX11EffectPass		* pNormalizePass;
 	static ID3DX11EffectUnorderedAccessViewVariable * pScalarMetricEV;
+	static ID3DX11EffectShaderResourceVariable * pRawMetricEV;
+	static ID3DX11EffectShaderResourceVariable * pJacobianEV[2][3];
+	static ID3DX11EffectUnorderedAccessViewVariable * pJacobianRWEV[3];
 	static ID3DX11EffectShaderResourceVariable * pVectorVolume0EV;
 	static ID3DX11EffectShaderResourceVariable * pVectorVolume1EV;
 	static ID3DX11EffectVectorVariable * pMetricMinMaxEV;
@@ -68,21 +92,66 @@ private:
 
 	// methods
 	void UpdateScalarMetric();	
+	MetricVolumeCache::Key GetMetricCacheKey();
+	void DispatchMetricShader(ID3D11UnorderedAccessView * pTarget, float timestepT);
+	void NormalizeMetric(ID3D11ShaderResourceView * pRawSRV);
+	void ComputeMetricOnCPU(std::vector<float> & values, float timestepT);
+	double ComputeFTLE(std::vector<float> & values, const MetricVolumeCache::Key & key);
+	XMFLOAT3 GetActualMetricMinMax();
+	bool ApplyCachedMetricRange();
 	HRESULT CreateScalarMetricBuffers();
+	HRESULT CreateJacobianBuffers();
+	void ReleaseJacobianBuffers();
+	void ComputeJacobian(int slot, ID3D11ShaderResourceView * pVolumeSRV);
+
+	// types
+	struct FTLESettings {
+		int gridDivisor;		// the flow map grid is the volume resolution divided by this
+		float integrationTime;	// negative for the backward FTLE
+		float stepsize;			// longest RK4 step
+		bool flowMapCache;		// compose the flow map from the maps in m_flowMapCache
+		int flowMapGridDivisor;	// the cached maps are sampled on the volume resolution divided by this
+		int flowMapsPerTimestep;
+		bool operator==(const FTLESettings & o) const {
+			return gridDivisor == o.gridDivisor && integrationTime == o.integrationTime && stepsize == o.stepsize &&
+				flowMapCache == o.flowMapCache && flowMapGridDivisor == o.flowMapGridDivisor && flowMapsPerTimestep == o.flowMapsPerTimestep;
+		}
+	};
 
 	// members
 	MetricType m_metricType, m_lastMetricType;
 	ScalarVolumeData * m_scalarMetricData;
 	XMFLOAT3 m_metricMinMax, m_lastMetricMinMax;
 	bool m_reverseMetricRange;
+	bool m_cpuMetrics;		// compute the metric with the MetricEngine and upload it instead of running the shader
 	bool m_boundaryMetricFixed;
 	float m_boundaryMetricValue;
 	float m_lastMetricUpdateTime;
+	bool m_metricHistogramValid;
+	bool m_halfPrecisionJacobian;	// setting, applied when the Jacobian buffers are created the next time
+	bool m_jacobianBuffersHalf;		// format of the existing Jacobian buffers
+	int m_jacobianTimestep[2];		// timestep whose Jacobian is in slot 0 and 1, -1 if none
+	MetricVolumeCache m_metricCache;
+	int m_metricCacheBudgetMB;
+	int m_metricCacheTimeSteps;		// metrics are evaluated at this many points between two timesteps, 0 for every frame
+	MetricVolumeCache::Key m_displayedMetricKey;	// raw values and mapping of the metric volume content
+	bool m_displayedMetricValid;
+	XMFLOAT3 m_displayedMetricMinMax;
+	bool m_displayedBoundaryFixed;
+	float m_displayedBoundaryValue;
+	FTLESettings m_ftle;
+	FTLESettings m_cachedFTLE;		// settings the FTLE volumes in the metric cache were computed with
+	AdvectionEngine m_ftleAdvection;
+	FlowMapCache m_flowMapCache;
+	int m_flowMapCacheBudgetMB;
 
 	// dx resources
 	ID3D11Texture3D * m_pScalarMetricTexture;
 	ID3D11ShaderResourceView * m_pScalarMetricSRV;
 	ID3D11UnorderedAccessView * m_pScalarMetricUAV;
+	ID3D11Texture3D * m_pJacobianTextures[2][3];
+	ID3D11ShaderResourceView * m_pJacobianSRVs[2][3];
+	ID3D11UnorderedAccessView * m_pJacobianUAVs[2][3];
 
 };
 
@@ -1,15 +1,37 @@
 #include "VolumeData.h"
+#include "TimestepPrefetcher.h"
+#include "PackedVolumeFile.h"
+#include "VolumeMetadataCache.h"
+#include "HistogramEngine.h"
+#include "BrickPyramid.h"
 
 #include "util/util.h"
+#include "util/ThreadPool.h"
 
 #include "AntTweakBar.h"
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+#include <cfloat>
 
 ID3D11Device	* VolumeData::pd3dDevice;
 TwBar			* VolumeData::pParametersBar;
 TwType			VolumeData::volumeDataType;
+VolumeData::LoaderMode VolumeData::loaderMode = VolumeData::LM_COPY;
+int				VolumeData::loaderThreads = 0;
+bool			VolumeData::prefetchEnabled = true;
+int				VolumeData::prefetchLookahead = 2;
+int				VolumeData::residencyBudgetMB = 0;
+VolumeData::EvictionPolicy VolumeData::evictionPolicy = VolumeData::EP_DISTANCE;
+int				VolumeData::packBrickSize = 32;
+bool			VolumeData::packCompressed = true;
+int				VolumeData::histogramBins = 256;
+bool			VolumeData::histogramAutoRange = true;
+float			VolumeData::histogramRangeMin = 0.f;
+float			VolumeData::histogramRangeMax = 1.f;
 
 int VolumeData::GetElementSize(DataFormat f) {
 	switch (f) {
@@ -47,6 +69,42 @@ VolumeData::DataFormat VolumeData::GetFormatFromStr(std::string str)
 	return DF_UNKNOWN;
 }
 
+void VolumeData::SaveLoaderConfig(SettingsStorage &store)
+{
+	store.StoreInt("volumedata.loader", loaderMode);
+	store.StoreInt("volumedata.loader.threads", loaderThreads);
+	store.StoreBool("volumedata.prefetch.enabled", prefetchEnabled);
+	store.StoreInt("volumedata.prefetch.lookahead", prefetchLookahead);
+	store.StoreInt("volumedata.residency.budgetMB", residencyBudgetMB);
+	store.StoreInt("volumedata.residency.policy", evictionPolicy);
+	store.StoreInt("volumedata.pack.bricksize", packBrickSize);
+	store.StoreBool("volumedata.pack.compressed", packCompressed);
+	store.StoreInt("volumedata.histogram.bins", histogramBins);
+	store.StoreBool("volumedata.histogram.autorange", histogramAutoRange);
+	store.StoreFloat("volumedata.histogram.min", histogramRangeMin);
+	store.StoreFloat("volumedata.histogram.max", histogramRangeMax);
+}
+
+void VolumeData::LoadLoaderConfig(SettingsStorage &store)
+{
+	int mode = loaderMode;
+	store.GetInt("volumedata.loader", mode);
+	loaderMode = (LoaderMode)mode;
+	store.GetInt("volumedata.loader.threads", loaderThreads);
+	store.GetBool("volumedata.prefetch.enabled", prefetchEnabled);
+	store.GetInt("volumedata.prefetch.lookahead", prefetchLookahead);
+	store.GetInt("volumedata.residency.budgetMB", residencyBudgetMB);
+	int policy = evictionPolicy;
+	store.GetInt("volumedata.residency.policy", policy);
+	evictionPolicy = (EvictionPolicy)policy;
+	store.GetInt("volumedata.pack.bricksize", packBrickSize);
+	store.GetBool("volumedata.pack.compressed", packCompressed);
+	store.GetInt("volumedata.histogram.bins", histogramBins);
+	store.GetBool("volumedata.histogram.autorange", histogramAutoRange);
+	store.GetFloat("volumedata.histogram.min", histogramRangeMin);
+	store.GetFloat("volumedata.histogram.max", histogramRangeMax);
+}
+
 HRESULT VolumeData::Initialize(ID3D11Device * pd3dDevice_, TwBar* pParametersBar_)
 {
 	pd3dDevice = pd3dDevice_;
@@ -64,6 +122,21 @@ void VolumeData::SetupTwBar(TwBar * pParametersBar_) {
 	//pParametersBar = pParametersBar_;
 	pParametersBar = TwNewBar("Volume Data");
 	TwDefine("'Volume Data' color='128 128 128' size='300 180' position='15 440'");
+
+	TwType loaderType = TwDefineEnumFromString("VolumeLoaderMode", "Copy,Memory Mapped");
+	TwAddVarRW(pParametersBar, "Loader", loaderType, &loaderMode, "help='How timesteps are loaded into RAM. Takes effect for the next loaded data set.'");
+	TwAddVarRW(pParametersBar, "Loader Threads", TW_TYPE_INT32, &loaderThreads, "min=0 max=64 help='Number of files loaded in parallel, 0 uses all hardware threads.'");
+	TwAddVarRW(pParametersBar, "Prefetch", TW_TYPE_BOOLCPP, &prefetchEnabled, "help='Prepare upcoming timesteps on a background thread. Takes effect for the next loaded data set.'");
+	TwAddVarRW(pParametersBar, "Prefetch Lookahead", TW_TYPE_INT32, &prefetchLookahead, "min=1 max=16");
+	TwType evictionType = TwDefineEnumFromString("VolumeEvictionPolicy", "LRU,Distance");
+	TwAddVarRW(pParametersBar, "Memory Budget (MB)", TW_TYPE_INT32, &residencyBudgetMB, "min=0 help='RAM used for timestep data, 0 keeps all timesteps resident.'");
+	TwAddVarRW(pParametersBar, "Eviction", evictionType, &evictionPolicy, "");
+	TwAddVarRW(pParametersBar, "Pack Brick Size", TW_TYPE_INT32, &packBrickSize, "min=4 max=256 help='Brick size used when packing a time series into a .vpk container.'");
+	TwAddVarRW(pParametersBar, "Pack Compressed", TW_TYPE_BOOLCPP, &packCompressed, "help='LZ compress the bricks when packing a time series.'");
+	TwAddVarRW(pParametersBar, "Histogram Bins", TW_TYPE_INT32, &histogramBins, "min=2 max=4096 help='Takes effect for the next loaded data set.'");
+	TwAddVarRW(pParametersBar, "Histogram Auto Range", TW_TYPE_BOOLCPP, &histogramAutoRange, "help='Bytes use their full range, other formats the range of the data. Takes effect for the next loaded data set.'");
+	TwAddVarRW(pParametersBar, "Histogram Min", TW_TYPE_FLOAT, &histogramRangeMin, "step=0.01 help='Used without auto range.'");
+	TwAddVarRW(pParametersBar, "Histogram Max", TW_TYPE_FLOAT, &histogramRangeMax, "step=0.01 help='Used without auto range.'");
 	
 	static TwStructMember resolutionMembers[] = // array used to describe tweakable variables of the Light structure
     {
@@ -100,13 +173,20 @@ void VolumeData::SetupTwBar(TwBar * pParametersBar_) {
 		{ "Time Data",		timeType,   offsetof(VolumeData, m_timestepIndices),    "" },
 		{ "External",		TW_TYPE_BOOLCPP,  offsetof(VolumeData, m_externalData), "" },
 		{ "Timestep Tex0",	TW_TYPE_INT32,  offsetof(VolumeData, m_currentDatasetSlot0), "" },
-		{ "Timestep Tex1",	TW_TYPE_INT32,  offsetof(VolumeData, m_currentDatasetSlot1), "" }
+		{ "Timestep Tex1",	TW_TYPE_INT32,  offsetof(VolumeData, m_currentDatasetSlot1), "" },
+		{ "Prefetch Stalls",	TW_TYPE_UINT32,  offsetof(VolumeData, m_prefetchStalls), "" },
+		{ "Resident Timesteps",	TW_TYPE_UINT32,  offsetof(VolumeData, m_numResident), "" }
     };
-    volumeDataType = TwDefineStruct("Volume Data", vdMembers, 7, sizeof(VolumeData), NULL, NULL);  // create a new TwType associated to the struct defined by the lightMembers array
+    volumeDataType = TwDefineStruct("Volume Data", vdMembers, 9, sizeof(VolumeData), NULL, NULL);  // create a new TwType associated to the struct defined by the lightMembers array
 }
 
-VolumeData::VolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution, float timestep, XMINT3 timestepIndices) :
+VolumeData::VolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution, float timestep, XMINT3 timestepIndices, std::string metadataFileName) :
 	m_objectFileName(objectFileName),
+	m_metadataFileName(metadataFileName),
+	m_metadataCache(nullptr),
+	m_histogramBins(std::max(2, histogramBins)),
+	m_histogramRange(histogramRangeMin, histogramRangeMax),
+	m_histogramRangeValid(!histogramAutoRange && histogramRangeMax > histogramRangeMin),
 	m_format(format),
 	m_sliceThickness(sliceThickness),
 	m_resolution(resolution),
@@ -123,15 +203,368 @@ VolumeData::VolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 s
 	m_timestep(timestep),
 	m_currentTime(0),
 	m_currentTimestepT(0),
+	m_prefetcher(nullptr),
+	m_packedFile(nullptr),
+	m_prefetchStalls(0),
+	m_buildBrickPyramids(false),
+	m_useCounter(0),
+	m_numResident(0),
 	m_timeSequenceLength(timestep * (timestepIndices.y - timestepIndices.x)/(float)timestepIndices.z)
 {
 	m_elementSize = GetElementSize(format);
 	m_elementPadding = GetElementPadding(format);
+
+	if(!m_histogramRangeValid && format == DF_BYTE) {
+		m_histogramRange = XMFLOAT2(0.f, 256.f);
+		m_histogramRangeValid = true;
+	}
 }
 
 
 VolumeData::~VolumeData(void)
 {
+	ReleaseData();
+}
+
+/**
+	Frees the CPU side copies of all timesteps and closes the file mappings
+*/
+void VolumeData::ReleaseData(void)
+{
+	// stop the worker first, it might still be reading from the mappings
+	if(m_prefetcher) {
+		delete m_prefetcher;
+		m_prefetcher = nullptr;
+	}
+	// the cache might be rebuilding from the files as well
+	if(m_metadataCache) {
+		delete m_metadataCache;
+		m_metadataCache = nullptr;
+	}
+
+	for(size_t i = 0; i < m_data.size(); i++) {
+		if(m_ownsData[i])
+			delete[] static_cast<char*>(m_data[i]);
+	}
+	std::for_each(m_mappedFiles.begin(), m_mappedFiles.end(), [](MappedFile* p) {if(p) delete p;});
+	std::for_each(m_histogram.begin(), m_histogram.end(), [](float* p) {if(p) delete[] p;});
+	std::for_each(m_brickPyramids.begin(), m_brickPyramids.end(), [](BrickPyramid* p) {if(p) delete p;});
+	if(m_packedFile) {
+		delete m_packedFile;
+		m_packedFile = nullptr;
+	}
+
+	m_data.clear();
+	m_ownsData.clear();
+	m_mappedFiles.clear();
+	m_histogram.clear();
+	m_brickPyramids.clear();
+	m_resident.clear();
+	m_prefetchPending.clear();
+	m_fileNames.clear();
+	m_lastUsed.clear();
+	m_numResident = 0;
+}
+
+/**
+	Returns the (padded) data of a timestep.
+	If the timestep is not resident yet (e.g. not yet padded from the mapping), it is prepared
+	synchronously. If the prefetcher is still working on it, we wait for it and count a stall.
+*/
+void * VolumeData::GetTimestepData(int timestep)
+{
+	assert(timestep < m_data.size());
+
+	if(!m_resident[timestep]) {
+		if(m_prefetcher && m_prefetchPending[timestep]) {
+			m_prefetchStalls++;
+			WaitForPrefetch(timestep);
+		}
+
+		if(!m_resident[timestep]) {
+			void * data;
+			float * histogram;
+			BrickPyramid * bricks;
+			PrepareTimestep(timestep, NeedsBrickPyramid(timestep), data, histogram, bricks);
+			InstallTimestep(timestep, data, histogram, bricks);
+		}
+	}
+
+	m_lastUsed[timestep] = ++m_useCounter;
+	return m_data[timestep];
+}
+
+/**
+	Returns the histogram of a timestep, computing it on first access
+	Byte histograms are usually computed when loading, other formats only when needed.
+*/
+float * VolumeData::GetTimestepHistogram(int timestep)
+{
+	assert(timestep < m_histogram.size());
+
+	if(!m_resident[timestep])
+		GetTimestepData(timestep);
+	if(!m_histogram[timestep])
+		ComputeHistogram(timestep);
+
+	return m_histogram[timestep];
+}
+
+void VolumeData::ComputeHistogram(int timestep)
+{
+	const void * data = GetTimestepData(timestep);
+	if(m_histogram[timestep])
+		return;
+
+	if(!m_histogramRangeValid)
+		DetermineHistogramRange(timestep);
+
+	m_histogram[timestep] = new float[m_histogramBins];
+	ComputeHistogram(data, m_elementSize + m_elementPadding, m_histogram[timestep]);
+}
+
+void VolumeData::ComputeHistogram(const void * data, int elementStride, float * histogram) const
+{
+	HistogramEngine::Compute(data, m_format, elementStride, m_resolution.x * m_resolution.y * m_resolution.z,
+		m_histogramRange, m_histogramBins, histogram);
+}
+
+/**
+	Fixes the histogram range so histograms of different timesteps can be interpolated
+	The range of all timesteps is known with a valid metadata cache, otherwise the range of the
+	first timestep that needs a histogram is used and later values outside of it end up in
+	the border bins.
+*/
+void VolumeData::DetermineHistogramRange(int timestep)
+{
+	XMFLOAT2 range(FLT_MAX, -FLT_MAX);
+	XMFLOAT2 cachedRange;
+	for(int t = 0; t < (int)m_data.size() && GetCachedValueRange(t, t, cachedRange); t++) {
+		range.x = std::min(range.x, cachedRange.x);
+		range.y = std::max(range.y, cachedRange.y);
+	}
+
+	if(range.x > range.y)
+		range = HistogramEngine::ComputeRange(GetTimestepData(timestep), m_format, m_elementSize + m_elementPadding, m_resolution.x * m_resolution.y * m_resolution.z);
+	// avoid an empty range for constant data
+	if(range.y <= range.x)
+		range.y = range.x + 1.f;
+
+	m_histogramRange = range;
+	m_histogramRangeValid = true;
+}
+
+/**
+	Brings a timestep into a state where it can be uploaded without touching the disk
+	This may be called from the prefetch thread, so it must not modify any members. The results
+	are handed to InstallTimestep on the render thread.
+	The render thread decides whether the brick pyramid is built as well (once the raycaster has
+	asked for pyramids, see NeedsBrickPyramid), so playback does not have to wait for it.
+*/
+void VolumeData::PrepareTimestep(int timestep, bool buildBricks, void *& data, float *& histogram, BrickPyramid *& bricks) const
+{
+	data = nullptr;
+	histogram = nullptr;
+	bricks = nullptr;
+
+	const MappedFile * file = m_mappedFiles[timestep];
+	const unsigned char * source = static_cast<const unsigned char*>(file ? file->GetData() : m_data[timestep]);
+	unsigned int voxelCount = m_resolution.x * m_resolution.y * m_resolution.z;
+
+	if(file && m_elementPadding) {
+		char * padded = new char[voxelCount * (m_elementSize + m_elementPadding)];
+		PadTimestep(reinterpret_cast<const char*>(source), padded);
+		data = padded;
+	}
+	else if(file) {
+		// touch every page so it is read from disk here and not during the upload
+		volatile unsigned char sink = 0;
+		for(unsigned long long i = 0; i < file->GetSize(); i += 4096)
+			sink += source[i];
+	}
+	else if(!source) {
+		// the timestep has been evicted, read it again
+		char * buffer = new char[voxelCount * (m_elementSize + m_elementPadding)];
+		if(m_elementPadding) {
+			char * unpadded = new char[voxelCount * m_elementSize];
+			ReadTimestepFile(timestep, unpadded);
+			PadTimestep(unpadded, buffer);
+			delete[] unpadded;
+		}
+		else
+			ReadTimestepFile(timestep, buffer);
+
+		data = buffer;
+		source = reinterpret_cast<unsigned char*>(buffer);
+	}
+
+	// skip timesteps with a cached histogram, m_histogram is not written while a timestep is being prefetched
+	// bytes are never padded, so the stride is the same for the mapping and our copies
+	if(m_format == DF_BYTE && !m_histogram[timestep]) {
+		histogram = new float[m_histogramBins];
+		ComputeHistogram(source, m_elementSize, histogram);
+	}
+
+	// the pyramids may be written by the render thread meanwhile, InstallTimestep drops the duplicate
+	// scalar data is never padded, so the source can be used as is
+	if(buildBricks) {
+		int resolution[3] = { m_resolution.x, m_resolution.y, m_resolution.z };
+		bricks = new BrickPyramid();
+		bricks->Build(source, m_format == DF_BYTE ? BrickPyramid::IF_BYTE : BrickPyramid::IF_FLOAT, resolution);
+	}
+}
+
+/**
+	Takes over the results of PrepareTimestep
+*/
+void VolumeData::InstallTimestep(int timestep, void * data, float * histogram, BrickPyramid * bricks)
+{
+	if(data) {
+		assert(!m_ownsData[timestep]);
+		m_data[timestep] = data;
+		m_ownsData[timestep] = true;
+		m_numResident++;
+
+		// the padded copy is all we need from now on
+		if(m_mappedFiles[timestep]) {
+			delete m_mappedFiles[timestep];
+			m_mappedFiles[timestep] = nullptr;
+		}
+	}
+
+	if(histogram) {
+		if(!m_histogram[timestep])
+			m_histogram[timestep] = histogram;
+		else
+			delete[] histogram;
+	}
+
+	if(bricks) {
+		if(!m_brickPyramids[timestep])
+			m_brickPyramids[timestep] = bricks;
+		else
+			delete bricks;
+	}
+
+	m_resident[timestep] = true;
+	m_prefetchPending[timestep] = false;
+}
+
+/**
+	Requests the timesteps that playback will reach next from the prefetcher
+	The direction is taken from the sign of timeDelta, the number of timesteps from
+	the distance covered in one frame plus prefetchLookahead.
+*/
+void VolumeData::RequestPrefetch(int timestep0, float timeDelta)
+{
+	int numTimesteps = (int)m_data.size();
+
+	// a large jump back is playback wrapping around at the end, not reverse playback
+	if(timeDelta < -0.5f * m_timeSequenceLength)
+		timeDelta += m_timeSequenceLength + m_timestep;
+
+	int direction = timeDelta < 0 ? -1 : 1;
+	int stepsPerFrame = (int)ceilf(fabsf(timeDelta) / m_timestep);
+	int lookahead = std::min(numTimesteps - 2, prefetchLookahead + stepsPerFrame);
+	// don't prefetch more than the budget allows us to keep
+	lookahead = std::min(lookahead, GetMaxResidentTimesteps() - 2);
+
+	// timestep0 and timestep0 + 1 are needed right now
+	int first = direction > 0 ? timestep0 + 2 : timestep0 - 1;
+	for(int k = 0; k < lookahead; k++) {
+		// playback wraps around at the end of the sequence
+		int t = ((first + direction * k) % numTimesteps + numTimesteps) % numTimesteps;
+		if(m_resident[t] || m_prefetchPending[t])
+			continue;
+
+		if(!m_prefetcher->Request(t, NeedsBrickPyramid(t)))
+			break;
+		m_prefetchPending[t] = true;
+	}
+}
+
+void VolumeData::CollectPrefetchedTimesteps(void)
+{
+	TimestepPrefetcher::Result r;
+	while(m_prefetcher->GetResult(r)) {
+		InstallTimestep(r.timestep, r.data, r.histogram, r.bricks);
+	}
+}
+
+void VolumeData::WaitForPrefetch(int timestep)
+{
+	while(m_prefetchPending[timestep]) {
+		m_prefetcher->WaitForResult(10);
+		CollectPrefetchedTimesteps();
+	}
+}
+
+/**
+	Number of timesteps that fit into residencyBudgetMB, but at least the two we need to interpolate
+*/
+int VolumeData::GetMaxResidentTimesteps(void)
+{
+	if(residencyBudgetMB <= 0)
+		return (int)m_data.size();
+
+	unsigned long long timestepBytes = (unsigned long long)m_resolution.x * m_resolution.y * m_resolution.z * (m_elementSize + m_elementPadding);
+	unsigned long long budget = (unsigned long long)residencyBudgetMB * 1024 * 1024;
+	return std::max(2, (int)std::min<unsigned long long>(m_data.size(), budget / timestepBytes));
+}
+
+/**
+	Drops the RAM copy of a timestep, it is read from disk again when needed
+	Timesteps that are used directly from a mapped view are not counted against the budget
+	since the OS can drop their pages at any time, so we never evict them.
+*/
+void VolumeData::EvictTimestep(int timestep)
+{
+	assert(m_ownsData[timestep] && !m_prefetchPending[timestep]);
+
+	delete[] static_cast<char*>(m_data[timestep]);
+	m_data[timestep] = nullptr;
+	m_ownsData[timestep] = false;
+	m_resident[timestep] = false;
+	m_numResident--;
+}
+
+/**
+	Evicts timesteps until we are within the budget again
+	timestep0 and timestep0 + 1 are in use and are never evicted
+*/
+void VolumeData::EnforceResidencyBudget(int timestep0)
+{
+	int maxResident = GetMaxResidentTimesteps();
+	int numTimesteps = (int)m_data.size();
+
+	while((int)m_numResident > maxResident) {
+		int victim = -1;
+		unsigned int victimScore = 0;
+
+		for(int t = 0; t < numTimesteps; t++) {
+			if(!m_ownsData[t] || m_prefetchPending[t] || t == timestep0 || t == timestep0 + 1)
+				continue;
+
+			unsigned int score;
+			if(evictionPolicy == EP_LRU) {
+				score = m_useCounter - m_lastUsed[t];
+			}
+			else {
+				// distance in timesteps, wrapping around since playback repeats
+				int d = std::abs(t - timestep0);
+				score = std::min(d, numTimesteps - d);
+			}
+
+			if(victim < 0 || score > victimScore) {
+				victim = t;
+				victimScore = score;
+			}
+		}
+
+		if(victim < 0)
+			break;
+		EvictTimestep(victim);
+	}
 }
 
 /*
@@ -144,6 +577,7 @@ void VolumeData::SetTime(float currentTime)
 	assert(currentTime >= 0);
 	//assert(currentTime <= m_data.size());
 
+	float timeDelta = currentTime - m_currentTime;
 	m_currentTime = currentTime;
 
 	// don't do anything if we have only one timestep
@@ -163,8 +597,16 @@ void VolumeData::SetTime(float currentTime)
 		requiredTimestep0--;
 	}
 
+	if(m_prefetcher) {
+		CollectPrefetchedTimesteps();
+		RequestPrefetch(requiredTimestep0, timeDelta);
+	}
+
 	m_currentTimestepT = currentTime/m_timestep - floorf(currentTime/m_timestep);
 	UpdateHistogram(requiredTimestep0, requiredTimestep0 + 1, m_currentTimestepT);
+
+	if(residencyBudgetMB > 0)
+		EnforceResidencyBudget(requiredTimestep0);
 //	std::cout << "T: " << currentTime << "; timestepT: " << m_currentTimestepT << std::endl;
 
 	// update the resources accordingly
@@ -185,6 +627,16 @@ void VolumeData::SetTime(float currentTime)
 		m_pVolumeData0SRV = m_pVolumeData1SRV;
 		m_pVolumeData1SRV = t;
 	}
+	// case that first slot has data that should be in the second slot (playing backwards)
+	else if(requiredTimestep0 + 1 == m_currentDatasetSlot0) {
+		// switch the srvs around
+		auto t = m_pVolumeData0SRV;
+		m_pVolumeData0SRV = m_pVolumeData1SRV;
+		m_pVolumeData1SRV = t;
+
+		// load the new data into the first buffer, which now holds the stale data
+		LoadTimestep(requiredTimestep0);
+	}
 	else {
 		// fill both buffers with new data*/
 		LoadTimestep(requiredTimestep0, requiredTimestep0 + 1);
@@ -193,6 +645,96 @@ void VolumeData::SetTime(float currentTime)
 	m_currentDatasetSlot1 = requiredTimestep0 + 1;
 }
 
+/**
+	Visits the intervals [t, t + 1] for first <= t < last in order, e.g. to integrate through time
+	Only the two timesteps of the current interval and the next one (requested from the prefetcher)
+	are brought into RAM at a time, timesteps that were not resident before are evicted again as
+	soon as we are past them, so the whole series never has to fit into memory.
+	backward visits the intervals from last - 1 down to first, e.g. for backward integration.
+	visit gets the padded data of t and t + 1 and returns false to stop early.
+	Returns false if there is no data in RAM to stream.
+*/
+bool VolumeData::StreamTimesteps(int first, int last, const std::function<bool(int timestep, const void * data0, const void * data1)> & visit, bool backward)
+{
+	if(m_externalData || m_data.empty())
+		return false;
+	first = std::max(0, first);
+	last = std::min((int)m_data.size() - 1, last);
+
+	std::vector<bool> wasResident(m_resident);
+	std::vector<bool> requested(m_data.size(), false);
+	// don't evict what is needed for playback or still being prepared
+	auto release = [&](int t) {
+		if(t < 0 || t >= (int)m_data.size() || wasResident[t] || !m_resident[t] || !m_ownsData[t] || m_prefetchPending[t])
+			return;
+		if(m_timeSequenceLength && (t == (int)m_currentDatasetSlot0 || t == (int)m_currentDatasetSlot1))
+			return;
+		EvictTimestep(t);
+	};
+
+	for(int i = first; i < last; i++) {
+		int t = backward ? first + last - 1 - i : i;
+		// the timestep the next interval adds
+		int next = backward ? t - 1 : t + 2;
+		if(m_prefetcher) {
+			CollectPrefetchedTimesteps();
+			if(next >= first && next <= last && !m_resident[next] && !m_prefetchPending[next] && m_prefetcher->Request(next, NeedsBrickPyramid(next))) {
+				m_prefetchPending[next] = true;
+				requested[next] = true;
+			}
+		}
+
+		const void * data0 = GetTimestepData(t);
+		const void * data1 = GetTimestepData(t + 1);
+		bool proceed = visit(t, data0, data1);
+		release(backward ? t + 1 : t);
+		if(!proceed)
+			break;
+	}
+
+	// the rest of the window and prefetches we did not use anymore after stopping early
+	for(int t = first; t <= last; t++) {
+		if(requested[t])
+			WaitForPrefetch(t);
+		release(t);
+	}
+	return true;
+}
+
+/**
+	Timestep whose data is in texture slot 0 or 1, -1 if the slot is unused
+*/
+int VolumeData::GetSlotTimestep(int slot)
+{
+	if(m_externalData)
+		return -1;
+	if(!m_timeSequenceLength)
+		return slot ? -1 : 0;
+	return slot ? m_currentDatasetSlot1 : m_currentDatasetSlot0;
+}
+
+// the data in RAM matching the texture slot, for processing on the CPU
+const void * VolumeData::GetSlotData(int slot)
+{
+	int timestep = GetSlotTimestep(slot);
+	return timestep >= 0 ? GetTimestepData(timestep) : nullptr;
+}
+
+/**
+	Value range covering both timesteps, taken from the metadata cache
+	Returns false if there is no valid cache (yet).
+*/
+bool VolumeData::GetCachedValueRange(int timestep0, int timestep1, XMFLOAT2 & range)
+{
+	if(!m_metadataCache || !m_metadataCache->IsValid())
+		return false;
+
+	const XMFLOAT2 & r0 = m_metadataCache->GetTimestepInfo(timestep0).valueRange;
+	const XMFLOAT2 & r1 = m_metadataCache->GetTimestepInfo(timestep1).valueRange;
+	range = XMFLOAT2(std::min(r0.x, r1.x), std::max(r0.y, r1.y));
+	return true;
+}
+
 XMFLOAT3	VolumeData::GetBoundingBox()
 {
 	return XMFLOAT3(m_resolution.x * m_sliceThickness.x,
@@ -211,13 +753,13 @@ void VolumeData::LoadTimestep(int timestep0, int timestep1) {
 	ID3D11Resource *srv0Resource, *srv1Resource;
 	assert(timestep0 < m_data.size());
 	m_pVolumeData0SRV->GetResource(&srv0Resource);
-	pContext->UpdateSubresource(srv0Resource, 0, nullptr, m_data[timestep0], m_resolution.x * (m_elementSize + m_elementPadding), m_resolution.x * m_resolution.y * (m_elementSize + m_elementPadding));
+	pContext->UpdateSubresource(srv0Resource, 0, nullptr, GetTimestepData(timestep0), m_resolution.x * (m_elementSize + m_elementPadding), m_resolution.x * m_resolution.y * (m_elementSize + m_elementPadding));
 	SAFE_RELEASE(srv0Resource);
 	
 	if(timestep1 >= 0) {
 		assert(timestep1 < m_data.size());
 		m_pVolumeData1SRV->GetResource(&srv1Resource);
-		pContext->UpdateSubresource(srv1Resource, 0, nullptr, m_data[timestep1], m_resolution.x * (m_elementSize + m_elementPadding), m_resolution.x * m_resolution.y * (m_elementSize + m_elementPadding));
+		pContext->UpdateSubresource(srv1Resource, 0, nullptr, GetTimestepData(timestep1), m_resolution.x * (m_elementSize + m_elementPadding), m_resolution.x * m_resolution.y * (m_elementSize + m_elementPadding));
 		SAFE_RELEASE(srv1Resource);
 	}
 	SAFE_RELEASE(pContext);
@@ -228,68 +770,206 @@ void VolumeData::LoadTimestep(int timestep0, int timestep1) {
 	Loads the data from HDD to RAM
 	objectFileName can be a either a fixed path or contain printf format specifiers. In
 	that case, the format is filled by the appropriate indices indicated by m_timestepIndices
+	If it is a .vpk container, all timesteps are read from that file instead.
+	With LM_MMAP, the files are only mapped here. Unpadded formats are then used directly from
+	the mapping, padded formats are converted on first access in GetTimestepData.
+	The files are loaded by a pool of loaderThreads threads, each file is read, converted and
+	histogrammed by one task so the stages of different files overlap.
 */
 void VolumeData::LoadDataFiles(std::string objectFileName) 
 {
-	std::cout << "Loading Data  from \"" << objectFileName << "\"to RAM..." << std::endl;
 	int numFiles = (m_timestepIndices.y - m_timestepIndices.x)/m_timestepIndices.z + 1;
-	char * unpadded;
-	m_data.resize(numFiles);
-	m_histogram.resize(numFiles);
-	unsigned int voxelCount = m_resolution.x * m_resolution.y * m_resolution.z;
-
-	if(m_elementPadding) {
-		unpadded = new char[voxelCount * m_elementSize];
+	if(PackedVolumeFile::IsPackedFile(objectFileName)) {
+		m_packedFile = new PackedVolumeFile();
+		if(m_packedFile->Open(objectFileName)) {
+			assert(m_packedFile->GetHeader().numTimesteps == numFiles);
+		}
+		else {
+			delete m_packedFile;
+			m_packedFile = nullptr;
+		}
 	}
 
+	m_data.resize(numFiles, nullptr);
+	m_ownsData.resize(numFiles, false);
+	m_mappedFiles.resize(numFiles, nullptr);
+	m_histogram.resize(numFiles, nullptr);
+	m_brickPyramids.resize(numFiles, nullptr);
+	m_resident.resize(numFiles, false);
+	m_prefetchPending.resize(numFiles, false);
+	m_fileNames.resize(numFiles);
+	m_lastUsed.resize(numFiles, 0);
+	int maxResident = GetMaxResidentTimesteps();
+
 	for(int i = 0; i < numFiles; i++)
 	{
+		if(m_packedFile) {
+			m_fileNames[i] = objectFileName;
+			continue;
+		}
 		char objectFileName_a[2048];
 		sprintf_s(objectFileName_a, 2048, objectFileName.c_str(), i * m_timestepIndices.z + m_timestepIndices.x);
-		std::ifstream in(objectFileName_a, std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
-
-
-		auto size = in.tellg();
-		assert(voxelCount*m_elementSize == size);
+		m_fileNames[i] = objectFileName_a;
+	}
 
-		m_data[i] = new char[voxelCount * (m_elementSize + m_elementPadding)];
-		in.seekg (0, std::ios::beg);
-		std::cout << "Reading " << size << " bytes from \"" << GetFilename(objectFileName_a) << "\"..." << std::flush;
-		
-		// insert padding if necessary
-		if(m_elementPadding) {
-			in.read(unpadded, size);
-			ZeroMemory(m_data[i], voxelCount * (m_elementSize + m_elementPadding));
-			for(unsigned int j=0; j < voxelCount; j++) {
-				memcpy(&static_cast<char*>(m_data[i])[j*(m_elementSize + m_elementPadding)], &unpadded[j*m_elementSize], m_elementSize);
+	// with a valid cache, the histograms don't have to be computed from the data
+	if(!m_metadataFileName.empty()) {
+		m_metadataCache = new VolumeMetadataCache(m_metadataFileName, m_fileNames, m_format, m_resolution);
+		// the cache holds byte histograms with one bin per value
+		bool useCachedHistograms = m_format == DF_BYTE && m_histogramBins == VolumeMetadataCache::HISTOGRAM_BINS &&
+			m_histogramRange.x == 0.f && m_histogramRange.y == 256.f;
+		if(m_metadataCache->Load() && useCachedHistograms) {
+			for(int i = 0; i < numFiles; i++) {
+				const std::vector<float> & bins = m_metadataCache->GetTimestepInfo(i).histogram;
+				m_histogram[i] = new float[m_histogramBins];
+				std::copy(bins.begin(), bins.end(), m_histogram[i]);
 			}
 		}
-		else
-			in.read ((char*)m_data[i], size);
+	}
 
-		std::cout << "\tDONE." << std::endl;
-		in.close();
+	ThreadPool pool(loaderThreads);
+	std::cout << "Loading Data  from \"" << objectFileName << "\"to RAM" << (loaderMode == LM_MMAP ? " (memory mapped)" : "") 
+		<< " using " << pool.GetNumThreads() << " threads..." << std::endl;
+	double startTime = GetTimeMs();
+
+	std::vector<double> readTime(numFiles, 0.), convertTime(numFiles, 0.), histogramTime(numFiles, 0.);
+	// with a residency budget, the remaining timesteps are loaded when playback gets there
+	pool.ParallelFor(0, numFiles, [&](int i) {
+		LoadDataFile(i, i < maxResident, readTime[i], convertTime[i], histogramTime[i]);
+	});
+
+	// the flags are set here since std::vector<bool> can't be written from several threads
+	for(int i = 0; i < numFiles; i++) {
+		if(m_data[i] && !m_mappedFiles[i]) {
+			m_ownsData[i] = true;
+			m_resident[i] = true;
+			m_numResident++;
+		}
+	}
 
-		if(m_format == DF_BYTE) {
-			m_histogram[i] = new float[255 * 4];
-			float histoCount[255];
+	std::cout << "Loaded " << numFiles << " timesteps in " << (GetTimeMs() - startTime) << " ms. Summed over all threads: "
+		<< "read " << std::accumulate(readTime.begin(), readTime.end(), 0.) << " ms, "
+		<< "convert " << std::accumulate(convertTime.begin(), convertTime.end(), 0.) << " ms, "
+		<< "histogram " << std::accumulate(histogramTime.begin(), histogramTime.end(), 0.) << " ms." << std::endl;
 
-			memset(histoCount, 0, sizeof(histoCount));
+	if(m_metadataCache && !m_metadataCache->IsValid())
+		m_metadataCache->RebuildAsync([this](int timestep, char * dst) { return ReadTimestepFile(timestep, dst); });
 
-			for(int j=0; j < size; j++) {
-				histoCount[static_cast<unsigned char*>(m_data[i])[j]] += 1.f;
-			}
+	if(prefetchEnabled && numFiles > 2)
+		m_prefetcher = new TimestepPrefetcher(*this);
+}
 
-			//calculate the histogram
-			for(int j=0; j < 255; j++) {
-				m_histogram[i][4*j] = histoCount[j] / size;
-				m_histogram[i][4*j + 1] = histoCount[j] / size;
-				m_histogram[i][4*j + 2] = histoCount[j] / size;
-				m_histogram[i][4*j + 3] = histoCount[j] / size;
-			}
+/**
+	Loads a single file, called concurrently for different timesteps by LoadDataFiles
+	Only writes the per-timestep entries of m_data, m_mappedFiles and m_histogram. The stage
+	timings are returned in milliseconds.
+*/
+void VolumeData::LoadDataFile(int timestep, bool loadIntoRAM, double & readTime, double & convertTime, double & histogramTime)
+{
+	unsigned int voxelCount = m_resolution.x * m_resolution.y * m_resolution.z;
+	const std::string & fileName = m_fileNames[timestep];
+	std::ostringstream log;
+	double t = GetTimeMs();
+
+	// a container can't be mapped per timestep, it is always copied
+	if(loaderMode == LM_MMAP && !m_packedFile) {
+		MappedFile * file = new MappedFile();
+		if(!file->Open(fileName)) {
+			log << "Falling back to copying \"" << GetFilename(fileName) << "\"" << std::endl;
+			delete file;
+		}
+		else {
+			assert(voxelCount*m_elementSize == file->GetSize());
+			m_mappedFiles[timestep] = file;
+
+			// no padding required, so we can hand the view to the GPU as it is
+			if(!m_elementPadding)
+				m_data[timestep] = const_cast<void*>(file->GetData());
+
+			readTime = GetTimeMs() - t;
+			log << "Mapped " << file->GetSize() << " bytes from \"" << GetFilename(fileName) << "\"." << std::endl;
+			std::cout << log.str() << std::flush;
+			// with mapped files, histograms are computed when the timestep is first needed
+			return;
 		}
 	}
 
-	if(m_elementPadding)
+	if(!loadIntoRAM)
+		return;
+
+	unsigned int size = voxelCount * m_elementSize;
+	char * data = new char[voxelCount * (m_elementSize + m_elementPadding)];
+	
+	// insert padding if necessary
+	if(m_elementPadding) {
+		char * unpadded = new char[size];
+		ReadTimestepFile(timestep, unpadded);
+		readTime = GetTimeMs() - t;
+		t = GetTimeMs();
+
+		PadTimestep(unpadded, data);
 		delete[] unpadded;
-}
\ No newline at end of file
+		convertTime = GetTimeMs() - t;
+	}
+	else {
+		ReadTimestepFile(timestep, data);
+		readTime = GetTimeMs() - t;
+	}
+	m_data[timestep] = data;
+
+	if(m_format == DF_BYTE && !m_histogram[timestep]) {
+		t = GetTimeMs();
+		m_histogram[timestep] = new float[m_histogramBins];
+		ComputeHistogram(data, m_elementSize, m_histogram[timestep]);
+		histogramTime = GetTimeMs() - t;
+	}
+
+	log << "Read " << size << " bytes from \"" << GetFilename(fileName) << "\"." << std::endl;
+	std::cout << log.str() << std::flush;
+}
+
+/**
+	Reads the unpadded data of a timestep from its raw file or the container into dst
+	Thread-safe, used by the loader threads and the prefetcher.
+*/
+bool VolumeData::ReadTimestepFile(int timestep, char * dst) const
+{
+	unsigned int size = m_resolution.x * m_resolution.y * m_resolution.z * m_elementSize;
+
+	if(m_packedFile)
+		return m_packedFile->ReadTimestep(timestep, dst);
+
+	std::ifstream in(m_fileNames[timestep], std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+	assert(size == in.tellg());
+	in.seekg (0, std::ios::beg);
+	if(!in.read(dst, size)) {
+		std::cerr << "Could not read " << size << " bytes from \"" << m_fileNames[timestep] << "\"!" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void VolumeData::PadTimestep(const char * src, char * dst) const
+{
+	unsigned int voxelCount = m_resolution.x * m_resolution.y * m_resolution.z;
+
+	ZeroMemory(dst, voxelCount * (m_elementSize + m_elementPadding));
+	for(unsigned int j=0; j < voxelCount; j++) {
+		memcpy(&dst[j*(m_elementSize + m_elementPadding)], &src[j*m_elementSize], m_elementSize);
+	}
+}
+
+/**
+	Converts the raw files of this data set into a single .vpk container
+	Uses packBrickSize and packCompressed.
+*/
+bool VolumeData::PackTimeSeries(const std::string & packedFileName)
+{
+	if(m_packedFile) {
+		std::cerr << "\"" << m_objectFileName << "\" is already packed." << std::endl;
+		return false;
+	}
+
+	return PackedVolumeFile::Pack(packedFileName, m_fileNames, m_format, m_resolution, m_sliceThickness, m_timestep,
+		packBrickSize, packCompressed ? PackedVolumeFile::PC_LZ : PackedVolumeFile::PC_NONE);
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "util/notification.h"
+#include "util/MappedFile.h"
+#include "SettingsStorage.h"
 
 #include "AntTweakBar.h"
 
@@ -10,10 +12,17 @@
 using namespace DirectX;
 
 #include <string>
+#include <vector>
+#include <functional>
 
+class TimestepPrefetcher;
+class BrickPyramid;
+class PackedVolumeFile;
+class VolumeMetadataCache;
 
 class VolumeData : public Observable
 {
+	friend class TimestepPrefetcher;
 public:
 	// types
 	enum DataFormat {
@@ -26,21 +35,50 @@ public:
 		DF_FLOAT4
 	};
 
+	// how LoadDataFiles gets the timesteps into RAM
+	enum LoaderMode {
+		LM_COPY,	// read each file into a heap buffer (and pad it) on load
+		LM_MMAP		// map the files and pad lazily when a timestep is first accessed
+	};
+
+	// which timestep to drop when the residency budget is exceeded
+	enum EvictionPolicy {
+		EP_LRU,			// the one that has not been used for the longest time
+		EP_DISTANCE		// the one farthest away from the current playback time
+	};
+
 	// statics 
 	static HRESULT Initialize(ID3D11Device * pd3dDevice, TwBar* pParametersBar);
 	static HRESULT Release(void);
 	static DataFormat GetFormatFromStr(std::string str);
 	static int GetElementSize(DataFormat f);
 	static int GetElementPadding(DataFormat f);
+	static void SaveLoaderConfig(SettingsStorage &store);
+	static void LoadLoaderConfig(SettingsStorage &store);
+
+	static LoaderMode loaderMode;	// applies to data sets loaded after changing it
+	static int loaderThreads;		// number of threads loading files in parallel, 0 uses all hardware threads
+	static bool prefetchEnabled;	// prepare upcoming timesteps on a background thread
+	static int prefetchLookahead;	// number of timesteps to prefetch in addition to those passed per frame
+	static int residencyBudgetMB;	// max. RAM used for timestep data, 0 means unlimited
+	static EvictionPolicy evictionPolicy;
+	static int packBrickSize;		// settings for PackTimeSeries
+	static bool packCompressed;
+	static int histogramBins;		// histogram settings, apply to data sets loaded after changing them
+	static bool histogramAutoRange;	// bytes use [0, 256), other formats the range of the data
+	static float histogramRangeMin;
+	static float histogramRangeMax;
 
 	// ctor, dtor
-	VolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution, float timestep, XMINT3 timestepIndices);
+	VolumeData(std::string objectFileName, DataFormat format, XMFLOAT3 sliceThickness, XMINT3 resolution, float timestep, XMINT3 timestepIndices, std::string metadataFileName = "");
 	virtual ~VolumeData(void);
 
 	// methods
 	virtual HRESULT CreateGPUBuffers(void) { return S_OK; };
 	virtual void ReleaseGPUBuffers(void) { };
 	virtual void UpdateHistogram(int timestep0, int timestep1, float timestepT) {};
+	bool PackTimeSeries(const std::string & packedFileName);
+	bool StreamTimesteps(int first, int last, const std::function<bool(int timestep, const void * data0, const void * data1)> & visit, bool backward = false);
 
 	//accessors
 	std::string GetObjectFileName() {			return m_objectFileName; };
@@ -50,13 +88,20 @@ public:
 	const float		& GetCurrentTimestepT() {	return m_currentTimestepT; };
 
 	const XMINT3	& GetResolution() 	{		return m_resolution;	};
+	DataFormat		GetFormat()			{		return m_format;		};
 	const XMFLOAT3	& GetSliceThickness() {		return m_sliceThickness;};
 	const float		& GetTimestep()		{		return m_timestep;	};
 	const float		& GetTimeSequenceLength() {	return m_timeSequenceLength;	};
+	int				GetNumTimesteps()	{		return (int)m_data.size();	};
 
 	ID3D11ShaderResourceView * GetTexture0SRV() {		return m_pVolumeData0SRV;	};
 	ID3D11ShaderResourceView * GetTexture1SRV() {		return m_pVolumeData1SRV;	};
 	ID3D11ShaderResourceView * GetHistogramSRV() {		return m_pHistogramSRV;		};
+	int GetHistogramBins() {							return m_histogramBins;		};
+	VolumeMetadataCache * GetMetadataCache() {			return m_metadataCache;		};
+	bool GetCachedValueRange(int timestep0, int timestep1, XMFLOAT2 & range);
+	int GetSlotTimestep(int slot);
+	const void * GetSlotData(int slot);
 
 protected:
 	// static functions
@@ -70,18 +115,54 @@ protected:
 	// methods
 	virtual void LoadTimestep(int timestep0, int timestep1 = -1);
 	void LoadDataFiles(std::string objectFileName);
+	void LoadDataFile(int timestep, bool loadIntoRAM, double & readTime, double & convertTime, double & histogramTime);
+	bool ReadTimestepFile(int timestep, char * dst) const;
+	void PadTimestep(const char * src, char * dst) const;
+	void ReleaseData(void);
+	void * GetTimestepData(int timestep);
+	float * GetTimestepHistogram(int timestep);
+	void ComputeHistogram(int timestep);
+	void ComputeHistogram(const void * data, int elementStride, float * histogram) const;
+	void DetermineHistogramRange(int timestep);
+	void PrepareTimestep(int timestep, bool buildBricks, void *& data, float *& histogram, BrickPyramid *& bricks) const;
+	bool NeedsBrickPyramid(int timestep) const {	return m_buildBrickPyramids && !m_brickPyramids[timestep];	};
+	void InstallTimestep(int timestep, void * data, float * histogram, BrickPyramid * bricks);
+	void RequestPrefetch(int timestep0, float timeDelta);
+	void CollectPrefetchedTimesteps(void);
+	void WaitForPrefetch(int timestep);
+	void EvictTimestep(int timestep);
+	void EnforceResidencyBudget(int timestep0);
+	int GetMaxResidentTimesteps(void);
 
 	// members
 	std::string m_objectFileName;
 	float m_currentTime;
 	float m_currentTimestepT;
-	std::vector<void *> m_data;
+	std::vector<void *> m_data;		// padded data per timestep, nullptr if not yet padded from the mapping
+	std::vector<bool> m_ownsData;	// whether m_data[i] was allocated by us or points into a mapped view
+	std::vector<MappedFile*> m_mappedFiles;	// only used with LM_MMAP
+	std::vector<std::string> m_fileNames;	// needed to reload evicted timesteps
+	PackedVolumeFile * m_packedFile;	// if the time series comes from a single container
+	std::string m_metadataFileName;		// sidecar cache, no cache is used if empty
+	VolumeMetadataCache * m_metadataCache;
+	std::vector<bool> m_resident;	// whether a timestep is in RAM and ready for upload
+	std::vector<unsigned int> m_lastUsed;	// value of m_useCounter when the timestep was last accessed
+	unsigned int m_useCounter;
+	unsigned int m_numResident;		// number of timesteps held in (counted) RAM
+	std::vector<bool> m_prefetchPending;	// whether a timestep has been requested from the prefetcher
+	TimestepPrefetcher * m_prefetcher;
+	unsigned int m_prefetchStalls;	// number of times a timestep was needed before the prefetcher delivered it
 	bool m_externalData;	// this signals that another class manages the data
 							// in that case, m_data contains nothing and the other class
 							// manages the GPU textures and updates the SRVs etc.
 	const float m_timeSequenceLength;	//the realtime length of the dataset
 	
-	std::vector<float*>		    m_histogram;
+	std::vector<float*>		    m_histogram;	// m_histogramBins relative frequencies per timestep
+	std::vector<BrickPyramid*>	m_brickPyramids;	// per timestep, nullptr if not built yet
+	bool		m_buildBrickPyramids;	// build the pyramids along with the timesteps, set on first use
+	int			m_histogramBins;
+	XMFLOAT2	m_histogramRange;
+	bool		m_histogramRangeValid;	// auto ranges of non-byte formats are determined on first use
 
 	DataFormat	m_format;
 	int			m_elementSize;
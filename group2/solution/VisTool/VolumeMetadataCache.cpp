@@ -0,0 +1,267 @@
+#include "VolumeMetadataCache.h"
+
+#include "util/util.h"
+
+#include <DirectXPackedVector.h>
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+	struct CacheHeader {
+		char	magic[4];	// "VMC1"
+		unsigned int version;
+		int		format;
+		int		resolution[3];
+		int		numTimesteps;
+		int		brickSize;
+		int		histogramBins;
+		int		numMetrics;
+	};
+
+	const unsigned int CACHE_VERSION = 1;
+}
+
+VolumeMetadataCache::VolumeMetadataCache(const std::string & cacheFileName, const std::vector<std::string> & sourceFileNames,
+	VolumeData::DataFormat format, XMINT3 resolution) :
+	m_cacheFileName(cacheFileName),
+	m_sourceFileNames(sourceFileNames),
+	m_format(format),
+	m_resolution(resolution),
+	m_numBricks((resolution.x + BRICK_SIZE - 1) / BRICK_SIZE, (resolution.y + BRICK_SIZE - 1) / BRICK_SIZE, (resolution.z + BRICK_SIZE - 1) / BRICK_SIZE),
+	m_elementSize(VolumeData::GetElementSize(format)),
+	m_valid(false),
+	m_stop(false)
+{
+	ZeroMemory(m_metricRanges, sizeof(m_metricRanges));
+
+	// containers hold all timesteps, so the same key is repeated
+	m_fileKeys.resize(m_sourceFileNames.size());
+	for(size_t i = 0; i < m_sourceFileNames.size(); i++)
+		m_fileKeys[i] = (i && m_sourceFileNames[i] == m_sourceFileNames[i - 1]) ? m_fileKeys[i - 1] : GetFileKey(m_sourceFileNames[i]);
+}
+
+VolumeMetadataCache::~VolumeMetadataCache(void)
+{
+	m_stop = true;
+	if(m_worker.joinable())
+		m_worker.join();
+}
+
+VolumeMetadataCache::FileKey VolumeMetadataCache::GetFileKey(const std::string & fileName)
+{
+	FileKey key = {0, 0};
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if(GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &attributes)) {
+		key.size = ((unsigned long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+		key.modificationTime = ((unsigned long long)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	}
+	return key;
+}
+
+bool VolumeMetadataCache::Load(void)
+{
+	std::ifstream in(m_cacheFileName, std::ifstream::in | std::ifstream::binary);
+	if(!in.is_open())
+		return false;
+
+	CacheHeader header;
+	in.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if(!in || memcmp(header.magic, "VMC1", 4) || header.version != CACHE_VERSION || header.format != m_format ||
+		header.resolution[0] != m_resolution.x || header.resolution[1] != m_resolution.y || header.resolution[2] != m_resolution.z ||
+		header.numTimesteps != (int)m_sourceFileNames.size() || header.brickSize != BRICK_SIZE ||
+		header.histogramBins != HISTOGRAM_BINS || header.numMetrics != MAX_METRICS) {
+		std::cout << "Metadata cache \"" << GetFilename(m_cacheFileName) << "\" does not match the data set." << std::endl;
+		return false;
+	}
+
+	std::vector<FileKey> keys(header.numTimesteps);
+	in.read(reinterpret_cast<char*>(keys.data()), keys.size() * sizeof(FileKey));
+	for(int i = 0; in && i < header.numTimesteps; i++) {
+		if(!(keys[i] == m_fileKeys[i])) {
+			std::cout << "Metadata cache \"" << GetFilename(m_cacheFileName) << "\" is out of date." << std::endl;
+			return false;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		in.read(reinterpret_cast<char*>(m_metricRanges), sizeof(m_metricRanges));
+	}
+
+	int numBricks = m_numBricks.x * m_numBricks.y * m_numBricks.z;
+	m_timesteps.resize(header.numTimesteps);
+	for(int i = 0; in && i < header.numTimesteps; i++) {
+		TimestepInfo & info = m_timesteps[i];
+		in.read(reinterpret_cast<char*>(&info.valueRange), sizeof(info.valueRange));
+		if(m_format == VolumeData::DF_BYTE) {
+			info.histogram.resize(HISTOGRAM_BINS);
+			in.read(reinterpret_cast<char*>(info.histogram.data()), HISTOGRAM_BINS * sizeof(float));
+		}
+		info.brickRanges.resize(numBricks);
+		in.read(reinterpret_cast<char*>(info.brickRanges.data()), numBricks * sizeof(XMFLOAT2));
+	}
+
+	if(!in) {
+		std::cerr << "Metadata cache \"" << GetFilename(m_cacheFileName) << "\" is truncated." << std::endl;
+		m_timesteps.clear();
+		return false;
+	}
+
+	m_valid = true;
+	return true;
+}
+
+bool VolumeMetadataCache::Save(void)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::ofstream out(m_cacheFileName, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	if(!out.is_open()) {
+		std::cerr << "Could not write metadata cache \"" << m_cacheFileName << "\"!" << std::endl;
+		return false;
+	}
+
+	CacheHeader header;
+	memcpy(header.magic, "VMC1", 4);
+	header.version = CACHE_VERSION;
+	header.format = m_format;
+	header.resolution[0] = m_resolution.x;	header.resolution[1] = m_resolution.y;	header.resolution[2] = m_resolution.z;
+	header.numTimesteps = (int)m_timesteps.size();
+	header.brickSize = BRICK_SIZE;
+	header.histogramBins = HISTOGRAM_BINS;
+	header.numMetrics = MAX_METRICS;
+
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(m_fileKeys.data()), m_fileKeys.size() * sizeof(FileKey));
+	out.write(reinterpret_cast<const char*>(m_metricRanges), sizeof(m_metricRanges));
+	for(size_t i = 0; i < m_timesteps.size(); i++) {
+		const TimestepInfo & info = m_timesteps[i];
+		out.write(reinterpret_cast<const char*>(&info.valueRange), sizeof(info.valueRange));
+		out.write(reinterpret_cast<const char*>(info.histogram.data()), info.histogram.size() * sizeof(float));
+		out.write(reinterpret_cast<const char*>(info.brickRanges.data()), info.brickRanges.size() * sizeof(XMFLOAT2));
+	}
+
+	return out.good();
+}
+
+void VolumeMetadataCache::RebuildAsync(ReadTimestepFunc readTimestep)
+{
+	if(m_worker.joinable())
+		return;
+
+	std::cout << "Rebuilding metadata cache \"" << GetFilename(m_cacheFileName) << "\" in the background..." << std::endl;
+	m_worker = std::thread(&VolumeMetadataCache::Rebuild, this, readTimestep);
+}
+
+/**
+	Runs on the worker thread. The timestep infos are only published by setting m_valid
+	once all of them are complete.
+*/
+void VolumeMetadataCache::Rebuild(ReadTimestepFunc readTimestep)
+{
+	double startTime = GetTimeMs();
+	std::vector<char> data(m_resolution.x * m_resolution.y * m_resolution.z * m_elementSize);
+
+	m_timesteps.resize(m_sourceFileNames.size());
+	for(size_t i = 0; i < m_timesteps.size(); i++) {
+		if(m_stop || !readTimestep((int)i, data.data()))
+			return;
+		ComputeTimestepInfo(data.data(), m_timesteps[i]);
+	}
+
+	m_valid = true;
+	if(Save())
+		std::cout << "Metadata cache \"" << GetFilename(m_cacheFileName) << "\" written in " << (GetTimeMs() - startTime) << " ms." << std::endl;
+}
+
+float VolumeMetadataCache::GetValue(const char * data, unsigned int voxel) const
+{
+	using namespace DirectX::PackedVector;
+	const char * p = data + voxel * m_elementSize;
+
+	switch(m_format) {
+	case VolumeData::DF_BYTE:
+		return *reinterpret_cast<const unsigned char*>(p);
+	case VolumeData::DF_FLOAT:
+		return *reinterpret_cast<const float*>(p);
+	case VolumeData::DF_HALF3:
+	case VolumeData::DF_HALF4: {
+		const HALF * h = reinterpret_cast<const HALF*>(p);
+		float x = XMConvertHalfToFloat(h[0]), y = XMConvertHalfToFloat(h[1]), z = XMConvertHalfToFloat(h[2]);
+		return sqrtf(x*x + y*y + z*z);
+	}
+	case VolumeData::DF_FLOAT3:
+	case VolumeData::DF_FLOAT4: {
+		const float * f = reinterpret_cast<const float*>(p);
+		return sqrtf(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+	}
+	}
+	return 0.f;
+}
+
+void VolumeMetadataCache::ComputeTimestepInfo(const char * data, TimestepInfo & info) const
+{
+	info.brickRanges.assign(m_numBricks.x * m_numBricks.y * m_numBricks.z, XMFLOAT2(FLT_MAX, -FLT_MAX));
+	info.valueRange = XMFLOAT2(FLT_MAX, -FLT_MAX);
+
+	std::vector<unsigned int> histoCount;
+	if(m_format == VolumeData::DF_BYTE)
+		histoCount.resize(HISTOGRAM_BINS, 0);
+
+	unsigned int voxel = 0;
+	for(int z = 0; z < m_resolution.z; z++) {
+		for(int y = 0; y < m_resolution.y; y++) {
+			int brickRow = (z / BRICK_SIZE * m_numBricks.y + y / BRICK_SIZE) * m_numBricks.x;
+			for(int x = 0; x < m_resolution.x; x++, voxel++) {
+				float v = GetValue(data, voxel);
+				XMFLOAT2 & brick = info.brickRanges[brickRow + x / BRICK_SIZE];
+				brick.x = std::min(brick.x, v);
+				brick.y = std::max(brick.y, v);
+				if(!histoCount.empty())
+					histoCount[(int)v]++;
+			}
+		}
+	}
+
+	for(size_t b = 0; b < info.brickRanges.size(); b++) {
+		info.valueRange.x = std::min(info.valueRange.x, info.brickRanges[b].x);
+		info.valueRange.y = std::max(info.valueRange.y, info.brickRanges[b].y);
+	}
+
+	info.histogram.resize(histoCount.size());
+	for(size_t i = 0; i < histoCount.size(); i++)
+		info.histogram[i] = histoCount[i] / (float)voxel;
+}
+
+bool VolumeMetadataCache::GetMetricRange(int metric, XMFLOAT2 & range)
+{
+	assert(metric < MAX_METRICS);
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if(!m_metricRanges[metric].valid)
+		return false;
+	range = XMFLOAT2(m_metricRanges[metric].min, m_metricRanges[metric].max);
+	return true;
+}
+
+/**
+	Stores the range of a metric, the file is updated right away if the cache is complete,
+	otherwise the range is written along with the rebuilt cache
+*/
+void VolumeMetadataCache::SetMetricRange(int metric, XMFLOAT2 range)
+{
+	assert(metric < MAX_METRICS);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_metricRanges[metric].valid = 1;
+		m_metricRanges[metric].min = range.x;
+		m_metricRanges[metric].max = range.y;
+	}
+
+	if(m_valid)
+		Save();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "VolumeData.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+/*
+	Sidecar file (.vmeta) holding statistics of a time series so they don't have to be
+	recomputed from the full data every time it is opened:
+	per timestep the value range, a byte histogram and min/max per brick, plus the last
+	computed range of every derived metric. Values of vector data are velocity magnitudes.
+	The cache is keyed by size and modification time of all source files; if any of them
+	changed, it is rebuilt on a background thread and written once complete.
+*/
+class VolumeMetadataCache
+{
+public:
+	static const int HISTOGRAM_BINS = 256;
+	static const int BRICK_SIZE = 32;
+	static const int MAX_METRICS = 16;
+
+	struct TimestepInfo {
+		XMFLOAT2			valueRange;
+		std::vector<float>	histogram;		// HISTOGRAM_BINS relative frequencies, only for DF_BYTE
+		std::vector<XMFLOAT2> brickRanges;	// min and max per brick, x fastest
+	};
+
+	// reads an unpadded timestep into dst, must be callable from the background thread
+	typedef std::function<bool(int timestep, char * dst)> ReadTimestepFunc;
+
+	VolumeMetadataCache(const std::string & cacheFileName, const std::vector<std::string> & sourceFileNames,
+		VolumeData::DataFormat format, XMINT3 resolution);
+	~VolumeMetadataCache(void);
+
+	// returns true if the file exists and matches the source files
+	bool Load(void);
+	void RebuildAsync(ReadTimestepFunc readTimestep);
+
+	// the timestep infos may only be accessed once the cache is valid
+	bool IsValid() const {				return m_valid;		};
+	const TimestepInfo & GetTimestepInfo(int timestep) const {	return m_timesteps[timestep];	};
+	XMINT3 GetNumBricks() const {		return m_numBricks;	};
+
+	bool GetMetricRange(int metric, XMFLOAT2 & range);
+	void SetMetricRange(int metric, XMFLOAT2 range);
+
+private:
+	// non-copyable since the worker references us
+	VolumeMetadataCache(const VolumeMetadataCache&);
+	VolumeMetadataCache& operator=(const VolumeMetadataCache&);
+
+	struct FileKey {
+		unsigned long long size;
+		unsigned long long modificationTime;
+		bool operator==(const FileKey & o) const {	return size == o.size && modificationTime == o.modificationTime;	};
+	};
+
+	struct MetricRange {
+		int		valid;
+		float	min;
+		float	max;
+	};
+
+	static FileKey GetFileKey(const std::string & fileName);
+
+	bool Save(void);
+	void Rebuild(ReadTimestepFunc readTimestep);
+	void ComputeTimestepInfo(const char * data, TimestepInfo & info) const;
+	float GetValue(const char * data, unsigned int voxel) const;
+
+	std::string					m_cacheFileName;
+	std::vector<std::string>	m_sourceFileNames;
+	VolumeData::DataFormat		m_format;
+	XMINT3						m_resolution;
+	XMINT3						m_numBricks;
+	int							m_elementSize;
+
+	std::vector<FileKey>		m_fileKeys;
+	std::vector<TimestepInfo>	m_timesteps;
+	MetricRange					m_metricRanges[MAX_METRICS];
+	std::mutex					m_mutex;		// guards m_metricRanges and writing the file
+
+	std::atomic<bool>			m_valid;
+	std::atomic<bool>			m_stop;
+	std::thread					m_worker;
+};
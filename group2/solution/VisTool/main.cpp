@@ -97,6 +97,8 @@ void LoadConfig(std::string filename)
 		else {
 		
 			g_globals.LoadConfig(store);
+			VolumeData::LoadLoaderConfig(store);
+			ScalarVolumeData::LoadNormalConfig(store);
 
 			if(g_currentScene) delete g_currentScene;
 			g_currentScene = new Scene(store);
@@ -130,6 +132,8 @@ void SaveConfig(std::string filename)
 		store.StoreFloat4x4("camera.ModelView.worldMatrix", camWorld.r[0].m128_f32);
 
 		g_globals.SaveConfig(store);
+		VolumeData::SaveLoaderConfig(store);
+		ScalarVolumeData::SaveNormalConfig(store);
 		if(g_currentScene)
 			g_currentScene->SaveConfig(store);
 		store.Save(std::string(filename));
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Converts an IEEE 754 half to float without DirectXMath, for the engines that also build headless
+inline float HalfToFloat(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+
+	uint32_t bits;
+	if(exponent == 0) {
+		// zero or denormalized, the value is mantissa * 2^-24
+		float f = mantissa * (1.f / 16777216.f);
+		return sign ? -f : f;
+	}
+	else if(exponent == 31)
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	else
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
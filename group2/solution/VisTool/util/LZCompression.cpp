@@ -0,0 +1,180 @@
+#include "LZCompression.h"
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+	const int HASH_BITS = 14;
+	const size_t MIN_MATCH = 4;
+	const size_t MAX_OFFSET = 65535;
+	// the last bytes are always stored as literals, so the match search never reads past the end
+	const size_t LAST_LITERALS = 5;
+
+	inline unsigned int Read32(const unsigned char * p)
+	{
+		unsigned int v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline unsigned int Hash(unsigned int v)
+	{
+		return (v * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	// writes a length that did not fit into the 4 bit token field
+	inline bool WriteLength(size_t length, unsigned char * dst, size_t & op, size_t dstCapacity)
+	{
+		while(length >= 255) {
+			if(op >= dstCapacity)
+				return false;
+			dst[op++] = 255;
+			length -= 255;
+		}
+		if(op >= dstCapacity)
+			return false;
+		dst[op++] = (unsigned char)length;
+		return true;
+	}
+
+	inline bool ReadLength(const unsigned char * src, size_t & ip, size_t srcSize, size_t & length)
+	{
+		unsigned char b;
+		do {
+			if(ip >= srcSize)
+				return false;
+			b = src[ip++];
+			length += b;
+		} while(b == 255);
+		return true;
+	}
+
+	// token: high nibble literal count, low nibble match length - MIN_MATCH, 15 means more length bytes follow
+	bool WriteSequence(const unsigned char * literals, size_t numLiterals, size_t offset, size_t matchLength,
+		unsigned char * dst, size_t & op, size_t dstCapacity)
+	{
+		if(op >= dstCapacity)
+			return false;
+		size_t token = op++;
+		dst[token] = (unsigned char)(std::min<size_t>(numLiterals, 15) << 4);
+		if(numLiterals >= 15 && !WriteLength(numLiterals - 15, dst, op, dstCapacity))
+			return false;
+
+		if(op + numLiterals > dstCapacity)
+			return false;
+		memcpy(&dst[op], literals, numLiterals);
+		op += numLiterals;
+
+		// the last sequence has no match
+		if(!matchLength)
+			return true;
+
+		if(op + 2 > dstCapacity)
+			return false;
+		dst[op++] = (unsigned char)(offset & 0xff);
+		dst[op++] = (unsigned char)(offset >> 8);
+
+		size_t length = matchLength - MIN_MATCH;
+		dst[token] |= (unsigned char)std::min<size_t>(length, 15);
+		if(length >= 15 && !WriteLength(length - 15, dst, op, dstCapacity))
+			return false;
+		return true;
+	}
+}
+
+size_t LZCompressBound(size_t srcSize)
+{
+	return srcSize + srcSize / 255 + 16;
+}
+
+size_t LZCompress(const unsigned char * src, size_t srcSize, unsigned char * dst, size_t dstCapacity)
+{
+	std::vector<size_t> table(1 << HASH_BITS, (size_t)-1);
+	size_t ip = 0, anchor = 0, op = 0;
+
+	while(srcSize > LAST_LITERALS + MIN_MATCH && ip < srcSize - LAST_LITERALS - MIN_MATCH) {
+		unsigned int sequence = Read32(&src[ip]);
+		unsigned int h = Hash(sequence);
+		size_t ref = table[h];
+		table[h] = ip;
+
+		if(ref == (size_t)-1 || ip - ref > MAX_OFFSET || Read32(&src[ref]) != sequence) {
+			ip++;
+			continue;
+		}
+
+		size_t length = MIN_MATCH;
+		while(ip + length < srcSize - LAST_LITERALS && src[ref + length] == src[ip + length])
+			length++;
+
+		if(!WriteSequence(&src[anchor], ip - anchor, ip - ref, length, dst, op, dstCapacity))
+			return 0;
+		ip += length;
+		anchor = ip;
+	}
+
+	if(!WriteSequence(&src[anchor], srcSize - anchor, 0, 0, dst, op, dstCapacity))
+		return 0;
+	return op;
+}
+
+bool LZDecompress(const unsigned char * src, size_t srcSize, unsigned char * dst, size_t dstSize)
+{
+	size_t ip = 0, op = 0;
+
+	while(ip < srcSize) {
+		unsigned char token = src[ip++];
+
+		size_t numLiterals = token >> 4;
+		if(numLiterals == 15 && !ReadLength(src, ip, srcSize, numLiterals))
+			return false;
+		if(ip + numLiterals > srcSize || op + numLiterals > dstSize)
+			return false;
+		memcpy(&dst[op], &src[ip], numLiterals);
+		ip += numLiterals;
+		op += numLiterals;
+
+		// end of the last sequence
+		if(ip == srcSize)
+			break;
+
+		if(ip + 2 > srcSize)
+			return false;
+		size_t offset = src[ip] | (src[ip + 1] << 8);
+		ip += 2;
+		if(!offset || offset > op)
+			return false;
+
+		size_t length = token & 15;
+		if(length == 15 && !ReadLength(src, ip, srcSize, length))
+			return false;
+		length += MIN_MATCH;
+		if(op + length > dstSize)
+			return false;
+
+		// byte by byte since the match may overlap the output
+		for(size_t i = 0; i < length; i++, op++)
+			dst[op] = dst[op - offset];
+	}
+
+	return op == dstSize;
+}
+
+void ShuffleBytes(const unsigned char * src, unsigned char * dst, size_t size, int elementSize)
+{
+	size_t numElements = size / elementSize;
+	for(int b = 0; b < elementSize; b++) {
+		for(size_t i = 0; i < numElements; i++)
+			dst[b * numElements + i] = src[i * elementSize + b];
+	}
+}
+
+void UnshuffleBytes(const unsigned char * src, unsigned char * dst, size_t size, int elementSize)
+{
+	size_t numElements = size / elementSize;
+	for(int b = 0; b < elementSize; b++) {
+		for(size_t i = 0; i < numElements; i++)
+			dst[i * elementSize + b] = src[b * numElements + i];
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef __LZCOMPRESSION_H__
+#define __LZCOMPRESSION_H__
+
+#include <cstddef>
+
+/*
+	Small LZ77 block codec in the spirit of LZ4 (byte aligned sequences of literals and
+	matches with a 64kB window). It trades compression ratio for decompression speed,
+	which is what matters when streaming timesteps from disk.
+	Shuffling groups byte k of every element together before compression, which makes
+	float data a lot more compressible.
+*/
+
+// worst case size of the compressed data
+size_t LZCompressBound(size_t srcSize);
+
+// returns the compressed size or 0 if the result would not fit into dstCapacity
+size_t LZCompress(const unsigned char * src, size_t srcSize, unsigned char * dst, size_t dstCapacity);
+// returns false if the data is corrupt or does not decompress to exactly dstSize bytes
+bool LZDecompress(const unsigned char * src, size_t srcSize, unsigned char * dst, size_t dstSize);
+
+// byte shuffle for elements of elementSize bytes, size must be a multiple of elementSize
+void ShuffleBytes(const unsigned char * src, unsigned char * dst, size_t size, int elementSize);
+void UnshuffleBytes(const unsigned char * src, unsigned char * dst, size_t size, int elementSize);
+
+#endif /* __LZCOMPRESSION_H__ */
@@ -0,0 +1,67 @@
+#include "MappedFile.h"
+
+#include <iostream>
+
+MappedFile::MappedFile(void) :
+	m_hFile(INVALID_HANDLE_VALUE),
+	m_hMapping(NULL),
+	m_pView(nullptr),
+	m_size(0)
+{
+}
+
+MappedFile::~MappedFile(void)
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string &filename)
+{
+	Close();
+
+	m_hFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(m_hFile == INVALID_HANDLE_VALUE) {
+		std::cerr << "Could not open \"" << filename << "\" for mapping!" << std::endl;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(m_hFile, &size) || size.QuadPart == 0) {
+		std::cerr << "Could not determine size of \"" << filename << "\"!" << std::endl;
+		Close();
+		return false;
+	}
+	m_size = size.QuadPart;
+
+	m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(!m_hMapping) {
+		std::cerr << "CreateFileMapping failed for \"" << filename << "\" with error " << GetLastError() << std::endl;
+		Close();
+		return false;
+	}
+
+	m_pView = MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if(!m_pView) {
+		std::cerr << "MapViewOfFile failed for \"" << filename << "\" with error " << GetLastError() << std::endl;
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::Close(void)
+{
+	if(m_pView)
+		UnmapViewOfFile(m_pView);
+	if(m_hMapping)
+		CloseHandle(m_hMapping);
+	if(m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+
+	m_pView = nullptr;
+	m_hMapping = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_size = 0;
+}
+
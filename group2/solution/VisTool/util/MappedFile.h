@@ -0,0 +1,34 @@
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+
+#include <string>
+#include <windows.h>
+
+// Read-only memory mapping of a whole file.
+// The view stays valid until Close() is called or the object is destroyed,
+// pages are only read from disk once they are touched.
+class MappedFile
+{
+public:
+	MappedFile(void);
+	~MappedFile(void);
+
+	bool Open(const std::string &filename);
+	void Close(void);
+
+	bool IsOpen() const {				return m_pView != nullptr;	};
+	const void * GetData() const {		return m_pView;				};
+	unsigned long long GetSize() const {	return m_size;			};
+
+private:
+	// non-copyable since we own the handles
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	HANDLE m_hFile;
+	HANDLE m_hMapping;
+	const void * m_pView;
+	unsigned long long m_size;
+};
+
+#endif /* __MAPPEDFILE_H__ */
@@ -0,0 +1,154 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool		* ThreadPool::s_sharedPool = nullptr;
+unsigned int	ThreadPool::s_sharedNumThreads = 0;
+
+ThreadPool::ThreadPool(unsigned int numThreads) :
+	m_nextQueue(0),
+	m_queuedTasks(0),
+	m_stop(false)
+{
+	if(!numThreads)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for(unsigned int i = 0; i < numThreads; i++)
+		m_queues.push_back(new WorkQueue());
+	for(unsigned int i = 0; i < numThreads; i++)
+		m_threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	std::for_each(m_threads.begin(), m_threads.end(), [](std::thread & t) { t.join(); });
+	std::for_each(m_queues.begin(), m_queues.end(), [](WorkQueue * q) { delete q; });
+}
+
+ThreadPool & ThreadPool::GetShared(void)
+{
+	if(!s_sharedPool)
+		s_sharedPool = new ThreadPool(s_sharedNumThreads);
+	return *s_sharedPool;
+}
+
+void ThreadPool::SetSharedNumThreads(unsigned int numThreads)
+{
+	if(s_sharedPool && numThreads == s_sharedNumThreads)
+		return;
+
+	s_sharedNumThreads = numThreads;
+	if(s_sharedPool) {
+		delete s_sharedPool;
+		s_sharedPool = nullptr;
+	}
+}
+
+void ThreadPool::Submit(Task task)
+{
+	unsigned int q = m_nextQueue++ % m_queues.size();
+	{
+		std::lock_guard<std::mutex> lock(m_queues[q]->mutex);
+		m_queues[q]->tasks.push_back(task);
+	}
+	m_queuedTasks++;
+
+	// lock to avoid a lost wakeup between a worker checking m_queuedTasks and going to sleep
+	std::lock_guard<std::mutex> lock(m_wakeMutex);
+	m_wake.notify_one();
+}
+
+/*
+	Runs one task, preferably from our own queue (LIFO), otherwise stolen from another queue (FIFO)
+	queueIndex may be out of range for threads not belonging to the pool, these only steal
+*/
+bool ThreadPool::RunOneTask(unsigned int queueIndex)
+{
+	Task task;
+	bool found = false;
+
+	if(queueIndex < m_queues.size()) {
+		WorkQueue & own = *m_queues[queueIndex];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if(!own.tasks.empty()) {
+			task = own.tasks.back();
+			own.tasks.pop_back();
+			found = true;
+		}
+	}
+
+	for(unsigned int i = 1; !found && i <= m_queues.size(); i++) {
+		WorkQueue & victim = *m_queues[(queueIndex + i) % m_queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if(!victim.tasks.empty()) {
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			found = true;
+		}
+	}
+
+	if(!found)
+		return false;
+
+	m_queuedTasks--;
+	task();
+	return true;
+}
+
+void ThreadPool::WorkerLoop(unsigned int queueIndex)
+{
+	for(;;) {
+		if(RunOneTask(queueIndex))
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_wakeMutex);
+		m_wake.wait(lock, [this] { return m_stop || m_queuedTasks > 0; });
+		if(m_stop)
+			return;
+	}
+}
+
+void ThreadPool::ParallelFor(int begin, int end, const std::function<void(int)> & body, int grain)
+{
+	ParallelForRange(begin, end, [&body](int b, int e) {
+		for(int i = b; i < e; i++)
+			body(i);
+	}, grain);
+}
+
+void ThreadPool::ParallelForRange(int begin, int end, const std::function<void(int, int)> & body, int grain)
+{
+	if(end <= begin)
+		return;
+	grain = std::max(1, grain);
+
+	// run small loops on the calling thread right away
+	if(end - begin <= grain) {
+		body(begin, end);
+		return;
+	}
+
+	std::atomic<int> remaining(0);
+	for(int b = begin; b < end; b += grain)
+		remaining++;
+
+	for(int b = begin; b < end; b += grain) {
+		int e = std::min(end, b + grain);
+		Submit([&body, &remaining, b, e] {
+			body(b, e);
+			remaining--;
+		});
+	}
+
+	// help out until our chunks are done, tasks of other loops may be run here as well
+	while(remaining > 0) {
+		if(!RunOneTask((unsigned int)m_queues.size()))
+			std::this_thread::yield();
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/*
+	Simple work-stealing thread pool.
+	Every worker owns a task deque. New tasks are distributed round-robin, a worker pops from the
+	back of its own deque and steals from the front of the others once it runs out of work.
+	ParallelFor blocks until all of its chunks are done; the calling thread helps processing tasks
+	in the meantime, so it is safe to call ParallelFor from within a task.
+*/
+class ThreadPool
+{
+public:
+	typedef std::function<void(void)> Task;
+
+	// numThreads = 0 uses one thread per hardware thread
+	ThreadPool(unsigned int numThreads = 0);
+	~ThreadPool(void);
+
+	unsigned int GetNumThreads() const {	return (unsigned int)m_threads.size();	};
+
+	// calls body(i) for every i in [begin, end), grain indices are processed per task
+	void ParallelFor(int begin, int end, const std::function<void(int)> & body, int grain = 1);
+	// calls body(chunkBegin, chunkEnd) for chunks of at most grain indices covering [begin, end)
+	void ParallelForRange(int begin, int end, const std::function<void(int, int)> & body, int grain = 1);
+
+	// pool shared by the CPU processing engines, created on first use
+	static ThreadPool & GetShared(void);
+	// recreates the shared pool, must not be called while it is in use
+	static void SetSharedNumThreads(unsigned int numThreads);
+
+private:
+	struct WorkQueue {
+		std::mutex			mutex;
+		std::deque<Task>	tasks;
+	};
+
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	void Submit(Task task);
+	bool RunOneTask(unsigned int queueIndex);
+	void WorkerLoop(unsigned int queueIndex);
+
+	std::vector<std::thread>	m_threads;
+	std::vector<WorkQueue*>		m_queues;
+	std::atomic<unsigned int>	m_nextQueue;
+	std::atomic<int>			m_queuedTasks;
+
+	std::mutex					m_wakeMutex;
+	std::condition_variable		m_wake;
+	bool						m_stop;
+
+	static ThreadPool			* s_sharedPool;
+	static unsigned int			s_sharedNumThreads;
+};
+
+#endif /* __THREADPOOL_H__ */
@@ -163,4 +163,15 @@ void PrintMatrix(XMMATRIX m)
 
 void printVector(std::string label, XMVECTOR &v) {
 	std::cout << label << ": " << v.m128_f32[0] << " " << v.m128_f32[1] << " " << v.m128_f32[2] << " " << v.m128_f32[3] << std::endl;
-}
\ No newline at end of file
+}
+
+double GetTimeMs()
+{
+	static LARGE_INTEGER frequency;
+	if(!frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return 1000.0 * now.QuadPart / frequency.QuadPart;
+}
@@ -33,6 +33,9 @@ void PrintMatrix(XMMATRIX m);
 
 void printVector(std::string label, XMVECTOR &v);
 
+// high resolution timestamp in milliseconds, for profiling
+double GetTimeMs();
+
 #define XMFLOAT3_EQUAL(a,b) (((a).x == (b).x) && ((a).y == (b).y) && ((a).z == (b).z))
 #define XMFLOAT4_EQUAL(a,b) (((a).x == (b).x) && ((a).y == (b).y) && ((a).z == (b).z) && ((a).w == (b).w))
 